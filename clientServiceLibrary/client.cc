@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "config.h"
 
 #include <iostream>
+#include <vector>
 #include <hash_mapWrapper.h>
 
 #include <sys/types.h>
@@ -366,6 +367,98 @@ pluton::clientBase::setDebug(bool nv)
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// The response cache belongs to the clientImpl, so it is shared by
+// all clients in this thread and disappears with the last of them.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientBase::setResponseCacheSize(unsigned long maximumBytes)
+{
+  _pcClient->getMyThreadImpl()->setResponseCacheSize(maximumBytes);
+}
+
+void
+pluton::clientBase::getResponseCacheStats(pluton::responseCacheStats& stats) const
+{
+  _pcClient->getMyThreadImpl()->getResponseCacheStats(stats);
+}
+
+bool
+pluton::clientBase::getTimingStats(const char* serviceKey, pluton::clientTimingStats& ts) const
+{
+  return _pcClient->getMyThreadImpl()->getTimingStats(serviceKey, ts);
+}
+
+void
+pluton::clientBase::getTimingServiceKeys(std::vector<std::string>& keys) const
+{
+  _pcClient->getMyThreadImpl()->getTimingServiceKeys(keys);
+}
+
+void
+pluton::clientBase::resetTimingStats()
+{
+  _pcClient->getMyThreadImpl()->resetTimingStats();
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Like the response cache, the zero-copy threshold belongs to the
+// clientImpl and thus applies to all clients in this thread.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientBase::setZeroCopyThreshold(unsigned int bytes)
+{
+  _pcClient->getMyThreadImpl()->setZeroCopyThreshold(bytes);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Batch coalescing is likewise per-thread. A maximum of one or zero
+// means every request is sent on its own.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientBase::setBatchCoalescing(unsigned int maximumRequests)
+{
+  _pcClient->getMyThreadImpl()->setBatchCoalescing(maximumRequests);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// As is binary framing. It is offered to services, which use it only
+// if they understand it.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientBase::setBinaryFraming(bool onOff)
+{
+  _pcClient->getMyThreadImpl()->setBinaryFraming(onOff);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// And compression. Data of at least thresholdBytes is compressed if
+// the other side has said it can decompress. The stats cover all
+// clients in this thread.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientBase::setCompression(pluton::compressionAlgorithm algorithm,
+				   unsigned int thresholdBytes)
+{
+  _pcClient->getMyThreadImpl()->setCompression(algorithm, thresholdBytes);
+}
+
+void
+pluton::clientBase::getCompressionStats(pluton::compressionStats& s) const
+{
+  _pcClient->getMyThreadImpl()->getCompressionStats(s);
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // The timeout value is a per-client setting rather than the singleton
 // setting.
@@ -467,6 +560,30 @@ pluton::client::addRequest(const char* serviceKey, pluton::clientRequest* R)
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Add a set of requests for the one service that are exchanged as a
+// single batch packet. Each request completes individually just as if
+// it had been added with addRequest().
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::client::addRequests(const char* serviceKey, pluton::clientRequest* requests[], int count)
+{
+  std::vector<pluton::clientRequestImpl*> impls;
+  for (int ix=0; ix < count; ++ix) {
+    pluton::clientRequestImpl* rImpl = requests[ix]->getImpl();
+    rImpl->setClientName(_pcClient->getClientName());
+    rImpl->setTimeoutMS(_pcClient->getTimeoutMilliSeconds());
+    rImpl->setClientRequestPtr(requests[ix]);
+    impls.push_back(rImpl);
+  }
+
+  if (impls.empty()) return true;
+
+  return _pcClient->getMyThreadImpl()->addRequests(_pcClient, serviceKey, &impls[0], count);
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // This minimalist interface is just for tools that are compiled with
 // the library/manager. Simply pass the completed request through to
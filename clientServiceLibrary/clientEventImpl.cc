@@ -85,6 +85,7 @@ pluton::clientImpl::getNextEventWanted(perCallerClient* owner, const struct time
     nextR = _todoQueue.getNext(R); 	// the body of this loop
 
     if (!progressOrTerminate(owner, R, &fds, 0)) continue;
+    if (fds.fd == -1) continue;		// Waiting for a remote endpoint, try again next time
 
     //////////////////////////////////////////////////////////////////////
     // This request is waiting on a blocking I/O. Remove from our
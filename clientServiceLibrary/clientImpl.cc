@@ -34,7 +34,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "config.h"
 
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <sstream>
 
 #include <sys/types.h>
@@ -42,6 +44,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/time.h>
 #include <sys/un.h>
 
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -59,6 +64,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "timeoutClock.h"
 #include "faultImpl.h"
 #include "clientImpl.h"
+#include "traceRecorder.h"
+#include "memfdPayload.h"
+#include "payloadCompressor.h"
+#include "remoteEndpoints.h"
 
 using namespace pluton;
 
@@ -72,9 +81,22 @@ static pluton::poll_handler_t	staticPollProxy = 0;
 
 pluton::clientImpl::clientImpl()
   : _oneAtATimePerThread(false),
-    _debugFlag(false), _requestID(100), _useCount(0), _todoQueue("todo")
+    _debugFlag(false), _requestID(100), _useCount(0), _zeroCopyThreshold(0),
+    _batchMaximum(0), _binaryFraming(false),
+    _compressionAlgorithm(pluton::noCompression), _compressionThreshold(0), _compressionStats(),
+    _todoQueue("todo"), _endpointWaiters(0), _endpointSleepers(0)
 {
+  _endpointWakeup[0] = _endpointWakeup[1] = -1;
   if (getenv("plutonClientDebug")) _debugFlag = true;
+
+  const char* zct = getenv("plutonZeroCopyThreshold");
+  if (zct) setZeroCopyThreshold(strtoul(zct, 0, 10));
+  const char* bc = getenv("plutonBatchCoalescing");
+  if (bc) setBatchCoalescing(strtoul(bc, 0, 10));
+  const char* bf = getenv("plutonBinaryFraming");
+  if (bf) setBinaryFraming(strtoul(bf, 0, 10) != 0);
+  const char* ct = getenv("plutonCompressionThreshold");
+  if (ct) setCompression(pluton::zlibCompression, strtoul(ct, 0, 10));
   DBGPRT << "clientImpl created" << std::endl;
 
   signal(SIGPIPE, SIG_IGN);				// Ignore these
@@ -84,6 +106,11 @@ pluton::clientImpl::clientImpl()
 pluton::clientImpl::~clientImpl()
 {
   deleteOwner(0);		// Called once at destruction of program
+
+  for (unsigned int ix=0; ix < _idleCarriers.size(); ++ix) delete _idleCarriers[ix];
+
+  if (_endpointWakeup[0] != -1) close(_endpointWakeup[0]);
+  if (_endpointWakeup[1] != -1) close(_endpointWakeup[1]);
 }
 
 
@@ -145,13 +172,14 @@ pluton::completionCondition::~completionCondition()
 
 
 //////////////////////////////////////////////////////////////////////
-// Prepare a socket for connect()
+// Prepare a socket for connect(). Local services are reached via
+// AF_UNIX and remote ones via TCP.
 //////////////////////////////////////////////////////////////////////
 
 static int
-openSocket()
+openSocket(int domain)
 {
-  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  int sock = socket(domain, SOCK_STREAM, 0);
   if (sock == -1) return -1;
 
   // Make sure the socket can't be used by child processes and that
@@ -180,6 +208,14 @@ openSocket()
   }
 #endif
 
+  // A request is written in one go and then waits for the response,
+  // so Nagle only ever adds latency.
+
+  if (domain == AF_INET) {
+    int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  }
+
   return sock;
 }
 
@@ -213,6 +249,20 @@ connectSocket(int sock, const char* path)
   return 1;
 }
 
+// TCP buffers are left to the kernel's auto-tuning which does far
+// better over a long RTT than any fixed size.
+
+static int
+connectSocket(int sock, const struct sockaddr_in* sin)
+{
+  if (connect(sock, (const struct sockaddr*) sin, sizeof(*sin)) == -1) {
+    if (errno != EINPROGRESS) return -1;
+    return 0;
+  }
+
+  return 1;
+}
+
 
 //////////////////////////////////////////////////////////////////////
 // Assemble the request into a set of write pointers. All packet data
@@ -235,7 +285,106 @@ pluton::clientImpl::assembleRequest(clientRequestImpl* R)
 
   R->_packetOutPre.clear();
   R->_packetOutPost.clear();
-  R->assembleRequestPacket(R->_packetOutPre, R->_packetOutPost);
+
+  //////////////////////////////////////////////////////////////////////
+  // Large request data is passed as a sealed memfd rather than being
+  // written through the socket. Telling the service our threshold
+  // lets it do the same with a large response.
+  //////////////////////////////////////////////////////////////////////
+
+  if (R->_memfdOut != -1) {			// Left over from a previous use
+    close(R->_memfdOut);
+    R->_memfdOut = -1;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // A remote service is reached via a plReceiver which relays whole
+  // netString packets. Descriptors cannot cross the network, so
+  // neither zero-copy nor the framing and parts that the relay does
+  // not understand are offered.
+  //////////////////////////////////////////////////////////////////////
+
+  bool remote = pluton::remoteEndpoints::isRemote(R->_rendezvousID);
+
+  bool dataViaMemfd = false;
+  R->setMemfdAcceptThreshold(0);
+  if (!remote && (_zeroCopyThreshold > 0) && pluton::memfdPayload::available()) {
+    R->setMemfdAcceptThreshold(_zeroCopyThreshold);
+    if ((unsigned) R->getRequestDataLength() >= _zeroCopyThreshold) {
+      const std::vector<struct iovec>& dataIOV = R->getRequestIOV();
+      if (dataIOV.empty()) {
+	const char* p;
+	int len;
+	R->getRequestData(p, len);
+	R->_memfdOut = pluton::memfdPayload::create(p, len);
+      }
+      else {
+	R->_memfdOut = pluton::memfdPayload::create(&dataIOV[0], dataIOV.size());
+      }
+      dataViaMemfd = (R->_memfdOut != -1);	// Fall back to inline on failure
+      DBGPRT << "assembleRequest memfd=" << R->_memfdOut
+	     << " L=" << R->getRequestDataLength() << std::endl;
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // Binary framing is offered to the service which answers with it if
+  // it understands it. The request itself is only binary framed on an
+  // affinity connection to a service that has already answered that
+  // way. Such requests cannot be retried, so they can never reach a
+  // different service that pre-dates binary framing.
+  //////////////////////////////////////////////////////////////////////
+
+  bool binaryRequest = R->getAffinity() && (R->_socket != -1) && R->_binarySocket;
+  R->setBinaryFraming(!remote && (_binaryFraming || binaryRequest));
+  R->_packetOutPre.setBinaryFraming(binaryRequest);
+  R->_packetOutPost.setBinaryFraming(binaryRequest);
+
+  R->setResponsePartAccept(!remote && R->hasResponsePartHandler());
+
+  //////////////////////////////////////////////////////////////////////
+  // Compression is offered in the same way: the service compresses a
+  // large response if it can and says whether it can decompress. The
+  // request data is only compressed on an affinity connection to a
+  // service that has said so. A memfd takes precedence as it avoids
+  // the copy altogether.
+  //////////////////////////////////////////////////////////////////////
+
+  R->_compressedOut.erase();
+  R->setCompressAccept(0, 0);
+  int compressedLength = -1;
+  if ((_compressionAlgorithm != pluton::noCompression)
+      && pluton::payloadCompressor::available(_compressionAlgorithm)) {
+    R->setCompressAccept(_compressionAlgorithm, _compressionThreshold);
+    if (!dataViaMemfd && R->getAffinity() && (R->_socket != -1)
+	&& (R->_compressSocket == _compressionAlgorithm)
+	&& (R->getRequestDataLength() > 0)
+	&& ((unsigned) R->getRequestDataLength() >= _compressionThreshold)) {
+      const std::vector<struct iovec>& dataIOV = R->getRequestIOV();
+      bool ok;
+      if (dataIOV.empty()) {
+	struct iovec vec;
+	const char* p;
+	int len;
+	R->getRequestData(p, len);
+	vec.iov_base = const_cast<char*>(p);
+	vec.iov_len = len;
+	ok = pluton::payloadCompressor::compress(_compressionAlgorithm, &vec, 1,
+						 R->_compressedOut, _compressionStats);
+      }
+      else {
+	ok = pluton::payloadCompressor::compress(_compressionAlgorithm,
+						 &dataIOV[0], dataIOV.size(),
+						 R->_compressedOut, _compressionStats);
+      }
+      if (ok) compressedLength = R->_compressedOut.length();
+      DBGPRT << "assembleRequest compressed=" << compressedLength
+	     << " L=" << R->getRequestDataLength() << std::endl;
+    }
+  }
+
+  R->assembleRequestPacket(R->_packetOutPre, R->_packetOutPost, true, dataViaMemfd,
+			   compressedLength);
 }
 
 
@@ -243,23 +392,34 @@ pluton::clientImpl::assembleRequest(clientRequestImpl* R)
 // A raw request is one that is pre-assembled (or perhaps read in from
 // a raw exchange with a tool) and does not need re-assembly. This is
 // a tools-only interface.
+//
+// The packet is copied into _packetOutPre as prepare() resets the
+// write pointers from there on every attempt.
 //////////////////////////////////////////////////////////////////////
 
 void
 pluton::clientImpl::assembleRawRequest(clientRequestImpl* R, const char* rawPtr, int rawLength)
 {
-  R->_sendDataPtr[0] = rawPtr;
-  R->_sendDataLength[0] = rawLength;
-  R->_sendDataPtr[1] = 0;
-  R->_sendDataLength[1] = 0;
-  R->_sendDataPtr[2] = 0;
-  R->_sendDataLength[2] = 0;
-  DBGPRT << "assembleRaw: L=" <<  R->_sendDataLength[0] << std::endl;
+  R->_packetOutPre.clear();
+  R->_packetOutPre.appendRaw(rawPtr, rawLength);
+  R->_packetOutPost.clear();
+  if (R->_memfdOut != -1) {			// Raw requests are always inline
+    close(R->_memfdOut);
+    R->_memfdOut = -1;
+  }
+  R->_compressedOut.erase();
+  R->setMemfdAcceptThreshold(0);
+  DBGPRT << "assembleRaw: L=" <<  rawLength << std::endl;
 }
 
 
 //////////////////////////////////////////////////////////////////////
 // Establish a connection with a service.
+//
+// A remote service is reached over TCP via one of its endpoints,
+// re-using an idle connection if there is one. If every endpoint is
+// at its limit, the request is left in the openConnection state to
+// try again once another request to the service completes.
 //////////////////////////////////////////////////////////////////////
 
 bool
@@ -267,10 +427,36 @@ pluton::clientImpl::openConnection(pluton::clientRequestImpl* R)
 {
   DBGPRT << "openConnection " << R->_rendezvousID << std::endl;
 
-  R->_socket = openSocket();
+  R->_binarySocket = false;
+  R->_compressSocket = 0;
+
+  const struct sockaddr_in* remoteAddress = 0;
+  const char* peerName = R->_rendezvousID.c_str();
+
+  if (pluton::remoteEndpoints::isRemote(R->_rendezvousID)) {
+    std::string em;
+    int res = _endpoints.acquire(R->_rendezvousID, R->_endpoint, em);
+    if (res < 0) {
+      R->setFault(pluton::connectFailed, em);
+      R->setState("openConnection::no endpoint", pluton::clientRequestImpl::done);
+      return false;
+    }
+    if (res == 0) return true;		// All at their limit
+
+    R->_socket = _endpoints.takeIdleSocket(R->_endpoint);
+    if (R->_socket != -1) {
+      R->setState("openConnection::idle", pluton::clientRequestImpl::opportunisticWrite);
+      return true;
+    }
+
+    remoteAddress = &R->_endpoint->address;
+    peerName = R->_endpoint->name.c_str();
+  }
+
+  R->_socket = openSocket(remoteAddress ? AF_INET : AF_UNIX);
   if (R->_socket == -1) {
     std::string em;
-    util::messageWithErrno(em, "System Error: socket() failed", R->_rendezvousID.c_str());
+    util::messageWithErrno(em, "System Error: socket() failed", peerName);
     R->setFault(pluton::openSocketFailed, em);
     R->setState("openConnection::open socket failed", pluton::clientRequestImpl::done);
     return false;
@@ -278,7 +464,13 @@ pluton::clientImpl::openConnection(pluton::clientRequestImpl* R)
 
   R->setState("openConnection", pluton::clientRequestImpl::connecting);
 
-  int res = connectSocket(R->_socket, R->_rendezvousID.c_str());
+  int res;
+  if (remoteAddress) {
+    res = connectSocket(R->_socket, remoteAddress);
+  }
+  else {
+    res = connectSocket(R->_socket, R->_rendezvousID.c_str());
+  }
 
   //////////////////////////////////////////////////////////////////////
   // There are three possible returns from the non-blocking
@@ -288,9 +480,10 @@ pluton::clientImpl::openConnection(pluton::clientRequestImpl* R)
 
   if (res < 0) {		// Errored
     std::string em;
-    util::messageWithErrno(em, "System Error: connect() failed", R->_rendezvousID.c_str());
+    util::messageWithErrno(em, "System Error: connect() failed", peerName);
     R->setFault(pluton::connectFailed, em);
     R->setState("openConnection::res < 0", pluton::clientRequestImpl::done);
+    if (R->_endpoint) _endpoints.markDown(R->_endpoint);
     return false;
   }
 
@@ -302,6 +495,81 @@ pluton::clientImpl::openConnection(pluton::clientRequestImpl* R)
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Finish with the connection of a request. A remote connection that
+// is reusable goes back to its endpoint for the next request,
+// everything else is closed.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientImpl::releaseConnection(pluton::clientRequestImpl* R, bool reusable)
+{
+  if (R->_endpoint) {
+    _endpoints.release(R->_endpoint, R->_socket, reusable);
+    R->_endpoint = 0;
+    endpointReleased();
+  }
+  else if (R->_socket != -1) {
+    close(R->_socket);
+  }
+  R->_socket = -1;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Endpoint slots are only ever freed by this clientImpl, so a caller
+// whose requests are all waiting for a slot sleeps on a pipe rather
+// than a timer. A release wakes it and its next constructPollList()
+// re-runs openConnection() for the waiting requests.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientImpl::endpointReleased()
+{
+  if ((_endpointSleepers == 0) || (_endpointWakeup[1] == -1)) return;
+
+  char c = 0;
+  if (write(_endpointWakeup[1], &c, 1) == -1) {
+    DBGPRT << "endpointReleased: wakeup write failed: " << errno << std::endl;
+  }
+}
+
+
+void
+pluton::clientImpl::waitForEndpoint(struct pollfd* fds, int timeoutMS)
+{
+  if (_endpointWakeup[0] == -1) {
+    if (pipe(_endpointWakeup) == -1) {
+      _endpointWakeup[0] = _endpointWakeup[1] = -1;	// Poll ignores fd -1 so
+    }							// this sleeps out the budget
+    else {
+      for (int ix=0; ix < 2; ++ix) {
+	util::setNonBlocking(_endpointWakeup[ix]);
+	util::setCloseOnExec(_endpointWakeup[ix]);
+      }
+    }
+  }
+
+  fds[0].fd = _endpointWakeup[0];
+  fds[0].events = POLLIN;
+  fds[0].revents = 0;
+
+  ++_endpointSleepers;
+  if (staticPollProxy) {
+    _oneAtATimePerThread = false;
+    (staticPollProxy)(fds, 1, timeoutMS * util::MICROMILLI);
+    _oneAtATimePerThread = true;
+  }
+  else {
+    poll(fds, 1, timeoutMS);
+  }
+  --_endpointSleepers;
+
+  char buf[64];
+  if (_endpointWakeup[0] != -1) while (read(_endpointWakeup[0], buf, sizeof(buf)) > 0) ;
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // Only do the initialization once per process, regarless of whether
 // there are threads or not. Since initialization is all about the
@@ -444,6 +712,7 @@ pluton::clientImpl::addRequest(pluton::perCallerClient* owner,
   }
 
   R->setDebug(_debugFlag);
+  R->startTiming();
 
   //////////////////////////////////////////////////////////////////////
   // Check for valid affinity constraints. If the request has an
@@ -493,6 +762,24 @@ pluton::clientImpl::addRequest(pluton::perCallerClient* owner,
   // on callers.
   //////////////////////////////////////////////////////////////////////
 
+  //////////////////////////////////////////////////////////////////////
+  // If tracing, this request either continues the trace of the
+  // request being served (when called from within a service) or
+  // starts a new trace. The trace context must be set before the
+  // packet is assembled.
+  //////////////////////////////////////////////////////////////////////
+
+  R->_traceID = R->_traceSpanID = R->_traceParentID = 0;
+  if (!rawPtr && pluton::traceRecorder::enabled()) {
+    pluton::traceRecorder::getCurrent(R->_traceID, R->_traceParentID);
+    if (R->_traceID == 0) R->_traceID = pluton::traceRecorder::newID();
+    R->_traceSpanID = pluton::traceRecorder::newID();
+
+    std::string traceContext;
+    pluton::traceRecorder::encode(traceContext, R->_traceID, R->_traceSpanID);
+    R->setTraceContext(traceContext);
+  }
+
   if (rawPtr) {
     R->setByPassIDCheck(true);
     assembleRawRequest(R, rawPtr, rawLength);
@@ -505,6 +792,20 @@ pluton::clientImpl::addRequest(pluton::perCallerClient* owner,
   R->prepare(R->getAttribute(pluton::needAffinityAttr));
   R->getClock().stop();			// Events use per-request timers
 
+  //////////////////////////////////////////////////////////////////////
+  // A cache hit completes the request right here without going near
+  // the service. It goes straight onto the completed queue so that
+  // all of the executeAndWait*() and event interfaces see it just as
+  // they would a request that went the distance.
+  //////////////////////////////////////////////////////////////////////
+
+  if (findCachedResponse(R, rawPtr != 0)) {
+    assertMutexFreeThenLock(owner);
+    terminateRequest(R, true);
+    unlockMutex(owner);
+    return true;
+  }
+
   assertMutexFreeThenLock(owner);	// No other thread better be here
   _todoQueue.addToHead(R);		// Ready for processing
   unlockMutex(owner);
@@ -513,6 +814,351 @@ pluton::clientImpl::addRequest(pluton::perCallerClient* owner,
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Add a set of requests for the one service that are to be exchanged
+// as a single batch packet. Each request is first added as usual so
+// that lookups, the response cache and all the usual checks apply;
+// whatever remains is then handed to a carrier.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::clientImpl::addRequests(pluton::perCallerClient* owner, const char* serviceKey,
+				pluton::clientRequestImpl** requests, int count)
+{
+  pluton::faultInternal* fault = owner->getFaultPtr();
+  fault->clear("pluton::client::addRequests");
+
+  for (int ix=0; ix < count; ++ix) {
+    if (!batchable(requests[ix])) {
+      fault->set(pluton::batchNotAllowed, __FUNCTION__, __LINE__, ix);
+      requests[ix]->setFault(pluton::batchNotAllowed, fault->getMessage());
+      return false;
+    }
+  }
+
+  std::vector<pluton::clientRequestImpl*> members;
+  for (int ix=0; ix < count; ++ix) {
+    if (!addRequest(owner, serviceKey, requests[ix])) return false;
+    if (requests[ix]->getState() != pluton::clientRequestImpl::done) {	// Not a cache hit
+      members.push_back(requests[ix]);
+    }
+  }
+
+  if ((members.size() > 1) && !pluton::remoteEndpoints::isRemote(members[0]->_rendezvousID)) {
+    assertMutexFreeThenLock(owner);
+    formBatch(owner, members);
+    unlockMutex(owner);
+  }
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Anything that needs its own connection or a passed fd cannot ride
+// in a batch.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::clientImpl::batchable(const pluton::clientRequestImpl* R) const
+{
+  if (R->getAttribute(pluton::noWaitAttr)) return false;
+  if (R->getAttribute(pluton::keepAffinityAttr)) return false;
+  if (R->getAttribute(pluton::needAffinityAttr)) return false;
+  if (R->hasFileDescriptor()) return false;
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// When coalescing is enabled, the requests added since the previous
+// executeAndWait*() call that have yet to go anywhere are grouped by
+// Service Key and each group is sent as one or more batches. Large
+// requests that go via a memfd are left alone as batching only pays
+// off for small requests.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientImpl::coalesceRequests(pluton::perCallerClient* owner)
+{
+  typedef std::map<std::string, std::vector<pluton::clientRequestImpl*> > groupMap;
+  groupMap groups;
+
+  for (pluton::clientRequestImpl* R = _todoQueue.getFirst(); R; R = _todoQueue.getNext(R)) {
+    if (R->getOwner() != owner) continue;
+    if (R->getState() != pluton::clientRequestImpl::openConnection) continue;
+    if ((R->_tryCount > 0) || !R->_batchMembers.empty()) continue;
+    if (R->byPassIDCheck() || (R->_memfdOut != -1) || !batchable(R)) continue;
+    if (pluton::remoteEndpoints::isRemote(R->_rendezvousID)) continue;
+
+    groups[R->getServiceKey()].push_back(R);
+  }
+
+  for (groupMap::iterator gi=groups.begin(); gi != groups.end(); ++gi) {
+    std::vector<pluton::clientRequestImpl*>& G = gi->second;
+    std::reverse(G.begin(), G.end());		// The queue is newest first
+
+    for (unsigned int start=0; start + 1 < G.size(); start += _batchMaximum) {
+      unsigned int end = std::min((unsigned int) G.size(), start + _batchMaximum);
+      if (end - start < 2) break;
+      std::vector<pluton::clientRequestImpl*> members(G.begin() + start, G.begin() + end);
+      formBatch(owner, members);
+    }
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Replace the members on the _todoQueue with a single carrier
+// request. The carrier is counted by the owner in place of the
+// members so the executeAndWait*() conditions work unchanged.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientImpl::formBatch(pluton::perCallerClient* owner,
+			      std::vector<pluton::clientRequestImpl*>& members)
+{
+  pluton::clientRequestImpl* carrier;
+  if (_idleCarriers.empty()) {
+    carrier = new pluton::clientRequestImpl;
+  }
+  else {
+    carrier = _idleCarriers.back();
+    _idleCarriers.pop_back();
+  }
+
+  pluton::clientRequestImpl* first = members[0];
+
+  carrier->reset();
+  carrier->setDebug(_debugFlag);
+  carrier->setServiceKey(first->getServiceKey());
+  carrier->setClientName(owner->getClientName());
+  carrier->setTimeoutMS(first->getTimeoutMS());
+  carrier->setByPassIDCheck(false);
+  carrier->_rendezvousID = first->_rendezvousID;
+  carrier->_traceID = carrier->_traceSpanID = carrier->_traceParentID = 0;
+  carrier->setOwner(owner);
+  owner->addTodoCount();		// Before the members are subtracted
+
+  carrier->_batchMembers = members;
+  for (unsigned int ix=0; ix < members.size(); ++ix) {
+    pluton::clientRequestImpl* M = members[ix];
+    _todoQueue.deleteRequest(M);
+    owner->subtractTodoCount();
+    M->_batchCarrier = carrier;
+    if (M->_memfdOut != -1) {			// Members always go inline
+      close(M->_memfdOut);
+      M->_memfdOut = -1;
+    }
+    M->setMemfdAcceptThreshold(0);
+    M->setResponsePartAccept(false);		// Parts come with the batch response
+    M->setCompressAccept(0, 0);		// and the batch is not compressed
+  }
+
+  DBGPRT << "formBatch: carrier=" << carrier << " members=" << members.size()
+	 << " " << first->getServiceKey() << std::endl;
+
+  assembleBatch(carrier);
+  carrier->prepare(false);
+  carrier->getClock().stop();
+  _todoQueue.addToHead(carrier);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The batch packet carries a complete request packet for each member
+// so that the service can decode a member just as it would a request
+// read from a socket.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientImpl::assembleBatch(pluton::clientRequestImpl* carrier)
+{
+  if (_requestID > 10000000) _requestID = 100;
+  carrier->setRequestID(_requestID);
+  carrier->_requestIDSent = _requestID;
+  ++_requestID;
+
+  netStringGenerate& pre = carrier->_packetOutPre;
+  pre.clear();
+  carrier->_packetOutPost.clear();
+
+  pre.append(pluton::batchRequestPT);
+  pre.append(pluton::requestIDNT, carrier->getRequestID());
+  pre.append(pluton::clientIDNT, carrier->getOwner()->getClientName());
+  pre.append(pluton::serviceKeyNT, carrier->getServiceKey());
+  pre.append(pluton::timeoutMSNT, carrier->getTimeoutMS());
+
+  netStringGenerate memberPre;
+  netStringGenerate memberPost;
+  for (unsigned int ix=0; ix < carrier->_batchMembers.size(); ++ix) {
+    pluton::clientRequestImpl* M = carrier->_batchMembers[ix];
+    memberPre.clear();
+    memberPost.clear();
+    M->assembleRequestPacket(memberPre, memberPost, true, false);
+
+    int len = M->getRequestDataLength();
+    pre.appendRawPrefix(pluton::batchMemberNT, memberPre.length() + len + memberPost.length());
+    pre.appendRaw(memberPre.data(), memberPre.length());
+    const std::vector<struct iovec>& dataIOV = M->getRequestIOV();
+    if (dataIOV.empty()) {
+      const char* p;
+      M->getRequestData(p, len);
+      if (len > 0) pre.appendRaw(p, len);
+    }
+    else {
+      for (unsigned int dx=0; dx < dataIOV.size(); ++dx) {
+	pre.appendRaw(static_cast<const char*>(dataIOV[dx].iov_base), dataIOV[dx].iov_len);
+      }
+    }
+    pre.appendRaw(memberPost.data(), memberPost.length());
+    pre.appendRawTerminator();
+  }
+
+  carrier->_packetOutPost.appendNL(pluton::endPacketNT);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The carrier has completed. Give each member its part of the batch
+// response and complete it as if it had been exchanged on its own. A
+// plain response to a batch can only be a fault that applies to every
+// member, as can a carrier failure.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientImpl::finishBatch(pluton::clientRequestImpl* carrier, bool ok)
+{
+  const pluton::decodeResponsePacket& D = carrier->_decoder;
+  std::vector<pluton::clientRequestImpl*>& members = carrier->_batchMembers;
+
+  bool haveBatch = ok && D.haveCompleteRequest() && D.isBatch()
+    && (D.getBatchCount() == (int) members.size());
+  if (ok && !haveBatch && !carrier->hasFault()) {
+    carrier->setFault(pluton::responsePacketFormatError, "Batch response does not match request");
+  }
+
+  DBGPRT << "finishBatch: carrier=" << carrier << " ok=" << ok
+	 << " haveBatch=" << haveBatch << " members=" << members.size() << std::endl;
+
+  std::string em;
+  for (unsigned int ix=0; ix < members.size(); ++ix) {
+    pluton::clientRequestImpl* M = members[ix];
+    if (!M) continue;				// Destroyed while in progress
+
+    M->_batchCarrier = 0;
+    M->copyExchangeTimes(carrier);
+
+    bool memberOK = false;
+    if (haveBatch) {
+      int offset, length;
+      D.getBatchMember(ix, offset, length);
+      M->setFault(pluton::noFault);
+      if (M->decodeBatchMember(carrier->_packetIn.getBasePtr() + offset, length, em) > 0) {
+	memberOK = true;
+      }
+      else {
+	M->resetResponseValues();
+	M->setFault(pluton::responsePacketFormatError, em);
+      }
+    }
+    else {
+      M->setFault(carrier->getFaultCode(), carrier->getFaultText());
+    }
+
+    M->getOwner()->addTodoCount();		// terminateRequest() takes it away again
+    terminateRequest(M, memberOK);
+  }
+
+  members.clear();
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Write the spans of a completed, traced request. The request as a
+// whole is the parent of the per-stage spans.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientImpl::recordTrace(const pluton::clientRequestImpl* R)
+{
+  static const char* stageNames[] = {
+    "client.lookup", "client.connect", "client.write", "client.wait", "client.read"
+  };
+
+  struct timeval startTime, endTime;
+  if (!R->getStageTimes(pluton::clientRequest::totalStage, startTime, endTime)) return;
+
+  pluton::traceRecorder::record(traceSpan::clientKind, R->getServiceKey().c_str(),
+				R->_traceID, R->_traceSpanID, R->_traceParentID,
+				startTime, endTime);
+
+  for (int st=0; st < pluton::clientRequest::totalStage; ++st) {
+    if (!R->getStageTimes(st, startTime, endTime)) continue;
+    pluton::traceRecorder::record(traceSpan::clientKind, stageNames[st],
+				  R->_traceID, pluton::traceRecorder::newID(), R->_traceSpanID,
+				  startTime, endTime);
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The caller may supply the Service Key in any valid form, so convert
+// it to the canonical form used to accumulate the stats.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::clientImpl::getTimingStats(const char* serviceKey, pluton::clientTimingStats& ts) const
+{
+  pluton::serviceKey SK;
+  if (SK.parse(serviceKey, strlen(serviceKey))) return false;
+
+  return _timingStats.get(SK.getEnglishKey(), ts);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Determine whether the request is a candidate for the response cache
+// and if so, whether there is a current response for it. Only plain
+// requests are eligible; affinity, noWait, passed fds and raw
+// requests all imply something beyond a simple exchange of data.
+//
+// Return: true if the request has been populated with a cached
+// response.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::clientImpl::findCachedResponse(pluton::clientRequestImpl* R, bool rawRequest)
+{
+  R->_cacheKey.erase();
+
+  if (!_responseCache.enabled() || rawRequest) return false;
+  if (R->getAttribute(pluton::noWaitAttr)) return false;
+  if (R->getAttribute(pluton::keepAffinityAttr)) return false;
+  if (R->getAttribute(pluton::needAffinityAttr)) return false;
+  if (R->hasFileDescriptor()) return false;
+  if (R->hasResponsePartHandler()) return false;
+
+  R->gatherRequestData();		// The key needs the data contiguous
+  R->getCacheKey(R->_cacheKey);
+
+  struct timeval now;
+  gettimeofday(&now, 0);
+  std::string serviceName;
+  if (!_responseCache.find(R->_cacheKey, now, R->_cachedResponse, serviceName)) return false;
+
+  DBGPRT << "Cache hit: " << R->getRequestID() << " " << R->getServiceKey() << std::endl;
+
+  R->_cacheKey.erase();			// Nothing to add to the cache on completion
+  R->setFault(pluton::noFault);
+  R->setServiceName(serviceName);
+  R->setResponseData(R->_cachedResponse);
+
+  return true;
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // Reset the perCallerClient to the initial state. This is mainly
 // about removing outstanding requests.
@@ -551,8 +1197,12 @@ pluton::clientImpl::deleteOwner(pluton::perCallerClient* owner,
     if (!owner || (R->getOwner() == owner)) {
       _todoQueue.deleteRequest(R);
       R->setFault(faultCode, faultText);
+      std::vector<pluton::clientRequestImpl*> members(R->_batchMembers);
       terminateRequest(R, false);
       R->setState("deleteOwner", pluton::clientRequestImpl::withCaller);
+      for (unsigned int ix=0; ix < members.size(); ++ix) {
+	if (members[ix]) members[ix]->setState("deleteOwner", pluton::clientRequestImpl::withCaller);
+      }
     }
   }
 }
@@ -571,6 +1221,16 @@ void
 pluton::clientImpl::deleteRequest(pluton::clientRequestImpl* deleteR)
 {
   if (_todoQueue.deleteRequest(deleteR)) deleteR->getOwner()->subtractTodoCount();
+  if (deleteR->_endpoint) releaseConnection(deleteR, false);
+
+  // A batch member is not on the queue, rather it is held by its carrier
+
+  pluton::clientRequestImpl* carrier = deleteR->_batchCarrier;
+  if (carrier) {
+    std::replace(carrier->_batchMembers.begin(), carrier->_batchMembers.end(),
+		 deleteR, (pluton::clientRequestImpl*) 0);
+    deleteR->_batchCarrier = 0;
+  }
 }
 
 
@@ -587,10 +1247,7 @@ pluton::clientImpl::retryRequest(pluton::clientRequestImpl* R)
   DBGPRT << R->getRequestID() << " retryRequest " << R->getFaultText() << std::endl;
 
 
-  if (R->_socket != -1) {	// A retry always closes the current socket
-    close(R->_socket);
-    R->_socket = -1;
-  }
+  releaseConnection(R, false);	// A retry always closes the current socket
 
   // Some requests cannot be retried .. for obvious reasons.
 
@@ -602,6 +1259,10 @@ pluton::clientImpl::retryRequest(pluton::clientRequestImpl* R)
 
   if (R->_tryCount >= MAXIMUM_TRY_COUNT) return false;
 
+  // Parts already given to the caller cannot be taken back
+
+  if (R->getResponsePartCount() > 0) return false;
+
   // Ok, this request is good to retry
 
   R->prepare(false);
@@ -627,19 +1288,58 @@ pluton::clientImpl::terminateRequest(pluton::clientRequestImpl* R, bool ok)
 	 << " oDone=" << R->getOwner()->getCompletedQueueCount()
 	 << std::endl;
 
+  //////////////////////////////////////////////////////////////////////
+  // An affinity connection to a remote endpoint belongs to the
+  // request from now on so it no longer counts against the
+  // endpoint. Otherwise a remote connection that saw a complete
+  // response is ready for re-use by the next request.
+  //////////////////////////////////////////////////////////////////////
+
   if (R->getAttribute(pluton::keepAffinityAttr) && ok) {
     R->setAffinity(true);
+    if (R->_endpoint) {
+      _endpoints.release(R->_endpoint, -1, false);
+      R->_endpoint = 0;
+      endpointReleased();
+    }
     DBGPRT << "Affinity set true: " << R->getRequestID() << std::endl;
   }
   else {
-    if (R->_socket != -1) {
-      close(R->_socket);
-      R->_socket = -1;
-    }
+    releaseConnection(R, ok && !R->getAttribute(pluton::noWaitAttr));
     R->setAffinity(false);
   }
 
+  //////////////////////////////////////////////////////////////////////
+  // If the service said the response can be re-used, give it to the
+  // cache now that the response data is stable.
+  //////////////////////////////////////////////////////////////////////
+
+  if (ok && !R->_cacheKey.empty() && (R->getCacheMaxAgeMS() > 0) && !R->hasFault()) {
+    const char* rp;
+    int rl;
+    R->getResponseData(rp, rl);
+    struct timeval now;
+    gettimeofday(&now, 0);
+    _responseCache.insert(R->_cacheKey, now, R->getCacheMaxAgeMS(), rp, rl, R->getServiceName());
+  }
+
   R->setState("terminateRequest", pluton::clientRequestImpl::done);
+
+  //////////////////////////////////////////////////////////////////////
+  // A carrier is internal so it is never seen by the caller. Its
+  // members are completed in its place.
+  //////////////////////////////////////////////////////////////////////
+
+  if (!R->_batchMembers.empty()) {
+    finishBatch(R, ok);
+    R->getOwner()->subtractTodoCount();
+    R->setState("terminateRequest", pluton::clientRequestImpl::withCaller);
+    _idleCarriers.push_back(R);
+    return;
+  }
+
+  _timingStats.record(R->getServiceKey(), R);
+  if (R->_traceID) recordTrace(R);
   R->getOwner()->subtractTodoCount();
   R->getOwner()->addToCompletedQueue(R);
 }
@@ -972,9 +1672,17 @@ pluton::clientImpl::executeAndWaitOne(pluton::perCallerClient* owner, pluton::cl
     unlockMutex(owner);
     return 0;
   }
-  waitOneCondition waitOne(R);
 
-  int res = progressRequests(owner, waitOne);
+  //////////////////////////////////////////////////////////////////////
+  // A request satisfied from the response cache is already done, so
+  // there is nothing to progress.
+  //////////////////////////////////////////////////////////////////////
+
+  int res = 1;
+  if (R->getState() != pluton::clientRequestImpl::done) {
+    waitOneCondition waitOne(R);
+    res = progressRequests(owner, waitOne);
+  }
 
   DBGPRT << "E&WOne=" << res << " oDone=" << owner->getCompletedQueueCount() << std::endl;
   owner->deleteCompletedRequest(R);
@@ -1040,6 +1748,8 @@ pluton::clientImpl::progressRequests(pluton::perCallerClient* owner,
   // iterations here so it only needs to be sized on entry.
   //////////////////////////////////////////////////////////////////////
 
+  if (_batchMaximum > 1) coalesceRequests(owner);
+
   int queueCount = _todoQueue.count();
   struct pollfd* fds = owner->sizePollArray(queueCount);
 
@@ -1077,9 +1787,23 @@ pluton::clientImpl::progressRequests(pluton::perCallerClient* owner,
     //////////////////////////////////////////////////////////////////////
     // Retries and failures can cause zero remaining requests, so if
     // there is nothing left to progress, get out of here.
+    //
+    // Requests waiting for a remote endpoint held by another caller
+    // have nothing to poll on, so they sleep until that caller
+    // releases a slot and then try openConnection() again.
     //////////////////////////////////////////////////////////////////////
 
-    if (pollSubmitCount == 0) continue;		
+    if (pollSubmitCount == 0) {
+      if (_endpointWaiters == 0) continue;
+      if (timeBudgetMS <= 0) {
+	deleteOwner(owner, pluton::serviceTimeout, "service timeout");
+	DBGPRT << "E&W timeout endpoint wait" << std::endl;
+	return 0;
+      }
+      waitForEndpoint(fds, timeBudgetMS);
+      nowIsCurrent = false;
+      continue;
+    }
 
     if (timeBudgetMS <= 0) {
       deleteOwner(owner, pluton::serviceTimeout, "service timeout");
@@ -1183,6 +1907,9 @@ pluton::clientImpl::progressRequests(pluton::perCallerClient* owner,
       if (staticPollProxy && (owner != R->getOwner())) continue;	// Not ours to touch
 
       int ix = R->getPollIndex();	// Which poll entry corresponds to this request?
+      if ((ix == -1) && (R->getState() == pluton::clientRequestImpl::openConnection)) {
+	continue;			// Waiting for a remote endpoint
+      }
       assert(ix != -1);			// Just to be sure of no bugs here
       R->setPollIndex(-1);		// Insurance
 
@@ -1198,7 +1925,11 @@ pluton::clientImpl::progressRequests(pluton::perCallerClient* owner,
       if (fds[ix].revents & (POLLIN|POLLRDNORM)) {	// proxyio returns POLLRDNORM
 	pr = readEvent(R, timeBudgetMS);
       }
-      if (fds[ix].revents & (POLLOUT|POLLWRNORM)) {
+      int writeMask = POLLOUT|POLLWRNORM;
+      if (R->_endpoint && (R->getState() == pluton::clientRequestImpl::connecting)) {
+	writeMask |= POLLERR|POLLHUP;		// A refused TCP connect only says this
+      }
+      if (fds[ix].revents & writeMask) {
 	pr = writeEvent(R, timeBudgetMS);
       }
 
@@ -1260,8 +1991,31 @@ pluton::clientImpl::writeEvent(pluton::clientRequestImpl* R, int timeBudgetMS)
 	 << " st=" << R->getStateEnglish() << std::endl;
 
   //////////////////////////////////////////////////////////////////////
-  // Internal consistency check: there is only one acceptable state
-  // for a writeEvent
+  // A TCP connect to a remote endpoint completes with a write event,
+  // successful or not.
+  //////////////////////////////////////////////////////////////////////
+
+  if (R->getState() == pluton::clientRequestImpl::connecting) {
+    int soError = 0;
+    socklen_t soLength = sizeof(soError);
+    if (getsockopt(R->_socket, SOL_SOCKET, SO_ERROR, &soError, &soLength) == -1) soError = errno;
+    if (soError != 0) {
+      errno = soError;
+      std::string em;
+      util::messageWithErrno(em, "System Error: connect() failed",
+			     R->_endpoint ? R->_endpoint->name.c_str() : R->_rendezvousID.c_str());
+      R->setFault(pluton::connectFailed, em);
+      if (R->_endpoint) _endpoints.markDown(R->_endpoint);
+      return retryMaybe;
+    }
+
+    R->setState("writeEvent::connected", pluton::clientRequestImpl::opportunisticWrite);
+    return needPoll;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // Internal consistency check: there is only one other acceptable
+  // state for a writeEvent
   //////////////////////////////////////////////////////////////////////
 
   if (R->getState() != pluton::clientRequestImpl::subsequentWrites) {
@@ -1398,6 +2152,7 @@ pluton::clientImpl::constructPollList(pluton::perCallerClient* owner,
 				      int timeBudgetMS)
 {
   int fdsInUse = 0;
+  _endpointWaiters = 0;
   pluton::clientRequestImpl* nextR = _todoQueue.getFirst();
 
   while (nextR) {
@@ -1416,6 +2171,11 @@ pluton::clientImpl::constructPollList(pluton::perCallerClient* owner,
     if (staticPollProxy && (owner != R->getOwner())) continue;	// Cannot touch non-owned requests
 
     if (progressOrTerminate(owner, R, fds+fdsInUse, timeBudgetMS)) {
+      if (fds[fdsInUse].fd == -1) {	// Waiting for a remote endpoint
+	++_endpointWaiters;
+	R->setPollIndex(-1);
+	continue;
+      }
       R->setPollIndex(fdsInUse);	// Say it *is* on the poll list
       ++fdsInUse;			// This request has progressed to poll
       assert(fdsInUse <= fdsSize);	// Just to be sure
@@ -1511,7 +2271,24 @@ pluton::clientImpl::progressTowardsPoll(pluton::clientRequestImpl* R, struct pol
   case pluton::clientRequestImpl::openConnection:
     R->_tryCount++;
     if (R->getState() == pluton::clientRequestImpl::openConnection) {
-      if (!openConnection(R)) return failed;		// No point retrying this
+
+      // A local failure is not worth retrying, but another remote
+      // endpoint may well be reachable.
+
+      if (!openConnection(R)) return R->_endpoint ? retryMaybe : failed;
+
+      //////////////////////////////////////////////////////////////////////
+      // Still here means every endpoint is at its limit. The request
+      // waits with an unused poll entry so it doesn't count as a try.
+      //////////////////////////////////////////////////////////////////////
+
+      if (R->getState() == pluton::clientRequestImpl::openConnection) {
+	R->_tryCount--;
+	fds->fd = -1;
+	fds->events = 0;
+	fds->revents = 0;
+	return needPoll;
+      }
     }
 
     R->setFault(pluton::requestInProgress, "Request incomplete");	// default fault
@@ -1520,7 +2297,7 @@ pluton::clientImpl::progressTowardsPoll(pluton::clientRequestImpl* R, struct pol
     DBGPRT << R->getRequestID() << " COPE2 " << R << " " << R->getState() << std::endl;
     if (R->getState() == pluton::clientRequestImpl::connecting) {
       fds->fd = R->_socket;
-      fds->events = POLLIN;
+      fds->events = R->_endpoint ? POLLOUT : POLLIN;	// TCP says writable when connected
       fds->revents = 0;
       return needPoll;
     }
@@ -1568,6 +2345,11 @@ pluton::clientImpl::progressTowardsPoll(pluton::clientRequestImpl* R, struct pol
     // service can do the read/write sequence.
 
   case pluton::clientRequestImpl::connecting:
+    fds->fd = R->_socket;
+    fds->events = R->_endpoint ? POLLOUT : POLLIN;
+    fds->revents = 0;
+    return needPoll;
+
   case pluton::clientRequestImpl::reading:
     fds->fd = R->_socket;
     fds->events = POLLIN;
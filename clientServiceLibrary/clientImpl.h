@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define P_CLIENTIMPL_H 1
 
 #include <string>
+#include <vector>
 
 #include <sys/time.h>
 
@@ -45,6 +46,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "requestImpl.h"
 #include "perCallerClient.h"
 #include "clientRequestImpl.h"
+#include "responseCache.h"
+#include "timingStats.h"
+#include "endpointPool.h"
 #include "shmLookup.h"
 
 
@@ -103,6 +107,8 @@ namespace pluton {
     bool	addRequest(pluton::perCallerClient* owner,
 			   const char* serviceKey, pluton::clientRequestImpl*,
 			   const char* rawPtr=0, int rawLength=0);
+    bool	addRequests(pluton::perCallerClient* owner, const char* serviceKey,
+			    pluton::clientRequestImpl** requests, int count);
 
     int 			executeAndWaitSent(pluton::perCallerClient*);
     int 			executeAndWaitAll(pluton::perCallerClient*);
@@ -117,6 +123,23 @@ namespace pluton {
     void	deleteRequest(pluton::clientRequestImpl*);
     void	setDebug(bool tf) { _debugFlag = tf; }
 
+    void	setResponseCacheSize(unsigned long mb) { _responseCache.setMaximumBytes(mb); }
+    void	getResponseCacheStats(pluton::responseCacheStats& s) const
+      { _responseCache.getStats(s); }
+
+    bool	getTimingStats(const char* serviceKey, pluton::clientTimingStats&) const;
+    void	getTimingServiceKeys(std::vector<std::string>& keys) const
+      { _timingStats.getServiceKeys(keys); }
+    void	resetTimingStats() { _timingStats.reset(); }
+
+    void	setZeroCopyThreshold(unsigned int bytes) { _zeroCopyThreshold = bytes; }
+    void	setBatchCoalescing(unsigned int maximumRequests) { _batchMaximum = maximumRequests; }
+    void	setBinaryFraming(bool onOff) { _binaryFraming = onOff; }
+    void	setCompression(pluton::compressionAlgorithm algorithm, unsigned int bytes)
+      { _compressionAlgorithm = algorithm; _compressionThreshold = bytes; }
+    void	getCompressionStats(pluton::compressionStats& s) const { s = _compressionStats; }
+    pluton::compressionStats&	compressionStatsRef() { return _compressionStats; }
+
     ////////////////////////////////////////
     // Event based interface
     ////////////////////////////////////////
@@ -153,10 +176,21 @@ namespace pluton {
     bool	setRendezvousID(pluton::faultInternal*,
 				pluton::clientRequestImpl*, const char* serviceKey);
     bool	openConnection(pluton::clientRequestImpl*);
+    void	releaseConnection(pluton::clientRequestImpl*, bool reusable);
+    void	endpointReleased();
+    void	waitForEndpoint(struct pollfd* fds, int timeoutMS);
     void	assembleRequest(pluton::clientRequestImpl*);
     void	assembleRawRequest(pluton::clientRequestImpl*, const char* rawPtr, int rawLength);
 
+    bool	findCachedResponse(pluton::clientRequestImpl*, bool rawRequest);
+
+    bool	batchable(const pluton::clientRequestImpl*) const;
+    void	coalesceRequests(pluton::perCallerClient* owner);
+    void	formBatch(pluton::perCallerClient* owner, std::vector<pluton::clientRequestImpl*>&);
+    void	assembleBatch(pluton::clientRequestImpl* carrier);
+    void	finishBatch(pluton::clientRequestImpl* carrier, bool ok);
     void	terminateRequest(pluton::clientRequestImpl*, bool ok);
+    void	recordTrace(const pluton::clientRequestImpl*);
     bool	retryRequest(pluton::clientRequestImpl*);
 
     // The main request progression routines
@@ -183,12 +217,45 @@ namespace pluton {
     bool			_debugFlag;
     unsigned int		_requestID;		// Unique ID for each request
     int				_useCount;		// pluton::client instances pointing to me
+    unsigned int		_zeroCopyThreshold;	// Data this large goes via memfd
+    unsigned int		_batchMaximum;		// Coalesce up to this many requests
+    bool			_binaryFraming;		// Offer binary framing to services
+    pluton::compressionAlgorithm	_compressionAlgorithm;	// Offered to services
+    unsigned int		_compressionThreshold;	// Data this large is compressed
+    pluton::compressionStats	_compressionStats;
 
     ////////////////////////////////////////
     // Queue of outstanding requests
     ////////////////////////////////////////
 
     pluton::requestQueue        _todoQueue;
+
+    ////////////////////////////////////////
+    // Carriers of batch requests are re-used
+    ////////////////////////////////////////
+
+    std::vector<pluton::clientRequestImpl*>	_idleCarriers;
+
+    ////////////////////////////////////////
+    // Responses the services have said can be re-used
+    ////////////////////////////////////////
+
+    pluton::responseCache	_responseCache;
+
+    ////////////////////////////////////////
+    // Per-service timings of completed requests
+    ////////////////////////////////////////
+
+    pluton::timingStats		_timingStats;
+
+    ////////////////////////////////////////
+    // Remote endpoints and their idle connections
+    ////////////////////////////////////////
+
+    pluton::endpointPool	_endpoints;
+    int				_endpointWaiters;	// Set by constructPollList()
+    int				_endpointSleepers;	// Callers in waitForEndpoint()
+    int				_endpointWakeup[2];	// Written by endpointReleased()
   };
 }
 
@@ -80,6 +80,12 @@ pluton::clientRequest::setRequestData(const std::string& request)
   _impl->setRequestData(request);
 }
 
+void
+pluton::clientRequest::setRequestData(const struct iovec* iov, int iovCount)
+{
+  _impl->setRequestData(iov, iovCount);
+}
+
 pluton::faultCode
 pluton::clientRequest::getResponseData(const char*& cp, int& len) const
 {
@@ -164,3 +170,15 @@ pluton::clientRequest::getClientHandle() const
 {
   return _impl->getClientHandle();
 }
+
+long
+pluton::clientRequest::getStageMicroSeconds(pluton::clientRequest::stage st) const
+{
+  return _impl->getStageMicroSeconds(st);
+}
+
+void
+pluton::clientRequest::setResponsePartHandler(responsePartHandler handler)
+{
+  _impl->setResponsePartHandler(handler);
+}
@@ -42,12 +42,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <unistd.h>
 #include <errno.h>
+#include <string.h>
 
 #include "misc.h"
 #include "util.h"
 #include "clientImpl.h"
 #include "perCallerClient.h"
 #include "clientRequestImpl.h"
+#include "memfdPayload.h"
 
 using namespace pluton;
 
@@ -55,13 +57,20 @@ using namespace pluton;
 //////////////////////////////////////////////////////////////////////
 
 pluton::clientRequestImpl::clientRequestImpl()
-  : _tryCount(0), _socket(-1), _packetIn(4096*4), _decoder(this),
+  : _tryCount(0), _socket(-1), _binarySocket(false), _compressSocket(0), _endpoint(0),
+    _sendIOVNext(0), _sendDataResidual(0),
+    _memfdOut(-1), _memfdOutPending(false), _memfdIn(-1),
+    _packetIn(4096*4), _decoder(this),
+    _traceID(0), _traceSpanID(0), _traceParentID(0),
+    _batchCarrier(0),
     _next(0),
     _state(withCaller), _affinity(false),
     _owner(0), _timeoutMS(0), _clientRequestPtr(0),
+    _partHandler(0), _responsePartCount(0),
     _clientHandle(0)
 {
   _packetIn.disableCompaction();	// Ensure pointers to response data are stable
+  startTiming();
 }
 
 pluton::clientRequestImpl::~clientRequestImpl()
@@ -72,6 +81,7 @@ pluton::clientRequestImpl::~clientRequestImpl()
   setState("destructor", withCaller);
 
   if (_socket != -1) close(_socket);
+  closeMemfds();
 }
 
 
@@ -97,6 +107,16 @@ pluton::clientRequestImpl::deleteFromQueues()
 }
 
 
+void
+pluton::clientRequestImpl::closeMemfds()
+{
+  if (_memfdOut != -1) close(_memfdOut);
+  if (_memfdIn != -1) close(_memfdIn);
+  _memfdOut = _memfdIn = -1;
+  _memfdOutPending = false;
+}
+
+
 const char*
 pluton::clientRequestImpl::stateToEnglish(pluton::clientRequestImpl::state st)
 {
@@ -151,21 +171,68 @@ pluton::clientRequestImpl::reset()
     close(_socket);
     _socket = -1;
   }
+  closeMemfds();
 
   resetRequestValues();
   resetResponseValues();
+  _cacheKey.erase();
+  _cachedResponse.erase();
 
   setState("reset", withCaller);
+  startTiming();
 
   _affinity = false;
 
   _owner = 0;
   _timeoutMS = 0;
   _clientRequestPtr = 0;
+  _partHandler = 0;
+  _responsePartCount = 0;
   _clientHandle = 0;
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Called by the decoder as each part of a response arrives. Parts are
+// only asked for when there is a handler, but a raw request may have
+// asked on its own.
+//
+// A part reaches the handler before the rest of the packet has
+// arrived, so it cannot wait for the routing check in
+// decodeResponse(). The identifying netStrings precede the first part
+// so they are checked here instead and a part that is not ours is
+// dropped. decodeResponse() faults the request once the packet is
+// complete.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientRequestImpl::responsePart(const char* partPtr, int partLength)
+{
+  if (!byPassIDCheck() && !responseIsOurs()) {
+    DBGPRT << "Dropped response part for " << _decoder.getRequestID() << std::endl;
+    return;
+  }
+
+  ++_responsePartCount;
+  if (_partHandler && _clientRequestPtr) _partHandler(_clientRequestPtr, partPtr, partLength);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Does the response, as far as it has been decoded, carry our client
+// name and the requestID we sent?
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::clientRequestImpl::responseIsOurs() const
+{
+  std::string cn;
+  getClientName(cn);
+
+  return (cn == getOwner()->getClientName()) && (_decoder.getRequestID() == _requestIDSent);
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // Decode the inbound response, in particular, make sure it matches
 // the request we sent. This protects against services doing the wrong
@@ -193,6 +260,14 @@ pluton::clientRequestImpl::decodeResponse(std::string& em)
     return -1;
   }
 
+  // Response data in a memfd arrived with the first bytes of the response
+
+  if ((nsType == pluton::memfdDataNT) && hasMemfdData()) {
+    int fd = _memfdIn;
+    _memfdIn = -1;
+    if (!mapMemfdData(fd, em)) return -1;
+  }
+
   //////////////////////////////////////////////////////////////////////
   // Is this now a complete response? If not, indicate to caller that
   // they need to read in more data.
@@ -210,24 +285,31 @@ pluton::clientRequestImpl::decodeResponse(std::string& em)
   // bypass. The test is a simple clientname + unique requestID match.
   //////////////////////////////////////////////////////////////////////
 
-  if (! byPassIDCheck()) {
+  if (! byPassIDCheck() && !responseIsOurs()) {
     std::string cn;
     getClientName(cn);
-    if ((cn != getOwner()->getClientName()) || (getRequestID() != _requestIDSent)) {
-      std::ostringstream os;
-      os << "Service routing to wrong clients. Expected=" << getOwner()->getClientName()
-	 << "/" << _requestIDSent
-	 << " Got=" << cn << "/" << getRequestID();
-
-      resetResponseValues();	// Don't let wrong data thru to client
-      setFault(pluton::seriousInternalRoutingError, os.str());
-      DBGPRT << "Hib = " << os.str() << std::endl;
-      return -1;
-    }
+    std::ostringstream os;
+    os << "Service routing to wrong clients. Expected=" << getOwner()->getClientName()
+       << "/" << _requestIDSent
+       << " Got=" << cn << "/" << _decoder.getRequestID();
+
+    resetResponseValues();	// Don't let wrong data thru to client
+    setFault(pluton::seriousInternalRoutingError, os.str());
+    DBGPRT << "Hib = " << os.str() << std::endl;
+    return -1;
   }
 
   DBGPRT << "Complete packet: " << getRequestID() << std::endl;
 
+  //////////////////////////////////////////////////////////////////////
+  // A service that answers in binary framing will also accept it, so
+  // a subsequent request on this connection can use it. The same goes
+  // for compressed request data if the service says it decompresses.
+  //////////////////////////////////////////////////////////////////////
+
+  _binarySocket = _packetIn.isBinary();
+  _compressSocket = getPeerDecompresses();
+
   //////////////////////////////////////////////////////////////////////
   // The decoder has recorded the buffer offsets of various parts of
   // the packet, now that parsing is complete and the managed
@@ -237,10 +319,58 @@ pluton::clientRequestImpl::decodeResponse(std::string& em)
 
   adjustOffsets(_packetIn.getBasePtr(), _packetIn.getRawOffset());
 
+  if (!decompressData(em, getOwner()->getMyThreadImpl()->compressionStatsRef())) return -1;
+
   return 1;
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// A member of a batch is given its own copy of its response packet
+// from the carrier so that the member's response data does not
+// depend on the carrier's buffer. The copy is then decoded exactly as
+// if it had been read from the socket.
+//
+// Return: as for decodeResponse() except that an incomplete packet
+// is an error.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::clientRequestImpl::decodeBatchMember(const char* packetPtr, int packetLength,
+					     std::string& em)
+{
+  while (packetLength > 0) {
+    char* bufPtr;
+    int minRequired, maxAllowed;
+    if (_packetIn.getReadParameters(bufPtr, minRequired, maxAllowed) == -1) {
+      em = "Batch member too large";
+      return -1;
+    }
+    int bytes = std::min(packetLength, maxAllowed);
+    memcpy(bufPtr, packetPtr, bytes);
+    _packetIn.addBytesRead(bytes);
+    _bytesRead += bytes;
+    packetPtr += bytes;
+    packetLength -= bytes;
+  }
+
+  const char* parseError = 0;
+  while (_packetIn.haveNetString(parseError)) {
+    int res = decodeResponse(em);
+    if (res != 0) return res;
+  }
+
+  if (parseError) {
+    em = parseError;
+  }
+  else {
+    em = "Incomplete batch member";
+  }
+
+  return -1;
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // Prepare the request for sending to a service. This routine has to
 // set anything that can change as a result of a request progressing
@@ -260,13 +390,45 @@ pluton::clientRequestImpl::prepare(bool needAffinity)
     setState("prepare", openConnection);
   }
 
-  _sendDataPtr[0] = _packetOutPre.data();
-  _sendDataLength[0] = _packetOutPre.length();
-  getRequestData(_sendDataPtr[1], _sendDataLength[1]);
-  _sendDataPtr[2] = _packetOutPost.data();
-  _sendDataLength[2] = _packetOutPost.length();
+  //////////////////////////////////////////////////////////////////////
+  // The request data goes between the assembled netStrings, either as
+  // one iovec or as the caller's own if it is scattered. Raw packets
+  // are all in _packetOutPre.
+  //////////////////////////////////////////////////////////////////////
+
+  _sendIOV.clear();
+  _sendIOVNext = 0;
+  _sendDataResidual = 0;
+
+  addSendIOV(_packetOutPre.data(), _packetOutPre.length());
+  if (_memfdOut != -1) {		// Request data goes in the memfd
+    _memfdOutPending = true;
+  }
+  else if (!_compressedOut.empty()) {
+    addSendIOV(_compressedOut.data(), _compressedOut.length());
+  }
+  else if (!byPassIDCheck()) {
+    const std::vector<struct iovec>& dataIOV = getRequestIOV();
+    if (dataIOV.empty()) {
+      const char* p;
+      int len;
+      getRequestData(p, len);
+      addSendIOV(p, len);
+    }
+    else {
+      for (unsigned int ix=0; ix < dataIOV.size(); ++ix) {
+	addSendIOV(static_cast<const char*>(dataIOV[ix].iov_base), dataIOV[ix].iov_len);
+      }
+    }
+  }
+  addSendIOV(_packetOutPost.data(), _packetOutPost.length());
+  if (_memfdIn != -1) {
+    close(_memfdIn);
+    _memfdIn = -1;
+  }
 
   resetResponseValues();
+  _responsePartCount = 0;
   _packetIn.reset();
   _decoder.reset();
   _decoder.setRequest(this);
@@ -291,6 +453,81 @@ pluton::clientRequestImpl::setState(const char* who, state newState)
   if (_state == reading) getOwner()->subtractReadingCount();	// executeAndWaitSent completion
 
   _state = newState;
+  if (_state != withCaller) gettimeofday(&_stateTimes[_state], 0);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Per-stage timing is derived from the state transition times. The
+// clock starts when the request is added so that the lookup is
+// included. Stages that were not reached have a zero start or end
+// time and report zero.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientRequestImpl::startTiming()
+{
+  memset((void*) _stateTimes, '\0', sizeof(_stateTimes));
+  _firstByteTime.tv_sec = _firstByteTime.tv_usec = 0;
+  gettimeofday(&_startTime, 0);
+}
+
+bool
+pluton::clientRequestImpl::getStageTimes(int stage,
+					 struct timeval& startTime, struct timeval& endTime) const
+{
+  const struct timeval& queued =
+    (util::timevalCompare(_stateTimes[openConnection], _stateTimes[bypassAffinityOpen]) > 0)
+    ? _stateTimes[openConnection] : _stateTimes[bypassAffinityOpen];
+
+  switch (stage) {
+  case pluton::clientRequest::lookupStage:
+    startTime = _startTime; endTime = queued; break;
+
+  case pluton::clientRequest::connectStage:
+    startTime = queued; endTime = _stateTimes[opportunisticWrite]; break;
+
+  case pluton::clientRequest::writeStage:
+    startTime = _stateTimes[opportunisticWrite]; endTime = _stateTimes[reading]; break;
+
+  case pluton::clientRequest::serviceStage:
+    startTime = _stateTimes[reading]; endTime = _firstByteTime; break;
+
+  case pluton::clientRequest::readStage:
+    startTime = _firstByteTime; endTime = _stateTimes[done]; break;
+
+  case pluton::clientRequest::totalStage:
+    startTime = _startTime; endTime = _stateTimes[done]; break;
+
+  default:
+    return false;
+  }
+
+  return (startTime.tv_sec != 0) && (endTime.tv_sec != 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Members of a batch take on the connect, write, wait and read times
+// of the carrier that exchanged them.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::clientRequestImpl::copyExchangeTimes(const clientRequestImpl* from)
+{
+  for (int ix=connecting; ix <= reading; ++ix) _stateTimes[ix] = from->_stateTimes[ix];
+  _firstByteTime = from->_firstByteTime;
+}
+
+long
+pluton::clientRequestImpl::getStageMicroSeconds(int stage) const
+{
+  struct timeval startTime, endTime;
+  if (!getStageTimes(stage, startTime, endTime)) return 0;
+
+  long uSecs = util::timevalDiffuS(endTime, startTime);
+  if (uSecs < 0) uSecs = 0;		// Clocks do go backwards
+
+  return uSecs;
 }
 
 
@@ -308,7 +545,13 @@ pluton::clientRequestImpl::issueRead(int timeoutMS)
     return -1;
   }
 
-  int bytes = recv(_socket, bufPtr, maxAllowed, 0);
+  int bytes;
+  if (getMemfdAcceptThreshold() > 0) {
+    bytes = pluton::memfdPayload::recvWithFD(_socket, bufPtr, maxAllowed, _memfdIn);
+  }
+  else {
+    bytes = recv(_socket, bufPtr, maxAllowed, 0);
+  }
   DBGPRT << "recv(" << _socket << ") max=" << maxAllowed
 	 << " read=" << bytes << " errno=" << errno;
   if (bytes > 0) DBGPRTMORE << " S=" << std::string(bufPtr, bytes > 300 ? 300 : bytes);
@@ -322,6 +565,7 @@ pluton::clientRequestImpl::issueRead(int timeoutMS)
   }
 
   if (bytes > 0) {
+    if (_bytesRead == 0) gettimeofday(&_firstByteTime, 0);
     _packetIn.addBytesRead(bytes);	// Tell factory about the new data
     _bytesRead += bytes;
   }
@@ -339,36 +583,34 @@ pluton::clientRequestImpl::issueRead(int timeoutMS)
 // cheaper.
 //////////////////////////////////////////////////////////////////////
 
+void
+pluton::clientRequestImpl::addSendIOV(const char* p, int len)
+{
+  if (len <= 0) return;
+
+  struct iovec iov;
+  iov.iov_base = const_cast<char*>(p);
+  iov.iov_len = len;
+  _sendIOV.push_back(iov);
+  _sendDataResidual += len;
+}
+
 int
 pluton::clientRequestImpl::issueWrite(int timeoutMS)
 {
-  struct iovec iov[maxIOVECs];
-  int ix;
+  int iovCount = _sendIOV.size() - _sendIOVNext;
+  if (iovCount == 0) return 0;
 
-  _sendDataResidual = 0;
-  int iovCount = 0;
-  for (ix=0; ix < maxIOVECs; ++ix) {
-    if (_sendDataLength[ix] > 0) {
-      iov[iovCount].iov_base = (char*)_sendDataPtr[ix];
-      iov[iovCount].iov_len = _sendDataLength[ix];
-      _sendDataResidual += _sendDataLength[ix];
-      ++iovCount;
-    }
-  }
+  struct iovec* iov = &_sendIOV[_sendIOVNext];
 
-  if (iovCount == 0) return 0;
+  //////////////////////////////////////////////////////////////////////
+  // A request memfd rides along with the first bytes of the packet.
+  //////////////////////////////////////////////////////////////////////
+
+  int passFD = _memfdOutPending ? _memfdOut : -1;
 
 #if !defined(SO_NOSIGPIPE) && defined(MSG_NOSIGNAL)
-  struct msghdr mh;
-  mh.msg_name = 0;
-  mh.msg_namelen = 0;
-  mh.msg_control = 0;
-  mh.msg_control = 0;
-  mh.msg_controllen = 0;
-  mh.msg_flags = 0;
-  mh.msg_iov = iov;
-  mh.msg_iovlen = iovCount;
-  int bytesSent = sendmsg(_socket, &mh, MSG_NOSIGNAL);
+  int bytesSent = pluton::memfdPayload::sendWithFD(_socket, iov, iovCount, passFD, MSG_NOSIGNAL);
   if (_debugFlag) {
     DBGPRT << "sendmsg(" << _socket << ", " << bytesSent << "/" << _sendDataResidual
 	   << ") errno=" << errno << std::endl;
@@ -377,7 +619,13 @@ pluton::clientRequestImpl::issueWrite(int timeoutMS)
     DBGPRTMORE << std::endl;
   }
 #else
-  int bytesSent = writev(_socket, iov, iovCount);
+  int bytesSent;
+  if (passFD != -1) {
+    bytesSent = pluton::memfdPayload::sendWithFD(_socket, iov, iovCount, passFD, 0);
+  }
+  else {
+    bytesSent = writev(_socket, iov, iovCount);
+  }
   if (_debugFlag) {
     DBGPRT << "writev(" << _socket << ", " << bytesSent << "/" << _sendDataResidual
 	   << ") errno=" << errno << std::endl;
@@ -388,18 +636,20 @@ pluton::clientRequestImpl::issueWrite(int timeoutMS)
 #endif
 
   if (bytesSent <= 0) return bytesSent;
+  _memfdOutPending = false;
 
   int bytesSentReturned = bytesSent;
   _sendDataResidual -= bytesSent;
 
-  for (ix=0; ix<iovCount; ++ix) {
-    if (bytesSent <= 0) break;
-    if (_sendDataLength[ix] == 0) continue;	// Ignore previously written vecs
+  // Step past the vecs written and adjust a partially written one
 
-    int sub = std::min(_sendDataLength[ix], bytesSent);
-    _sendDataLength[ix] -= sub;
-    _sendDataPtr[ix] += sub;
+  while ((bytesSent > 0) && (_sendIOVNext < _sendIOV.size())) {
+    struct iovec& vec = _sendIOV[_sendIOVNext];
+    int sub = std::min((int) vec.iov_len, bytesSent);
+    vec.iov_base = static_cast<char*>(vec.iov_base) + sub;
+    vec.iov_len -= sub;
     bytesSent -= sub;
+    if (vec.iov_len == 0) ++_sendIOVNext;
   }
 
   return bytesSentReturned;
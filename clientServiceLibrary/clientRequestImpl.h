@@ -31,17 +31,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef P_CLIENTREQUESTIMPL_H
 #define P_CLIENTREQUESTIMPL_H 1
 
+#include <vector>
+
 #include <sys/time.h>
 #include <sys/types.h>
 
 #include "netString.h"
+#include "stdintWrapper.h"
 
 #include "pluton/clientEvent.h"
+#include "pluton/clientRequest.h"
 
 #include "timeoutClock.h"
 #include "faultImpl.h"
 #include "decodePacket.h"
 #include "requestImpl.h"
+#include "endpointPool.h"
 
 
 //////////////////////////////////////////////////////////////////////
@@ -87,6 +92,8 @@ namespace pluton {
     int 	issueWrite(int timeoutMS);
     int 	issueRead(int timeoutMS);
     int		decodeResponse(std::string& errorMessage);
+    bool	responseIsOurs() const;
+    int		decodeBatchMember(const char* packetPtr, int packetLength, std::string& em);
 
     enum state { withCaller, openConnection, bypassAffinityOpen, connecting,
 		 opportunisticWrite, subsequentWrites, reading,
@@ -100,6 +107,11 @@ namespace pluton {
     state	getState() const { return _state; }
     const char*	getStateEnglish() const { return stateToEnglish(_state); }
 
+    void	startTiming();
+    bool	getStageTimes(int stage, struct timeval& startTime, struct timeval& endTime) const;
+    long	getStageMicroSeconds(int stage) const;
+    void	copyExchangeTimes(const clientRequestImpl* from);
+
     void	setAffinity(bool tf) { _affinity = tf; }
     bool	getAffinity() const { return _affinity; }
 
@@ -123,30 +135,61 @@ namespace pluton {
     void		setClientRequestPtr(pluton::clientRequest* setH) { _clientRequestPtr = setH; }
     pluton::clientRequest*	getClientRequestPtr() const { return _clientRequestPtr; }
 
+    void	setResponsePartHandler(pluton::clientRequest::responsePartHandler h) { _partHandler = h; }
+    bool	hasResponsePartHandler() const { return _partHandler != 0; }
+    int		getResponsePartCount() const { return _responsePartCount; }
+    void	responsePart(const char* partPtr, int partLength);
+
     ////////////////////////////////////////
 
     std::string		_rendezvousID;
 
     int			_tryCount;
     int 		_socket;
+    bool		_binarySocket;		// Service on _socket answered in binary framing
+    char		_compressSocket;	// Service on _socket decompresses this algorithm
+    pluton::endpointPool::endpoint*	_endpoint;	// Remote endpoint counting this request
     unsigned int	_requestIDSent;
 
     netStringGenerate	_packetOutPre;		// Output packet is assembled in
     netStringGenerate	_packetOutPost;		// these netStrings
 
-    static const int	maxIOVECs = 3;
+    std::vector<struct iovec>	_sendIOV;	// Point back to the assembled netStrings
+    unsigned int		_sendIOVNext;	// and request data, used by writev() et al.
+    int				_sendDataResidual;
 
-    const char* 	_sendDataPtr[maxIOVECs];	// Point back to the assembled netStrings
-    int 		_sendDataLength[maxIOVECs];	// used by writev() et al.
-    int			_sendDataResidual;
+    int			_memfdOut;		// Request data passed as a memfd
+    bool		_memfdOutPending;	// Not yet passed on this attempt
+    int			_memfdIn;		// Response memfd passed by the service
+
+    std::string		_compressedOut;		// Request data as sent, if compressed
 
     netStringFactoryManaged 	_packetIn;
     decodeResponsePacket 	_decoder;
     int				_bytesRead;
+    struct timeval		_firstByteTime;		// Start of the read stage
+
+    uint64_t			_traceID;		// Zero if not being traced
+    uint64_t			_traceSpanID;
+    uint64_t			_traceParentID;
+
+    std::string			_cacheKey;		// Empty if not cacheable
+    std::string			_cachedResponse;	// Response data of a cache hit
+
+    //////////////////////////////////////////////////////////////////////
+    // A batch is exchanged by an internal carrier request on behalf
+    // of its members. Members are not on the _todoQueue while the
+    // carrier is in progress.
+    //////////////////////////////////////////////////////////////////////
+
+    std::vector<clientRequestImpl*>	_batchMembers;		// Set in the carrier
+    clientRequestImpl*			_batchCarrier;		// Set in each member
 
   private:
     void 		deleteFromQueues();
     void		debugLogIOV(int, struct iovec*, int maxBytes=400);
+    void		addSendIOV(const char* p, int len);
+    void		closeMemfds();
 
     //////////////////////////////////////////////////////////////////////
     // The requests are moved within and between two queues as they
@@ -159,6 +202,8 @@ namespace pluton {
     clientRequestImpl*	_next;
 
     state		_state;
+    struct timeval	_startTime;			// Set by addRequest()
+    struct timeval	_stateTimes[done+1];		// Most recent entry into each state
     bool		_affinity;
     int			_pollIndex;			// Index to pending pollfds array
 
@@ -174,6 +219,9 @@ namespace pluton {
     pluton::timeoutClock	_clock;
     pluton::clientRequest*      _clientRequestPtr;
 
+    pluton::clientRequest::responsePartHandler	_partHandler;
+    int						_responsePartCount;	// This attempt
+
 
     //////////////////////////////////////////////////////////////////////
     // A general container for the client to help track requests. It
@@ -58,6 +58,7 @@ struct __spluton_request_C_obj {
   int _requestDataSize;		// malloc size of _requestData
   mutable std::string* _faultText;
   mutable std::string* _serviceName;
+  void (*_partHandler)(pluton_request_C_obj*, const char*, int);
 };
 
 struct __spluton_client_C_obj {
@@ -73,6 +74,7 @@ internal_reset(pluton_request_C_obj* R)
   R->_requestDataSize = 0;
   R->_faultText = 0;
   R->_serviceName = 0;
+  R->_partHandler = 0;
 }
 
 pluton_request_C_obj*
@@ -189,6 +191,15 @@ pluton_request_C_setRequestData(pluton_request_C_obj* R,
   R->_pR->setRequestData(R->_requestData, len);
 }
 
+// Scattered request data is never copied, so the buffers must remain
+// until the request completes.
+
+void
+pluton_request_C_setRequestDataV(pluton_request_C_obj* R, const struct iovec* iov, int iovCount)
+{
+  R->_pR->setRequestData(iov, iovCount);
+}
+
 void
 pluton_request_C_setAttribute(pluton_request_C_obj* R, int attrs)
 {
@@ -292,6 +303,29 @@ if (GMyDebugFlag) fprintf(stderr, "C GCH %p/%p from %p\n", (void*)R, (void*)R->_
   return R->_clientHandle;
 }
 
+long
+pluton_request_C_getStageMicroSeconds(const pluton_request_C_obj* R, int stage)
+{
+  return R->_pR->getStageMicroSeconds(static_cast<pluton::clientRequest::stage>(stage));
+}
+
+// The C++ handle always points back to the C object
+
+static void
+partTrampoline(pluton::clientRequest* pR, const char* p, int len)
+{
+  pluton_request_C_obj* R = static_cast<pluton_request_C_obj*>(pR->getClientHandle());
+  if (R->_partHandler) R->_partHandler(R, p, len);
+}
+
+void
+pluton_request_C_setResponsePartHandler(pluton_request_C_obj* R,
+					void (*handler)(pluton_request_C_obj*, const char*, int))
+{
+  R->_partHandler = handler;
+  R->_pR->setResponsePartHandler(handler ? partTrampoline : 0);
+}
+
 //////////////////////////////////////////////////////////////////////
 
 const char*
@@ -354,6 +388,98 @@ pluton_client_C_getTimeoutMilliSeconds(const pluton_client_C_obj* C)
 }
 
 
+void
+pluton_client_C_setResponseCacheSize(pluton_client_C_obj* C, unsigned long maximumBytes)
+{
+  C->_pC->setResponseCacheSize(maximumBytes);
+}
+
+
+void
+pluton_client_C_setZeroCopyThreshold(pluton_client_C_obj* C, unsigned int bytes)
+{
+  C->_pC->setZeroCopyThreshold(bytes);
+}
+
+
+void
+pluton_client_C_setBatchCoalescing(pluton_client_C_obj* C, unsigned int maximumRequests)
+{
+  C->_pC->setBatchCoalescing(maximumRequests);
+}
+
+
+void
+pluton_client_C_setBinaryFraming(pluton_client_C_obj* C, int onOff)
+{
+  C->_pC->setBinaryFraming(onOff != 0);
+}
+
+
+void
+pluton_client_C_setCompression(pluton_client_C_obj* C, int algorithm, unsigned int thresholdBytes)
+{
+  C->_pC->setCompression(static_cast<pluton::compressionAlgorithm>(algorithm), thresholdBytes);
+}
+
+
+void
+pluton_client_C_getCompressionStats(const pluton_client_C_obj* C,
+				    unsigned long long* uncompressedBytes,
+				    unsigned long long* compressedBytes,
+				    unsigned long long* cpuMicroSeconds)
+{
+  pluton::compressionStats stats;
+  C->_pC->getCompressionStats(stats);
+  if (uncompressedBytes) *uncompressedBytes = stats.uncompressedBytes;
+  if (compressedBytes) *compressedBytes = stats.compressedBytes;
+  if (cpuMicroSeconds) *cpuMicroSeconds = stats.cpuMicroSeconds;
+}
+
+
+void
+pluton_client_C_getResponseCacheStats(const pluton_client_C_obj* C,
+				      unsigned long* hits, unsigned long* misses)
+{
+  pluton::responseCacheStats stats;
+  C->_pC->getResponseCacheStats(stats);
+  if (hits) *hits = stats.hits;
+  if (misses) *misses = stats.misses;
+}
+
+
+int
+pluton_client_C_getTimingStats(const pluton_client_C_obj* C, const char* serviceKey, int stage,
+			       unsigned long* count, unsigned long long* totaluSecs,
+			       unsigned long* maximumuSecs,
+			       unsigned long* buckets, int bucketCount)
+{
+  if ((stage < 0) || (stage >= pluton::clientRequest::stageCount)) return 0;
+
+  pluton::clientTimingStats ts;
+  if (!C->_pC->getTimingStats(serviceKey, ts)) return 0;
+
+  const pluton::clientStageHistogram& sh = ts.stage[stage];
+  if (count) *count = sh.count;
+  if (totaluSecs) *totaluSecs = sh.totaluSecs;
+  if (maximumuSecs) *maximumuSecs = sh.maximumuSecs;
+  if (buckets) {
+    for (int ix=0; ix < bucketCount; ++ix) {
+      buckets[ix] = (ix < pluton::clientStageHistogram::bucketCount) ? sh.bucket[ix] : 0;
+    }
+  }
+
+  return 1;
+}
+
+
+void
+pluton_client_C_resetTimingStats(pluton_client_C_obj* C)
+{
+  C->_pC->resetTimingStats();
+}
+
+
 int
 pluton_client_C_addRequest(pluton_client_C_obj* C, const char* serviceKey, pluton_request_C_obj* R)
 {
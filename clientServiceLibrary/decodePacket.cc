@@ -52,8 +52,27 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //////////////////////////////////////////////////////////////////////
 
 
-pluton::decodePacket::decodePacket(pluton::packetType setStartingType, pluton::requestImpl* R)
-  : _startingType(setStartingType), _requestIn(R), _state(needStartingType)
+//////////////////////////////////////////////////////////////////////
+// Convert a numeric netString value. A binary framed netString has no
+// terminator to stop strtol(), so the value is copied out first.
+//////////////////////////////////////////////////////////////////////
+
+static long
+nsToLong(const char* nsDataPtr, int nsDataLength)
+{
+  char buf[24];
+  if (nsDataLength >= (int) sizeof(buf)) nsDataLength = sizeof(buf) - 1;
+  memcpy(buf, nsDataPtr, nsDataLength);
+  buf[nsDataLength] = '\0';
+
+  return strtol(buf, 0, 10);
+}
+
+
+pluton::decodePacket::decodePacket(pluton::packetType setStartingType,
+				   pluton::packetType setBatchStartingType, pluton::requestImpl* R)
+  : _startingType(setStartingType), _batchStartingType(setBatchStartingType),
+    _requestIn(R), _state(needStartingType), _requestID(0), _batchFlag(false)
 {
   memset((void*) _haveMap, '\0', sizeof(_haveMap));
 }
@@ -64,7 +83,7 @@ pluton::decodePacket::~decodePacket()
 
 
 pluton::decodeRequestPacket::decodeRequestPacket(pluton::requestImpl* R)
-  : decodePacket(pluton::requestPT, R)
+  : decodePacket(pluton::requestPT, pluton::batchRequestPT, R)
 {
 }
 
@@ -73,7 +92,7 @@ pluton::decodeRequestPacket::~decodeRequestPacket()
 }
 
 pluton::decodeResponsePacket::decodeResponsePacket(pluton::requestImpl* R)
-  : decodePacket(pluton::responsePT, R)
+  : decodePacket(pluton::responsePT, pluton::batchResponsePT, R)
 {
 }
   
@@ -94,6 +113,10 @@ pluton::decodePacket::reset()
 
   _requestID = 0;
   _requestIn = 0;
+
+  _batchFlag = false;
+  _batchOffsets.clear();
+  _batchLengths.clear();
 }
 
 
@@ -109,6 +132,11 @@ pluton::decodePacket::addType(char nsType, const char* nsDataPtr, int nsDataLeng
 			      int nsDataOffset, std::string& errorMessage)
 {
   if (_state == needStartingType) {
+    if (nsType == _batchStartingType) {
+      _batchFlag = true;
+      _state = acceptingOthers;
+      return true;
+    }
     if (nsType != _startingType) {
       std::ostringstream os;
 
@@ -141,6 +169,22 @@ pluton::decodePacket::addType(char nsType, const char* nsDataPtr, int nsDataLeng
     return false;
   }
 
+  //////////////////////////////////////////////////////////////////////
+  // Batch members and response parts are the only types that may
+  // legitimately repeat.
+  //////////////////////////////////////////////////////////////////////
+
+  if ((nsType == pluton::batchMemberNT) && _batchFlag) {
+    _batchOffsets.push_back(nsDataOffset);
+    _batchLengths.push_back(nsDataLength);
+    return true;
+  }
+
+  if (nsType == pluton::responsePartNT) {
+    if (_requestIn) _requestIn->responsePart(nsDataPtr, nsDataLength);
+    return true;
+  }
+
   if (_haveMap[(unsigned) nsType]) {
     errorMessage = "decodePacket: Duplicate netString type of ";
     errorMessage += pluton::misc::NSTypeToEnglish(static_cast<pluton::netStringType> (nsType));
@@ -165,7 +209,7 @@ pluton::decodePacket::addType(char nsType, const char* nsDataPtr, int nsDataLeng
 
   case pluton::faultCodeNT:
     if (_requestIn) {
-      _requestIn->setFaultCode(static_cast<pluton::faultCode>(strtol(nsDataPtr, 0, 10)));
+      _requestIn->setFaultCode(static_cast<pluton::faultCode>(nsToLong(nsDataPtr, nsDataLength)));
     }
     break;
 
@@ -178,7 +222,7 @@ pluton::decodePacket::addType(char nsType, const char* nsDataPtr, int nsDataLeng
     break;
 
   case pluton::requestIDNT:
-    _requestID = strtol(nsDataPtr, 0, 10);	// The NS terminator stops strtol()
+    _requestID = nsToLong(nsDataPtr, nsDataLength);
     break;
 
   case pluton::contextNT:
@@ -190,21 +234,71 @@ pluton::decodePacket::addType(char nsType, const char* nsDataPtr, int nsDataLeng
     break;
 
   case pluton::timeoutMSNT:
-    if (_requestIn) _requestIn->setTimeoutMS(strtol(nsDataPtr, 0, 10));
+    if (_requestIn) _requestIn->setTimeoutMS(nsToLong(nsDataPtr, nsDataLength));
     break;
 
   case pluton::fileDescriptorNT:
     if (_requestIn) _requestIn->setHasFileDescriptor(true);
     break;
 
+  case pluton::binaryFramingNT:
+    if (_requestIn) _requestIn->setBinaryFraming(true);
+    break;
+
+  case pluton::responsePartAcceptNT:
+    if (_requestIn) _requestIn->setResponsePartAccept(true);
+    break;
+
+  case pluton::memfdAcceptNT:
+    if (_requestIn) _requestIn->setMemfdAcceptThreshold(nsToLong(nsDataPtr, nsDataLength));
+    break;
+
+  case pluton::memfdDataNT:		// Caller maps the passed memfd
+    if (_requestIn) _requestIn->setMemfdDataLength(nsToLong(nsDataPtr, nsDataLength),
+						   _startingType == pluton::responsePT);
+    break;
+
   case pluton::responseDataNT:
     if (_requestIn) _requestIn->setResponseOffset(nsDataOffset, nsDataLength);
     break;
 
+  case pluton::compressAcceptNT:
+    if (!_requestIn || (nsDataLength < 1)) break;
+    if (_startingType == pluton::responsePT) {
+      _requestIn->setPeerDecompresses(*nsDataPtr);
+    }
+    else {
+      _requestIn->setCompressAccept(*nsDataPtr, nsToLong(nsDataPtr+1, nsDataLength-1));
+    }
+    break;
+
+  case pluton::compressionNT:
+    if (nsDataLength < 2) {
+      errorMessage = "decodePacket: compressionNT lacks an algorithm and length";
+      return false;
+    }
+    if (_requestIn) _requestIn->setCompression(*nsDataPtr, nsToLong(nsDataPtr+1, nsDataLength-1),
+					       _startingType == pluton::responsePT);
+    break;
+
+  case pluton::compressedDataNT:		// Caller inflates the complete packet
+    if (!_requestIn) break;
+    if (_startingType == pluton::responsePT) {
+      _requestIn->setResponseOffset(nsDataOffset, nsDataLength);
+    }
+    else {
+      _requestIn->setRequestOffset(nsDataOffset, nsDataLength);
+    }
+    break;
+
   case pluton::faultTextNT:
     if (_requestIn) _requestIn->setFaultText(nsDataPtr, nsDataLength);
     break;
 
+  case pluton::cacheMaxAgeNT:
+    if (_requestIn) _requestIn->setCacheMaxAgeMS(nsToLong(nsDataPtr, nsDataLength));
+    break;
+
   case pluton::attributeNoWaitNT:
     if (_requestIn) _requestIn->setAttribute(pluton::noWaitAttr);
     break;
@@ -240,3 +334,123 @@ pluton::decodePacket::addType(char nsType, const char* nsDataPtr, int nsDataLeng
 
   return true;
 }
+
+
+//////////////////////////////////////////////////////////////////////
+// Decode a complete packet that is encapsulated in a buffer which
+// will not move, such as a member of a batch. The offsets are
+// relative to basePtr, just as they are for a packet read in
+// piece-meal, so the request ends up pointing into the buffer.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::decodePacket::decodeEncapsulated(const char* basePtr, int packetOffset, int packetLength,
+					 std::string& errorMessage)
+{
+  netStringParse nsp(basePtr + packetOffset, packetLength);
+  if (_requestIn) {
+    _requestIn->setPacketOffset(packetOffset);
+    if ((packetLength > 0) && (basePtr[packetOffset] & 0x80)) {	// Binary framed
+      _requestIn->setBinaryFraming(true);
+    }
+  }
+
+  while (!haveCompleteRequest()) {
+    char nsType;
+    const char* nsDataPtr;
+    int nsDataLength;
+    const char* err = nsp.getNext(nsType, nsDataPtr, nsDataLength);
+    if (err) {
+      errorMessage = "decodePacket: Encapsulated packet: ";
+      errorMessage += err;
+      return false;
+    }
+    if (!addType(nsType, nsDataPtr, nsDataLength, nsDataPtr - basePtr, errorMessage)) {
+      return false;
+    }
+  }
+
+  if (_batchFlag) {
+    errorMessage = "decodePacket: Batch packets cannot be nested";
+    return false;
+  }
+
+  if (_requestIn) _requestIn->adjustOffsets(basePtr, packetOffset + packetLength);
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Generate the netStrings either side of a packet being sent in a
+// multiplexed frame.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::decodeMultiplexFrame::assemble(unsigned int tag, int packetLength,
+				       netStringGenerate& pre, netStringGenerate& post)
+{
+  pre.append(pluton::multiplexPT);
+  pre.append(pluton::multiplexTagNT, tag);
+  pre.appendRawPrefix(pluton::multiplexPacketNT, packetLength);
+
+  post.appendRawTerminator();
+  post.appendNL(pluton::endPacketNT);
+}
+
+
+void
+pluton::decodeMultiplexFrame::reset()
+{
+  _state = needStartingType;
+  _tag = 0;
+  _packetOffset = 0;
+  _packetLength = -1;
+}
+
+
+bool
+pluton::decodeMultiplexFrame::addType(char nsType, const char* nsDataPtr, int nsDataLength,
+				      int nsDataOffset, std::string& errorMessage)
+{
+  switch (_state) {
+  case needStartingType:
+    if (nsType != pluton::multiplexPT) {
+      errorMessage = "decodeMultiplexFrame: Expected multiplexPT, but got: ";
+      errorMessage += pluton::misc::packetToEnglish((pluton::packetType) nsType);
+      return false;
+    }
+    _state = acceptingOthers;
+    break;
+
+  case acceptingOthers:
+    switch (nsType) {
+    case pluton::multiplexTagNT:
+      _tag = nsToLong(nsDataPtr, nsDataLength);
+      break;
+
+    case pluton::multiplexPacketNT:
+      _packetOffset = nsDataOffset;
+      _packetLength = nsDataLength;
+      break;
+
+    case pluton::endPacketNT:
+      if (_packetLength == -1) {
+	errorMessage = "decodeMultiplexFrame: Frame ended without a packet";
+	return false;
+      }
+      _state = haveFullFrame;
+      break;
+
+    default:			// Allow unknown types from newer peers
+      break;
+    }
+    break;
+
+  case haveFullFrame:
+    errorMessage = "decodeMultiplexFrame: Have a complete frame ready, already";
+    return false;
+  }
+
+  return true;
+}
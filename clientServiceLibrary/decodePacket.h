@@ -42,12 +42,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 
 #include "global.h"
+#include "netString.h"
 #include "requestImpl.h"
 
 namespace pluton {
   class decodePacket {
   protected:
-    decodePacket(pluton::packetType startingType, pluton::requestImpl* R=0);
+    decodePacket(pluton::packetType startingType, pluton::packetType batchStartingType,
+		 pluton::requestImpl* R=0);
 
   public:
     virtual ~decodePacket() = 0;
@@ -57,12 +59,26 @@ namespace pluton {
 			int nsDataOffset, std::string& em);
     bool	haveCompleteRequest() const { return _state == haveFullRequest; }
 
+    bool	decodeEncapsulated(const char* basePtr, int packetOffset, int packetLength,
+				   std::string& em);
+
+    //////////////////////////////////////////////////////////////////////
+    // A batch packet carries complete member packets. Their offsets
+    // are relative to the same base as all other offsets.
+    //////////////////////////////////////////////////////////////////////
+
+    bool	isBatch() const { return _batchFlag; }
+    int		getBatchCount() const { return _batchOffsets.size(); }
+    void	getBatchMember(int ix, int& offset, int& length) const
+      { offset = _batchOffsets[ix]; length = _batchLengths[ix]; }
+
     void 			setRequest(pluton::requestImpl* R) { _requestIn = R; }
     pluton::requestImpl*	getRequest() const { return _requestIn; }
     unsigned int 		getRequestID() const { return _requestID; }
 
   protected:
     pluton::packetType	_startingType;
+    pluton::packetType	_batchStartingType;
 
   private:
     decodePacket&	operator=(const decodePacket& rhs);	// Assign not ok
@@ -71,6 +87,9 @@ namespace pluton {
     pluton::requestImpl *_requestIn;
     enum { needStartingType, acceptingOthers, haveFullRequest } _state;
     unsigned int	_requestID;
+    bool		_batchFlag;
+    std::vector<int>	_batchOffsets;
+    std::vector<int>	_batchLengths;
 
     static const unsigned int	_haveMapSize = 'z' + 1;			// Track which types have
     char			_haveMap[_haveMapSize];			// already been seen
@@ -87,6 +106,38 @@ namespace pluton {
     decodeResponsePacket(pluton::requestImpl* R=0);
     ~decodeResponsePacket();
   };
+
+
+  //////////////////////////////////////////////////////////////////////
+  // A multiplexed frame wraps one complete request or response packet
+  // with a tag so that many requests can be outstanding on the one
+  // connection between plTransmitter and plReceiver. Responses carry
+  // the tag of their request and may come back in any order.
+  //////////////////////////////////////////////////////////////////////
+
+  class decodeMultiplexFrame {
+  public:
+    decodeMultiplexFrame() { reset(); }
+
+    static void	assemble(unsigned int tag, int packetLength,
+			 netStringGenerate& pre, netStringGenerate& post);
+
+    void	reset();
+    bool	addType(char nsType, const char* nsDataPtr, int nsDataLength,
+			int nsDataOffset, std::string& em);
+    bool	isStarted() const { return _state != needStartingType; }
+    bool	haveCompleteFrame() const { return _state == haveFullFrame; }
+
+    unsigned int	getTag() const { return _tag; }
+    void		getPacket(int& offset, int& length) const
+      { offset = _packetOffset; length = _packetLength; }
+
+  private:
+    enum { needStartingType, acceptingOthers, haveFullFrame } _state;
+    unsigned int	_tag;
+    int			_packetOffset;
+    int			_packetLength;
+  };
 }
 
 #endif
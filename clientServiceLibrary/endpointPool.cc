@@ -0,0 +1,249 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#include <netinet/in.h>		// FBSD4 needs this for getaddrinfo()
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "remoteEndpoints.h"
+#include "endpointPool.h"
+
+
+pluton::endpointPool::endpointPool()
+{
+}
+
+
+pluton::endpointPool::~endpointPool()
+{
+  for (groupIter gi=_groups.begin(); gi != _groups.end(); ++gi) {
+    group* g = gi->second;
+    for (unsigned int ix=0; ix < g->endpoints.size(); ++ix) {
+      std::vector<int>& idle = g->endpoints[ix].idleSockets;
+      for (unsigned int sx=0; sx < idle.size(); ++sx) close(idle[sx]);
+    }
+    delete g;
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Parse the rendezvousID and resolve each endpoint. Resolution only
+// happens the first time a thread uses a remote service so the cost
+// of a blocking getaddrinfo() is not paid per request. An endpoint
+// that fails to resolve is marked down rather than given up on;
+// acquire() tries it again once the down time has passed.
+//////////////////////////////////////////////////////////////////////
+
+pluton::endpointPool::group*
+pluton::endpointPool::createGroup(const std::string& rendezvousID)
+{
+  group* g = new group;
+  g->next = 0;
+
+  pluton::remoteEndpoints re;
+  if (!re.parse(rendezvousID, g->errorMessage)) return g;
+
+  const std::vector<pluton::remoteEndpoints::endpoint>& eps = re.getEndpoints();
+  g->endpoints.resize(eps.size());
+
+  for (unsigned int ix=0; ix < eps.size(); ++ix) {
+    endpoint& ep = g->endpoints[ix];
+    ep.host = eps[ix].host;
+    ep.port = eps[ix].port;
+    ep.name = ep.host + ":" + util::ltos(ep.port);
+    ep.resolved = false;
+    ep.maximumOutstanding = eps[ix].maximumOutstanding;
+    ep.outstanding = 0;
+    ep.downUntil = 0;
+
+    if (!resolve(&ep, g->errorMessage)) markDown(&ep);
+  }
+
+  return g;
+}
+
+
+bool
+pluton::endpointPool::resolve(endpoint* ep, std::string& em)
+{
+  struct addrinfo hints;
+  memset((void*) &hints, '\0', sizeof(hints));
+  hints.ai_family = PF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+
+  struct addrinfo* ai = 0;
+  int gae = getaddrinfo(ep->host.c_str(), 0, &hints, &ai);
+  if (gae || !ai || !ai->ai_addr) {
+    em = "Could not resolve remote endpoint ";
+    em += ep->name;
+    if (gae) {
+      em += ": ";
+      em += gai_strerror(gae);
+    }
+    if (ai) freeaddrinfo(ai);
+    return false;
+  }
+
+  memcpy((void*) &ep->address, ai->ai_addr, sizeof(ep->address));
+  ep->address.sin_port = htons((unsigned short) ep->port);
+  ep->resolved = true;
+  freeaddrinfo(ai);
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Choose the endpoint for a new request and count it as outstanding
+// there.
+//
+// Return <0 == error, 0 == all endpoints are at their limit, >0 == ep set
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::endpointPool::acquire(const std::string& rendezvousID, endpoint*& ep, std::string& em)
+{
+  group* g;
+  groupIter gi = _groups.find(rendezvousID);
+  if (gi != _groups.end()) {
+    g = gi->second;
+  }
+  else {
+    g = createGroup(rendezvousID);
+    _groups[rendezvousID] = g;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // Least outstanding wins. Endpoints that recently refused a
+  // connection are only considered if nothing else is available, not
+  // even by waiting for a busy endpoint. Endpoints that have not yet
+  // resolved are retried once their down time has passed.
+  //////////////////////////////////////////////////////////////////////
+
+  time_t now = time(0);
+  unsigned int count = g->endpoints.size();
+  bool atLimit = false;
+  ep = 0;
+
+  for (int pass=0; !ep && !atLimit && (pass < 2); ++pass) {
+    for (unsigned int ix=0; ix < count; ++ix) {
+      endpoint* candidate = &g->endpoints[(g->next + ix) % count];
+      if (!candidate->resolved) {
+	if (candidate->downUntil > now) continue;
+	if (!resolve(candidate, g->errorMessage)) {
+	  markDown(candidate);
+	  continue;
+	}
+      }
+      if ((candidate->maximumOutstanding > 0)
+	  && (candidate->outstanding >= candidate->maximumOutstanding)) {
+	atLimit = true;
+	continue;
+      }
+      if ((pass == 0) && (candidate->downUntil > now)) continue;
+      if (!ep || (candidate->outstanding < ep->outstanding)) ep = candidate;
+    }
+  }
+
+  if (!ep) {
+    if (atLimit) return 0;
+    em = g->errorMessage.empty() ? "No usable remote endpoints" : g->errorMessage;
+    return -1;
+  }
+
+  if (count > 0) g->next = (g->next + 1) % count;
+  ++ep->outstanding;
+
+  return 1;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Return the most recently used idle connection that is still open
+// or -1 if there is none. The far end closes connections that have
+// been idle for too long, so each one is checked with a non-blocking
+// peek first: a healthy idle connection has nothing to read.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::endpointPool::takeIdleSocket(endpoint* ep)
+{
+  while (!ep->idleSockets.empty()) {
+    int sock = ep->idleSockets.back();
+    ep->idleSockets.pop_back();
+
+    char c;
+    int res = recv(sock, &c, 1, MSG_PEEK);
+    if ((res == -1) && util::retryNonBlockIO(errno)) return sock;
+    close(sock);
+  }
+
+  return -1;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// A request is done with the endpoint. Only a connection that has
+// completed a clean exchange can be re-used, anything else may have
+// residual data in flight.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::endpointPool::release(endpoint* ep, int sock, bool reusable)
+{
+  --ep->outstanding;
+  if (sock == -1) return;
+
+  int maximumIdle = ep->maximumOutstanding > 0 ? ep->maximumOutstanding : maximumIdleSockets;
+  if (reusable && ((int) ep->idleSockets.size() < maximumIdle)) {
+    ep->idleSockets.push_back(sock);
+  }
+  else {
+    close(sock);
+  }
+}
+
+
+void
+pluton::endpointPool::markDown(endpoint* ep)
+{
+  ep->downUntil = time(0) + downSeconds;
+}
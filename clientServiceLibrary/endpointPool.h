@@ -0,0 +1,110 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_ENDPOINTPOOL_H
+#define P_ENDPOINTPOOL_H 1
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <time.h>
+
+#include "hashString.h"
+#include "hash_mapWrapper.h"
+
+
+//////////////////////////////////////////////////////////////////////
+// An endpointPool tracks the remote endpoints of services that are
+// reached directly over TCP. There is one pool per clientImpl, thus
+// one per thread, so no locking is needed.
+//
+// Each endpoint counts its outstanding requests so that a new request
+// goes to the least busy endpoint that is under its limit. Ties are
+// broken round-robin. Connections are persistent: when a request
+// completes cleanly its socket is returned to the endpoint as idle
+// and the next request to that endpoint re-uses it rather than paying
+// for another connect() and slow-start.
+//
+// An endpoint that refuses a connection is skipped for a few seconds
+// unless there is no other endpoint to use or wait for. An endpoint
+// whose host does not resolve is skipped for the same few seconds and
+// then resolved again.
+//////////////////////////////////////////////////////////////////////
+
+namespace pluton {
+
+  class endpointPool {
+  public:
+    endpointPool();
+    ~endpointPool();
+
+    class endpoint {
+    public:
+      std::string		host;
+      int			port;
+      std::string		name;			// host:port for messages
+      struct sockaddr_in	address;
+      bool			resolved;
+      int			maximumOutstanding;	// Zero means no limit
+      int			outstanding;
+      time_t			downUntil;
+      std::vector<int>		idleSockets;		// Most recently used last
+    };
+
+    int		acquire(const std::string& rendezvousID, endpoint*& ep, std::string& em);
+    int		takeIdleSocket(endpoint* ep);
+    void	release(endpoint* ep, int sock, bool reusable);
+    void	markDown(endpoint* ep);
+
+  private:
+    endpointPool&	operator=(const endpointPool& rhs);	// Assign not ok
+    endpointPool(const endpointPool& rhs);			// Copy not ok
+
+    static const int	maximumIdleSockets = 16;	// Per unlimited endpoint
+    static const int	downSeconds = 5;
+
+    class group {
+    public:
+      std::vector<endpoint>	endpoints;
+      unsigned int		next;			// Round-robin start
+      std::string		errorMessage;		// Parse or latest resolution failure
+    };
+
+    group*	createGroup(const std::string& rendezvousID);
+    bool	resolve(endpoint* ep, std::string& em);
+
+    P_STLMAP<std::string, group*, hashString>	_groups;
+    typedef P_STLMAP<std::string, group*, hashString>::iterator groupIter;
+  };
+}
+
+#endif
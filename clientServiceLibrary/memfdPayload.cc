@@ -0,0 +1,239 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "config.h"
+
+#include <string>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "memfdPayload.h"
+
+#if defined(HAVE_MEMFD_CREATE) && defined(MFD_ALLOW_SEALING) && defined(F_ADD_SEALS)
+#define P_HAVE_MEMFD 1
+static const int requiredSeals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL;
+#endif
+
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+
+bool
+pluton::memfdPayload::available()
+{
+#ifdef P_HAVE_MEMFD
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Return a sealed memfd containing the data or -1 if one could not be
+// created, in which case the caller simply sends the data inline.
+// Scattered data is written piece by piece.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::memfdPayload::create(const char* p, int len)
+{
+  struct iovec iov;
+  iov.iov_base = const_cast<char*>(p);
+  iov.iov_len = len;
+
+  return create(&iov, 1);
+}
+
+int
+pluton::memfdPayload::create(const struct iovec* iov, int iovCount)
+{
+#ifdef P_HAVE_MEMFD
+  int fd = memfd_create("pluton", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd == -1) return -1;
+
+  for (int ix=0; ix < iovCount; ++ix) {
+    const char* p = static_cast<const char*>(iov[ix].iov_base);
+    int len = iov[ix].iov_len;
+    while (len > 0) {
+      int bytes = write(fd, p, len);
+      if (bytes <= 0) {
+	if ((bytes == -1) && (errno == EINTR)) continue;
+	close(fd);
+	return -1;
+      }
+      p += bytes;
+      len -= bytes;
+    }
+  }
+
+  if (fcntl(fd, F_ADD_SEALS, requiredSeals) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+#else
+  return -1;
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Map a received memfd. The fd is always consumed. Return the
+// read-only mapping or zero with errorMessage set.
+//////////////////////////////////////////////////////////////////////
+
+const char*
+pluton::memfdPayload::map(int fd, int len, std::string& em)
+{
+  if (fd == -1) {
+    em = "memfd data announced but no descriptor was passed";
+    return 0;
+  }
+
+#ifdef P_HAVE_MEMFD
+  int seals = fcntl(fd, F_GET_SEALS);
+  if ((seals == -1) || ((seals & requiredSeals) != requiredSeals)) {
+    close(fd);
+    em = "Passed memfd is not sealed";
+    return 0;
+  }
+
+  struct stat sb;
+  if ((fstat(fd, &sb) == -1) || (sb.st_size != len)) {
+    close(fd);
+    em = "Passed memfd size does not match announced length of ";
+    em += util::ltos(len);
+    return 0;
+  }
+
+  void* vp = mmap(0, len, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (vp == MAP_FAILED) {
+    util::messageWithErrno(em, "System Error: mmap() of passed memfd failed");
+    return 0;
+  }
+
+  return static_cast<const char*>(vp);
+#else
+  close(fd);
+  em = "memfd data is not supported on this system";
+  return 0;
+#endif
+}
+
+
+void
+pluton::memfdPayload::unmap(const char* p, int len)
+{
+  munmap((void*) p, len);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The descriptor travels as SCM_RIGHTS ancillary data attached to the
+// first byte of the packet.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::memfdPayload::sendWithFD(int sock, struct iovec* iov, int iovCount, int fd, int flags)
+{
+  struct msghdr mh;
+  memset((void*) &mh, '\0', sizeof(mh));
+  mh.msg_iov = iov;
+  mh.msg_iovlen = iovCount;
+
+  char cmsgBuffer[CMSG_SPACE(sizeof(int))];
+  if (fd != -1) {
+    memset(cmsgBuffer, '\0', sizeof(cmsgBuffer));
+    mh.msg_control = cmsgBuffer;
+    mh.msg_controllen = sizeof(cmsgBuffer);
+    struct cmsghdr* cmp = CMSG_FIRSTHDR(&mh);
+    cmp->cmsg_level = SOL_SOCKET;
+    cmp->cmsg_type = SCM_RIGHTS;
+    cmp->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmp), &fd, sizeof(int));
+  }
+
+  return sendmsg(sock, &mh, flags);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// A recv() that also accepts a passed descriptor. fd is only changed
+// if a descriptor arrives. Anything unexpected in the ancillary data
+// is closed so that a misbehaving peer cannot leak descriptors into
+// this process.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::memfdPayload::recvWithFD(int sock, char* p, int len, int& fd)
+{
+  struct iovec iov;
+  iov.iov_base = p;
+  iov.iov_len = len;
+
+  struct msghdr mh;
+  memset((void*) &mh, '\0', sizeof(mh));
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+
+  char cmsgBuffer[CMSG_SPACE(sizeof(int) * 4)];
+  mh.msg_control = cmsgBuffer;
+  mh.msg_controllen = sizeof(cmsgBuffer);
+
+  int bytes = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+  if (bytes == -1) return bytes;
+
+  for (struct cmsghdr* cmp = CMSG_FIRSTHDR(&mh); cmp; cmp = CMSG_NXTHDR(&mh, cmp)) {
+    if ((cmp->cmsg_level != SOL_SOCKET) || (cmp->cmsg_type != SCM_RIGHTS)) continue;
+    int count = (cmp->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (int ix=0; ix < count; ++ix) {
+      int passedFD;
+      memcpy(&passedFD, CMSG_DATA(cmp) + ix * sizeof(int), sizeof(int));
+      if (fd != -1) close(fd);		// Only the most recent is of interest
+      fd = passedFD;
+    }
+  }
+
+  return bytes;
+}
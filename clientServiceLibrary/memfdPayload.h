@@ -0,0 +1,72 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_MEMFDPAYLOAD_H
+#define P_MEMFDPAYLOAD_H 1
+
+#include <string>
+
+#include <sys/uio.h>
+
+
+//////////////////////////////////////////////////////////////////////
+// Large request and response data can be passed as a sealed memfd
+// rather than being copied through the socket. The sender writes the
+// data into an anonymous memfd, seals it against further change and
+// passes the descriptor with the first write of the packet. The
+// packet carries a memfdDataNT netString holding the data length in
+// place of the usual data netString. The receiver maps the memfd
+// read-only and points the request or response data at the mapping.
+//
+// Sealing is what makes this safe: the receiver checks that the
+// sender can no longer shrink or modify the memfd, so the mapping
+// cannot change underneath it or fault on truncation.
+//
+// memfds are a Linux facility. On other systems available() returns
+// false and everything travels through the socket as usual.
+//////////////////////////////////////////////////////////////////////
+
+namespace pluton {
+
+  class memfdPayload {
+  public:
+    static bool		available();
+
+    static int		create(const char* p, int len);
+    static int		create(const struct iovec* iov, int iovCount);
+    static const char*	map(int fd, int len, std::string& errorMessage);
+    static void		unmap(const char* p, int len);
+
+    static int		sendWithFD(int sock, struct iovec* iov, int iovCount, int fd, int flags);
+    static int		recvWithFD(int sock, char* p, int len, int& fd);
+  };
+}
+
+#endif
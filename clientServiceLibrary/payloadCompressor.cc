@@ -0,0 +1,212 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "config.h"
+
+#include <string>
+
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#include <time.h>
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+
+#include "pluton/common.h"
+
+#include "util.h"
+#include "payloadCompressor.h"
+
+
+//////////////////////////////////////////////////////////////////////
+// Charge the thread's CPU time if the system can tell us, otherwise
+// fall back to elapsed time which is near enough for such short,
+// CPU-bound calls.
+//////////////////////////////////////////////////////////////////////
+
+static unsigned long long
+cpuMicroSeconds()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+    return (unsigned long long) ts.tv_sec * util::MICROSECOND + ts.tv_nsec / 1000;
+  }
+#endif
+
+  struct timeval now;
+  gettimeofday(&now, 0);
+
+  return (unsigned long long) now.tv_sec * util::MICROSECOND + now.tv_usec;
+}
+
+
+bool
+pluton::payloadCompressor::available(char algorithm)
+{
+#ifdef HAVE_ZLIB_H
+  return algorithm == pluton::zlibCompression;
+#else
+  return false;
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Compress the scattered data into out. The output is limited to the
+// size of the input so that incompressible data is abandoned as soon
+// as it proves so. Return false if the data is not worth sending
+// compressed, in which case the caller sends it as is.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::payloadCompressor::compress(char algorithm, const struct iovec* iov, int iovCount,
+				    std::string& out, pluton::compressionStats& stats)
+{
+  out.erase();
+  if (!available(algorithm)) return false;
+
+#ifdef HAVE_ZLIB_H
+  unsigned long long startCPU = cpuMicroSeconds();
+
+  unsigned int totalLength = 0;
+  for (int ix=0; ix < iovCount; ++ix) totalLength += iov[ix].iov_len;
+
+  z_stream zs;
+  zs.zalloc = Z_NULL;
+  zs.zfree = Z_NULL;
+  zs.opaque = Z_NULL;
+  if (deflateInit(&zs, Z_BEST_SPEED) != Z_OK) return false;
+
+  out.resize(totalLength);
+  zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  zs.avail_out = totalLength;
+
+  int res = Z_OK;
+  for (int ix=0; (ix < iovCount) && (res == Z_OK) && (zs.avail_out > 0); ++ix) {
+    zs.next_in = static_cast<Bytef*>(iov[ix].iov_base);
+    zs.avail_in = iov[ix].iov_len;
+    while ((zs.avail_in > 0) && (zs.avail_out > 0) && (res == Z_OK)) {
+      res = deflate(&zs, Z_NO_FLUSH);
+    }
+  }
+  if ((res == Z_OK) && (zs.avail_out > 0)) {
+    zs.next_in = 0;
+    zs.avail_in = 0;
+    do res = deflate(&zs, Z_FINISH); while ((res == Z_OK) && (zs.avail_out > 0));
+  }
+
+  bool worthwhile = (res == Z_STREAM_END) && (zs.total_out < totalLength);
+  deflateEnd(&zs);
+
+  stats.cpuMicroSeconds += cpuMicroSeconds() - startCPU;
+  if (!worthwhile) {
+    out.erase();
+    return false;
+  }
+
+  out.resize(zs.total_out);
+  ++stats.compressed;
+  stats.uncompressedBytes += totalLength;
+  stats.compressedBytes += out.length();
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Inflate into out, which must come to exactly uncompressedLength.
+// zlib cannot expand by more than about a thousand to one so a larger
+// claim is rejected before anything is allocated for it.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::payloadCompressor::decompress(char algorithm, const char* p, int len,
+				      int uncompressedLength, std::string& out,
+				      std::string& em, pluton::compressionStats& stats)
+{
+  out.erase();
+  if (!available(algorithm)) {
+    em = "Compressed data uses an unsupported algorithm: ";
+    em += algorithm;
+    return false;
+  }
+
+#ifdef HAVE_ZLIB_H
+  if ((uncompressedLength < 0) || (len < 0)
+      || ((long long) uncompressedLength > (long long) len * 1032 + 64)) {
+    em = "Compressed data has an impossible uncompressed length of ";
+    em += util::ltos(uncompressedLength);
+    return false;
+  }
+
+  unsigned long long startCPU = cpuMicroSeconds();
+
+  z_stream zs;
+  zs.zalloc = Z_NULL;
+  zs.zfree = Z_NULL;
+  zs.opaque = Z_NULL;
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(p));
+  zs.avail_in = len;
+  if (inflateInit(&zs) != Z_OK) {
+    em = "inflateInit() failed";
+    return false;
+  }
+
+  out.resize(uncompressedLength);
+  zs.next_out = reinterpret_cast<Bytef*>(uncompressedLength > 0 ? &out[0] : 0);
+  zs.avail_out = uncompressedLength;
+
+  int res = inflate(&zs, Z_FINISH);
+  bool ok = (res == Z_STREAM_END) && (zs.total_out == (unsigned) uncompressedLength)
+    && (zs.avail_in == 0);
+  inflateEnd(&zs);
+
+  stats.cpuMicroSeconds += cpuMicroSeconds() - startCPU;
+  if (!ok) {
+    out.erase();
+    em = "Compressed data is corrupt or does not match its uncompressed length";
+    return false;
+  }
+
+  ++stats.decompressed;
+  stats.uncompressedBytes += uncompressedLength;
+  stats.compressedBytes += len;
+
+  return true;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,70 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_PAYLOADCOMPRESSOR_H
+#define P_PAYLOADCOMPRESSOR_H 1
+
+#include <string>
+
+#include <sys/uio.h>
+
+#include "pluton/common.h"
+
+
+//////////////////////////////////////////////////////////////////////
+// Large request and response data can be compressed on its way
+// through the socket. The packet carries a compressionNT netString
+// holding the algorithm and uncompressed length followed by a
+// compressedDataNT in place of the usual data netString. The
+// receiver inflates the data once the packet is complete.
+//
+// Algorithms are identified by a single character so that new ones
+// can be added without changing the packet format. zlib is the only
+// one at present and is used at its fastest level as the aim is to
+// save transmission time rather than every last byte.
+//
+// Each call adds its sizes and CPU cost to the caller's stats.
+//////////////////////////////////////////////////////////////////////
+
+namespace pluton {
+
+  class payloadCompressor {
+  public:
+    static bool	available(char algorithm);
+
+    static bool	compress(char algorithm, const struct iovec* iov, int iovCount,
+			 std::string& out, pluton::compressionStats& stats);
+    static bool	decompress(char algorithm, const char* p, int len, int uncompressedLength,
+			   std::string& out, std::string& errorMessage,
+			   pluton::compressionStats& stats);
+  };
+}
+
+#endif
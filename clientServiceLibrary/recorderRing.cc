@@ -0,0 +1,252 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "config.h"
+
+#include <string>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "recorderRing.h"
+
+#ifndef MAP_NOSYNC
+#define MAP_NOSYNC 0
+#endif
+
+
+//////////////////////////////////////////////////////////////////////
+// Helpers to lay netStrings directly into the mapped slot.
+//////////////////////////////////////////////////////////////////////
+
+static int
+digits(int n)
+{
+  int d = 1;
+  while (n >= 10) {
+    n /= 10;
+    ++d;
+  }
+
+  return d;
+}
+
+static char*
+putPrefix(char* p, char nsType, int len)
+{
+  p += sprintf(p, "%d", len);
+  *p++ = nsType;
+
+  return p;
+}
+
+static char*
+putNumber(char* p, char nsType, uint64_t value)
+{
+  char buf[24];
+  int len = sprintf(buf, "%llu", (unsigned long long) value);
+  p = putPrefix(p, nsType, len);
+  memcpy(p, buf, len);
+  p += len;
+  *p++ = ',';
+
+  return p;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Return the data length of a padding netString that occupies
+// exactly "bytes", or -1 if there is none. A few sizes, such as 13,
+// cannot be hit exactly as the length digits roll over.
+//////////////////////////////////////////////////////////////////////
+
+static int
+padLength(int bytes)
+{
+  for (int len = bytes - 2 - digits(bytes); len >= 0 && len < bytes; ++len) {
+    int total = digits(len) + len + 2;
+    if (total == bytes) return len;
+    if (total > bytes) break;
+  }
+
+  return -1;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Fill "bytes" of the slot with padding. The padding data is left as
+// is, only the prefix and terminator are written.
+//////////////////////////////////////////////////////////////////////
+
+static void
+putPad(char* p, int bytes)
+{
+  int len = padLength(bytes);
+  if (len == -1) {			// Split into two that do fit
+    p = putPrefix(p, pluton::recordPadNT, 0);
+    *p++ = ',';
+    bytes -= 3;
+    len = padLength(bytes);
+  }
+
+  char* data = putPrefix(p, pluton::recordPadNT, len);
+  data[len] = ',';
+}
+
+
+pluton::recorderRing::recorderRing()
+  : _basePtr(0), _slotCount(0), _slotSize(0), _nextSequence(0)
+{
+}
+
+pluton::recorderRing::~recorderRing()
+{
+  if (_basePtr) munmap(_basePtr, (size_t) _slotCount * _slotSize);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Create the ring file and make every slot an empty record so the
+// file is readable from the outset. The file is completely
+// preallocated so recording never extends it.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::recorderRing::open(const std::string& path, int slotCount, int slotSize)
+{
+  if (slotCount < 1) return false;
+  if (slotSize < minimumSlotSize) slotSize = minimumSlotSize;
+  if (padLength(slotSize - 3) == -1) --slotSize;	// See record()
+
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0640);
+  if (fd == -1) return false;
+
+  size_t mapSize = (size_t) slotCount * slotSize;
+  if (ftruncate(fd, mapSize) == -1) {
+    close(fd);
+    return false;
+  }
+
+  void* p = mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NOSYNC, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return false;
+
+  _basePtr = static_cast<char*>(p);
+  _slotCount = slotCount;
+  _slotSize = slotSize;
+
+  for (int ix=0; ix < _slotCount; ++ix) {
+    char* slot = _basePtr + (size_t) ix * _slotSize;
+    memcpy(slot, "0R,", 3);
+    putPad(slot + 3, _slotSize - 6);
+    memcpy(slot + _slotSize - 3, "0z,", 3);
+  }
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Write a request/response pair into the next slot. The response is
+// supplied in up to three pieces as that is how the service library
+// assembles it.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::recorderRing::record(const struct timeval& startTime, const struct timeval& endTime,
+			     const std::string& requestPacket,
+			     const char* p1, int l1, const char* p2, int l2,
+			     const char* p3, int l3)
+{
+  if (!_basePtr) return;
+
+  uint64_t sequence = __sync_fetch_and_add(&_nextSequence, 1);
+  char* slot = _basePtr + (size_t) (sequence % _slotCount) * _slotSize;
+
+  uint64_t startuSecs = (uint64_t) startTime.tv_sec * 1000000 + startTime.tv_usec;
+  uint64_t enduSecs = (uint64_t) endTime.tv_sec * 1000000 + endTime.tv_usec;
+
+  char header[100];
+  char* hp = putPrefix(header, pluton::recordPT, 0);
+  *hp++ = ',';
+  hp = putNumber(hp, pluton::recordSequenceNT, sequence + 1);
+  hp = putNumber(hp, pluton::recordStartNT, startuSecs);
+  hp = putNumber(hp, pluton::recordDurationNT, (enduSecs > startuSecs) ? enduSecs - startuSecs : 0);
+  int headerLength = hp - header;
+
+  //////////////////////////////////////////////////////////////////////
+  // Turn the whole slot into padding while the record is written so
+  // that a concurrent or post-mortem reader sees a valid slot.
+  //////////////////////////////////////////////////////////////////////
+
+  char* end = slot + _slotSize - 3;
+  putPad(slot, _slotSize - 3);
+  __sync_synchronize();
+
+  int requestLength = requestPacket.length();
+  int responseLength = l1 + l2 + l3;
+
+  int available = _slotSize - headerLength - 6;		// Less the end and minimum pad
+  int requestBytes = digits(requestLength) + requestLength + 2;
+  bool haveRequest = requestBytes <= available;
+  if (haveRequest) available -= requestBytes;
+  bool haveResponse = (digits(responseLength) + responseLength + 2) <= available;
+
+  char* p = slot + headerLength;
+  if (haveRequest) {
+    p = putPrefix(p, pluton::recordRequestNT, requestLength);
+    memcpy(p, requestPacket.data(), requestLength);
+    p += requestLength;
+    *p++ = ',';
+  }
+
+  if (haveResponse) {
+    p = putPrefix(p, pluton::recordResponseNT, responseLength);
+    if (l1 > 0) memcpy(p, p1, l1);
+    p += l1;
+    if (l2 > 0) memcpy(p, p2, l2);
+    p += l2;
+    if (l3 > 0) memcpy(p, p3, l3);
+    p += l3;
+    *p++ = ',';
+  }
+
+  putPad(p, end - p);
+  memcpy(end, "0z,", 3);
+
+  __sync_synchronize();
+  memcpy(slot, header, headerLength);		// Last, now the record is complete
+}
@@ -0,0 +1,88 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_RECORDERRING_H
+#define P_RECORDERRING_H 1
+
+#include <string>
+
+#include <sys/time.h>
+
+#include "stdintWrapper.h"
+
+
+//////////////////////////////////////////////////////////////////////
+// A recorderRing is the low-cost alternative to writing a pair of
+// files for every request. Each service process appends its
+// request/response pairs to a preallocated, mmap()ed file of
+// fixed-size slots, so recording costs a couple of memcpy()s rather
+// than an open(), several write()s and a close() per request.
+//
+// Every slot is a valid series of netStrings: a recordPT packet with
+// a sequence number, timestamps, the complete request and response
+// packets and enough padding to fill the slot. The file as a whole is
+// thus readable by plNetStringGrep, and "plNetStringGrep -d I"
+// extracts the request packets in a form suitable for replaying via a
+// faux STDIO service. A request or response that does not fit in a
+// slot is left out of the record.
+//
+// A slot is written padding first and header last so a reader never
+// sees a partially written record as anything other than padding.
+//////////////////////////////////////////////////////////////////////
+
+namespace pluton {
+
+  class recorderRing {
+  public:
+    static const int	minimumSlotSize = 256;
+
+    recorderRing();
+    ~recorderRing();
+
+    bool	open(const std::string& path, int slotCount, int slotSize);
+    bool	isOpen() const { return _basePtr != 0; }
+
+    void	record(const struct timeval& startTime, const struct timeval& endTime,
+		       const std::string& requestPacket,
+		       const char* p1, int l1, const char* p2=0, int l2=0,
+		       const char* p3=0, int l3=0);
+
+  private:
+    recorderRing&	operator=(const recorderRing& rhs);	// Assign not ok
+    recorderRing(const recorderRing& rhs);			// Copy not ok
+
+    char*		_basePtr;
+    int			_slotCount;
+    int			_slotSize;
+    volatile uint64_t	_nextSequence;
+  };
+}
+
+#endif
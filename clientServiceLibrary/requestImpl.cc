@@ -32,6 +32,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <string>
 
+#include <errno.h>
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -42,6 +44,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "util.h"
 #include "requestImpl.h"
+#include "traceRecorder.h"
+#include "memfdPayload.h"
+#include "payloadCompressor.h"
 
 
 pluton::requestImpl::requestImpl(const std::string& name, const std::string& function,
@@ -49,11 +54,16 @@ pluton::requestImpl::requestImpl(const std::string& name, const std::string& fun
 				 unsigned int version)
   : _debugFlag(false),
     _requestID(0), _SK(name, function, type, version), _attributeBits(0),
-    _hasFileDescriptor(false),
+    _hasFileDescriptor(false), _memfdAcceptThreshold(0), _binaryFraming(false),
+    _responsePartAccept(false),
+    _compressAcceptAlgorithm(0), _compressAcceptThreshold(0), _peerDecompresses(0),
     _requestDataPtr(""), _requestDataOffset(0), _requestDataLen(0),
     _responseDataPtr(""), _responseDataOffset(0), _responseDataLen(0),
+    _responseFileFD(-1), _responseFileOffset(0),
+    _memfdDataLen(-1), _memfdDataIsResponse(false), _memfdMapPtr(0),
+    _compressedAlgorithm(0), _uncompressedLen(0), _compressedIsResponse(false),
     _inboundPacketPtr(""), _inboundPacketOffset(0), _inboundPacketLen(0),
-    _faultCode(pluton::requestNotAdded),
+    _faultCode(pluton::requestNotAdded), _cacheMaxAgeMS(0),
     _byPassIDCheck(false),
     _passedFileDescriptor(-1), _timeoutMS(0),
     _contextParsed(false), _eventTypeWanted(pluton::clientEvent::wantNothing)
@@ -63,6 +73,7 @@ pluton::requestImpl::requestImpl(const std::string& name, const std::string& fun
 pluton::requestImpl::~requestImpl()
 {
   if (_passedFileDescriptor != -1) close(_passedFileDescriptor);
+  releaseMemfdData();
 }
 
 
@@ -74,12 +85,25 @@ pluton::requestImpl::resetRequestValues()
   _SK.erase();
   _attributeBits = 0;
   _contextNS.erase();
+  _traceContextStr.erase();
   if (_passedFileDescriptor != -1) close(_passedFileDescriptor);
   _passedFileDescriptor = -1;
   _hasFileDescriptor = false;
+  _memfdAcceptThreshold = 0;
+  _binaryFraming = false;
+  _responsePartAccept = false;
+  _compressAcceptAlgorithm = 0;
+  _compressAcceptThreshold = 0;
+  if (!_memfdDataIsResponse) releaseMemfdData();
+  if (!_compressedIsResponse) {
+    _compressedAlgorithm = 0;
+    if (!_decompressBuffer.empty()) std::string().swap(_decompressBuffer);
+  }
   _requestDataPtr = "";
   _requestDataOffset = 0;
   _requestDataLen = 0;
+  _requestIOV.clear();
+  if (!_gatherBuffer.empty()) std::string().swap(_gatherBuffer);
 
   _inboundPacketPtr = "";
   _inboundPacketOffset = 0;
@@ -95,11 +119,21 @@ pluton::requestImpl::resetResponseValues()
   _serviceNameStr.erase();
   _faultCode = pluton::requestNotAdded;
   _faultText.erase();
+  _cacheMaxAgeMS = 0;
   _contextStr.erase();
   _contextParsed = false;
+  if (_memfdDataIsResponse) releaseMemfdData();
+  _peerDecompresses = 0;
+  if (_compressedIsResponse) {
+    _compressedAlgorithm = 0;
+    if (!_decompressBuffer.empty()) std::string().swap(_decompressBuffer);
+  }
   _responseDataPtr = "";
   _responseDataOffset = 0;
   _responseDataLen = 0;
+  _responseIOV.clear();
+  _responseFileFD = -1;
+  _responseFileOffset = 0;
 
   _inboundPacketPtr = "";
   _inboundPacketOffset = 0;
@@ -112,6 +146,7 @@ pluton::requestImpl::resetResponseValues()
 void
 pluton::requestImpl::setRequestData(const char *cp, int len)
 {
+  _requestIOV.clear();
   _requestDataPtr = cp;
   _requestDataOffset = 0;
   _requestDataLen = len;
@@ -120,6 +155,7 @@ pluton::requestImpl::setRequestData(const char *cp, int len)
 void
 pluton::requestImpl::setRequestData(const std::string& ns)
 {
+  _requestIOV.clear();
   _requestDataPtr = ns.data();
   _requestDataOffset = 0;
   _requestDataLen = ns.length();
@@ -128,6 +164,7 @@ pluton::requestImpl::setRequestData(const std::string& ns)
 void
 pluton::requestImpl::setRequestOffset(int offset, int len)
 {
+  _requestIOV.clear();
   _requestDataPtr = 0;
   _requestDataOffset = offset;
   _requestDataLen = len;
@@ -136,6 +173,8 @@ pluton::requestImpl::setRequestOffset(int offset, int len)
 void
 pluton::requestImpl::setResponseData(const char *cp, int len)
 {
+  _responseIOV.clear();
+  _responseFileFD = -1;
   _responseDataPtr = cp;
   _responseDataOffset = 0;
   _responseDataLen = len;
@@ -144,6 +183,8 @@ pluton::requestImpl::setResponseData(const char *cp, int len)
 void
 pluton::requestImpl::setResponseData(const std::string& ns)
 {
+  _responseIOV.clear();
+  _responseFileFD = -1;
   _responseDataPtr = ns.data();
   _responseDataOffset = 0;
   _responseDataLen = ns.length();
@@ -152,16 +193,136 @@ pluton::requestImpl::setResponseData(const std::string& ns)
 void
 pluton::requestImpl::setResponseOffset(int offset, int len)
 {
+  _responseIOV.clear();
+  _responseFileFD = -1;
   _responseDataPtr = 0;
   _responseDataOffset = offset;
   _responseDataLen = len;
 }
 
+//////////////////////////////////////////////////////////////////////
+// Scattered data is kept as the caller's iovecs, less the empty ones,
+// and passed straight through to writev(). The packet netStrings take
+// an iovec either side of the data, so data in more pieces than
+// writev() accepts in one call is gathered into _gatherBuffer up
+// front. A single piece is simply contiguous.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef IOV_MAX
+#define IOV_MAX 16				// The POSIX minimum
+#endif
+
+static int
+setScattered(std::vector<struct iovec>& dest, std::string& gatherBuffer,
+	     const struct iovec* iov, int iovCount, const char*& dataPtr)
+{
+  dest.clear();
+  int totalLength = 0;
+  for (int ix=0; ix < iovCount; ++ix) {
+    if (iov[ix].iov_len == 0) continue;
+    dest.push_back(iov[ix]);
+    totalLength += iov[ix].iov_len;
+  }
+
+  dataPtr = "";
+  if (dest.size() == 1) {
+    dataPtr = static_cast<const char*>(dest[0].iov_base);
+    dest.clear();
+  }
+  else if (dest.size() > IOV_MAX - 2) {
+    gatherBuffer.erase();
+    gatherBuffer.reserve(totalLength);
+    for (unsigned int ix=0; ix < dest.size(); ++ix) {
+      gatherBuffer.append(static_cast<const char*>(dest[ix].iov_base), dest[ix].iov_len);
+    }
+    dataPtr = gatherBuffer.data();
+    dest.clear();
+  }
+  else if (!dest.empty()) {
+    dataPtr = 0;				// Only valid once gathered
+  }
+
+  return totalLength;
+}
+
+static void
+gather(std::vector<struct iovec>& iov, std::string& gatherBuffer, const char*& dataPtr)
+{
+  if (iov.empty()) return;
+
+  gatherBuffer.erase();
+  for (unsigned int ix=0; ix < iov.size(); ++ix) {
+    gatherBuffer.append(static_cast<const char*>(iov[ix].iov_base), iov[ix].iov_len);
+  }
+  dataPtr = gatherBuffer.data();
+  iov.clear();
+}
+
+void
+pluton::requestImpl::setRequestData(const struct iovec* iov, int iovCount)
+{
+  _requestDataOffset = 0;
+  _requestDataLen = setScattered(_requestIOV, _gatherBuffer, iov, iovCount, _requestDataPtr);
+}
+
+void
+pluton::requestImpl::setResponseData(const struct iovec* iov, int iovCount)
+{
+  _responseFileFD = -1;
+  _responseDataOffset = 0;
+  _responseDataLen = setScattered(_responseIOV, _gatherBuffer, iov, iovCount, _responseDataPtr);
+}
+
+void
+pluton::requestImpl::gatherRequestData()
+{
+  gather(_requestIOV, _gatherBuffer, _requestDataPtr);
+}
+
+// A file range is read in. Return false if it cannot all be read.
+
+bool
+pluton::requestImpl::gatherResponseData()
+{
+  if (_responseFileFD == -1) {
+    gather(_responseIOV, _gatherBuffer, _responseDataPtr);
+    return true;
+  }
+
+  _gatherBuffer.resize(_responseDataLen);
+  int bytesRead = 0;
+  while (bytesRead < _responseDataLen) {
+    int res = pread(_responseFileFD, &_gatherBuffer[bytesRead], _responseDataLen - bytesRead,
+		    _responseFileOffset + bytesRead);
+    if (res <= 0) {
+      if ((res == -1) && (errno == EINTR)) continue;
+      return false;
+    }
+    bytesRead += res;
+  }
+  _responseFileFD = -1;
+  _responseDataPtr = _gatherBuffer.data();
+
+  return true;
+}
+
+void
+pluton::requestImpl::setResponseFile(int fd, off_t offset, int length)
+{
+  _responseIOV.clear();
+  _responseFileFD = fd;
+  _responseFileOffset = offset;
+  _responseDataPtr = 0;				// Only valid once gathered
+  _responseDataOffset = 0;
+  _responseDataLen = length;
+}
+
+
 void
 pluton::requestImpl::adjustOffsets(const char* cp, int endingOffset)
 {
-  _requestDataPtr = cp + _requestDataOffset;
-  _responseDataPtr = cp + _responseDataOffset;
+  if (!_memfdMapPtr || _memfdDataIsResponse) _requestDataPtr = cp + _requestDataOffset;
+  if (!_memfdMapPtr || !_memfdDataIsResponse) _responseDataPtr = cp + _responseDataOffset;
   _inboundPacketPtr = cp + _inboundPacketOffset;
   _inboundPacketLen = endingOffset - _inboundPacketOffset;
 }
@@ -412,6 +573,91 @@ pluton::requestImpl::getFileDescriptor()
   return fd;
 }
 
+//////////////////////////////////////////////////////////////////////
+// The decoder notes that the data is in a passed memfd. Once the
+// caller has the descriptor, mapMemfdData() makes the mapping the
+// request or response data. The mapping lasts until the corresponding
+// values are reset.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::requestImpl::setMemfdDataLength(int len, bool isResponse)
+{
+  releaseMemfdData();
+  _memfdDataLen = len;
+  _memfdDataIsResponse = isResponse;
+}
+
+bool
+pluton::requestImpl::mapMemfdData(int fd, std::string& em)
+{
+  if (_memfdDataLen <= 0) {
+    if (fd != -1) close(fd);
+    em = "Invalid memfd data length";
+    return false;
+  }
+
+  _memfdMapPtr = pluton::memfdPayload::map(fd, _memfdDataLen, em);
+  if (!_memfdMapPtr) return false;
+
+  if (_memfdDataIsResponse) {
+    setResponseData(_memfdMapPtr, _memfdDataLen);
+  }
+  else {
+    setRequestData(_memfdMapPtr, _memfdDataLen);
+  }
+
+  return true;
+}
+
+void
+pluton::requestImpl::releaseMemfdData()
+{
+  if (_memfdMapPtr) pluton::memfdPayload::unmap(_memfdMapPtr, _memfdDataLen);
+  _memfdMapPtr = 0;
+  _memfdDataLen = -1;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The decoder notes the algorithm and uncompressed length from the
+// compressionNT. Once the packet is complete, decompressData()
+// inflates the compressed data and makes the result the request or
+// response data. Data that arrived uncompressed is left alone.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::requestImpl::setCompression(char algorithm, int uncompressedLength, bool isResponse)
+{
+  _compressedAlgorithm = algorithm;
+  _uncompressedLen = uncompressedLength;
+  _compressedIsResponse = isResponse;
+}
+
+bool
+pluton::requestImpl::decompressData(std::string& em, pluton::compressionStats& stats)
+{
+  if (!_compressedAlgorithm) return true;
+
+  bool ok;
+  if (_compressedIsResponse) {
+    ok = pluton::payloadCompressor::decompress(_compressedAlgorithm,
+					       _responseDataPtr, _responseDataLen,
+					       _uncompressedLen, _decompressBuffer, em, stats);
+    if (ok) setResponseData(_decompressBuffer.data(), _decompressBuffer.length());
+  }
+  else {
+    ok = pluton::payloadCompressor::decompress(_compressedAlgorithm,
+					       _requestDataPtr, _requestDataLen,
+					       _uncompressedLen, _decompressBuffer, em, stats);
+    if (ok) setRequestData(_decompressBuffer.data(), _decompressBuffer.length());
+  }
+  _compressedAlgorithm = 0;			// Inflated data is now in place
+
+  return ok;
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // assembleRequestPacket() avoids copying data by assemble pre and
 // post-request data packets so that the caller can writev() the three
@@ -420,7 +666,7 @@ pluton::requestImpl::getFileDescriptor()
 
 void
 pluton::requestImpl::assembleRequestPacket(netStringGenerate& pre, netStringGenerate& post,
-					   bool doBegin) const
+					   bool doBegin, bool dataViaMemfd, int compressedLength) const
 {
   pre.reserve(_contextNS.length()+100);
   post.reserve(20);
@@ -438,11 +684,43 @@ pluton::requestImpl::assembleRequestPacket(netStringGenerate& pre, netStringGene
   if (_attributeBits & pluton::keepAffinityAttr) pre.append(pluton::attributeKeepAffinityNT);
   if (_attributeBits & pluton::needAffinityAttr) pre.append(pluton::attributeNeedAffinityNT);
 
-  if (!_contextNS.empty()) pre.append(pluton::contextNT, _contextNS);
+  //////////////////////////////////////////////////////////////////////
+  // The trace context is added to the caller's context as it goes out
+  // the door so that it never contributes to the cache key.
+  //////////////////////////////////////////////////////////////////////
+
+  if (!_traceContextStr.empty()) {
+    netStringGenerate ctx;
+    ctx.appendRaw(_contextNS.data(), _contextNS.length());
+    ctx.append('k', pluton::traceRecorder::contextKey);
+    ctx.append('v', _traceContextStr);
+    pre.append(pluton::contextNT, ctx);
+  }
+  else {
+    if (!_contextNS.empty()) pre.append(pluton::contextNT, _contextNS);
+  }
 
   if (_hasFileDescriptor) pre.append(pluton::fileDescriptorNT);
+  if (_memfdAcceptThreshold > 0) pre.append(pluton::memfdAcceptNT, _memfdAcceptThreshold);
+  if (_binaryFraming) pre.append(pluton::binaryFramingNT);
+  if (_responsePartAccept) pre.append(pluton::responsePartAcceptNT);
+  if (_compressAcceptAlgorithm) {
+    std::string accept(1, _compressAcceptAlgorithm);
+    accept += util::ltos(_compressAcceptThreshold);
+    pre.append(pluton::compressAcceptNT, accept);
+  }
 
-  if (_requestDataLen > 0) {
+  if (dataViaMemfd) {
+    pre.append(pluton::memfdDataNT, _requestDataLen);	// Caller passes the memfd
+  }
+  else if (compressedLength >= 0) {		// Caller supplies the compressed data
+    std::string compression(1, _compressAcceptAlgorithm);
+    compression += util::ltos(_requestDataLen);
+    pre.append(pluton::compressionNT, compression);
+    pre.appendRawPrefix(pluton::compressedDataNT, compressedLength);
+    post.appendRawTerminator();
+  }
+  else if (_requestDataLen > 0) {
     pre.appendRawPrefix(pluton::requestDataNT, _requestDataLen);
     post.appendRawTerminator();
   }
@@ -464,22 +742,46 @@ pluton::requestImpl::assembleRequestPacket(netStringGenerate& pre, netStringGene
 void
 pluton::requestImpl::assembleResponsePacket(const std::string& serviceName,
 					    netStringGenerate& pre, netStringGenerate& post,
-					    bool doBegin) const
+					    bool doBegin, bool dataViaMemfd, bool partsSent,
+					    int compressedLength) const
 {
   pre.reserve(_faultText.length() + _clientNameStr.length() + serviceName.length() + 16);
   post.reserve(16);
 
-  if (doBegin) pre.append(pluton::responsePT);
-  pre.append(pluton::requestIDNT, _requestID);
-  if (!_clientNameStr.empty()) pre.append(pluton::clientIDNT, _clientNameStr);
-  if (!serviceName.empty()) pre.append(pluton::serviceIDNT, serviceName);
+  pre.setBinaryFraming(_binaryFraming);		// If the client said it accepts it
+  post.setBinaryFraming(_binaryFraming);
+
+  if (!partsSent) {				// Otherwise they went with the first part
+    if (doBegin) pre.append(pluton::responsePT);
+    pre.append(pluton::requestIDNT, _requestID);
+    if (!_clientNameStr.empty()) pre.append(pluton::clientIDNT, _clientNameStr);
+    if (!serviceName.empty()) pre.append(pluton::serviceIDNT, serviceName);
+  }
 
   if (_faultCode != pluton::noFault) {
     pre.append(pluton::faultCodeNT, _faultCode);
     if (!_faultText.empty()) pre.append(pluton::faultTextNT, _faultText);
   }
 
-  if (_responseDataLen > 0) {
+  else {
+    if (_cacheMaxAgeMS > 0) pre.append(pluton::cacheMaxAgeNT, _cacheMaxAgeMS);
+  }
+
+  if (_compressAcceptAlgorithm && pluton::payloadCompressor::available(_compressAcceptAlgorithm)) {
+    pre.append(pluton::compressAcceptNT, std::string(1, _compressAcceptAlgorithm));
+  }
+
+  if (dataViaMemfd) {
+    pre.append(pluton::memfdDataNT, _responseDataLen);	// Caller passes the memfd
+  }
+  else if (compressedLength >= 0) {		// Caller supplies the compressed data
+    std::string compression(1, _compressAcceptAlgorithm);
+    compression += util::ltos(_responseDataLen);
+    pre.append(pluton::compressionNT, compression);
+    pre.appendRawPrefix(pluton::compressedDataNT, compressedLength);
+    post.appendRawTerminator();
+  }
+  else if (_responseDataLen > 0) {
     pre.appendRawPrefix(pluton::responseDataNT, _responseDataLen);
     post.appendRawTerminator();
   }
@@ -488,6 +790,54 @@ pluton::requestImpl::assembleResponsePacket(const std::string& serviceName,
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// A response sent in parts starts with the same identifying
+// netStrings as a whole response, followed by one responsePartNT per
+// part. The fault, cache age, final data and end of packet follow
+// from assembleResponsePacket() with partsSent set. As with the whole
+// response, the part data itself goes between pre and post.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::requestImpl::assembleResponsePart(const std::string& serviceName,
+					  netStringGenerate& pre, netStringGenerate& post,
+					  int partLength, bool firstPart) const
+{
+  pre.setBinaryFraming(_binaryFraming);
+  post.setBinaryFraming(_binaryFraming);
+
+  if (firstPart) {
+    pre.append(pluton::responsePT);
+    pre.append(pluton::requestIDNT, _requestID);
+    if (!_clientNameStr.empty()) pre.append(pluton::clientIDNT, _clientNameStr);
+    if (!serviceName.empty()) pre.append(pluton::serviceIDNT, serviceName);
+  }
+
+  pre.appendRawPrefix(pluton::responsePartNT, partLength);
+  post.appendRawTerminator();
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The client response cache identifies a request by everything that
+// can influence the service's answer: the service key, the context
+// and the request data. These are packed as netStrings so that no
+// combination of values can alias another.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::requestImpl::getCacheKey(std::string& key) const
+{
+  key.erase();
+  netStringGenerate ns(key);		// Generate directly into the caller's key
+  ns.reserve(_requestDataLen + _contextNS.length() + 60);
+
+  ns.append(pluton::serviceKeyNT, _SK.getEnglishKey());
+  if (!_contextNS.empty()) ns.append(pluton::contextNT, _contextNS);
+  ns.append(pluton::requestDataNT, _requestDataPtr, _requestDataLen);
+}
+
+
 std::ostream&
 pluton::requestImpl::put(std::ostream& s) const
 {
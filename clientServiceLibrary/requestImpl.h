@@ -32,6 +32,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define P_REQUESTIMPL_H 1
 
 #include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
 #include "hashString.h"
 #include "hash_mapWrapper.h"
 #include "ostreamWrapper.h"
@@ -110,6 +114,31 @@ namespace pluton {
     pluton::faultCode	getResponseData(std::string&) const;
     int		getResponseDataLength() const { return _responseDataLen; }
 
+    //////////////////////////////////////////////////////////////////////
+    // Outbound data may be left scattered across the caller's buffers
+    // and written with writev(). Only the iovecs are kept, so the
+    // buffers must stay put until the data is sent. Code that needs
+    // the data contiguous must gather it before calling get*Data().
+    //////////////////////////////////////////////////////////////////////
+
+    void	setRequestData(const struct iovec* iov, int iovCount);
+    void	setResponseData(const struct iovec* iov, int iovCount);
+
+    const std::vector<struct iovec>&	getRequestIOV() const { return _requestIOV; }
+    const std::vector<struct iovec>&	getResponseIOV() const { return _responseIOV; }
+
+    void	gatherRequestData();
+    bool	gatherResponseData();
+
+    //////////////////////////////////////////////////////////////////////
+    // Or the response data can be a range of an open file which is
+    // sent with sendfile() rather than read in.
+    //////////////////////////////////////////////////////////////////////
+
+    void	setResponseFile(int fd, off_t offset, int length);
+    int		getResponseFileFD() const { return _responseFileFD; }	// -1 if not a file
+    off_t	getResponseFileOffset() const { return _responseFileOffset; }
+
     void	setPacketOffset(int of) { _inboundPacketOffset = of; }	// Tools only
     void	adjustOffsets(const char*, int endingOffset);		// Tools only
     void	getInboundPacketData(const char*& p, int& len) const;	// Tools only
@@ -118,6 +147,7 @@ namespace pluton {
     void	getContextData(const char*& p, int& len) const;
 
     bool	setContext(const char* key, const std::string& value);
+    void	setTraceContext(const std::string& value) { _traceContextStr = value; }
     bool	getContext(const char* key, std::string& value);
 
     void	setFault(pluton::faultCode, const std::string& faultText);
@@ -134,6 +164,10 @@ namespace pluton {
     pluton::faultCode	getFaultCode() const { return _faultCode; }
     std::string		getFaultText() const { return _faultText; }
 
+    void		setCacheMaxAgeMS(unsigned int ms) { _cacheMaxAgeMS = ms; }
+    unsigned int	getCacheMaxAgeMS() const { return _cacheMaxAgeMS; }
+    void		getCacheKey(std::string& key) const;
+
     void	setAttribute(pluton::requestAttributes);
     bool	getAttribute(pluton::requestAttributes) const;
     void	clearAttribute(pluton::requestAttributes);
@@ -146,6 +180,37 @@ namespace pluton {
     bool	hasFileDescriptor() const { return _hasFileDescriptor; }
     int		getFileDescriptor();
 
+    void	setMemfdDataLength(int len, bool isResponse);
+    bool	hasMemfdData() const { return _memfdDataLen >= 0; }
+    bool	mapMemfdData(int fd, std::string& errorMessage);
+
+    void		setMemfdAcceptThreshold(unsigned int t) { _memfdAcceptThreshold = t; }
+    unsigned int	getMemfdAcceptThreshold() const { return _memfdAcceptThreshold; }
+
+    void	setBinaryFraming(bool tf) { _binaryFraming = tf; }
+    bool	getBinaryFraming() const { return _binaryFraming; }
+
+    void	setResponsePartAccept(bool tf) { _responsePartAccept = tf; }
+    bool	getResponsePartAccept() const { return _responsePartAccept; }
+    virtual void	responsePart(const char*, int) {}	// Client hook, as each arrives
+
+    //////////////////////////////////////////////////////////////////////
+    // A request can offer to accept compressed response data at or
+    // above a threshold, and a service that understands the offer says
+    // in its response that it can decompress. Compressed data is
+    // inflated by decompressData() once the packet is complete.
+    //////////////////////////////////////////////////////////////////////
+
+    void	setCompressAccept(char algorithm, unsigned int threshold)
+		{ _compressAcceptAlgorithm = algorithm; _compressAcceptThreshold = threshold; }
+    char	getCompressAcceptAlgorithm() const { return _compressAcceptAlgorithm; }
+    unsigned int getCompressAcceptThreshold() const { return _compressAcceptThreshold; }
+    void	setPeerDecompresses(char algorithm) { _peerDecompresses = algorithm; }
+    char	getPeerDecompresses() const { return _peerDecompresses; }
+
+    void	setCompression(char algorithm, int uncompressedLength, bool isResponse);
+    bool	decompressData(std::string& errorMessage, pluton::compressionStats& stats);
+
     ////////////////////////////////////////
 
     void	setEventTypeWanted(pluton::clientEvent::eventType ew) { _eventTypeWanted = ew; }
@@ -156,11 +221,16 @@ namespace pluton {
     ////////////////////////////////////////
 
     void	assembleRequestPacket(netStringGenerate& pre, netStringGenerate& post,
-				      bool doBegin=true) const;
+				      bool doBegin=true, bool dataViaMemfd=false,
+				      int compressedLength=-1) const;
 
     void	assembleResponsePacket(const std::string& serviceNameStr,
 				       netStringGenerate& pre, netStringGenerate& post,
-				       bool doBegin=true) const;
+				       bool doBegin=true, bool dataViaMemfd=false,
+				       bool partsSent=false, int compressedLength=-1) const;
+    void	assembleResponsePart(const std::string& serviceNameStr,
+				     netStringGenerate& pre, netStringGenerate& post,
+				     int partLength, bool firstPart) const;
 
   ////////////////////////////////////////
 
@@ -174,6 +244,7 @@ namespace pluton {
     requestImpl(const requestImpl& rhs);			// Copy not ok
 
     bool	parseContext();
+    void	releaseMemfdData();
 
     //////////////////////////////////////////////////////////////////////
     // Values exchanged in request and/or response
@@ -185,8 +256,15 @@ namespace pluton {
     unsigned long	_attributeBits;		// Req
 
     netStringGenerate	_contextNS;		// Req
+    std::string		_traceContextStr;	// Req - not part of the cache key
 
     bool		_hasFileDescriptor;	// Req
+    unsigned int	_memfdAcceptThreshold;	// Req
+    bool		_binaryFraming;		// Req - client accepts a binary framed response
+    bool		_responsePartAccept;	// Req - client accepts response data in parts
+    char		_compressAcceptAlgorithm;	// Req - zero if not offered
+    unsigned int	_compressAcceptThreshold;	// Req
+    char		_peerDecompresses;	// Resp - service accepts this algorithm
 
     const char*	_requestDataPtr;		// Req
     int		_requestDataOffset;		// Req
@@ -196,6 +274,22 @@ namespace pluton {
     int		_responseDataOffset;		// Resp
     int		_responseDataLen;		// Resp
 
+    std::vector<struct iovec>	_requestIOV;	// Req - empty unless scattered
+    std::vector<struct iovec>	_responseIOV;	// Resp - empty unless scattered
+    std::string			_gatherBuffer;	// Req/Resp - scattered data made contiguous
+
+    int		_responseFileFD;		// Resp - owned by the service
+    off_t	_responseFileOffset;		// Resp
+
+    int		_memfdDataLen;			// Req/Resp - -1 if data is inline
+    bool	_memfdDataIsResponse;
+    const char*	_memfdMapPtr;			// Set while the passed memfd is mapped
+
+    char	_compressedAlgorithm;		// Req/Resp - zero unless data is compressed
+    int		_uncompressedLen;
+    bool	_compressedIsResponse;
+    std::string	_decompressBuffer;		// Req/Resp - inflated data
+
     const char*	_inboundPacketPtr;		// Req/Resp
     int		_inboundPacketOffset;		// Req/Resp
     int		_inboundPacketLen;		// Req/Resp
@@ -203,6 +297,7 @@ namespace pluton {
     std::string		_serviceNameStr;	// Resp
     pluton::faultCode	_faultCode;		// Resp
     std::string		_faultText;		// Resp
+    unsigned int	_cacheMaxAgeMS;		// Resp
 
     bool	_byPassIDCheck;			// Req
 
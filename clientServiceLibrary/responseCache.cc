@@ -0,0 +1,215 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "util.h"
+#include "responseCache.h"
+
+
+pluton::responseCache::responseCache()
+  : _maximumBytes(0), _newest(0), _oldest(0)
+{
+  memset((void*) &_stats, '\0', sizeof(_stats));
+}
+
+
+pluton::responseCache::~responseCache()
+{
+  flush();
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Changing the size takes effect immediately. A size of zero
+// disables the cache and releases all entries.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::responseCache::setMaximumBytes(unsigned long maximumBytes)
+{
+  _maximumBytes = maximumBytes;
+  trimTo(_maximumBytes);
+}
+
+
+void
+pluton::responseCache::flush()
+{
+  while (_oldest) remove(_oldest);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Return true and a copy of the cached response if there is an
+// unexpired entry for this key. A hit makes the entry the most
+// recently used. Expired entries are released as they are found.
+//
+// Each lookup counts as exactly one of a hit or a miss; a miss is
+// only counted once it is known that no fresh entry exists.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::responseCache::find(const std::string& key, const struct timeval& now,
+			    std::string& responseData, std::string& serviceName)
+{
+  entry* E = 0;
+  mapIter mi = _map.find(key);
+  if (mi != _map.end()) E = mi->second;
+
+  if (E && (util::timevalCompare(now, E->_expires) >= 0)) {
+    ++_stats.expirations;
+    remove(E);
+    E = 0;
+  }
+
+  if (!E) {
+    ++_stats.misses;
+    return false;
+  }
+
+  unlink(E);
+  linkAsNewest(E);
+
+  responseData = E->_responseData;
+  serviceName = E->_serviceName;
+  ++_stats.hits;
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Add or replace the entry for this key. Responses that could never
+// fit are silently ignored rather than flushing the whole cache.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::responseCache::insert(const std::string& key, const struct timeval& now,
+			      unsigned int maxAgeMS,
+			      const char* responsePtr, int responseLength,
+			      const std::string& serviceName)
+{
+  if (!enabled() || (maxAgeMS == 0)) return;
+
+  unsigned long bytes = sizeof(entry) + key.length() + responseLength + serviceName.length();
+  if (bytes > _maximumBytes) return;
+
+  mapIter mi = _map.find(key);
+  if (mi != _map.end()) remove(mi->second);
+
+  trimTo(_maximumBytes - bytes);	// Make room before adding
+
+  entry* E = new entry;
+  E->_key = key;
+  E->_responseData.assign(responsePtr, responseLength);
+  E->_serviceName = serviceName;
+  E->_bytes = bytes;
+
+  struct timeval age;
+  age.tv_sec = maxAgeMS / util::MILLISECOND;
+  age.tv_usec = (maxAgeMS % util::MILLISECOND) * util::MICROMILLI;
+  E->_expires = now;
+  util::timevalAdd(E->_expires, age);
+
+  _map[key] = E;
+  linkAsNewest(E);
+
+  ++_stats.inserts;
+  ++_stats.entries;
+  _stats.bytes += bytes;
+}
+
+
+void
+pluton::responseCache::getStats(pluton::responseCacheStats& stats) const
+{
+  stats = _stats;
+  stats.maximumBytes = _maximumBytes;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// LRU list management. _newest is the most recently used entry.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::responseCache::trimTo(unsigned long maximumBytes)
+{
+  while (_oldest && (_stats.bytes > maximumBytes)) {
+    ++_stats.evictions;
+    remove(_oldest);
+  }
+}
+
+
+void
+pluton::responseCache::remove(entry* E)
+{
+  unlink(E);
+  _map.erase(E->_key);
+  --_stats.entries;
+  _stats.bytes -= E->_bytes;
+  delete E;
+}
+
+
+void
+pluton::responseCache::unlink(entry* E)
+{
+  if (E->_newer) {
+    E->_newer->_older = E->_older;
+  }
+  else {
+    _newest = E->_older;
+  }
+
+  if (E->_older) {
+    E->_older->_newer = E->_newer;
+  }
+  else {
+    _oldest = E->_newer;
+  }
+
+  E->_newer = E->_older = 0;
+}
+
+
+void
+pluton::responseCache::linkAsNewest(entry* E)
+{
+  E->_newer = 0;
+  E->_older = _newest;
+  if (_newest) _newest->_newer = E;
+  _newest = E;
+  if (!_oldest) _oldest = E;
+}
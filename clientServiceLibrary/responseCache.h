@@ -0,0 +1,106 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_RESPONSECACHE_H
+#define P_RESPONSECACHE_H 1
+
+#include <string>
+
+#include <sys/time.h>
+
+#include "hashString.h"
+#include "hash_mapWrapper.h"
+
+#include "pluton/client.h"
+
+
+//////////////////////////////////////////////////////////////////////
+// The responseCache holds service responses that the service has
+// marked as cacheable via the cacheMaxAgeNT netString. There is one
+// cache per clientImpl, thus one per thread, so no locking is
+// needed. Memory is bounded by a byte limit with least-recently-used
+// eviction.
+//
+// The LRU list is hand-coded with internal pointers, in the same
+// spirit as requestQueue, to avoid an allocator per list operation.
+//////////////////////////////////////////////////////////////////////
+
+namespace pluton {
+
+  class responseCache {
+  public:
+    responseCache();
+    ~responseCache();
+
+    void	setMaximumBytes(unsigned long maximumBytes);
+    bool	enabled() const { return _maximumBytes > 0; }
+
+    bool	find(const std::string& key, const struct timeval& now,
+		     std::string& responseData, std::string& serviceName);
+    void	insert(const std::string& key, const struct timeval& now, unsigned int maxAgeMS,
+		       const char* responsePtr, int responseLength,
+		       const std::string& serviceName);
+    void	flush();
+
+    void	getStats(pluton::responseCacheStats&) const;
+
+  private:
+    responseCache&	operator=(const responseCache& rhs);	// Assign not ok
+    responseCache(const responseCache& rhs);		// Copy not ok
+
+    class entry {
+    public:
+      std::string	_key;
+      std::string	_responseData;
+      std::string	_serviceName;
+      struct timeval	_expires;
+      unsigned long	_bytes;
+
+      entry*		_newer;
+      entry*		_older;
+    };
+
+    void	unlink(entry*);
+    void	linkAsNewest(entry*);
+    void	remove(entry*);
+    void	trimTo(unsigned long maximumBytes);
+
+    unsigned long	_maximumBytes;
+    entry*		_newest;
+    entry*		_oldest;
+
+    pluton::responseCacheStats	_stats;
+
+    P_STLMAP<std::string, entry*, hashString>	_map;
+    typedef P_STLMAP<std::string, entry*, hashString>::iterator mapIter;
+  };
+}
+
+#endif
@@ -50,17 +50,33 @@ pluton::service::setInternalAttributes(int attributes)
 }
 
 pluton::service::service(const char* name)
+  : _ownsImpl(true)
   {
     _impl = new serviceImpl;
-    _impl->setDefaultRequest(new pluton::serviceRequestImpl);
-    _impl->setDefaultOwner(new pluton::perCallerService(name));
+    _request = new pluton::serviceRequestImpl;
+    _owner = new pluton::perCallerService(name);
+    _impl->setDefaultRequest(_request);
+    _impl->setDefaultOwner(_owner);
+  }
+
+
+//////////////////////////////////////////////////////////////////////
+// A per-thread handle used by threadedService. The Impl is shared
+// with the other threads, the owner and request are not.
+//////////////////////////////////////////////////////////////////////
+
+pluton::service::service(serviceImpl* sharedImpl, const char* name, int threadID)
+  : _impl(sharedImpl), _ownsImpl(false)
+  {
+    _request = new pluton::serviceRequestImpl;
+    _owner = new pluton::perCallerService(name, threadID);
   }
 
 pluton::service::~service()
 {
-  delete _impl->getDefaultOwner();
-  delete _impl->getDefaultRequest();
-  delete _impl;
+  delete _owner;
+  delete _request;
+  if (_ownsImpl) delete _impl;
 }
 
 const char*
@@ -72,69 +88,143 @@ pluton::service::getAPIVersion()
 bool
 pluton::service::initialize()
 {
-  _impl->getDefaultOwner()->initialize();
-  return _impl->initialize(_impl->getDefaultOwner());
+  _owner->initialize();
+  return _impl->initialize(_owner);
 }
 
 bool
 pluton::service::hasFault() const
 {
-  return _impl->getDefaultOwner()->hasFault();
+  return _owner->hasFault();
 }
 
 const pluton::fault&
 pluton::service::getFault() const
 {
-  return _impl->getDefaultOwner()->getFault();
+  return _owner->getFault();
 }
 
 bool
 pluton::service::getRequest()
 {
-  return _impl->getRequest(_impl->getDefaultOwner(), _impl->getDefaultRequest());
+  return _impl->getRequest(_owner, _request);
 }
 
 bool
 pluton::service::sendResponse(const char* responsePointer)
 {
   int responseLength = strlen(responsePointer);
-  requestImpl* R = _impl->getDefaultRequest();
+  requestImpl* R = _request;
   R->setFault(pluton::noFault);
   R->setResponseData(responsePointer, responseLength);
-  return _impl->sendResponse(_impl->getDefaultOwner(), R);
+  return _impl->sendResponse(_owner, R);
 }
 
 bool
 pluton::service::sendResponse(const char* responsePointer, int responseLength)
 {
-  requestImpl* R = _impl->getDefaultRequest();
+  requestImpl* R = _request;
   R->setFault(pluton::noFault);
   R->setResponseData(responsePointer, responseLength);
-  return _impl->sendResponse(_impl->getDefaultOwner(), R);
+  return _impl->sendResponse(_owner, R);
 }
 
 bool
 pluton::service::sendResponse(const std::string& responseData)
 {
-  requestImpl* R = _impl->getDefaultRequest();
+  requestImpl* R = _request;
   R->setFault(pluton::noFault);
   R->setResponseData(responseData);
-  return _impl->sendResponse(_impl->getDefaultOwner(), R);
+  return _impl->sendResponse(_owner, R);
+}
+
+bool
+pluton::service::sendResponse(const struct iovec* iov, int iovCount)
+{
+  requestImpl* R = _request;
+  R->setFault(pluton::noFault);
+  R->setResponseData(iov, iovCount);
+  return _impl->sendResponse(_owner, R);
+}
+
+bool
+pluton::service::sendResponsePart(const char* partPointer, int partLength)
+{
+  return _impl->sendResponsePart(_owner, _request, partPointer, partLength);
+}
+
+bool
+pluton::service::sendResponsePart(const std::string& partData)
+{
+  return _impl->sendResponsePart(_owner, _request, partData.data(), partData.length());
+}
+
+bool
+pluton::service::sendResponseFromFile(int fd, off_t offset, int length)
+{
+  requestImpl* R = _request;
+  R->setFault(pluton::noFault);
+  R->setResponseFile(fd, offset, length);
+  return _impl->sendResponse(_owner, R);
 }
 
 bool
 pluton::service::sendFault(unsigned int faultCode, const char* faultText)
 {
-  requestImpl* R = _impl->getDefaultRequest();
+  requestImpl* R = _request;
   R->setFault(static_cast<pluton::faultCode>(faultCode), faultText);
   R->setResponseData("", 0);
-  return _impl->sendResponse(_impl->getDefaultOwner(), R);
+  return _impl->sendResponse(_owner, R);
+}
+
+int
+pluton::service::getRequestBatch(const pluton::batchRequest*& batch)
+{
+  return _impl->getRequestBatch(_owner, _request, batch);
+}
+
+bool
+pluton::service::sendBatchResponse(int index, const char* responsePointer, int responseLength)
+{
+  return _impl->sendBatchResponse(_owner, _request, index, pluton::noFault, 0,
+				  responsePointer, responseLength);
+}
+
+bool
+pluton::service::sendBatchFault(int index, unsigned int faultCode, const char* faultText)
+{
+  return _impl->sendBatchResponse(_owner, _request, index,
+				  static_cast<pluton::faultCode>(faultCode), faultText, "", 0);
+}
+
+void
+pluton::service::setCacheMaxAgeMilliSeconds(unsigned int maxAgeMS)
+{
+  _request->setCacheMaxAgeMS(maxAgeMS);
+}
+
+bool
+pluton::service::getSharedCache(const char* keyPtr, int keyLength, std::string& value) const
+{
+  return _impl->getSharedCache(keyPtr, keyLength, value);
+}
+
+bool
+pluton::service::putSharedCache(const char* keyPtr, int keyLength,
+				const char* valuePtr, int valueLength, unsigned int maxAgeMS)
+{
+  return _impl->putSharedCache(keyPtr, keyLength, valuePtr, valueLength, maxAgeMS);
 }
 
 void
 pluton::service::terminate()
 {
-  _impl->terminate();
+  if (_ownsImpl) {
+    _impl->terminate();
+  }
+  else {
+    _impl->requestShutdown();		// The threadedService owns the Impl
+  }
 }
 
 
@@ -145,40 +235,40 @@ pluton::service::terminate()
 const std::string&
 pluton::service::getServiceKey(std::string& sk) const
 {
-  _impl->getDefaultRequest()->getServiceKey(sk);
+  _request->getServiceKey(sk);
   return sk;
 }
 
 const std::string&
 pluton::service::getServiceApplication(std::string& sa) const
 {
-  _impl->getDefaultRequest()->getServiceApplication(sa);
+  _request->getServiceApplication(sa);
   return sa;
 }
 
 const std::string&
 pluton::service::getServiceFunction(std::string& sf) const
 {
-  _impl->getDefaultRequest()->getServiceFunction(sf);
+  _request->getServiceFunction(sf);
   return sf;
 }
 
 unsigned int
 pluton::service::getServiceVersion() const
 {
-  return _impl->getDefaultRequest()->getServiceVersion();
+  return _request->getServiceVersion();
 }
 
 pluton::serializationType
 pluton::service::getSerializationType() const
 {
-  return _impl->getDefaultRequest()->getSerializationType();
+  return _request->getSerializationType();
 }
 
 const std::string&
 pluton::service::getClientName(std::string& cn) const
 {
-  _impl->getDefaultRequest()->getClientName(cn);
+  _request->getClientName(cn);
   return cn;
 }
 
@@ -186,30 +276,30 @@ pluton::service::getClientName(std::string& cn) const
 void
 pluton::service::getRequestData(const char*& cp, int& len) const
 {
-  _impl->getDefaultRequest()->getRequestData(cp, len);
+  _request->getRequestData(cp, len);
 }
 
 const std::string&
 pluton::service::getRequestData(std::string& r) const
 {
-  _impl->getDefaultRequest()->getRequestData(r);
+  _request->getRequestData(r);
   return r;
 }
 
 bool
 pluton::service::getContext(const char* key, std::string& value) const
 {
-  return _impl->getDefaultRequest()->getContext(key, value);
+  return _request->getContext(key, value);
 }
 
 bool
 pluton::service::hasFileDescriptor() const
 {
-  return _impl->getDefaultRequest()->hasFileDescriptor();
+  return _request->hasFileDescriptor();
 }
 
 int
 pluton::service::getFileDescriptor()
 {
-  return _impl->getDefaultRequest()->getFileDescriptor();
+  return _request->getFileDescriptor();
 }
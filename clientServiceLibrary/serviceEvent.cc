@@ -0,0 +1,238 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "config.h"
+
+#include <string>
+
+#include "pluton/fault.h"
+#include "pluton/serviceEvent.h"
+#include "serviceEventImpl.h"
+
+//////////////////////////////////////////////////////////////////////
+// All user visible classes are encapsulated in a wrapper class to
+// protect against binary compatability.
+//////////////////////////////////////////////////////////////////////
+
+pluton::serviceEvent::serviceEvent(const char* name)
+  {
+    _impl = new serviceEventImpl(name);
+  }
+
+pluton::serviceEvent::~serviceEvent()
+{
+  delete _impl;
+}
+
+bool
+pluton::serviceEvent::initialize()
+{
+  return _impl->initialize();
+}
+
+bool
+pluton::serviceEvent::hasFault() const
+{
+  return _impl->hasFault();
+}
+
+const pluton::fault&
+pluton::serviceEvent::getFault() const
+{
+  return _impl->getFault();
+}
+
+void
+pluton::serviceEvent::setMaximumConnections(int maximumConnections)
+{
+  _impl->setMaximumConnections(maximumConnections);
+}
+
+void
+pluton::serviceEvent::setRequestTimeoutMilliSeconds(unsigned int requestTimeoutMS)
+{
+  _impl->setRequestTimeoutMS(requestTimeoutMS);
+}
+
+const pluton::serviceEvent::eventWanted*
+pluton::serviceEvent::getNextEventWanted(const struct timeval* now)
+{
+  return _impl->getNextEventWanted(now);
+}
+
+int
+pluton::serviceEvent::sendCanReadEvent(int fd)
+{
+  return _impl->sendCanReadEvent(fd);
+}
+
+int
+pluton::serviceEvent::sendCanWriteEvent(int fd)
+{
+  return _impl->sendCanWriteEvent(fd);
+}
+
+int
+pluton::serviceEvent::sendTimeoutEvent(int fd, bool abortFlag)
+{
+  return _impl->sendTimeoutEvent(fd, abortFlag);
+}
+
+pluton::serviceEventRequest*
+pluton::serviceEvent::getNextRequest()
+{
+  return _impl->getNextRequest();
+}
+
+bool
+pluton::serviceEvent::sendResponse(pluton::serviceEventRequest* R,
+				   const char* responsePointer, int responseLength)
+{
+  pluton::serviceEventConnection* C = R ? R->_connection : 0;
+  if (C) {
+    C->_request.setFault(pluton::noFault);
+    C->_request.setResponseData(responsePointer, responseLength);
+  }
+  return _impl->sendResponse(C);
+}
+
+bool
+pluton::serviceEvent::sendResponse(pluton::serviceEventRequest* R, const std::string& responseData)
+{
+  pluton::serviceEventConnection* C = R ? R->_connection : 0;
+  if (C) {
+    C->_request.setFault(pluton::noFault);
+    C->_request.setResponseData(responseData);
+  }
+  return _impl->sendResponse(C);
+}
+
+bool
+pluton::serviceEvent::sendFault(pluton::serviceEventRequest* R,
+				unsigned int faultCode, const char* faultText)
+{
+  pluton::serviceEventConnection* C = R ? R->_connection : 0;
+  if (C) {
+    C->_request.setFault(static_cast<pluton::faultCode>(faultCode), faultText);
+    C->_request.setResponseData("", 0);
+  }
+  return _impl->sendResponse(C);
+}
+
+bool
+pluton::serviceEvent::isShutdown() const
+{
+  return _impl->isShutdown();
+}
+
+void
+pluton::serviceEvent::terminate()
+{
+  _impl->terminate();
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// serviceEventRequest proxies
+//////////////////////////////////////////////////////////////////////
+
+pluton::serviceEventRequest::serviceEventRequest(serviceEventConnection* C)
+  : _connection(C)
+{
+}
+
+pluton::serviceEventRequest::~serviceEventRequest()
+{
+}
+
+const std::string&
+pluton::serviceEventRequest::getServiceKey(std::string& sk) const
+{
+  _connection->_request.getServiceKey(sk);
+  return sk;
+}
+
+const std::string&
+pluton::serviceEventRequest::getServiceApplication(std::string& sa) const
+{
+  _connection->_request.getServiceApplication(sa);
+  return sa;
+}
+
+const std::string&
+pluton::serviceEventRequest::getServiceFunction(std::string& sf) const
+{
+  _connection->_request.getServiceFunction(sf);
+  return sf;
+}
+
+unsigned int
+pluton::serviceEventRequest::getServiceVersion() const
+{
+  return _connection->_request.getServiceVersion();
+}
+
+pluton::serializationType
+pluton::serviceEventRequest::getSerializationType() const
+{
+  return _connection->_request.getSerializationType();
+}
+
+const std::string&
+pluton::serviceEventRequest::getClientName(std::string& cn) const
+{
+  _connection->_request.getClientName(cn);
+  return cn;
+}
+
+void
+pluton::serviceEventRequest::getRequestData(const char*& cp, int& len) const
+{
+  _connection->_request.getRequestData(cp, len);
+}
+
+const std::string&
+pluton::serviceEventRequest::getRequestData(std::string& r) const
+{
+  _connection->_request.getRequestData(r);
+  return r;
+}
+
+bool
+pluton::serviceEventRequest::getContext(const char* key, std::string& value) const
+{
+  return _connection->_request.getContext(key, value);
+}
+
+void
+pluton::serviceEventRequest::setCacheMaxAgeMilliSeconds(unsigned int maxAgeMS)
+{
+  _connection->_request.setCacheMaxAgeMS(maxAgeMS);
+}
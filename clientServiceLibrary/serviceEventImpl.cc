@@ -0,0 +1,455 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "config.h"
+
+//////////////////////////////////////////////////////////////////////
+// The connection management behind pluton::serviceEvent. Connections
+// move between three places: the todo list while they wait to hand
+// the caller an I/O event, the ready list while a complete request
+// waits for getNextRequest() and with the caller until the response
+// is sent. serviceImpl does the actual I/O.
+//////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "util.h"
+#include "serviceEventImpl.h"
+
+static const int	pollIntervalMS = 1000;	// Re-check for shutdown this often
+
+
+pluton::serviceEventImpl::serviceEventImpl(const char* name)
+  : _name(name), _owner(name), _maximumConnections(100), _requestTimeoutMS(0), _inFlight(0),
+    _acceptOutstanding(false), _acceptClosed(false)
+{
+}
+
+pluton::serviceEventImpl::~serviceEventImpl()
+{
+  terminate();
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// When reading from fd3 and writing to fd4 there is no accept socket,
+// just the one connection for the life of the process.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::serviceEventImpl::initialize()
+{
+  _owner.initialize();
+  if (!_serviceImpl.initialize(&_owner)) return false;
+  _serviceImpl.setEventsInFlight(0);
+
+  if (_serviceImpl.inFauxSTDIOMode()) {
+    serviceEventConnection* C = newConnection(-1, -1);
+    _serviceImpl.getOneConnection(&C->_owner, 0);
+    C->_readFD = C->_owner._sockIn;
+    C->_writeFD = C->_owner._sockOut;
+    startReading(C);
+  }
+
+  return true;
+}
+
+
+void
+pluton::serviceEventImpl::setMaximumConnections(int maximumConnections)
+{
+  if (maximumConnections > 0) _maximumConnections = maximumConnections;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Return the accept socket if another connection can be taken on,
+// otherwise the next connection waiting on I/O. Connections that have
+// exceeded the request timeout are closed along the way.
+//////////////////////////////////////////////////////////////////////
+
+const pluton::serviceEvent::eventWanted*
+pluton::serviceEventImpl::getNextEventWanted(const struct timeval* now)
+{
+  int acceptSocket = _serviceImpl.getAcceptSocket();
+  if (!_acceptOutstanding && !_acceptClosed && (acceptSocket != -1)
+      && ((int) _connections.size() < _maximumConnections)) {
+    if (_serviceImpl.acceptingEvents()) {
+      _acceptOutstanding = true;
+      _acceptEW.type = pluton::serviceEvent::wantRead;
+      _acceptEW.fd = acceptSocket;
+      _acceptEW.timeout.tv_sec = pollIntervalMS / util::MILLISECOND;
+      _acceptEW.timeout.tv_usec = 0;
+      return &_acceptEW;
+    }
+    _acceptClosed = true;
+  }
+
+  while (!_todo.empty()) {
+    serviceEventConnection* C = _todo.front();
+    _todo.pop_front();
+
+    if (_requestTimeoutMS > 0) {
+      if (!C->_clock.isRunning()) C->_clock.start(now, _requestTimeoutMS);
+      if (C->_clock.getMSremaining(now, &C->_ew.timeout) <= 0) {
+	_serviceImpl.abortEvent(&C->_owner, &C->_request,
+				C->_state == serviceEventConnection::reading ?
+				reportingChannel::readError : reportingChannel::writeError);
+	deleteConnection(C);
+	continue;
+      }
+    }
+    else {
+      C->_ew.timeout.tv_sec = pollIntervalMS / util::MILLISECOND;
+      C->_ew.timeout.tv_usec = 0;
+    }
+
+    if (C->_state == serviceEventConnection::reading) {
+      C->_ew.type = pluton::serviceEvent::wantRead;
+      C->_ew.fd = C->_owner._sockIn;
+    }
+    else {
+      C->_ew.type = pluton::serviceEvent::wantWrite;
+      C->_ew.fd = C->_owner._sockOut;
+    }
+    C->_eventOutstanding = true;
+
+    return &C->_ew;
+  }
+
+  return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Pass events back in. As with clientEvent, callers may get it wrong
+// so check that the event matches what was asked for.
+//
+// Return: the number of requests now ready for getNextRequest() or
+// a negative value if the event is not recognized.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceEventImpl::sendCanReadEvent(int fd)
+{
+  _owner._fault.clear("pluton::serviceEvent::sendCanReadEvent");
+
+  if (_acceptOutstanding && (fd == _serviceImpl.getAcceptSocket())) {
+    _acceptOutstanding = false;
+    int sock = _serviceImpl.acceptEvent(&_owner);
+    if (sock == -1) _acceptClosed = true;
+    if (sock < 0) return 0;
+
+    serviceEventConnection* C = newConnection(sock, sock);
+    C->_owner._sockIn = C->_owner._sockOut = sock;
+    startReading(C);
+    return 0;
+  }
+
+  serviceEventConnection* C = findConnection(fd);
+  if (!C) return -1;
+  if (!C->_eventOutstanding || (C->_ew.type != pluton::serviceEvent::wantRead)) return -3;
+
+  C->_eventOutstanding = false;
+  setInFlight(C, true);
+
+  return progress(C, _serviceImpl.readEvent(&C->_owner, &C->_request));
+}
+
+
+int
+pluton::serviceEventImpl::sendCanWriteEvent(int fd)
+{
+  _owner._fault.clear("pluton::serviceEvent::sendCanWriteEvent");
+
+  serviceEventConnection* C = findConnection(fd);
+  if (!C) return -1;
+  if (!C->_eventOutstanding || (C->_ew.type != pluton::serviceEvent::wantWrite)) return -3;
+
+  C->_eventOutstanding = false;
+
+  return progress(C, _serviceImpl.writeEvent(&C->_owner, &C->_request, C->_pendingOut));
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// A timeout only means the caller's wait is over. The connection goes
+// back on the todo list and getNextEventWanted() decides whether it
+// has truly timed out.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceEventImpl::sendTimeoutEvent(int fd, bool abortFlag)
+{
+  _owner._fault.clear("pluton::serviceEvent::sendTimeoutEvent");
+
+  if (_acceptOutstanding && (fd == _serviceImpl.getAcceptSocket())) {
+    _acceptOutstanding = false;
+    return 0;
+  }
+
+  serviceEventConnection* C = findConnection(fd);
+  if (!C) return -1;
+  if (!C->_eventOutstanding) return -3;
+
+  C->_eventOutstanding = false;
+
+  if (abortFlag) {
+    _serviceImpl.abortEvent(&C->_owner, &C->_request,
+			    C->_state == serviceEventConnection::reading ?
+			    reportingChannel::readError : reportingChannel::writeError);
+    deleteConnection(C);
+  }
+  else {
+    _todo.push_front(C);
+  }
+
+  return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Move the connection along based on the serviceImpl result which is
+// >0 for done, 0 for more I/O and <0 for a closed connection.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceEventImpl::progress(serviceEventConnection* C, int res)
+{
+  if (res < 0) {
+    deleteConnection(C);
+    return 0;
+  }
+
+  if (res == 0) {
+    _todo.push_back(C);
+    return 0;
+  }
+
+  if (C->_state == serviceEventConnection::writing) {
+    responseSent(C);
+    return 0;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // Have a request. A noWait client has already been disconnected so
+  // its fds are no longer ours to track.
+  //////////////////////////////////////////////////////////////////////
+
+  C->_clock.stop();
+  C->_state = serviceEventConnection::withCaller;
+  if (C->_owner._sockIn == -1) {
+    if (C->_readFD != -1) _connectionByFD[C->_readFD] = 0;
+    if (C->_writeFD != -1) _connectionByFD[C->_writeFD] = 0;
+    C->_readFD = C->_writeFD = -1;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // Batched requests are only served by the blocking service APIs. A
+  // fault in a plain response fails the whole batch at the client.
+  //////////////////////////////////////////////////////////////////////
+
+  if (C->_owner._decoder.isBatch()) {
+    C->_request.setFault(pluton::batchNotSupported, "serviceEvent cannot serve a batch");
+    sendResponse(C);
+    return 0;
+  }
+
+  _ready.push_back(C);
+
+  return 1;
+}
+
+
+pluton::serviceEventRequest*
+pluton::serviceEventImpl::getNextRequest()
+{
+  if (_ready.empty()) return 0;
+
+  serviceEventConnection* C = _ready.front();
+  _ready.pop_front();
+
+  return &C->_handle;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Send as much of the response as possible now. The rest is written
+// as the caller passes in write events.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::serviceEventImpl::sendResponse(serviceEventConnection* C)
+{
+  _owner._fault.clear("pluton::serviceEvent::sendResponse");
+
+  if (!C || (C->_state != serviceEventConnection::withCaller)) {
+    _owner._fault.set(sendResponseNotNext, __FUNCTION__, __LINE__);
+    return false;
+  }
+
+  int res = _serviceImpl.sendResponseEvent(&C->_owner, &C->_request, C->_pendingOut);
+  if (res > 0) {
+    responseSent(C);
+    return true;
+  }
+
+  if (res == 0) {
+    C->_state = serviceEventConnection::writing;
+    C->_clock.stop();
+    _todo.push_back(C);
+    return true;
+  }
+
+  bool faultFlag = C->_owner.hasFault();
+  if (faultFlag) _owner._fault.set(C->_owner.getFault().getFaultCode(), __FUNCTION__, __LINE__);
+  deleteConnection(C);
+
+  return !faultFlag;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// An affinity connection stays open and reads the next request,
+// otherwise the connection is finished.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::serviceEventImpl::responseSent(serviceEventConnection* C)
+{
+  if (C->_owner._sockIn == -1) {
+    deleteConnection(C);
+  }
+  else {
+    startReading(C);
+  }
+}
+
+
+void
+pluton::serviceEventImpl::startReading(serviceEventConnection* C)
+{
+  setInFlight(C, false);
+  C->_state = serviceEventConnection::reading;
+  C->_clock.stop();
+  C->_pendingOut.erase();
+  _serviceImpl.startEventRequest(&C->_owner, &C->_request);
+  _todo.push_back(C);
+}
+
+
+pluton::serviceEventConnection*
+pluton::serviceEventImpl::newConnection(int readFD, int writeFD)
+{
+  serviceEventConnection* C = new serviceEventConnection(_name.c_str());
+  C->_readFD = readFD;
+  C->_writeFD = writeFD;
+  _connections.push_back(C);
+
+  int maxFD = std::max(readFD, writeFD);
+  if (maxFD >= (int) _connectionByFD.size()) _connectionByFD.resize(maxFD + 1, 0);
+  if (readFD != -1) _connectionByFD[readFD] = C;
+  if (writeFD != -1) _connectionByFD[writeFD] = C;
+
+  return C;
+}
+
+
+void
+pluton::serviceEventImpl::deleteConnection(serviceEventConnection* C)
+{
+  setInFlight(C, false);
+  if (C->_readFD != -1) _connectionByFD[C->_readFD] = 0;
+  if (C->_writeFD != -1) _connectionByFD[C->_writeFD] = 0;
+
+  _todo.remove(C);
+  _ready.remove(C);
+  _connections.remove(C);
+  delete C;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// A request is in flight from when its connection first becomes
+// readable until its response is sent or the connection is
+// abandoned. An idle persistent connection waiting for its next
+// request is not active.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::serviceEventImpl::setInFlight(serviceEventConnection* C, bool inFlight)
+{
+  if (C->_inFlight == inFlight) return;
+
+  C->_inFlight = inFlight;
+  _inFlight += inFlight ? 1 : -1;
+  _serviceImpl.setEventsInFlight(_inFlight);
+}
+
+
+pluton::serviceEventConnection*
+pluton::serviceEventImpl::findConnection(int fd) const
+{
+  if ((fd < 0) || (fd >= (int) _connectionByFD.size())) return 0;
+
+  return _connectionByFD[fd];
+}
+
+
+bool
+pluton::serviceEventImpl::isShutdown() const
+{
+  return (_acceptClosed || (_serviceImpl.getAcceptSocket() == -1)) && _connections.empty();
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Abandon any connections still in progress and release the accept
+// socket.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::serviceEventImpl::terminate()
+{
+  _serviceImpl.requestShutdown();
+
+  while (!_connections.empty()) {
+    serviceEventConnection* C = _connections.front();
+    _serviceImpl.abortEvent(&C->_owner, &C->_request,
+			    C->_state == serviceEventConnection::writing ?
+			    reportingChannel::writeError : reportingChannel::readError);
+    deleteConnection(C);
+  }
+
+  _serviceImpl.terminate();
+}
@@ -0,0 +1,130 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_SERVICEEVENTIMPL_H
+#define P_SERVICEEVENTIMPL_H 1
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "pluton/fault.h"
+#include "pluton/serviceEvent.h"
+
+#include "serviceImpl.h"
+#include "timeoutClock.h"
+
+namespace pluton {
+
+  //////////////////////////////////////////////////////////////////////
+  // Each connection carries its own perCallerService so that
+  // serviceImpl sees it as an independent caller.
+  //////////////////////////////////////////////////////////////////////
+
+  class serviceEventConnection {
+  public:
+    serviceEventConnection(const char* name) : _owner(name), _handle(this),
+      _state(reading), _eventOutstanding(false), _inFlight(false), _readFD(-1), _writeFD(-1) {}
+
+    perCallerService		_owner;
+    serviceRequestImpl		_request;
+    serviceEventRequest		_handle;
+    timeoutClock		_clock;
+    std::string			_pendingOut;
+
+    enum { reading, withCaller, writing } _state;
+    bool			_eventOutstanding;
+    pluton::serviceEvent::eventWanted	_ew;
+    bool			_inFlight;		// A request has started arriving
+
+    int		_readFD;		// As mapped in _connectionByFD
+    int		_writeFD;
+
+  private:
+    serviceEventConnection&	operator=(const serviceEventConnection& rhs);	// Assign not ok
+    serviceEventConnection(const serviceEventConnection& rhs);		// Copy not ok
+  };
+
+
+  class serviceEventImpl {
+  public:
+    serviceEventImpl(const char* name);
+    ~serviceEventImpl();
+
+    bool		initialize();
+
+    bool		hasFault() const { return _owner.hasFault(); }
+    const pluton::fault& getFault() const { return _owner.getFault(); }
+
+    void	setMaximumConnections(int maximumConnections);
+    void	setRequestTimeoutMS(unsigned int requestTimeoutMS) { _requestTimeoutMS = requestTimeoutMS; }
+
+    const pluton::serviceEvent::eventWanted*	getNextEventWanted(const struct timeval* now);
+    int		sendCanReadEvent(int fd);
+    int		sendCanWriteEvent(int fd);
+    int		sendTimeoutEvent(int fd, bool abortFlag);
+
+    pluton::serviceEventRequest*	getNextRequest();
+    bool	sendResponse(serviceEventConnection* C);
+
+    bool	isShutdown() const;
+    void	terminate();
+
+  private:
+    serviceEventImpl&	operator=(const serviceEventImpl& rhs);	// Assign not ok
+    serviceEventImpl(const serviceEventImpl& rhs);		// Copy not ok
+
+    serviceEventConnection*	newConnection(int readFD, int writeFD);
+    void			deleteConnection(serviceEventConnection* C);
+    void			startReading(serviceEventConnection* C);
+    void			responseSent(serviceEventConnection* C);
+    void			setInFlight(serviceEventConnection* C, bool inFlight);
+    int				progress(serviceEventConnection* C, int res);
+    serviceEventConnection*	findConnection(int fd) const;
+
+    std::string		_name;
+    serviceImpl		_serviceImpl;
+    perCallerService	_owner;			// Faults for the caller
+    int			_maximumConnections;
+    unsigned int	_requestTimeoutMS;
+    int			_inFlight;		// Connections with a request in flight
+
+    std::list<serviceEventConnection*>	_connections;	// All of them
+    std::list<serviceEventConnection*>	_todo;		// Waiting to give caller an event
+    std::list<serviceEventConnection*>	_ready;		// Requests not yet given to caller
+    std::vector<serviceEventConnection*> _connectionByFD;
+
+    pluton::serviceEvent::eventWanted	_acceptEW;
+    bool		_acceptOutstanding;
+    bool		_acceptClosed;
+  };
+}
+
+#endif
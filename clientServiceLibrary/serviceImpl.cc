@@ -41,6 +41,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+#include <sys/sendfile.h>
+#define P_HAVE_SENDFILE
+#endif
 #ifdef HAVE_SYS_SELECT
 #include <sys/select.h>
 #endif
@@ -51,6 +55,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <poll.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -66,9 +71,31 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "serviceImpl.h"
 #include "serviceAttributes.h"
 #include "decodePacket.h"
+#include "traceRecorder.h"
+#include "memfdPayload.h"
+#include "payloadCompressor.h"
 
 static bool GInsideJVM = false;
 
+
+//////////////////////////////////////////////////////////////////////
+// Hold a serviceImpl mutex for the duration of a scope.
+//////////////////////////////////////////////////////////////////////
+
+namespace {
+  class scopedLock {
+  public:
+    scopedLock(pthread_mutex_t* m) : _m(m) { pthread_mutex_lock(_m); }
+    ~scopedLock() { pthread_mutex_unlock(_m); }
+
+  private:
+    scopedLock&	operator=(const scopedLock& rhs);	// Assign not ok
+    scopedLock(const scopedLock& rhs);			// Copy not ok
+
+    pthread_mutex_t*	_m;
+  };
+}
+
 int
 pluton::serviceImpl::setInternalAttributes(int attributes)
 {
@@ -88,16 +115,24 @@ pluton::serviceImpl::serviceImpl() :
   _mode(initializing),
   _acceptSocket(-1), _reportingSocket(-1),
   _myPid(0),
-  _recorderIndex(0), _recorderCycle(0),
+  _recorderIndex(0), _recorderCycle(0), _threadedFlag(false), _shutdownRequested(false),
   _affinityTimeout(0), _maximumRequests(0),
-  _requestCount(0), _responseCount(0), _faultCount(0),
+  _requestCount(0), _responseCount(0), _faultCount(0), _eventsInFlight(-1),
   _defaultOwner(0), _defaultRequest(0),
   _oldSIGURGHandler(0), _packetTraceFlag(false), _debugFlag(false), _pollProxy(0)
 {
+  pthread_mutex_init(&_mutex, 0);
+  pthread_mutex_init(&_acceptMutex, 0);
+
+  _eventsActiveSince.tv_sec = _eventsActiveSince.tv_usec = 0;
+
   _myPid = getpid();
   _evRequests.pid = _myPid;
   _evRequests.type = reportingChannel::performanceReport;
   _evRequests.U.pd.entries = 0;
+  _evRequests.U.pd.uncompressedBytes = 0;
+  _evRequests.U.pd.compressedBytes = 0;
+  _evRequests.U.pd.compressionMicroSeconds = 0;
 
   ////////////////////////////////////////////////////////////
   // Check for environment variable settings
@@ -111,6 +146,9 @@ pluton::serviceImpl::serviceImpl() :
 pluton::serviceImpl::~serviceImpl()
 {
   terminate();
+
+  pthread_mutex_destroy(&_acceptMutex);
+  pthread_mutex_destroy(&_mutex);
 }
 
 
@@ -164,7 +202,7 @@ pluton::serviceImpl::startResponseTimer(pluton::perCallerService* owner)
 {
   gettimeofday(&owner->_requestStartTime, 0);		// Start the clock on the service
   if (_mode == managerMode) _shmService.startResponseTimer(owner->_requestStartTime,
-							   owner->_affinityFlag);
+							   owner->_affinityFlag, owner->_myTid);
 }
 
 
@@ -180,6 +218,9 @@ pluton::serviceImpl::stopResponseTimer(pluton::perCallerService* owner,
 				       const std::string& function)
 {
   gettimeofday(&owner->_requestEndTime, 0);		// Stop the clock on the service
+  if (owner->_traceID) recordTrace(owner);
+
+  scopedLock lock(&_mutex);
   if (rr == reportingChannel::ok) {
     ++_responseCount;
     _shmService.setProcessResponseCount(_responseCount);
@@ -206,10 +247,75 @@ pluton::serviceImpl::stopResponseTimer(pluton::perCallerService* owner,
 	    sizeof(_evRequests.U.pd.rqL[_evRequests.U.pd.entries].function)-1);
     _evRequests.U.pd.rqL[_evRequests.U.pd.entries].function[sizeof(_evRequests.U.pd.rqL[_evRequests.U.pd.entries].function)-1] = '\0';
 
+    _evRequests.U.pd.uncompressedBytes += owner->_compression.uncompressedBytes;
+    _evRequests.U.pd.compressedBytes += owner->_compression.compressedBytes;
+    _evRequests.U.pd.compressionMicroSeconds += owner->_compression.cpuMicroSeconds;
+
     if (++_evRequests.U.pd.entries == reportingChannel::maximumPerformanceEntries) sendReports();
   }
 
-  if (_mode == managerMode) _shmService.stopResponseTimer(owner->_requestEndTime);
+  if (_mode == managerMode) _shmService.stopResponseTimer(owner->_requestStartTime,
+							  owner->_requestEndTime,
+							  _eventsInFlight < 0);
+
+  owner->_compression = pluton::compressionStats();	// Only this request is reported
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// If the client sent a trace context, this request becomes a span in
+// that trace and the current trace for any nested client requests.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::serviceImpl::startTrace(pluton::perCallerService* owner, pluton::requestImpl* R)
+{
+  owner->_traceID = 0;
+  if (!pluton::traceRecorder::enabled()) return;
+
+  std::string traceContext;
+  if (!R->getContext(pluton::traceRecorder::contextKey, traceContext)) return;
+  if (!pluton::traceRecorder::decode(traceContext, owner->_traceID, owner->_traceParentID)) {
+    owner->_traceID = 0;
+    return;
+  }
+
+  owner->_traceSpanID = pluton::traceRecorder::newID();
+  owner->_traceName = R->getServiceKey();
+  gettimeofday(&owner->_requestReadTime, 0);
+  owner->_responseStartTime = owner->_requestReadTime;
+
+  pluton::traceRecorder::setCurrent(owner->_traceID, owner->_traceSpanID);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Write the spans for the request just completed. The read span
+// covers the time from accepting the connection to having the whole
+// request.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::serviceImpl::recordTrace(pluton::perCallerService* owner)
+{
+  pluton::traceRecorder::record(traceSpan::serviceKind, owner->_traceName.c_str(),
+				owner->_traceID, owner->_traceSpanID, owner->_traceParentID,
+				owner->_requestStartTime, owner->_requestEndTime);
+  pluton::traceRecorder::record(traceSpan::serviceKind, "service.read",
+				owner->_traceID, pluton::traceRecorder::newID(),
+				owner->_traceSpanID,
+				owner->_requestStartTime, owner->_requestReadTime);
+  pluton::traceRecorder::record(traceSpan::serviceKind, "service.process",
+				owner->_traceID, pluton::traceRecorder::newID(),
+				owner->_traceSpanID,
+				owner->_requestReadTime, owner->_responseStartTime);
+  pluton::traceRecorder::record(traceSpan::serviceKind, "service.write",
+				owner->_traceID, pluton::traceRecorder::newID(),
+				owner->_traceSpanID,
+				owner->_responseStartTime, owner->_requestEndTime);
+
+  pluton::traceRecorder::setCurrent(0, 0);
+  owner->_traceID = 0;
 }
 
 
@@ -238,9 +344,31 @@ pluton::serviceImpl::stopResponseTimer(pluton::perCallerService* owner,
 int
 pluton::serviceImpl::readRequestPacket(pluton::perCallerService* owner,
 				       requestImpl* R, unsigned int requestTimeoutSecs)
+{
+  startRequestPacket(owner, R);
+
+  while (true) {
+    int res = decodeRequestPacket(owner, R);
+    if (res > 0) return 1;
+    if (res < 0) return 0;		// decodeRequestPacket sets _fault
+
+    if (!handleRead(owner, requestTimeoutSecs)) {
+      finishRequestPacket(owner);
+      return 0;				// Eof or error (handleRead sets _fault)
+    }
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Prepare the owner to read a new request packet.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::serviceImpl::startRequestPacket(pluton::perCallerService* owner, requestImpl* R)
 {
   if (_mode != fauxSTDIOMode) {
-    owner->_packetIn.reset();			// Clear out possible previous read errors
+    owner->_packetIn.reset();			// Clear out previous errors and large buffers
   }
   else {
     owner->_packetIn.reclaimByCompaction();	// Opportunitistic garbage collection
@@ -249,64 +377,95 @@ pluton::serviceImpl::readRequestPacket(pluton::perCallerService* owner,
   owner->_decoder.setRequest(R);
   R->setPacketOffset(owner->_packetIn.getRawOffset());
 
-  std::string em;
-  int recorderFD = -1;
-
-  if (!_recorderPrefix.empty()) {
-    recorderFD = recordPacketInStart();
-  }
+  owner->_recorderFD = -1;
+  owner->_recordingIn = false;
+  if (!_recorderPrefix.empty()) recordPacketInStart(owner);
 
   if (_packetTraceFlag) write(2, "PktIn: ", 7);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Decode all of the netStrings read so far.
+//
+// Return: 0 need more bytes
+//	   <0 decode error, _fault set
+//	   >0 have complete request
+//////////////////////////////////////////////////////////////////////
 
-  // Loop on getting each netString until the decoder says we have a
-  // complete packet.
+int
+pluton::serviceImpl::decodeRequestPacket(pluton::perCallerService* owner, requestImpl* R)
+{
+  std::string em;
 
   do {
     const char* parseError = 0;
-    while (!owner->_packetIn.haveNetString(parseError)) {
-      if (parseError) {
-	if (_packetTraceFlag) write(2, "\n", 1);
-	if (recorderFD != -1) close(recorderFD);
-	owner->_fault.set(requestNetStringParseError, __FUNCTION__, __LINE__, 0, 0, 0,
-			  parseError);
-	return 0;
-      }
-
-      if (!handleRead(owner, requestTimeoutSecs)) {
-	if (_packetTraceFlag) write(2, "\n", 1);
-	if (recorderFD != -1) close(recorderFD);
-	return 0;	// Eof or error (handleRead sets _fault)
-      }
+    if (!owner->_packetIn.haveNetString(parseError)) {
+      if (!parseError) return 0;
+      finishRequestPacket(owner);
+      owner->_fault.set(requestNetStringParseError, __FUNCTION__, __LINE__, 0, 0, 0,
+			parseError);
+      return -1;
     }
 
     //////////////////////////////////////////////////////////////////////
     // Write out this netString as part of the recorder file
     //////////////////////////////////////////////////////////////////////
 
-    const char* nsDataPtr;
-    int nsDataLength;
-    if (recorderFD != -1) {
-      owner->_packetIn.getRawString(nsDataPtr, nsDataLength);
-      write(recorderFD, nsDataPtr, nsDataLength);
-    }
+    const char* rawPtr = 0;
+    int rawLength = 0;
+    if (owner->_recordingIn) owner->_packetIn.getRawString(rawPtr, rawLength);
 
     //////////////////////////////////////////////////////////////////////
     // Extract the netString and check that it is a type we want
     //////////////////////////////////////////////////////////////////////
 
     char nsType;
+    const char* nsDataPtr;
+    int nsDataLength;
     int nsDataOffset;
     owner->_packetIn.getNetString(nsType, nsDataPtr, nsDataLength, &nsDataOffset);
 
+    // A client that sends binary framing can obviously accept it back
+
+    if (owner->_packetIn.isBinary()) R->setBinaryFraming(true);
+
+    if (owner->_recordingIn && (nsType != pluton::memfdDataNT)) {
+      recordPacketIn(owner, rawPtr, rawLength);
+    }
+
     //////////////////////////////////////////////////////////////////////
     // The packet decoder does all the type checking for us.
     //////////////////////////////////////////////////////////////////////
 
     if (!owner->_decoder.addType(nsType, nsDataPtr, nsDataLength, nsDataOffset, em)) {
-      if (_packetTraceFlag) write(2, "\n", 1);
-      if (recorderFD != -1) close(recorderFD);
+      finishRequestPacket(owner);
       owner->_fault.set(requestDecodeFailed, __FUNCTION__, __LINE__, 0, 0, em.c_str());
-      return 0;
+      return -1;
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    // Request data in a memfd arrived with the first bytes of the
+    // packet. The recorder gets the data inline so that a replay
+    // does not depend on the memfd.
+    //////////////////////////////////////////////////////////////////////
+
+    if ((nsType == pluton::memfdDataNT) && R->hasMemfdData()) {
+      int fd = owner->_passedFD;
+      owner->_passedFD = -1;
+      if (!R->mapMemfdData(fd, em)) {
+	finishRequestPacket(owner);
+	owner->_fault.set(requestDecodeFailed, __FUNCTION__, __LINE__, 0, 0, em.c_str());
+	return -1;
+      }
+      if (owner->_recordingIn) {
+	const char* p;
+	int len;
+	R->getRequestData(p, len);
+	netStringGenerate inlineData;
+	inlineData.append(pluton::requestDataNT, p, len);
+	recordPacketIn(owner, inlineData.data(), inlineData.length());
+      }
     }
   } while (!owner->_decoder.haveCompleteRequest());
 
@@ -317,14 +476,29 @@ pluton::serviceImpl::readRequestPacket(pluton::perCallerService* owner,
   //////////////////////////////////////////////////////////////////////
 
   R->adjustOffsets(owner->_packetIn.getBasePtr(), owner->_packetIn.getRawOffset());
+  finishRequestPacket(owner);
 
-  if (_packetTraceFlag) write(2, "\n", 1);
-  if (recorderFD != -1) close(recorderFD);
+  if (!R->decompressData(em, owner->_compression)) {
+    owner->_fault.set(requestDecodeFailed, __FUNCTION__, __LINE__, 0, 0, em.c_str());
+    return -1;
+  }
 
   return 1;
 }
 
 
+void
+pluton::serviceImpl::finishRequestPacket(pluton::perCallerService* owner)
+{
+  if (_packetTraceFlag) write(2, "\n", 1);
+  if (owner->_recorderFD != -1) {
+    close(owner->_recorderFD);
+    owner->_recorderFD = -1;
+  }
+  owner->_recordingIn = false;
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // Write the outbound packet back to the client. The socket is
 // non-blocking so this routine does an opportunistic write as it's
@@ -336,7 +510,9 @@ pluton::serviceImpl::readRequestPacket(pluton::perCallerService* owner,
 // specified time and closes the socket.
 //
 // The write is done as as set of iovecs because the response data is
-// supplied as a set of (upto) three pointer, length pairs.
+// supplied as a set of (upto) three pointer, length pairs, or as the
+// service's own iovecs between the assembled netStrings. The iovecs
+// are adjusted as the write progresses.
 //////////////////////////////////////////////////////////////////////
 
 int
@@ -344,7 +520,7 @@ pluton::serviceImpl::writeResponsePacket(pluton::perCallerService* owner,
 					 const char* firstPtr, int firstLen,
 					 const char* middlePtr, int middleLen,
 					 const char* lastPtr, int lastLen,
-					 unsigned int timeoutSecs, int traceFD)
+					 unsigned int timeoutSecs, int traceFD, int passFD)
 {
   struct iovec iov[3];
   int iovCount = 0;
@@ -364,6 +540,14 @@ pluton::serviceImpl::writeResponsePacket(pluton::perCallerService* owner,
     iov[iovCount++].iov_len = lastLen;
   }
 
+  return writeResponseIOV(owner, iov, iovCount, timeoutSecs, traceFD, passFD);
+}
+
+int
+pluton::serviceImpl::writeResponseIOV(pluton::perCallerService* owner,
+				      struct iovec* iov, int iovCount,
+				      unsigned int timeoutSecs, int traceFD, int passFD)
+{
   struct iovec* iovPtr = iov;	// Iterate through if write is repeated
 
   if ((traceFD >= 0) && (iovCount > 0)) {
@@ -373,22 +557,17 @@ pluton::serviceImpl::writeResponsePacket(pluton::perCallerService* owner,
 
   int bytesWritten = 0;
   while (iovCount > 0) {
-    int res = writev(owner->_sockOut, iovPtr, iovCount);
+    int res;
+    if (passFD != -1) {				// Passed with the first bytes
+      res = pluton::memfdPayload::sendWithFD(owner->_sockOut, iovPtr, iovCount, passFD, 0);
+      if (res > 0) passFD = -1;
+    }
+    else {
+      res = writev(owner->_sockOut, iovPtr, iovCount);
+    }
     if (res <= 0) {
       if ((errno == EAGAIN) || (errno == EINTR)) {
-	struct pollfd fds;
-	fds.fd = owner->_sockOut;
-	fds.events = POLLOUT;
-	fds.revents = 0;
-	if (_pollProxy) {
-	  res = (_pollProxy)(&fds, 1,
-			     timeoutSecs > 0 ? timeoutSecs * util::MICROSECOND : (unsigned) -2);
-	}
-	else {
-	  res = poll(&fds, 1, -1);
-	}
-	if (_debugFlag) std::clog << "poll write=" << res << " fd=" << fds.fd
-				  << " rev=" << fds.revents << std::endl;
+	res = pollWritable(owner, timeoutSecs);
 	if (res == 1) continue;
       }
       return res;
@@ -417,6 +596,95 @@ pluton::serviceImpl::writeResponsePacket(pluton::perCallerService* owner,
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Wait for the client socket to drain. Return as for poll().
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceImpl::pollWritable(pluton::perCallerService* owner, unsigned int timeoutSecs)
+{
+  struct pollfd fds;
+  fds.fd = owner->_sockOut;
+  fds.events = POLLOUT;
+  fds.revents = 0;
+
+  int res;
+  if (_pollProxy) {
+    res = (_pollProxy)(&fds, 1,
+		       timeoutSecs > 0 ? timeoutSecs * util::MICROSECOND : (unsigned) -2);
+  }
+  else {
+    res = poll(&fds, 1, -1);
+  }
+  if (_debugFlag) std::clog << "poll write=" << res << " fd=" << fds.fd
+			    << " rev=" << fds.revents << std::endl;
+
+  return res;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Write length bytes of a file, starting at offset, to the client
+// between the netStrings written by writeResponsePacket(). sendfile()
+// moves the data from the page cache to the socket without it coming
+// into the service. If sendfile() is not available or won't take this
+// pair of descriptors (faux STDIO mode on older kernels), the data is
+// read and written in chunks instead. Return the bytes written or -1
+// with errno set. A file that shrinks under us is an EIO.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceImpl::writeResponseFile(pluton::perCallerService* owner, int fd, off_t offset,
+				       int length, unsigned int timeoutSecs)
+{
+  int bytesWritten = 0;
+#ifdef P_HAVE_SENDFILE
+  bool useSendfile = true;
+#endif
+
+  while (bytesWritten < length) {
+    int res;
+#ifdef P_HAVE_SENDFILE
+    if (useSendfile) {
+      off_t fileOffset = offset + bytesWritten;
+      res = sendfile(owner->_sockOut, fd, &fileOffset, length - bytesWritten);
+      if ((res == -1) && ((errno == EINVAL) || (errno == ENOSYS)) && (bytesWritten == 0)) {
+	useSendfile = false;
+	continue;
+      }
+      if (res == 0) {
+	errno = EIO;
+	return -1;
+      }
+      if (res < 0) {
+	if ((errno == EAGAIN) || (errno == EINTR)) {
+	  res = pollWritable(owner, timeoutSecs);
+	  if (res == 1) continue;
+	}
+	return res;
+      }
+      bytesWritten += res;
+      continue;
+    }
+#endif
+
+    char buffer[8192];
+    res = pread(fd, buffer, std::min((int) sizeof(buffer), length - bytesWritten),
+		offset + bytesWritten);
+    if (res <= 0) {
+      if ((res == -1) && (errno == EINTR)) continue;
+      if (res == 0) errno = EIO;
+      return -1;
+    }
+    res = writeResponsePacket(owner, buffer, res, 0, 0, 0, 0, timeoutSecs, -1);
+    if (res <= 0) return res;
+    bytesWritten += res;
+  }
+
+  return bytesWritten;
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // Do post-contruction initialization. This routine mainly exists so
 // that we can communicate back to the caller without raising
@@ -476,6 +744,8 @@ pluton::serviceImpl::initialize(pluton::perCallerService* owner, bool threadedFl
     return false;
   }
 
+  _threadedFlag = threadedFlag;
+
   ////////////////////////////////////////////////////////////
   // Check for environment variable over-rides
   ////////////////////////////////////////////////////////////
@@ -530,6 +800,26 @@ pluton::serviceImpl::initialize(pluton::perCallerService* owner, bool threadedFl
 	_recorderCycle = _shmService.getServicePtr()->_config._recorderCycle;
 	_recorderPrefix.assign(_shmService.getServicePtr()->_config._recorderPrefix);
 
+	//////////////////////////////////////////////////////////////////////
+	// Capturing just the slow requests means holding each request in
+	// memory until its duration is known, which is what the recorder
+	// ring does anyway, so slow requests always go to a ring.
+	//////////////////////////////////////////////////////////////////////
+
+	_slowRequestFilter.configure(_shmService.getServicePtr()->_config._slowRequestMilliSeconds,
+				     _shmService.getServicePtr()->_config._slowRequestPermille);
+
+	int slotSize = _shmService.getServicePtr()->_config._recorderSlotSize;
+	if (_slowRequestFilter.enabled() && (slotSize == 0)) slotSize = 64 * 1024;
+	if (!_recorderPrefix.empty() && (slotSize > 0)) {
+	  std::ostringstream os;
+	  os << _recorderPrefix << (_slowRequestFilter.enabled() ? "slow." : "ring.") << _myPid;
+	  if (!_recorderRing.open(os.str(), (_recorderCycle > 0) ? _recorderCycle : 1000, slotSize)) {
+	    if (_debugFlag) std::clog << "SIDebug: Recorder ring failed: " << os.str() << std::endl;
+	    _recorderPrefix.erase();		// Recording is best effort
+	  }
+	}
+
 	_acceptSocket = plutonGlobal::inheritedAcceptFD;
 	util::increaseOSBuffer(_acceptSocket, 64*1024, 64*1024);	// These get inherited
 
@@ -583,6 +873,34 @@ pluton::serviceImpl::initialize(pluton::perCallerService* owner, bool threadedFl
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Give the caller the next request. Members of a batch are handed
+// out one at a time without going near the connection until they
+// have all been answered.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::serviceImpl::getRequest(pluton::perCallerService* owner, requestImpl* R,
+				unsigned int acceptTimeoutSecs, unsigned int requestTimeoutSecs,
+				bool exposeClientErrors)
+{
+  if ((owner->_batchNext < owner->_batchCount)
+      && (owner->_state == pluton::perCallerService::canGetRequest)) {
+    owner->_fault.clear("pluton::service::getRequest");
+    nextBatchMember(owner, R);
+    return true;
+  }
+
+  if (!acceptRequest(owner, R, acceptTimeoutSecs, requestTimeoutSecs, exposeClientErrors)) {
+    return false;
+  }
+
+  if (owner->_batchCount > 0) nextBatchMember(owner, R);
+
+  return true;
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // Read the request in. Return false if caller should exit. This code
 // is mostly about deciding *how* to get the request data based on the
@@ -591,9 +909,9 @@ pluton::serviceImpl::initialize(pluton::perCallerService* owner, bool threadedFl
 //////////////////////////////////////////////////////////////////////
 
 bool
-pluton::serviceImpl::getRequest(pluton::perCallerService* owner, requestImpl* R,
-				unsigned int acceptTimeoutSecs, unsigned int requestTimeoutSecs,
-				bool exposeClientErrors)
+pluton::serviceImpl::acceptRequest(pluton::perCallerService* owner, requestImpl* R,
+				   unsigned int acceptTimeoutSecs, unsigned int requestTimeoutSecs,
+				   bool exposeClientErrors)
 {
   if (_debugFlag) std::clog << "SIDebug: getRequest mode=" << _mode << std::endl;
 
@@ -661,6 +979,7 @@ pluton::serviceImpl::getRequest(pluton::perCallerService* owner, requestImpl* R,
     }
 
     res = readRequestPacket(owner, R, requestTimeoutSecs);
+    if ((res > 0) && owner->_decoder.isBatch() && !startBatch(owner, R)) res = 0;
     if (res > 0) break;
 
     //////////////////////////////////////////////////////////////////////
@@ -674,20 +993,38 @@ pluton::serviceImpl::getRequest(pluton::perCallerService* owner, requestImpl* R,
     if (exposeClientErrors || _mode != managerMode) return false;
   }
 
-  //////////////////////////////////////////////////////////////////////
-  // We have a request - update shm scoreboard and return to caller.
-  //////////////////////////////////////////////////////////////////////
+  haveRequest(owner, R);
+
+  if (_debugFlag) std::clog << "SIDebug: get ok _noWait=" << owner->_noWaitFlag
+			    << " _affinity=" << owner->_affinityFlag << std::endl;
+
+  return true;
+}
+
 
+//////////////////////////////////////////////////////////////////////
+// We have a request - update shm scoreboard and remember the
+// attributes for when the caller sends the response.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::serviceImpl::haveRequest(pluton::perCallerService* owner, requestImpl* R)
+{
   owner->_state = pluton::perCallerService::canSendResponse;
+  owner->resetResponseParts();
   unsigned int requestID = owner->_decoder.getRequestID();
   R->setRequestID(requestID);
+  startTrace(owner, R);
 
   std::string cname;
   R->getClientName(cname);
-  ++_requestCount;
-  _shmService.setProcessRequestCount(_requestCount);
+  {
+    scopedLock lock(&_mutex);
+    ++_requestCount;
+    _shmService.setProcessRequestCount(_requestCount);
+  }
   _shmService.setProcessClientDetails(requestID, owner->_requestStartTime,
-				      cname.data(), cname.length());
+				      cname.data(), cname.length(), owner->_myTid);
 
   //////////////////////////////////////////////////////////////////////
   // Remember the attributes for when the caller sends the response.
@@ -701,88 +1038,394 @@ pluton::serviceImpl::getRequest(pluton::perCallerService* owner, requestImpl* R,
   else {
     owner->_affinityFlag = R->getAttribute(pluton::keepAffinityAttr);
   }
-
-  if (_debugFlag) std::clog << "SIDebug: get ok _noWait=" << owner->_noWaitFlag
-			    << " _affinity=" << owner->_affinityFlag << std::endl;
-
-  return true;
 }
 
 
 //////////////////////////////////////////////////////////////////////
-// This routine does most of the work to establish an inbound
-// connection. It is in a separate routine so the parent can easily
-// iterate on non-fatal errors.
-//
-// Accept the next connection from the acceptSocket if such a socket
-// is open. If a socket is already open due to a previous keepAffinity
-// request or non-manager mode, do nothing.
-//
-// Return: 0 no connection
-//	   <0 no connection, unexpect serviceImpl error _fault set
-//	   >0 have connection
+// A batch request has been read. Decode every member now so that a
+// malformed batch is rejected like any other bad packet and so that
+// getRequestBatch() has them all to hand. The members point into
+// _packetIn which does not move until the next request is read.
 //////////////////////////////////////////////////////////////////////
 
-int
-pluton::serviceImpl::getOneConnection(pluton::perCallerService* owner, unsigned int timeoutSecs)
+bool
+pluton::serviceImpl::startBatch(pluton::perCallerService* owner, requestImpl* R)
 {
-  if (_debugFlag) std::clog << "SIDebug: getOneConnection mode=" << _mode
-		       << " _affinity=" << owner->_affinityFlag << std::endl;
+  int count = owner->_decoder.getBatchCount();
+  if (count == 0) {
+    owner->_fault.set(requestDecodeFailed, __FUNCTION__, __LINE__, 0, 0, "Empty batch");
+    return false;
+  }
 
-  if ((_mode == acceptMode) || (_mode == managerMode)) {
-    if (!owner->_affinityFlag) {
-      if (_mode == managerMode) _shmService.setProcessAcceptingRequests(true);
-      int sock = acceptConnection(owner, timeoutSecs);
-      if (_mode == managerMode) _shmService.setProcessAcceptingRequests(false);
-      if (sock == -1) return -1;			// Unrecoverable
-      if (sock == -2) return 0;				// Timeout
-      owner->_sockIn = owner->_sockOut = sock;
-    }
+  while ((int) owner->_batchRequests.size() < count) {
+    owner->_batchRequests.push_back(new pluton::serviceRequestImpl);
   }
-  else {
-    owner->_sockIn = FAUX_STDIN;
-    owner->_sockOut = FAUX_STDOUT;
+
+  const char* basePtr = owner->_packetIn.getBasePtr();
+  std::string em;
+  for (int ix=0; ix < count; ++ix) {
+    pluton::serviceRequestImpl* M = owner->_batchRequests[ix];
+    M->resetRequestValues();
+    M->resetResponseValues();
+    M->setFault(pluton::noFault);
+
+    int offset, length;
+    owner->_decoder.getBatchMember(ix, offset, length);
+    pluton::decodeRequestPacket memberDecoder(M);
+    if (!memberDecoder.decodeEncapsulated(basePtr, offset, length, em)) {
+      owner->_fault.set(requestDecodeFailed, __FUNCTION__, __LINE__, ix, 0, em.c_str());
+      return false;
+    }
+    M->setRequestID(memberDecoder.getRequestID());
   }
 
-  return 1;
+  if (_debugFlag) std::clog << "SIDebug: startBatch count=" << count << std::endl;
+
+  owner->_batchCount = count;
+  owner->_batchNext = 0;
+  owner->_batchCurrent = 0;
+  owner->_batchFirst = 0;
+  owner->_batchAnswered = 0;
+  owner->_batchRequestID = owner->_decoder.getRequestID();
+  R->getClientName(owner->_batchClientName);
+  owner->_batchFunction = R->getServiceFunction();
+
+  const char* packetPtr;
+  R->getInboundPacketData(packetPtr, owner->_batchRequestLength);
+
+  owner->_batchResponses.resize(count);
+  for (int ix=0; ix < count; ++ix) owner->_batchResponses[ix].erase();
+
+  return true;
 }
 
 
 //////////////////////////////////////////////////////////////////////
-// Use select to check for accept. There is a timing window between
-// the select and the accept where another service could have grabbed
-// the connection. In this case we will block and if an attempt by the
-// manager to signal us occurs then, then we will ultimately
-// abnormally terminate as we will stay blocked until the Manager
-// SIGINTs us.
+// Present the next member of the batch as the current request.
 //////////////////////////////////////////////////////////////////////
 
-#ifdef __linux__
-int
-pluton::serviceImpl::linuxAccept(int acceptFD, struct sockaddr *sa, socklen_t *salen)
+void
+pluton::serviceImpl::nextBatchMember(pluton::perCallerService* owner, requestImpl* R)
 {
-  while (true) {
-    fd_set fds;
-    FD_ZERO(&fds);
-    struct timeval tv;
-    tv.tv_sec = 10;
-    tv.tv_usec = 0;
-    FD_SET(acceptFD, &fds);
-    int res = select(acceptFD+1, &fds, 0, 0, &tv);
-    if (_debugFlag) std::clog << "SIDebug: select=" << res << " errno=" << errno << std::endl;
+  int ix = owner->_batchNext++;
+  owner->_batchCurrent = ix;
 
-    if (res < 0) return -1;
-    if (res == 1) break;
-  }
+  R->resetRequestValues();
+  R->resetResponseValues();
+  R->setFault(pluton::noFault);
 
-  return accept(acceptFD, sa, salen);
+  int offset, length;
+  owner->_decoder.getBatchMember(ix, offset, length);
+  pluton::decodeRequestPacket memberDecoder(R);
+  std::string em;
+  memberDecoder.decodeEncapsulated(owner->_packetIn.getBasePtr(), offset, length, em);
+  R->setRequestID(memberDecoder.getRequestID());	// Already validated by startBatch()
+
+  owner->_state = pluton::perCallerService::canSendResponse;
+  owner->resetResponseParts();
 }
-#endif
+
 
 //////////////////////////////////////////////////////////////////////
-// Accept a new connection from the socket. If we're in manager mode,
-// we may get a signal from the manager telling us to check for a
-// shutdown request. The timeout only applies if a proxy Poll handler
+// Return the whole batch to the caller. A request that was not
+// batched is returned as a batch of one so that a batch-aware service
+// works with all clients.
+//
+// Return: number of members, 0 if the caller should exit
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceImpl::getRequestBatch(pluton::perCallerService* owner, requestImpl* R,
+				     const pluton::batchRequest*& batch)
+{
+  batch = 0;
+
+  if ((owner->_batchNext < owner->_batchCount)
+      && (owner->_state == pluton::perCallerService::canGetRequest)) {
+    owner->_fault.clear("pluton::service::getRequestBatch");
+  }
+  else {
+    if (!acceptRequest(owner, R, 0, 0, false)) return 0;
+  }
+
+  if (owner->_batchCount == 0) {
+    owner->_batchArray.resize(1);
+    R->getRequestData(owner->_batchArray[0].requestData, owner->_batchArray[0].requestLength);
+    batch = &owner->_batchArray[0];
+    return 1;
+  }
+
+  owner->_batchFirst = owner->_batchNext;
+  int count = owner->_batchCount - owner->_batchFirst;
+  owner->_batchArray.resize(count);
+  for (int ix=0; ix < count; ++ix) {
+    pluton::batchRequest& BR = owner->_batchArray[ix];
+    owner->_batchRequests[owner->_batchFirst + ix]->getRequestData(BR.requestData,
+								    BR.requestLength);
+  }
+
+  owner->_batchNext = owner->_batchCount;
+  owner->_batchCurrent = -1;			// Only answerable by index
+  owner->_state = pluton::perCallerService::canSendResponse;
+
+  batch = &owner->_batchArray[0];
+
+  return count;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Answer one member of the batch returned by getRequestBatch().
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::serviceImpl::sendBatchResponse(pluton::perCallerService* owner, requestImpl* R,
+				       int index, pluton::faultCode fc, const char* faultText,
+				       const char* responsePtr, int responseLength)
+{
+  owner->_fault.clear("pluton::service::sendBatchResponse");
+  if (owner->_state != pluton::perCallerService::canSendResponse) {
+    owner->_fault.set(sendResponseNotNext, __FUNCTION__, __LINE__);
+    return false;
+  }
+
+  if (owner->_batchCount == 0) {		// A batch of one
+    if (index != 0) {
+      owner->_fault.set(batchIndexInvalid, __FUNCTION__, __LINE__, index);
+      return false;
+    }
+    R->setFault(fc, faultText ? faultText : "");
+    R->setResponseData(responsePtr, responseLength);
+    return sendResponse(owner, R);
+  }
+
+  if (owner->_batchCurrent >= 0) {		// Member came from getRequest()
+    owner->_fault.set(sendResponseNotNext, __FUNCTION__, __LINE__);
+    return false;
+  }
+
+  if ((index < 0) || (index >= owner->_batchCount - owner->_batchFirst)) {
+    owner->_fault.set(batchIndexInvalid, __FUNCTION__, __LINE__, index);
+    return false;
+  }
+
+  pluton::serviceRequestImpl* M = owner->_batchRequests[owner->_batchFirst + index];
+  M->setFault(fc, faultText ? faultText : "");
+  M->setResponseData(responsePtr, responseLength);
+
+  return answerBatchMember(owner, owner->_batchFirst + index, M, 0);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Assemble the response packet for one member. The member responses
+// are copied as the caller's data need not outlive this call. Once
+// the last member is answered the batch response goes back to the
+// client in one write.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::serviceImpl::answerBatchMember(pluton::perCallerService* owner, int ix,
+				       const requestImpl* M, unsigned int timeoutSecs)
+{
+  if ((ix < 0) || (ix >= owner->_batchCount) || !owner->_batchResponses[ix].empty()) {
+    owner->_fault.set(batchIndexInvalid, __FUNCTION__, __LINE__, ix);
+    return false;
+  }
+
+  const char* resP;
+  int resL;
+  M->getResponseData(resP, resL);
+
+  std::string& memberOut = owner->_batchResponses[ix];
+  netStringGenerate memberPre(memberOut);	// Generate directly into the member string
+  netStringGenerate memberPost;
+  M->assembleResponsePacket(owner->_name, memberPre, memberPost, true, false);
+  if (resL > 0) memberOut.append(resP, resL);
+  memberOut.append(memberPost.data(), memberPost.length());
+
+  if (++owner->_batchAnswered < owner->_batchCount) {
+    owner->_state = (owner->_batchCurrent < 0) ?
+      pluton::perCallerService::canSendResponse : pluton::perCallerService::canGetRequest;
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // All members are answered - send the batch response.
+  //////////////////////////////////////////////////////////////////////
+
+  owner->_batchCount = owner->_batchNext = 0;
+  if (owner->_traceID) gettimeofday(&owner->_responseStartTime, 0);
+
+  int writeBytes = 0;
+  if (!owner->_noWaitFlag) {
+    int totalLength = 0;
+    for (unsigned int jx=0; jx < owner->_batchResponses.size(); ++jx) {
+      totalLength += owner->_batchResponses[jx].length() + 12;
+    }
+
+    netStringGenerate packetOut;
+    packetOut.setBinaryFraming(M->getBinaryFraming());	// Members all come from the one client
+    packetOut.reserve(totalLength + owner->_batchClientName.length() + owner->_name.length() + 30);
+    packetOut.append(pluton::batchResponsePT);
+    packetOut.append(pluton::requestIDNT, owner->_batchRequestID);
+    if (!owner->_batchClientName.empty()) {
+      packetOut.append(pluton::clientIDNT, owner->_batchClientName);
+    }
+    packetOut.append(pluton::serviceIDNT, owner->_name);
+    for (unsigned int jx=0; jx < owner->_batchResponses.size(); ++jx) {
+      packetOut.append(pluton::batchMemberNT, owner->_batchResponses[jx]);
+    }
+    packetOut.appendNL(pluton::endPacketNT);
+
+    if (!_recorderPrefix.empty()) recordPacketOut(owner, packetOut.data(), packetOut.length());
+
+    writeBytes = writeResponsePacket(owner, packetOut.data(), packetOut.length(), 0, 0, 0, 0,
+				     timeoutSecs, _packetTraceFlag ? 2 : -1);
+    if (_debugFlag) std::clog << "SIDebug: batch writeResponsePacket=" << writeBytes
+			      << " errno=" << errno << std::endl;
+
+    if ((writeBytes == -1) && (errno != EPIPE)) {
+      owner->_fault.set(socketWriteFailed, __FUNCTION__, __LINE__, 0, errno);
+      closeConnection(owner);
+      owner->_state = pluton::perCallerService::mustShutdown;
+      _shmService.setProcessExitReason(processExit::lostIO);
+      return false;
+    }
+
+    closeConnection(owner, true);
+  }
+
+  owner->_state = pluton::perCallerService::canGetRequest;
+  stopResponseTimer(owner, reportingChannel::ok, owner->_batchRequestLength,
+		    writeBytes > 0 ? writeBytes : 0, owner->_batchFunction);
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// This routine does most of the work to establish an inbound
+// connection. It is in a separate routine so the parent can easily
+// iterate on non-fatal errors.
+//
+// Accept the next connection from the acceptSocket if such a socket
+// is open. If a socket is already open due to a previous keepAffinity
+// request or non-manager mode, do nothing.
+//
+// Return: 0 no connection
+//	   <0 no connection, unexpect serviceImpl error _fault set
+//	   >0 have connection
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceImpl::getOneConnection(pluton::perCallerService* owner, unsigned int timeoutSecs)
+{
+  if (_debugFlag) std::clog << "SIDebug: getOneConnection mode=" << _mode
+		       << " _affinity=" << owner->_affinityFlag << std::endl;
+
+  if ((_mode == acceptMode) || (_mode == managerMode)) {
+    if (!owner->_affinityFlag) {
+      if (_mode == managerMode) _shmService.setProcessAcceptingRequests(true, owner->_myTid);
+      int sock = acceptConnection(owner, timeoutSecs);
+      if (_mode == managerMode) _shmService.setProcessAcceptingRequests(false, owner->_myTid);
+      if (sock == -1) return -1;			// Unrecoverable
+      if (sock == -2) return 0;				// Timeout
+      owner->_sockIn = owner->_sockOut = sock;
+    }
+  }
+  else {
+    owner->_sockIn = FAUX_STDIN;
+    owner->_sockOut = FAUX_STDOUT;
+  }
+
+  return 1;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Use select to check for accept. There is a timing window between
+// the select and the accept where another service could have grabbed
+// the connection. In this case we will block and if an attempt by the
+// manager to signal us occurs then, then we will ultimately
+// abnormally terminate as we will stay blocked until the Manager
+// SIGINTs us.
+//////////////////////////////////////////////////////////////////////
+
+#ifdef __linux__
+int
+pluton::serviceImpl::linuxAccept(int acceptFD, struct sockaddr *sa, socklen_t *salen)
+{
+  while (true) {
+    fd_set fds;
+    FD_ZERO(&fds);
+    struct timeval tv;
+    tv.tv_sec = 10;
+    tv.tv_usec = 0;
+    FD_SET(acceptFD, &fds);
+    int res = select(acceptFD+1, &fds, 0, 0, &tv);
+    if (_debugFlag) std::clog << "SIDebug: select=" << res << " errno=" << errno << std::endl;
+
+    if (res < 0) return -1;
+    if (res == 1) break;
+  }
+
+  return accept(acceptFD, sa, salen);
+}
+#endif
+
+
+//////////////////////////////////////////////////////////////////////
+// Threads of a threaded service take turns on the accept socket so
+// that only one of them can be left blocked in accept() by another
+// process winning the connection. A closed fd does not wake up
+// threads blocked in accept(), so the turn-holder polls with a short
+// timeout to notice a shutdown request or the manager's SIGURG.
+//
+// The accept socket is shared with other processes so it cannot be
+// made non-blocking; there is the same timing window between poll()
+// and accept() as described for linuxAccept(). As with acceptEvent(),
+// accept() failing with EAGAIN or ECONNABORTED because another
+// process won the connection goes back to poll().
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceImpl::threadedAccept(struct sockaddr *sa, socklen_t *salen)
+{
+  scopedLock lock(&_acceptMutex);
+
+  while (true) {
+    if (_shutdownRequested) return -1;
+    if ((_mode == managerMode) && (staticAcceptFD == -1)) {
+      errno = EBADF;
+      return -1;
+    }
+
+    struct pollfd fds;
+    fds.fd = _acceptSocket;
+    fds.events = POLLIN;
+    fds.revents = 0;
+    int res = poll(&fds, 1, 1 * util::MILLISECOND);
+    if (_debugFlag) std::clog << "SIDebug: threaded poll=" << res << " errno=" << errno << std::endl;
+
+    if (res == 0) continue;
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+
+    int sock = accept(_acceptSocket, sa, salen);
+    if ((sock == -1)
+	&& ((errno == EINTR) || (errno == ECONNABORTED) || util::retryNonBlockIO(errno))) continue;
+
+    return sock;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+// Accept a new connection from the socket. If we're in manager mode,
+// we may get a signal from the manager telling us to check for a
+// shutdown request. The timeout only applies if a proxy Poll handler
 // has been registered. _fault is set on unexpected failure.
 //
 // If the caller has a SIGURG handler, wrap our signal handler around
@@ -822,6 +1465,9 @@ pluton::serviceImpl::acceptConnection(pluton::perCallerService* owner, unsigned
       return -2;
     }
   }
+  else if (_threadedFlag) {
+    sock = threadedAccept(&sa, &salen);
+  }
   else {
 
     //////////////////////////////////////////////////////////////////////
@@ -859,6 +1505,11 @@ pluton::serviceImpl::acceptConnection(pluton::perCallerService* owner, unsigned
     return sock;
   }
 
+  if (_shutdownRequested) {
+    if (_debugFlag) std::clog << "SIDebug: accept=-1 shutdown requested" << std::endl;
+    return -1;					// Not a fault
+  }
+
   //////////////////////////////////////////////////////////////////////
   // Accept failed, complain if it wasn't a signal from the manager.
   //////////////////////////////////////////////////////////////////////
@@ -897,7 +1548,7 @@ pluton::serviceImpl::acceptConnection(pluton::perCallerService* owner, unsigned
 
 bool
 pluton::serviceImpl::sendResponse(pluton::perCallerService* owner,
-				  const requestImpl* R, unsigned int timeoutSecs)
+				  requestImpl* R, unsigned int timeoutSecs)
 {
   owner->_fault.clear("pluton::service::sendResponse");
   if (owner->_state != pluton::perCallerService::canSendResponse) {
@@ -905,6 +1556,62 @@ pluton::serviceImpl::sendResponse(pluton::perCallerService* owner,
     return false;
   }
 
+  //////////////////////////////////////////////////////////////////////
+  // Response data from a file must all be there before anything is
+  // written as the length goes out ahead of the data.
+  //////////////////////////////////////////////////////////////////////
+
+  if (R->getResponseFileFD() != -1) {
+    struct stat sb;
+    if ((fstat(R->getResponseFileFD(), &sb) == -1) || !S_ISREG(sb.st_mode)
+	|| (R->getResponseFileOffset() < 0)
+	|| (R->getResponseFileOffset() + R->getResponseDataLength() > sb.st_size)) {
+      owner->_fault.set(sendFileFailed, __FUNCTION__, __LINE__, 0, errno);
+      return false;
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // Scattered response data is only written as is. Everything else
+  // wants it contiguous. A recording of file data only holds a
+  // reference to the file so that is not read in.
+  //////////////////////////////////////////////////////////////////////
+
+  if (!owner->_responseParts.empty() || (owner->_batchCount > 0)
+      || (!_recorderPrefix.empty() && (R->getResponseFileFD() == -1))) {
+    if (!R->gatherResponseData()) {
+      owner->_fault.set(sendFileFailed, __FUNCTION__, __LINE__, 0, errno);
+      return false;
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // Parts that were held back by sendResponsePart() go ahead of the
+  // final data as one whole response. A fault replaces them.
+  //////////////////////////////////////////////////////////////////////
+
+  if (!owner->_responseParts.empty() && (R->getFaultCode() == pluton::noFault)) {
+    const char* finalP;
+    int finalL;
+    R->getResponseData(finalP, finalL);
+    owner->_responseParts.append(finalP, finalL);
+    R->setResponseData(owner->_responseParts);
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // A member of a batch is answered as part of the batch response.
+  //////////////////////////////////////////////////////////////////////
+
+  if (owner->_batchCount > 0) {
+    if (owner->_batchCurrent < 0) {		// Batch came from getRequestBatch()
+      owner->_fault.set(sendResponseNotNext, __FUNCTION__, __LINE__);
+      return false;
+    }
+    return answerBatchMember(owner, owner->_batchCurrent, R, timeoutSecs);
+  }
+
+  if (owner->_traceID && !owner->_responsePartsSent) gettimeofday(&owner->_responseStartTime, 0);
+
   //////////////////////////////////////////////////////////////////////
   // If the client didn't stick around, short-cut the response
   // processing.
@@ -920,28 +1627,125 @@ pluton::serviceImpl::sendResponse(pluton::perCallerService* owner,
 
   //////////////////////////////////////////////////////////////////////
   // Assemble as a three-part writev to avoid copying the response
-  // data set by the caller.
+  // data set by the caller, or more if the caller's data is
+  // scattered.
+  //////////////////////////////////////////////////////////////////////
+
+  const std::vector<struct iovec>& resIOV = R->getResponseIOV();
+  int fileFD = R->getResponseFileFD();
+  const char* resP = 0;
+  int resL = R->getResponseDataLength();
+  if (resIOV.empty() && (fileFD == -1)) R->getResponseData(resP, resL);
+
+  //////////////////////////////////////////////////////////////////////
+  // If the client said it accepts large responses as a memfd, pass
+  // the response data that way. Recording and packet tracing want to
+  // see the data, so they keep it inline. So does the end of a
+  // response sent in parts as the memfd must go with the first bytes.
+  //////////////////////////////////////////////////////////////////////
+
+  int memfd = -1;
+  unsigned int memfdThreshold = R->getMemfdAcceptThreshold();
+  if ((memfdThreshold > 0) && (resL > 0) && ((unsigned) resL >= memfdThreshold)
+      && (_mode != fauxSTDIOMode) && _recorderPrefix.empty() && !_packetTraceFlag
+      && !owner->_responsePartsSent && (fileFD == -1)) {
+    if (resIOV.empty()) {
+      memfd = pluton::memfdPayload::create(resP, resL);
+    }
+    else {
+      memfd = pluton::memfdPayload::create(&resIOV[0], resIOV.size());
+    }
+  }
+
   //////////////////////////////////////////////////////////////////////
+  // Otherwise compress the response data if the client accepts
+  // compressed data of this size. Data that does not shrink goes as
+  // is.
+  //////////////////////////////////////////////////////////////////////
+
+  std::string compressed;
+  int compressedLength = -1;
+  char algorithm = R->getCompressAcceptAlgorithm();
+  if (algorithm && (resL > 0) && ((unsigned) resL >= R->getCompressAcceptThreshold())
+      && (memfd == -1) && (fileFD == -1) && !owner->_responsePartsSent) {
+    bool ok;
+    if (resIOV.empty()) {
+      struct iovec vec;
+      vec.iov_base = const_cast<char*>(resP);
+      vec.iov_len = resL;
+      ok = pluton::payloadCompressor::compress(algorithm, &vec, 1, compressed,
+					       owner->_compression);
+    }
+    else {
+      ok = pluton::payloadCompressor::compress(algorithm, &resIOV[0], resIOV.size(), compressed,
+					       owner->_compression);
+    }
+    if (ok) compressedLength = compressed.length();
+  }
 
   netStringGenerate packetOutPre;
   netStringGenerate packetOutPost;
-  R->assembleResponsePacket(owner->_name, packetOutPre, packetOutPost);
+  R->assembleResponsePacket(owner->_name, packetOutPre, packetOutPost, true, memfd != -1,
+			    owner->_responsePartsSent, compressedLength);
 
-  const char* resP;
-  int resL;
-  R->getResponseData(resP, resL);
   if (!_recorderPrefix.empty()) {
-    recordPacketOut(packetOutPre.data(), packetOutPre.length(),
-		    resP, resL,
-		    packetOutPost.data(), packetOutPost.length());
+    if (fileFD == -1) {
+      recordPacketOut(owner, packetOutPre.data(), packetOutPre.length(),
+		      compressedLength >= 0 ? compressed.data() : resP,
+		      compressedLength >= 0 ? compressedLength : resL,
+		      packetOutPost.data(), packetOutPost.length());
+    }
+    else {
+      recordFileReference(owner, R);
+    }
   }
 
-  int writeBytes = writeResponsePacket(owner,
-				       packetOutPre.data(), packetOutPre.length(),
-				       resP, resL,
-				       packetOutPost.data(), packetOutPost.length(),
-				       timeoutSecs,
-				       _packetTraceFlag ? 2 : -1);
+  int writeBytes;
+  if (fileFD != -1) {
+    writeBytes = writeResponsePacket(owner, packetOutPre.data(), packetOutPre.length(),
+				     0, 0, 0, 0, timeoutSecs, _packetTraceFlag ? 2 : -1);
+    if (writeBytes > 0) {
+      int res = writeResponseFile(owner, fileFD, R->getResponseFileOffset(), resL, timeoutSecs);
+      if (res >= 0) {
+	writeBytes += res;
+	res = writeResponsePacket(owner, 0, 0, 0, 0,
+				  packetOutPost.data(), packetOutPost.length(),
+				  timeoutSecs, _packetTraceFlag ? 2 : -1);
+      }
+      writeBytes = (res < 0) ? res : writeBytes + res;
+    }
+  }
+  else if (compressedLength >= 0) {
+    writeBytes = writeResponsePacket(owner,
+				     packetOutPre.data(), packetOutPre.length(),
+				     compressed.data(), compressedLength,
+				     packetOutPost.data(), packetOutPost.length(),
+				     timeoutSecs,
+				     _packetTraceFlag ? 2 : -1);
+  }
+  else if (resIOV.empty() || (memfd != -1)) {
+    writeBytes = writeResponsePacket(owner,
+				     packetOutPre.data(), packetOutPre.length(),
+				     memfd == -1 ? resP : 0, resL,
+				     packetOutPost.data(), packetOutPost.length(),
+				     timeoutSecs,
+				     _packetTraceFlag ? 2 : -1, memfd);
+  }
+  else {
+    std::vector<struct iovec> iov;
+    iov.reserve(resIOV.size() + 2);
+    struct iovec vec;
+    vec.iov_base = const_cast<char*>(packetOutPre.data());
+    vec.iov_len = packetOutPre.length();
+    iov.push_back(vec);
+    iov.insert(iov.end(), resIOV.begin(), resIOV.end());
+    vec.iov_base = const_cast<char*>(packetOutPost.data());
+    vec.iov_len = packetOutPost.length();
+    iov.push_back(vec);
+    writeBytes = writeResponseIOV(owner, &iov[0], iov.size(), timeoutSecs,
+				  _packetTraceFlag ? 2 : -1);
+  }
+  if (memfd != -1) close(memfd);
 
   //////////////////////////////////////////////////////////////////////
   // It's pretty hard to determine the reason for a failed write as
@@ -966,13 +1770,424 @@ pluton::serviceImpl::sendResponse(pluton::perCallerService* owner,
 
   stopResponseTimer(owner, R->getFaultCode() == pluton::noFault ?
 		    reportingChannel::ok : reportingChannel::fault,
-		    R->getRequestDataLength(), R->getResponseDataLength(),
+		    R->getRequestDataLength(),
+		    R->getResponseDataLength()
+		    + (owner->_responsePartsSent ? owner->_responsePartBytes : 0),
 		    R->getServiceFunction());
 
   return true;
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Send part of the response data ahead of the rest. If the client
+// said it accepts parts, each part is written straight away as a
+// responsePartNT, with the first one preceded by the netStrings that
+// identify the response. sendResponse() then completes the response
+// as usual.
+//
+// The parts are held back and go with the final data as one whole
+// response if the client cannot take parts, if the request is a
+// batch member or if responses are being recorded, as a recording
+// holds whole packets.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::serviceImpl::sendResponsePart(pluton::perCallerService* owner, requestImpl* R,
+				      const char* partPtr, int partLength, unsigned int timeoutSecs)
+{
+  owner->_fault.clear("pluton::service::sendResponsePart");
+  if ((owner->_state != pluton::perCallerService::canSendResponse)
+      || ((owner->_batchCount > 0) && (owner->_batchCurrent < 0))) {
+    owner->_fault.set(sendResponseNotNext, __FUNCTION__, __LINE__);
+    return false;
+  }
+
+  if (owner->_noWaitFlag || (partLength <= 0)) return true;
+
+  owner->_responsePartBytes += partLength;
+
+  if (!R->getResponsePartAccept() || (owner->_batchCount > 0) || !_recorderPrefix.empty()) {
+    owner->_responseParts.append(partPtr, partLength);
+    return true;
+  }
+
+  if (owner->_traceID && !owner->_responsePartsSent) {
+    gettimeofday(&owner->_responseStartTime, 0);
+  }
+
+  netStringGenerate packetOutPre;
+  netStringGenerate packetOutPost;
+  R->assembleResponsePart(owner->_name, packetOutPre, packetOutPost, partLength,
+			  !owner->_responsePartsSent);
+  owner->_responsePartsSent = true;
+
+  // A binary framed part has no terminator, and an empty iovec would
+  // look like a failed write.
+
+  int writeBytes = writeResponsePacket(owner,
+				       packetOutPre.data(), packetOutPre.length(),
+				       partPtr, partLength,
+				       packetOutPost.length() > 0 ? packetOutPost.data() : 0,
+				       packetOutPost.length(),
+				       timeoutSecs, _packetTraceFlag ? 2 : -1);
+
+  if (_debugFlag) std::clog << "SIDebug: part writeResponsePacket=" << writeBytes
+			    << " errno=" << errno << std::endl;
+
+  if ((writeBytes == -1) && (errno != EPIPE)) {		// As for sendResponse()
+    owner->_fault.set(socketWriteFailed, __FUNCTION__, __LINE__, 0, errno);
+    closeConnection(owner);
+    owner->_state = pluton::perCallerService::mustShutdown;
+    _shmService.setProcessExitReason(processExit::lostIO);
+    return false;
+  }
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Event-driven primitives used by pluton::serviceEvent. None of these
+// block; the caller is responsible for only calling them when the
+// relevant fd is ready. Each owner is one connection.
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Return false once the service should stop taking on new
+// connections. Existing connections are allowed to complete.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::serviceImpl::acceptingEvents()
+{
+  if (_shutdownRequested) return false;
+  if (_mode != managerMode) return true;
+
+  if (staticAcceptFD == -1) {
+    if (_debugFlag) std::clog << "SIDebug: acceptingEvents Manager shutdown" << std::endl;
+    _shmService.setProcessExitReason(_shmService.getProcessShutdownRequest());
+    _shutdownRequested = true;
+    return false;
+  }
+
+  if ((_maximumRequests > 0) && (_requestCount >= _maximumRequests)) {
+    if (_debugFlag) std::clog << "SIDebug: acceptingEvents no more" << std::endl;
+    _shmService.setProcessExitReason(processExit::maxRequests);
+    _shutdownRequested = true;
+    return false;
+  }
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The accept socket is readable. As with threadedAccept() the socket
+// is shared with other processes so it cannot be made non-blocking;
+// poll() first so that a spurious event costs nothing. Should another
+// process win the connection, accept() failing with EAGAIN or
+// ECONNABORTED sends the caller back to its poll().
+//
+// Return: -2 no connection
+//	   -1 stop accepting, _fault set if unexpected
+//	   otherwise the accepted socket
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceImpl::acceptEvent(pluton::perCallerService* owner)
+{
+  owner->_fault.clear("pluton::serviceEvent::acceptEvent");
+
+  if (!acceptingEvents()) return -1;
+
+  struct pollfd fds;
+  fds.fd = _acceptSocket;
+  fds.events = POLLIN;
+  fds.revents = 0;
+  int res = poll(&fds, 1, 0);
+  if ((res == 0) || ((res < 0) && (errno == EINTR))) return -2;
+
+  struct sockaddr sa;
+  socklen_t salen = sizeof(sa);
+  int sock = -1;
+  if (res == 1) sock = accept(_acceptSocket, &sa, &salen);
+  if (_debugFlag) std::clog << "SIDebug: acceptEvent=" << sock << " errno=" << errno << std::endl;
+
+  if (sock != -1) {
+    util::setNonBlocking(sock);
+    return sock;
+  }
+
+  if ((errno == EINTR) || (errno == ECONNABORTED) || util::retryNonBlockIO(errno)) return -2;
+
+  if ((_mode == managerMode) && (errno == EBADF) && (staticAcceptFD == -1)) {
+    acceptingEvents();					// Sets the exit reason
+    return -1;
+  }
+
+  owner->_fault.set(acceptFailed, __FUNCTION__, __LINE__, 0, errno);
+  if (_mode == managerMode) _shmService.setProcessExitReason(processExit::acceptFailed);
+  _shutdownRequested = true;
+
+  return -1;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Prepare a connection to read its next request.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::serviceImpl::startEventRequest(pluton::perCallerService* owner, requestImpl* R)
+{
+  R->resetRequestValues();
+  R->resetResponseValues();
+  R->setFault(pluton::noFault);
+  startResponseTimer(owner);
+  startRequestPacket(owner, R);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The connection is readable. Read what is on offer and decode it.
+//
+// Return: 0 need more
+//	   <0 connection closed, _fault set if unexpected
+//	   >0 have request
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceImpl::readEvent(pluton::perCallerService* owner, requestImpl* R)
+{
+  owner->_fault.clear("pluton::serviceEvent::readEvent");
+
+  char* bufPtr;
+  int minRequired, maxAllowed;
+  int bytesRead = -1;
+  if (owner->_packetIn.getReadParameters(bufPtr, minRequired, maxAllowed) == -1) {
+    owner->_fault.set(netStringTooLarge, __FUNCTION__, __LINE__, maxAllowed);
+  }
+  else {
+    if (_mode == fauxSTDIOMode) {
+      bytesRead = read(owner->_sockIn, bufPtr, maxAllowed);
+    }
+    else {
+      bytesRead = pluton::memfdPayload::recvWithFD(owner->_sockIn, bufPtr, maxAllowed,
+						   owner->_passedFD);
+    }
+    if (_debugFlag) std::clog << "SIDebug: readEvent=" << owner->_sockIn
+			      << " readres=" << bytesRead << " errno=" << errno << std::endl;
+
+    if ((bytesRead < 0) && util::retryNonBlockIO(errno)) return 0;
+    if (bytesRead < 0) owner->_fault.set(socketReadFailed, __FUNCTION__, __LINE__,
+					  maxAllowed, errno);
+  }
+
+  int res = -1;
+  if (bytesRead > 0) {
+    if (_packetTraceFlag) write(2, bufPtr, bytesRead);
+    owner->_packetIn.addBytesRead(bytesRead);
+    res = decodeRequestPacket(owner, R);
+    if (res == 0) return 0;
+    if (res > 0) {
+      haveRequest(owner, R);
+      return 1;
+    }
+  }
+
+  finishRequestPacket(owner);
+  stopResponseTimer(owner, reportingChannel::readError, 0, 0, "");
+  closeConnection(owner);
+
+  return -1;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Send as much of the response as the socket will take. Whatever is
+// left over is copied to pendingOut for writeEvent().
+//
+// Return: 0 response pending in pendingOut
+//	   <0 connection closed, _fault set if unexpected
+//	   >0 response sent
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceImpl::sendResponseEvent(pluton::perCallerService* owner, const requestImpl* R,
+				       std::string& pendingOut)
+{
+  owner->_fault.clear("pluton::serviceEvent::sendResponse");
+  if (owner->_state != pluton::perCallerService::canSendResponse) {
+    owner->_fault.set(sendResponseNotNext, __FUNCTION__, __LINE__);
+    return -1;
+  }
+
+  if (owner->_traceID) gettimeofday(&owner->_responseStartTime, 0);
+
+  if (owner->_noWaitFlag) {
+    finishResponseEvent(owner, R);
+    return 1;
+  }
+
+  const char* resP;
+  int resL;
+  R->getResponseData(resP, resL);
+
+  netStringGenerate packetOutPre;
+  netStringGenerate packetOutPost;
+  R->assembleResponsePacket(owner->_name, packetOutPre, packetOutPost, true);
+
+  if (!_recorderPrefix.empty()) {
+    recordPacketOut(owner, packetOutPre.data(), packetOutPre.length(),
+		    resP, resL,
+		    packetOutPost.data(), packetOutPost.length());
+  }
+
+  struct iovec iov[3];
+  iov[0].iov_base = (char*) packetOutPre.data();
+  iov[0].iov_len = packetOutPre.length();
+  iov[1].iov_base = (char*) resP;
+  iov[1].iov_len = resL;
+  iov[2].iov_base = (char*) packetOutPost.data();
+  iov[2].iov_len = packetOutPost.length();
+  int total = packetOutPre.length() + resL + packetOutPost.length();
+
+  if (_packetTraceFlag) {
+    write(2, "PktOut: ", 8);
+    writev(2, iov, 3);
+  }
+
+  int res = writev(owner->_sockOut, iov, 3);
+  if (_debugFlag) std::clog << "SIDebug: sendResponseEvent=" << res
+			    << " of " << total << " errno=" << errno << std::endl;
+
+  if (res == total) {
+    finishResponseEvent(owner, R);
+    return 1;
+  }
+
+  if ((res < 0) && !util::retryNonBlockIO(errno)) return writeFailedEvent(owner, R);
+
+  //////////////////////////////////////////////////////////////////////
+  // Keep the unwritten remainder for when the socket is writable.
+  //////////////////////////////////////////////////////////////////////
+
+  if (res < 0) res = 0;
+  pendingOut.erase();
+  pendingOut.reserve(total - res);
+  for (int ix=0; ix < 3; ++ix) {
+    int sub = std::min(res, (int) iov[ix].iov_len);
+    pendingOut.append(static_cast<const char*>(iov[ix].iov_base) + sub, iov[ix].iov_len - sub);
+    res -= sub;
+  }
+
+  return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The connection is writable. Return values are as for
+// sendResponseEvent().
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceImpl::writeEvent(pluton::perCallerService* owner, const requestImpl* R,
+				std::string& pendingOut)
+{
+  owner->_fault.clear("pluton::serviceEvent::writeEvent");
+
+  int res = write(owner->_sockOut, pendingOut.data(), pendingOut.length());
+  if (_debugFlag) std::clog << "SIDebug: writeEvent=" << res
+			    << " of " << pendingOut.length() << " errno=" << errno << std::endl;
+
+  if (res < 0) {
+    if (util::retryNonBlockIO(errno)) return 0;
+    return writeFailedEvent(owner, R);
+  }
+
+  pendingOut.erase(0, res);
+  if (!pendingOut.empty()) return 0;
+
+  finishResponseEvent(owner, R);
+
+  return 1;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The response is complete. An affinity connection remains open for
+// the next request.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::serviceImpl::finishResponseEvent(pluton::perCallerService* owner, const requestImpl* R)
+{
+  closeConnection(owner, true);
+  owner->_state = pluton::perCallerService::canGetRequest;
+
+  stopResponseTimer(owner, R->getFaultCode() == pluton::noFault ?
+		    reportingChannel::ok : reportingChannel::fault,
+		    R->getRequestDataLength(), R->getResponseDataLength(),
+		    R->getServiceFunction());
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// As with sendResponse(), EPIPE is taken to be the client going away
+// and anything else is a fault. Unlike sendResponse() the fault only
+// costs this connection as other connections may be fine.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceImpl::writeFailedEvent(pluton::perCallerService* owner, const requestImpl* R)
+{
+  if (errno != EPIPE) owner->_fault.set(socketWriteFailed, __FUNCTION__, __LINE__, 0, errno);
+
+  return abortEvent(owner, R, reportingChannel::writeError);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Abandon the connection - typically due to a timeout.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::serviceImpl::abortEvent(pluton::perCallerService* owner, const requestImpl* R,
+				reportingChannel::reportReason rr)
+{
+  finishRequestPacket(owner);
+  closeConnection(owner);
+  owner->_state = pluton::perCallerService::canGetRequest;
+  stopResponseTimer(owner, rr, R->getRequestDataLength(), 0, R->getServiceFunction());
+
+  return -1;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// serviceEvent reports each change in the number of requests in
+// flight. The time since the previous change is active time if any
+// were in flight, so the process is never more than 100% active and
+// a long busy spell is reported as it goes rather than at its end.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::serviceImpl::setEventsInFlight(int inFlight)
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+
+  if ((_eventsInFlight > 0) && (_mode == managerMode)) {
+    _shmService.addProcessActiveuSecs(util::timevalDiffuS(now, _eventsActiveSince));
+  }
+  _eventsInFlight = inFlight;
+  _eventsActiveSince = now;
+
+  if (_mode == managerMode) _shmService.setProcessActiveCount(inFlight);
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // A tools-only interface for sending a raw packet back instead of
 // having the service assemble it from a request. This method is only
@@ -992,7 +2207,7 @@ pluton::serviceImpl::sendRawResponse(pluton::perCallerService* owner,
     return false;
   }
 
-  if (!_recorderPrefix.empty()) recordPacketOut(p, l);
+  if (!_recorderPrefix.empty()) recordPacketOut(owner, p, l);
 
   int writeBytes = writeResponsePacket(owner,
 				       p, l,		// Data one
@@ -1039,6 +2254,11 @@ pluton::serviceImpl::closeConnection(pluton::perCallerService* owner, bool canKe
     owner->_sockIn = owner->_sockOut = -1;
   }
 
+  if (owner->_passedFD != -1) {
+    close(owner->_passedFD);
+    owner->_passedFD = -1;
+  }
+
   owner->_affinityFlag = false;
 }
 
@@ -1070,6 +2290,7 @@ pluton::serviceImpl::terminate()
 void
 pluton::serviceImpl::notifyManager()
 {
+  scopedLock lock(&_mutex);
   sendReports(true);
 }
 
@@ -1091,6 +2312,9 @@ pluton::serviceImpl::sendReports(bool forceWriteFlag)
       _reportingSocket = -1;
     }
     _evRequests.U.pd.entries = 0;
+    _evRequests.U.pd.uncompressedBytes = 0;
+    _evRequests.U.pd.compressedBytes = 0;
+    _evRequests.U.pd.compressionMicroSeconds = 0;
   }
 }
 
@@ -1158,7 +2382,14 @@ pluton::serviceImpl::handleRead(pluton::perCallerService* owner, unsigned int re
   // Read is indicated - slurp in as much as the netString allows.
   //////////////////////////////////////////////////////////////////////
 
-  int bytesRead = read(owner->_sockIn, bufPtr, maxAllowed);
+  int bytesRead;
+  if (_mode == fauxSTDIOMode) {
+    bytesRead = read(owner->_sockIn, bufPtr, maxAllowed);
+  }
+  else {						// Request data may be in a memfd
+    bytesRead = pluton::memfdPayload::recvWithFD(owner->_sockIn, bufPtr, maxAllowed,
+						 owner->_passedFD);
+  }
 
   if (_debugFlag) std::clog << "SIDebug: read=" << owner->_sockIn
 		       << " maxAllowed=" << maxAllowed
@@ -1216,39 +2447,117 @@ writeRecord(const char* fname,
 //
 // Recording of inbound has to be done piece-meal because that's the
 // way it is parsed in. This routine opens the file for recording the
-// inbound packet and returns the fd for subsequent writes.
+// inbound packet and sets the fd for subsequent writes.
+//
+// With a recorder ring, the inbound packet is instead collected in
+// memory and written to the ring along with the response, so there
+// are no system calls at all.
 //////////////////////////////////////////////////////////////////////
 
-int
-pluton::serviceImpl::recordPacketInStart()
+void
+pluton::serviceImpl::recordPacketInStart(pluton::perCallerService* owner)
 {
-  ++_recorderIndex;
-  if (_recorderCycle > 0) _recorderIndex %= _recorderCycle;
+  if (_recorderRing.isOpen()) {
+    owner->_recordedRequest.erase();
+    owner->_recordingIn = true;
+    return;
+  }
+
+  {
+    scopedLock lock(&_mutex);
+    ++_recorderIndex;
+    if (_recorderCycle > 0) _recorderIndex %= _recorderCycle;
+    owner->_recorderIndex = _recorderIndex;
+  }
 
   std::ostringstream os;
   os << _recorderPrefix << "in."
      << _myPid << "."
-     << std::setw(5) << std::setfill('0') << _recorderIndex;
+     << std::setw(5) << std::setfill('0') << owner->_recorderIndex;
   std::string fname = os.str();
 
-  return open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0640);
+  owner->_recorderFD = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0640);
+  owner->_recordingIn = (owner->_recorderFD != -1);
 }
 
 void
-pluton::serviceImpl::recordPacketOut(const char* firstPtr, int firstLen,
+pluton::serviceImpl::recordPacketIn(pluton::perCallerService* owner, const char* p, int len)
+{
+  if (_recorderRing.isOpen()) {
+    owner->_recordedRequest.append(p, len);
+  }
+  else {
+    write(owner->_recorderFD, p, len);
+  }
+}
+
+void
+pluton::serviceImpl::recordPacketOut(pluton::perCallerService* owner,
+				     const char* firstPtr, int firstLen,
 				     const char* middlePtr, int middleLen,
 				     const char* lastPtr, int lastLen)
 {
+  if (_recorderRing.isOpen()) {
+    struct timeval now;
+    gettimeofday(&now, 0);
+    if (_slowRequestFilter.enabled()) {
+      scopedLock lock(&_mutex);
+      if (!_slowRequestFilter.isSlow(util::timevalDiffuS(now, owner->_requestStartTime))) return;
+    }
+    _recorderRing.record(owner->_requestStartTime, now, owner->_recordedRequest,
+			 firstPtr, firstLen, middlePtr, middleLen, lastPtr, lastLen);
+    return;
+  }
+
   std::ostringstream os;
   os << _recorderPrefix << "out."
      << _myPid << "."
-     << std::setw(5) << std::setfill('0') << _recorderIndex;
+     << std::setw(5) << std::setfill('0') << owner->_recorderIndex;
   std::string fname = os.str();
 
   writeRecord(fname.c_str(), firstPtr, firstLen, middlePtr, middleLen, lastPtr, lastLen);
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Response data sent from a file is recorded as a reference to the
+// file rather than a copy of what could be a very large amount of
+// data. The reference replaces the data in an otherwise normal
+// response packet.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::serviceImpl::recordFileReference(pluton::perCallerService* owner, requestImpl* R)
+{
+  int fd = R->getResponseFileFD();
+  off_t offset = R->getResponseFileOffset();
+  int length = R->getResponseDataLength();
+
+  std::ostringstream os;
+  char path[PATH_MAX];
+  std::ostringstream procPath;
+  procPath << "/proc/self/fd/" << fd;
+  int res = readlink(procPath.str().c_str(), path, sizeof(path) - 1);
+  if (res > 0) {
+    os << "file=" << std::string(path, res);
+  }
+  else {
+    os << "fd=" << fd;
+  }
+  os << " offset=" << offset << " length=" << length;
+
+  std::string reference = os.str();
+  R->setResponseData(reference);
+  netStringGenerate refPre;
+  netStringGenerate refPost;
+  R->assembleResponsePacket(owner->_name, refPre, refPost, true, false, owner->_responsePartsSent);
+  R->setResponseFile(fd, offset, length);
+
+  recordPacketOut(owner, refPre.data(), refPre.length(), reference.data(), reference.length(),
+		  refPost.data(), refPost.length());
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // perCallerService manages state unique to parallel service
 // handlers. It only applies to tools built with the rest of pluton
@@ -1258,7 +2567,13 @@ pluton::serviceImpl::recordPacketOut(const char* firstPtr, int firstLen,
 pluton::perCallerService::perCallerService(const char* setName, int threadID)
   : _state(canGetRequest),
     _noWaitFlag(false), _affinityFlag(false),
-    _sockIn(-1), _sockOut(-1), _myTid(threadID), _packetIn(16 * 1024)
+    _sockIn(-1), _sockOut(-1), _myTid(threadID), _passedFD(-1), _recorderIndex(0), _recorderFD(-1),
+    _recordingIn(false),
+    _packetIn(16 * 1024),
+    _traceID(0), _traceSpanID(0), _traceParentID(0),
+    _batchCount(0), _batchNext(0), _batchCurrent(0), _batchFirst(0), _batchAnswered(0),
+    _batchRequestLength(0), _batchRequestID(0),
+    _responsePartsSent(false), _responsePartBytes(0), _compression()
 {
   util::IA ia;
   _name = setName;
@@ -1273,9 +2588,24 @@ pluton::perCallerService::perCallerService(const char* setName, int threadID)
 
 pluton::perCallerService::~perCallerService()
 {
+  if (_passedFD != -1) close(_passedFD);
+  if (_recorderFD != -1) close(_recorderFD);
+
+  for (unsigned int ix=0; ix < _batchRequests.size(); ++ix) delete _batchRequests[ix];
 }
 
 void
 pluton::perCallerService::initialize()
 {
 }
+
+// Held parts may be large, so give the memory back rather than keep
+// the capacity for the next request.
+
+void
+pluton::perCallerService::resetResponseParts()
+{
+  _responsePartsSent = false;
+  _responsePartBytes = 0;
+  if (!_responseParts.empty()) std::string().swap(_responseParts);
+}
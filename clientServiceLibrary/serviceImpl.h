@@ -32,20 +32,26 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define P_SERVICEIMPL_H 1
 
 #include <string>
+#include <vector>
 
+#include <pthread.h>
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "netString.h"
 
+#include "pluton/service.h"
 
 #include "global.h"
 #include "faultImpl.h"
 #include "decodePacket.h"
 #include "reportingChannel.h"
+#include "recorderRing.h"
 #include "requestImpl.h"
 #include "shmService.h"
+#include "slowRequestFilter.h"
+#include "stdintWrapper.h"
 
 namespace pluton {
 
@@ -68,6 +74,14 @@ namespace pluton {
     bool	initialize(pluton::perCallerService* owner, bool threadedFlag=false);
 
     int		getMaximumThreads() const { return _shmService.getMaximumThreads(); }
+    bool	inManagerMode() const { return _mode == managerMode; }
+    bool	inFauxSTDIOMode() const { return _mode == fauxSTDIOMode; }
+
+    bool	getSharedCache(const char* keyPtr, int keyLength, std::string& value) const
+    { return _shmService.getSharedCache(keyPtr, keyLength, value); }
+    bool	putSharedCache(const char* keyPtr, int keyLength,
+			       const char* valuePtr, int valueLength, unsigned int maxAgeMS)
+    { return _shmService.putSharedCache(keyPtr, keyLength, valuePtr, valueLength, maxAgeMS); }
 
     bool	getRequest(pluton::perCallerService* owner, pluton::requestImpl*,
 			   unsigned int acceptTimeoutSecs=0, unsigned int requestTimeoutSecs=0,
@@ -75,10 +89,44 @@ namespace pluton {
 
     int		getOneConnection(pluton::perCallerService* owner, unsigned int acceptTimeoutSecs);
 
-    bool	sendResponse(pluton::perCallerService* owner, const pluton::requestImpl*,
+    bool	sendResponse(pluton::perCallerService* owner, pluton::requestImpl*,
 			     unsigned int timeoutSecs=0);
+    bool	sendResponsePart(pluton::perCallerService* owner, pluton::requestImpl*,
+				 const char* partPtr, int partLength, unsigned int timeoutSecs=0);
     void	terminate();
 
+    int		getRequestBatch(pluton::perCallerService* owner, pluton::requestImpl*,
+				const pluton::batchRequest*& batch);
+    bool	sendBatchResponse(pluton::perCallerService* owner, pluton::requestImpl*,
+				  int index, pluton::faultCode, const char* faultText,
+				  const char* responsePtr, int responseLength);
+
+    //////////////////////////////////////////////////////////////////////
+    // Threaded services ask all threads to stop accepting new
+    // requests. Threads complete their current request first.
+    //////////////////////////////////////////////////////////////////////
+
+    void	requestShutdown() { _shutdownRequested = true; }
+    bool	shutdownRequested() const { return _shutdownRequested; }
+
+    //////////////////////////////////////////////////////////////////////
+    // Non-blocking primitives for pluton::serviceEvent. Each owner is
+    // one connection.
+    //////////////////////////////////////////////////////////////////////
+
+    int		getAcceptSocket() const { return _acceptSocket; }
+    bool	acceptingEvents();
+    int		acceptEvent(pluton::perCallerService* owner);
+    void	startEventRequest(pluton::perCallerService* owner, pluton::requestImpl*);
+    int		readEvent(pluton::perCallerService* owner, pluton::requestImpl*);
+    int		sendResponseEvent(pluton::perCallerService* owner, const pluton::requestImpl*,
+				  std::string& pendingOut);
+    int		writeEvent(pluton::perCallerService* owner, const pluton::requestImpl*,
+			   std::string& pendingOut);
+    int		abortEvent(pluton::perCallerService* owner, const pluton::requestImpl*,
+			   reportingChannel::reportReason);
+    void	setEventsInFlight(int inFlight);
+
     // Tools only
 
     bool	sendRawResponse(pluton::perCallerService* owner, int requestLength,
@@ -106,6 +154,15 @@ namespace pluton {
     pid_t	_myPid;
     int		_recorderIndex;
     int		_recorderCycle;
+    bool	_threadedFlag;
+    volatile bool	_shutdownRequested;
+
+    // Protects the counters, reports and recorder index when
+    // concurrent threads share this instance. Accepts are serialized
+    // separately.
+
+    pthread_mutex_t	_mutex;
+    pthread_mutex_t	_acceptMutex;
 
     reportingChannel::record	_evRequests;
     shmServiceHandler		_shmService;
@@ -115,6 +172,8 @@ namespace pluton {
     int		_affinityTimeout;
     int		_maximumRequests;
     std::string	_recorderPrefix;
+    pluton::recorderRing	_recorderRing;		// Only if recorder-slot-size is set
+    pluton::slowRequestFilter	_slowRequestFilter;	// Only record the slow ones
 
     // Counters transferred to shm so others can see them
 
@@ -122,6 +181,13 @@ namespace pluton {
     int		_responseCount;
     int		_faultCount;
 
+    // An event-driven service has many requests in flight on the one
+    // thread so its active time runs while any of them is in flight
+    // rather than being the sum of their durations.
+
+    int			_eventsInFlight;	// -1 if not event-driven
+    struct timeval	_eventsActiveSince;
+
     // Misc
 
     perCallerService*		_defaultOwner;		// These two are used by
@@ -141,17 +207,38 @@ namespace pluton {
 #ifdef __linux__
     int		linuxAccept(int acceptFD, struct sockaddr *sa, socklen_t *salen);
 #endif
+    int		threadedAccept(struct sockaddr *sa, socklen_t *salen);
     void	startResponseTimer(pluton::perCallerService* owner);
     void	stopResponseTimer(pluton::perCallerService* owner,
 				  reportingChannel::reportReason,
 				  int requestLength, int responseLength,
 				  const std::string& function);
+    void	startTrace(pluton::perCallerService* owner, pluton::requestImpl*);
+    void	recordTrace(pluton::perCallerService* owner);
 
     int		readRequestPacket(pluton::perCallerService* owner,
 				  requestImpl* R, unsigned int timeoutSecs);
+    void	startRequestPacket(pluton::perCallerService* owner, requestImpl* R);
+    int		decodeRequestPacket(pluton::perCallerService* owner, requestImpl* R);
+    void	finishRequestPacket(pluton::perCallerService* owner);
+    void	haveRequest(pluton::perCallerService* owner, requestImpl* R);
+    bool	acceptRequest(pluton::perCallerService* owner, requestImpl* R,
+			      unsigned int acceptTimeoutSecs, unsigned int requestTimeoutSecs,
+			      bool exposeClientErrors);
+    bool	startBatch(pluton::perCallerService* owner, requestImpl* R);
+    void	nextBatchMember(pluton::perCallerService* owner, requestImpl* R);
+    bool	answerBatchMember(pluton::perCallerService* owner, int ix, const requestImpl* M,
+				  unsigned int timeoutSecs);
+    void	finishResponseEvent(pluton::perCallerService* owner, const requestImpl* R);
+    int		writeFailedEvent(pluton::perCallerService* owner, const requestImpl* R);
     int		writeResponsePacket(pluton::perCallerService* owner,
 				    const char*, int, const char*, int, const char*, int,
-				    unsigned int timeoutSecs, int traceFD);
+				    unsigned int timeoutSecs, int traceFD, int passFD=-1);
+    int		writeResponseIOV(pluton::perCallerService* owner, struct iovec* iov, int iovCount,
+				 unsigned int timeoutSecs, int traceFD, int passFD=-1);
+    int		writeResponseFile(pluton::perCallerService* owner, int fd, off_t offset, int length,
+				  unsigned int timeoutSecs);
+    int		pollWritable(pluton::perCallerService* owner, unsigned int timeoutSecs);
 
     bool	handleRead(pluton::perCallerService* owner, unsigned int timeoutSecs);
     int		handleWrite(const char*, int);
@@ -159,8 +246,11 @@ namespace pluton {
     void	notifyManager();
     void	sendReports(bool forceWriteFlag=false);
 
-    int		recordPacketInStart();
-    void	recordPacketOut(const char*, int, const char* p1=0, int=0, const char* p2=0, int=0);
+    void	recordPacketInStart(pluton::perCallerService* owner);
+    void	recordPacketIn(pluton::perCallerService* owner, const char*, int);
+    void	recordPacketOut(pluton::perCallerService* owner,
+				const char*, int, const char* p1=0, int=0, const char* p2=0, int=0);
+    void	recordFileReference(pluton::perCallerService* owner, requestImpl* R);
 
     bool	checkManagerHeartbeat();
   };
@@ -191,6 +281,11 @@ namespace pluton {
     int		_sockIn;
     int		_sockOut;
     int		_myTid;
+    int		_passedFD;		// memfd passed with the request data
+    int		_recorderIndex;		// Pairs the in and out recordings
+    int		_recorderFD;		// While the request is being read
+    bool	_recordingIn;
+    std::string	_recordedRequest;	// Held until the response when recording to a ring
 
     netStringFactoryManaged	_packetIn;
     decodeRequestPacket		_decoder;
@@ -198,6 +293,40 @@ namespace pluton {
 
     struct timeval		_requestStartTime;
     struct timeval		_requestEndTime;
+
+    // Only set when the request is being traced
+
+    uint64_t			_traceID;
+    uint64_t			_traceSpanID;
+    uint64_t			_traceParentID;
+    std::string			_traceName;
+    struct timeval		_requestReadTime;
+    struct timeval		_responseStartTime;
+
+    // Only set while a batch request is being served
+
+    int				_batchCount;		// Members in the batch
+    int				_batchNext;		// Next for getRequest()
+    int				_batchCurrent;		// Last given by getRequest()
+    int				_batchFirst;		// Index 0 of getRequestBatch()
+    int				_batchAnswered;
+    int				_batchRequestLength;
+    unsigned int		_batchRequestID;
+    std::string			_batchClientName;
+    std::string			_batchFunction;
+    std::vector<serviceRequestImpl*>	_batchRequests;
+    std::vector<std::string>		_batchResponses;	// Assembled member packets
+    std::vector<pluton::batchRequest>	_batchArray;
+
+    // Only set while a response is being sent in parts
+
+    bool			_responsePartsSent;	// The start of the response has gone
+    int				_responsePartBytes;
+    std::string			_responseParts;		// Held back until sendResponse()
+
+    pluton::compressionStats	_compression;		// Of the current request
+
+    void	resetResponseParts();
   };
 }
 
@@ -93,12 +93,55 @@ extern "C" {
     return S.sendResponse(p, l);
   }
 
+  int
+  pluton_service_C_sendResponseV(const struct iovec* iov, int iovCount)
+  {
+    return S.sendResponse(iov, iovCount);
+  }
+
+  int
+  pluton_service_C_sendResponsePart(const char* p, int l)
+  {
+    return S.sendResponsePart(p, l);
+  }
+
+  int
+  pluton_service_C_sendResponseFromFile(int fd, off_t offset, int length)
+  {
+    return S.sendResponseFromFile(fd, offset, length);
+  }
+
   int
   pluton_service_C_sendFault(unsigned int code, const char* txt)
   {
     return S.sendFault(code, txt);
   }
 
+  void
+  pluton_service_C_setCacheMaxAgeMilliSeconds(unsigned int maxAgeMS)
+  {
+    S.setCacheMaxAgeMilliSeconds(maxAgeMS);
+  }
+
+  int
+  pluton_service_C_getSharedCache(const char* key, int keyLen, const char** vp, int* vl)
+  {
+    static std::string value;
+    if (!S.getSharedCache(key, keyLen, value)) return 0;
+
+    *vp = value.data();
+    *vl = value.length();
+
+    return 1;
+  }
+
+  int
+  pluton_service_C_putSharedCache(const char* key, int keyLen,
+				  const char* vp, int vl, unsigned int maxAgeMS)
+  {
+    return S.putSharedCache(key, keyLen, vp, vl, maxAgeMS);
+  }
+
   int
   pluton_service_C_hasFault()
   {
@@ -0,0 +1,133 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "config.h"
+
+#include "slowRequestFilter.h"
+
+static const unsigned long reestimateEvery = 256;
+static const unsigned long halveAfter = 1000000;
+
+
+pluton::slowRequestFilter::slowRequestFilter()
+  : _fixeduSecs(0), _permille(0), _count(0), _estimateduSecs(0)
+{
+  for (int ix=0; ix < bucketCount; ++ix) _bucket[ix] = 0;
+}
+
+
+void
+pluton::slowRequestFilter::configure(int thresholdMilliSeconds, int permille)
+{
+  _fixeduSecs = (thresholdMilliSeconds > 0) ? thresholdMilliSeconds * 1000UL : 0;
+  _permille = (permille > 0) ? permille : 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Durations below subBuckets microseconds have a bucket each. Above
+// that, each power-of-two range is split into subBuckets equal
+// parts.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::slowRequestFilter::bucketIndex(unsigned long uSecs)
+{
+  if (uSecs < (unsigned long) subBuckets) return uSecs;
+
+  int power = 0;
+  while ((uSecs >> power) >= (unsigned long) (2 * subBuckets)) ++power;
+
+  int ix = (power + 1) * subBuckets + (uSecs >> power) - subBuckets;
+  if (ix >= bucketCount) ix = bucketCount - 1;
+
+  return ix;
+}
+
+unsigned long
+pluton::slowRequestFilter::bucketLower(int ix)
+{
+  if (ix < subBuckets) return ix;
+
+  int power = ix / subBuckets - 1;
+
+  return (unsigned long) (subBuckets + ix % subBuckets) << power;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Add the duration to the histogram and return true if it is slow.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::slowRequestFilter::isSlow(unsigned long uSecs)
+{
+  if ((_fixeduSecs > 0) && (uSecs >= _fixeduSecs)) return true;
+  if (_permille == 0) return false;
+
+  ++_bucket[bucketIndex(uSecs)];
+  if ((++_count % reestimateEvery) == 0) estimateThreshold();
+
+  return (_estimateduSecs > 0) && (uSecs >= _estimateduSecs);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Walk down from the slowest bucket until the tail holds permille of
+// the requests. The threshold is interpolated linearly within the
+// bucket where that happens.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::slowRequestFilter::estimateThreshold()
+{
+  if (_count * _permille < 10000) return;		// Want ten or more in the tail
+
+  unsigned long tail = _count * _permille / 1000;
+  unsigned long seen = 0;
+  for (int ix=bucketCount-1; ix > 0; --ix) {
+    if (seen + _bucket[ix] > tail) {
+      unsigned long lower = bucketLower(ix);
+      unsigned long width = (ix + 1 < bucketCount) ? bucketLower(ix + 1) - lower : lower;
+      unsigned long need = tail - seen;
+      _estimateduSecs = lower + width - (width * need) / _bucket[ix];
+      break;
+    }
+    seen += _bucket[ix];
+  }
+
+  if (_count >= halveAfter) {
+    _count = 0;
+    for (int ix=0; ix < bucketCount; ++ix) {
+      _bucket[ix] /= 2;
+      _count += _bucket[ix];
+    }
+  }
+}
@@ -0,0 +1,78 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_SLOWREQUESTFILTER_H
+#define P_SLOWREQUESTFILTER_H 1
+
+
+//////////////////////////////////////////////////////////////////////
+// Decide whether a just-completed request is slow enough to be worth
+// recording. A request is slow if it took at least a fixed number of
+// milliseconds, or if it is in the slowest "permille" parts per
+// thousand of the requests seen by this process.
+//
+// The tail is estimated from a histogram of durations with eight
+// buckets per power-of-two, interpolating within the bucket that
+// contains the threshold, which is accurate to a few percent. No
+// request is treated as slow by the percentile test until enough have
+// been seen to make the estimate meaningful, and the histogram is
+// halved periodically so the estimate follows changes in load.
+//////////////////////////////////////////////////////////////////////
+
+namespace pluton {
+
+  class slowRequestFilter {
+  public:
+    slowRequestFilter();
+
+    void	configure(int thresholdMilliSeconds, int permille);
+    bool	enabled() const { return (_fixeduSecs > 0) || (_permille > 0); }
+
+    bool	isSlow(unsigned long uSecs);
+    unsigned long	getThreshold() const { return _estimateduSecs; }
+
+  private:
+    static const int	subBuckets = 8;
+    static const int	bucketCount = 30 * subBuckets;
+
+    static int		bucketIndex(unsigned long uSecs);
+    static unsigned long	bucketLower(int ix);
+
+    void	estimateThreshold();
+
+    unsigned long	_fixeduSecs;
+    int			_permille;
+    unsigned long	_count;
+    unsigned long	_estimateduSecs;	// Zero until warmed up
+    unsigned long	_bucket[bucketCount];
+  };
+}
+
+#endif
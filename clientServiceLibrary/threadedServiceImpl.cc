@@ -0,0 +1,231 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "config.h"
+
+//////////////////////////////////////////////////////////////////////
+// The thread pool behind pluton::threadedService. All threads share
+// the one serviceImpl and each has its own pluton::service handle
+// and thus its own perCallerService and request.
+//////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <pthread.h>
+
+#include "pluton/fault.h"
+#include "pluton/service.h"
+#include "pluton/threadedService.h"
+
+#include "threadedServiceImpl.h"
+
+namespace {
+  struct workerArg {
+    pluton::threadedServiceImpl*	impl;
+    pluton::service*			S;
+  };
+}
+
+
+pluton::threadedServiceImpl::threadedServiceImpl(const char* name)
+  : _name(name), _owner(name), _threadCount(1), _running(false),
+    _handler(0), _arg(0), _faultWorker(0)
+{
+  pthread_mutex_init(&_faultMutex, 0);
+}
+
+pluton::threadedServiceImpl::~threadedServiceImpl()
+{
+  deleteWorkers();
+  pthread_mutex_destroy(&_faultMutex);
+}
+
+
+bool
+pluton::threadedServiceImpl::initialize()
+{
+  _owner.initialize();
+  return _serviceImpl.initialize(&_owner, true);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// A fault from a worker is only reported if nothing went wrong with
+// the pool itself.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::threadedServiceImpl::hasFault() const
+{
+  if (_owner.hasFault()) return true;
+
+  return _faultWorker != 0;
+}
+
+const pluton::fault&
+pluton::threadedServiceImpl::getFault() const
+{
+  if (!_owner.hasFault() && _faultWorker) return _faultWorker->getFault();
+
+  return _owner.getFault();
+}
+
+
+void
+pluton::threadedServiceImpl::setThreadCount(int threadCount)
+{
+  if (threadCount > 0) _threadCount = threadCount;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The manager sized the shm scoreboard with maximum-threads slots for
+// each process, so that is the thread count in manager mode. fd3/fd4
+// can only be read by one thread.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::threadedServiceImpl::getThreadCount() const
+{
+  if (_serviceImpl.inManagerMode()) return _serviceImpl.getMaximumThreads();
+  if (_serviceImpl.inFauxSTDIOMode()) return 1;
+
+  return _threadCount;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Start the workers and wait for them all to finish. The calling
+// thread is worker zero which is also the thread that gets signals
+// if the caller has not arranged otherwise.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::threadedServiceImpl::run(pluton::threadedService::requestHandler_t handler, void* arg)
+{
+  _owner._fault.clear("pluton::threadedService::run");
+
+  deleteWorkers();
+  _handler = handler;
+  _arg = arg;
+
+  int threadCount = getThreadCount();
+  if (threadCount < 1) threadCount = 1;
+
+  std::vector<workerArg> args(threadCount);
+  std::vector<pthread_t> tids(threadCount);
+
+  for (int ix=0; ix < threadCount; ++ix) {
+    _workers.push_back(new pluton::service(&_serviceImpl, _name.c_str(), ix));
+    args[ix].impl = this;
+    args[ix].S = _workers[ix];
+  }
+
+  _running = true;
+  int started = 1;
+  for (; started < threadCount; ++started) {
+    int res = pthread_create(&tids[started], 0, workerMain, &args[started]);
+    if (res != 0) {
+      _owner._fault.set(seriousInternalOSError, __FUNCTION__, __LINE__, started, res,
+			"pthread_create");
+      _serviceImpl.requestShutdown();
+      break;
+    }
+  }
+
+  if (!_owner.hasFault()) runWorker(_workers[0]);
+
+  for (int ix=1; ix < started; ++ix) pthread_join(tids[ix], 0);
+  _running = false;
+
+  return !hasFault();
+}
+
+
+void*
+pluton::threadedServiceImpl::workerMain(void* arg)
+{
+  workerArg* wa = static_cast<workerArg*>(arg);
+  wa->impl->runWorker(wa->S);
+
+  return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Each worker loops until getRequest() says there are no more
+// requests for it. Whatever the reason, the rest of the pool follows
+// this worker out so that the process can exit and be replaced.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::threadedServiceImpl::runWorker(pluton::service* S)
+{
+  while (!_serviceImpl.shutdownRequested() && S->getRequest()) {
+    (_handler)(*S, _arg);
+
+    // A handler that forgets to respond would otherwise stall this
+    // worker on its next getRequest().
+
+    if (S->_owner->_state == pluton::perCallerService::canSendResponse) {
+      S->sendFault(pluton::lastReservedUserFault, "No response from threadedService handler");
+    }
+  }
+
+  pthread_mutex_lock(&_faultMutex);
+  if (!_faultWorker && S->hasFault()) _faultWorker = S;
+  pthread_mutex_unlock(&_faultMutex);
+
+  _serviceImpl.requestShutdown();
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// While the pool is running, terminate() only asks the workers to
+// stop, the accept socket is closed once they have.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::threadedServiceImpl::terminate()
+{
+  _serviceImpl.requestShutdown();
+  if (!_running) _serviceImpl.terminate();
+}
+
+
+void
+pluton::threadedServiceImpl::deleteWorkers()
+{
+  for (unsigned int ix=0; ix < _workers.size(); ++ix) delete _workers[ix];
+  _workers.clear();
+  _faultWorker = 0;
+}
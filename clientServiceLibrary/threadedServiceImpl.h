@@ -0,0 +1,87 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_THREADEDSERVICEIMPL_H
+#define P_THREADEDSERVICEIMPL_H 1
+
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+#include "pluton/fault.h"
+#include "pluton/service.h"
+#include "pluton/threadedService.h"
+
+#include "serviceImpl.h"
+
+namespace pluton {
+
+  class threadedServiceImpl {
+  public:
+    threadedServiceImpl(const char* name);
+    ~threadedServiceImpl();
+
+    bool		initialize();
+
+    bool		hasFault() const;
+    const pluton::fault& getFault() const;
+
+    void	setThreadCount(int threadCount);
+    int		getThreadCount() const;
+
+    bool	run(pluton::threadedService::requestHandler_t handler, void* arg);
+
+    void	terminate();
+
+  private:
+    threadedServiceImpl&	operator=(const threadedServiceImpl& rhs);	// Assign not ok
+    threadedServiceImpl(const threadedServiceImpl& rhs);		// Copy not ok
+
+    static void*	workerMain(void* arg);
+    void		runWorker(pluton::service* S);
+    void		deleteWorkers();
+
+    std::string		_name;
+    serviceImpl		_serviceImpl;
+    perCallerService	_owner;			// Faults outside of the workers
+    int			_threadCount;
+    volatile bool	_running;
+
+    pluton::threadedService::requestHandler_t	_handler;
+    void*					_arg;
+
+    pthread_mutex_t		_faultMutex;
+    std::vector<pluton::service*> _workers;
+    const pluton::service*	_faultWorker;	// First worker to stop with a fault
+  };
+}
+
+#endif
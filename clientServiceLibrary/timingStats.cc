@@ -0,0 +1,120 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "clientRequestImpl.h"
+#include "timingStats.h"
+
+
+pluton::timingStats::timingStats()
+{
+}
+
+
+pluton::timingStats::~timingStats()
+{
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Return the power-of-two bucket for a duration. Bucket zero is for
+// zero durations, bucket N for 2^(N-1) to 2^N-1 microseconds.
+//////////////////////////////////////////////////////////////////////
+
+int
+pluton::timingStats::bucketIndex(unsigned long uSecs)
+{
+  int ix = 0;
+  while (uSecs > 0) {
+    ++ix;
+    uSecs >>= 1;
+  }
+
+  if (ix >= pluton::clientStageHistogram::bucketCount) {
+    ix = pluton::clientStageHistogram::bucketCount - 1;
+  }
+
+  return ix;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Add the timings of a completed request to the stats of its
+// service. Stages that were not reached are not counted.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::timingStats::record(const std::string& serviceKey, const pluton::clientRequestImpl* R)
+{
+  mapIter mi = _map.find(serviceKey);
+  if (mi == _map.end()) {
+    pluton::clientTimingStats zero;
+    memset((void*) &zero, '\0', sizeof(zero));
+    mi = _map.insert(std::make_pair(serviceKey, zero)).first;
+  }
+
+  pluton::clientTimingStats& ts = mi->second;
+  ++ts.requests;
+  if (R->hasFault()) ++ts.faults;
+
+  for (int st=0; st < pluton::clientRequest::stageCount; ++st) {
+    long uSecs = R->getStageMicroSeconds(st);
+    if ((uSecs == 0) && (st != pluton::clientRequest::totalStage)) continue;
+
+    pluton::clientStageHistogram& sh = ts.stage[st];
+    ++sh.count;
+    sh.totaluSecs += uSecs;
+    if ((unsigned long) uSecs > sh.maximumuSecs) sh.maximumuSecs = uSecs;
+    ++sh.bucket[bucketIndex(uSecs)];
+  }
+}
+
+
+bool
+pluton::timingStats::get(const std::string& serviceKey, pluton::clientTimingStats& ts) const
+{
+  mapConstIter mi = _map.find(serviceKey);
+  if (mi == _map.end()) return false;
+
+  ts = mi->second;
+
+  return true;
+}
+
+
+void
+pluton::timingStats::getServiceKeys(std::vector<std::string>& keys) const
+{
+  keys.clear();
+  for (mapConstIter mi=_map.begin(); mi != _map.end(); ++mi) keys.push_back(mi->first);
+}
@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_TIMINGSTATS_H
+#define P_TIMINGSTATS_H 1
+
+#include <string>
+#include <vector>
+
+#include "hashString.h"
+#include "hash_mapWrapper.h"
+
+#include "pluton/client.h"
+
+
+//////////////////////////////////////////////////////////////////////
+// Accumulate per-stage timings of completed requests, keyed by
+// Service Key. As with the responseCache there is one per clientImpl,
+// thus one per thread, so no locking is needed.
+//////////////////////////////////////////////////////////////////////
+
+namespace pluton {
+
+  class clientRequestImpl;
+
+  class timingStats {
+  public:
+    timingStats();
+    ~timingStats();
+
+    void	record(const std::string& serviceKey, const pluton::clientRequestImpl*);
+
+    bool	get(const std::string& serviceKey, pluton::clientTimingStats&) const;
+    void	getServiceKeys(std::vector<std::string>&) const;
+    void	reset() { _map.clear(); }
+
+    static int	bucketIndex(unsigned long uSecs);
+
+  private:
+    timingStats&	operator=(const timingStats& rhs);	// Assign not ok
+    timingStats(const timingStats& rhs);			// Copy not ok
+
+    P_STLMAP<std::string, pluton::clientTimingStats, hashString>	_map;
+    typedef P_STLMAP<std::string, pluton::clientTimingStats, hashString>::iterator mapIter;
+    typedef P_STLMAP<std::string, pluton::clientTimingStats, hashString>::const_iterator
+    mapConstIter;
+  };
+}
+
+#endif
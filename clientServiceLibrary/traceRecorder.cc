@@ -0,0 +1,227 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "config.h"
+
+#include <string>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "traceRecorder.h"
+
+#ifndef MAP_NOSYNC
+#define MAP_NOSYNC 0
+#endif
+
+
+const char* pluton::traceRecorder::contextKey = "pluton.trace";
+
+enum { unknownState, openingState, enabledState, disabledState };
+
+static volatile int	S_state = unknownState;
+static traceRingHeader*	S_header = 0;
+static traceSpan*	S_spans = 0;
+
+static uint64_t		S_idSeed = 0;
+static uint64_t		S_idCounter = 0;
+
+// The current trace is per thread so that each worker of a threaded
+// service links its nested requests to the request it is serving.
+
+static __thread uint64_t	S_currentTraceID = 0;
+static __thread uint64_t	S_currentSpanID = 0;
+
+
+//////////////////////////////////////////////////////////////////////
+// Tracing state is determined once on first use. Concurrent first
+// callers that lose the race simply see tracing as disabled until the
+// winner has opened the ring.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::traceRecorder::enabled()
+{
+  if (S_state == enabledState) return true;
+  if (S_state != unknownState) return false;
+
+  if (!__sync_bool_compare_and_swap(&S_state, unknownState, openingState)) return false;
+
+  S_state = openRing() ? enabledState : disabledState;
+
+  return S_state == enabledState;
+}
+
+
+bool
+pluton::traceRecorder::openRing()
+{
+  const char* directory = getenv("plutonTraceDirectory");
+  if (!directory || !*directory) return false;
+
+  struct timeval now;
+  gettimeofday(&now, 0);
+  S_idSeed = ((uint64_t) getpid() << 40) ^ ((uint64_t) now.tv_sec << 20) ^ now.tv_usec;
+
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/pluton.trace.%d", directory, (int) getpid());
+
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) return false;
+
+  int mapSize = sizeof(traceRingHeader) + sizeof(traceSpan) * ringCapacity;
+  if (ftruncate(fd, mapSize) == -1) {
+    close(fd);
+    return false;
+  }
+
+  void* p = mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NOSYNC, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return false;
+
+  S_header = static_cast<traceRingHeader*>(p);
+  S_spans = reinterpret_cast<traceSpan*>(static_cast<char*>(p) + sizeof(traceRingHeader));
+
+  S_header->_version = traceRingHeader::ringVersion;
+  S_header->_recordSize = sizeof(traceSpan);
+  S_header->_capacity = ringCapacity;
+  S_header->_next = 0;
+  S_header->_pid = getpid();
+  S_header->_magic = traceRingHeader::ringMagic;	// Last, once the header is valid
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// IDs only need to be unique enough to not collide within a merged
+// set of trace rings. A counter scrambled with a per-process seed is
+// plenty and is never zero, as zero means "no ID".
+//////////////////////////////////////////////////////////////////////
+
+uint64_t
+pluton::traceRecorder::newID()
+{
+  uint64_t z = S_idSeed + __sync_add_and_fetch(&S_idCounter, 1) * 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z ^= z >> 31;
+
+  return z ? z : 1;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The context value is "traceID:spanID" in hex where spanID is the
+// span of the sender, which becomes the parent of the receiver.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::traceRecorder::encode(std::string& value, uint64_t traceID, uint64_t spanID)
+{
+  char buf[40];
+  snprintf(buf, sizeof(buf), "%016llx:%016llx",
+	   (unsigned long long) traceID, (unsigned long long) spanID);
+  value = buf;
+}
+
+bool
+pluton::traceRecorder::decode(const std::string& value, uint64_t& traceID, uint64_t& spanID)
+{
+  unsigned long long t, s;
+  if (sscanf(value.c_str(), "%llx:%llx", &t, &s) != 2) return false;
+  if (t == 0) return false;
+
+  traceID = t;
+  spanID = s;
+
+  return true;
+}
+
+
+void
+pluton::traceRecorder::setCurrent(uint64_t traceID, uint64_t spanID)
+{
+  S_currentTraceID = traceID;
+  S_currentSpanID = spanID;
+}
+
+void
+pluton::traceRecorder::getCurrent(uint64_t& traceID, uint64_t& spanID)
+{
+  traceID = S_currentTraceID;
+  spanID = S_currentSpanID;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Claim the next slot in the ring and fill it in. The sequence is
+// set last so that a reader can skip partially written records.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::traceRecorder::record(traceSpan::kind kind, const char* name,
+			      uint64_t traceID, uint64_t spanID, uint64_t parentID,
+			      const struct timeval& startTime, const struct timeval& endTime)
+{
+  if (!enabled()) return;
+
+  uint64_t slot = __sync_fetch_and_add(&S_header->_next, 1);
+  traceSpan* sp = S_spans + (slot % ringCapacity);
+
+  sp->_sequence = 0;
+  __sync_synchronize();
+
+  long duration = util::timevalDiffuS(endTime, startTime);
+  if (duration < 0) duration = 0;
+
+  sp->_traceID = traceID;
+  sp->_spanID = spanID;
+  sp->_parentID = parentID;
+  sp->_startuSecs = (uint64_t) startTime.tv_sec * util::MICROSECOND + startTime.tv_usec;
+  sp->_durationuSecs = duration;
+  sp->_pid = getpid();
+  sp->_kind = kind;
+  strncpy(sp->_name, name, sizeof(sp->_name)-1);
+  sp->_name[sizeof(sp->_name)-1] = '\0';
+
+  __sync_synchronize();
+  sp->_sequence = (uint32_t) slot + 1;
+  if (sp->_sequence == 0) sp->_sequence = 1;
+}
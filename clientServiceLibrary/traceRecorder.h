@@ -0,0 +1,83 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_TRACERECORDER_H
+#define P_TRACERECORDER_H 1
+
+#include <string>
+
+#include <sys/time.h>
+
+#include "stdintWrapper.h"
+
+#include "traceRing.h"
+
+
+//////////////////////////////////////////////////////////////////////
+// The traceRecorder writes spans to the per-process trace ring. It is
+// shared by the client and service side of the library so that a
+// service which is also a client links the spans of its nested
+// requests to the request it is serving.
+//
+// Tracing is only active if the plutonTraceDirectory environment
+// variable names a directory, in which case the ring is created there
+// as pluton.trace.<pid> on first use.
+//
+// The "current" trace is kept per thread. It is set when a service
+// accepts a request and cleared when the response is sent, so each
+// thread of a threaded service has its own parent span.
+//////////////////////////////////////////////////////////////////////
+
+namespace pluton {
+
+  class traceRecorder {
+  public:
+    static const char*	contextKey;		// "pluton.trace" - a reserved context key
+    static const int	ringCapacity = 8192;	// Records per ring
+
+    static bool		enabled();
+    static uint64_t	newID();
+
+    static void		encode(std::string& value, uint64_t traceID, uint64_t spanID);
+    static bool		decode(const std::string& value, uint64_t& traceID, uint64_t& spanID);
+
+    static void		setCurrent(uint64_t traceID, uint64_t spanID);
+    static void		getCurrent(uint64_t& traceID, uint64_t& spanID);
+
+    static void		record(traceSpan::kind, const char* name,
+			       uint64_t traceID, uint64_t spanID, uint64_t parentID,
+			       const struct timeval& startTime, const struct timeval& endTime);
+
+  private:
+    static bool		openRing();
+  };
+}
+
+#endif
@@ -38,19 +38,24 @@ using namespace std;
 #include <sstream>
 #include <string>
 
+#include <sys/time.h>
+
 #include <errno.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "util.h"
+#include "loadDistribution.h"
 #include "pluton/client.h"
 
 
 static const char* usage =
 "\n"
 "Usage: plBatch [ -dh ] [-c repeatCount] [-i seconds] [ -m minrequests ] [-L lookupMap]\n"
+"               [-P phases]\n"
 "\n"
 "Read in a batch file from STDIN and execute that repeatedly.\n"
 "\n"
@@ -60,12 +65,35 @@ static const char* usage =
 " -i	Number of seconds between batches (default: 1)\n"
 " -m    Minimum requests per batch (default: 1)\n"
 " -L   The Lookup Map used to connect with the manager (default: '')\n"
+" -P    Run the batch at a scripted rate rather than -c times every -i\n"
+"       seconds. phases is a comma separated list of:\n"
+"\n"
+"         steady:seconds:rate\n"
+"         ramp:seconds:fromRate:toRate\n"
+"         spike:seconds:rate:peakRate:peakSeconds   (peak in the middle)\n"
+"         diurnal:seconds:lowRate:highRate[:period] (sinusoidal, low first)\n"
+"\n"
+"       where rates are batches per second.\n"
 "\n"
 "The batch file consists of a single line per request with columns:\n"
 "\n"
 "                     Request Data           CPU                 Latency\n"
 "command probability MinSize MaxSize   MinValue MaxValue    MinValue MaxValue\n"
 "\n"
+"or, to reproduce production traffic shapes, with distributions:\n"
+"\n"
+"command probability Size CPU Latency [Memory]\n"
+"\n"
+"Size is in bytes, CPU and Latency in milliseconds and Memory in kilobytes\n"
+"per request. Each is a number or a distribution, such as:\n"
+"\n"
+"  uniform:2,8  exponential:5  lognormal:5,0.8  pareto:2,1.5\n"
+"  0.9@lognormal:5,0.3|0.1@fixed:200                  (bimodal)\n"
+"\n"
+"The CPU, Latency and Memory values are sent as the 'cpu', 'latency' and\n"
+"'memory' context expected by the loadSimulator service. Blank lines and\n"
+"lines starting with '#' are ignored.\n"
+"\n"
 "See also: " PACKAGE_URL "\n"
 "\n";
 
@@ -76,16 +104,178 @@ public:
   string 	serviceKey;
   float		probability;
   bool		sentInBatch;
-  int		requestMinSize;
-  int		requestMaxSize;
-  int		cpuMinValue;
-  int		cpuMaxValue;
-  int		latencyMinValue;
-  int		latencyMaxValue;
+  util::loadDistribution	size;
+  util::loadDistribution	cpu;
+  util::loadDistribution	latency;
+  util::loadDistribution	memory;
+  bool		haveMemory;
   string	requestData;
   pluton::clientRequest R;
 };
 
+
+//////////////////////////////////////////////////////////////////////
+// Parse a batch file line into the command. The original format of
+// min/max pairs is converted to uniform distributions.
+//////////////////////////////////////////////////////////////////////
+
+static bool
+parseCommand(const string& line, command* c, string& em)
+{
+  istringstream is(line);
+  vector<string> tokens;
+  string token;
+  while (is >> token) tokens.push_back(token);
+
+  if ((tokens.size() != 5) && (tokens.size() != 6) && (tokens.size() != 8)) {
+    em = "Expected 5, 6 or 8 columns";
+    return false;
+  }
+
+  c->serviceKey = tokens[0];
+  c->probability = atof(tokens[1].c_str());
+  c->haveMemory = false;
+
+  if (tokens.size() == 8) {
+    return c->size.parse("uniform:" + tokens[2] + "," + tokens[3], em)
+      && c->cpu.parse("uniform:" + tokens[4] + "," + tokens[5], em)
+      && c->latency.parse("uniform:" + tokens[6] + "," + tokens[7], em);
+  }
+
+  if (!c->size.parse(tokens[2], em) || !c->cpu.parse(tokens[3], em)
+      || !c->latency.parse(tokens[4], em)) return false;
+
+  if (tokens.size() == 6) {
+    if (!c->memory.parse(tokens[5], em)) return false;
+    c->haveMemory = true;
+  }
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// A load phase determines how many batches per second are started
+// at each point in a scripted run.
+//////////////////////////////////////////////////////////////////////
+
+class loadPhase {
+public:
+  enum shape { steady, ramp, spike, diurnal };
+
+  shape		type;
+  double	seconds;
+  double	rate;
+  double	otherRate;		// ramp to, spike peak or diurnal high
+  double	extra;			// spike duration or diurnal period
+
+  double	rateAt(double t) const;
+};
+
+double
+loadPhase::rateAt(double t) const
+{
+  switch (type) {
+  case ramp:
+    return rate + (otherRate - rate) * t / seconds;
+
+  case spike:
+    if (fabs(t - seconds / 2) < extra / 2) return otherRate;
+    return rate;
+
+  case diurnal:
+    return rate + (otherRate - rate) * (1 - cos(2 * M_PI * t / extra)) / 2;
+
+  case steady:
+  default:
+    break;
+  }
+
+  return rate;
+}
+
+static bool
+parsePhases(const string& spec, vector<loadPhase>& phases, string& em)
+{
+  istringstream is(spec);
+  string one;
+  while (getline(is, one, ',')) {
+    vector<string> f;
+    istringstream fis(one);
+    string field;
+    while (getline(fis, field, ':')) f.push_back(field);
+
+    loadPhase lp;
+    unsigned int need;
+    if (f.empty()) {
+      em = "Empty phase";
+      return false;
+    }
+    if (f[0] == "steady") {
+      lp.type = loadPhase::steady;
+      need = 3;
+    }
+    else if (f[0] == "ramp") {
+      lp.type = loadPhase::ramp;
+      need = 4;
+    }
+    else if (f[0] == "spike") {
+      lp.type = loadPhase::spike;
+      need = 5;
+    }
+    else if (f[0] == "diurnal") {
+      lp.type = loadPhase::diurnal;
+      need = 4;
+    }
+    else {
+      em = "Unknown phase '" + f[0] + "'";
+      return false;
+    }
+
+    if ((f.size() != need) && !((lp.type == loadPhase::diurnal) && (f.size() == 5))) {
+      em = "Wrong number of values in phase '" + one + "'";
+      return false;
+    }
+
+    lp.seconds = atof(f[1].c_str());
+    lp.rate = atof(f[2].c_str());
+    lp.otherRate = (f.size() > 3) ? atof(f[3].c_str()) : lp.rate;
+    lp.extra = (f.size() > 4) ? atof(f[4].c_str()) : lp.seconds;
+    if ((lp.seconds <= 0) || (lp.rate < 0) || (lp.otherRate < 0) || (lp.extra <= 0)) {
+      em = "Invalid values in phase '" + one + "'";
+      return false;
+    }
+    phases.push_back(lp);
+  }
+
+  if (phases.empty()) {
+    em = "No phases";
+    return false;
+  }
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Return the batch rate at elapsed time t, or false once all phases
+// are complete.
+//////////////////////////////////////////////////////////////////////
+
+static bool
+phaseRate(const vector<loadPhase>& phases, double t, double& rate)
+{
+  for (unsigned int ix=0; ix < phases.size(); ++ix) {
+    if (t < phases[ix].seconds) {
+      rate = phases[ix].rateAt(t);
+      return true;
+    }
+    t -= phases[ix].seconds;
+  }
+
+  return false;
+}
+
 static  int	totalBatchCount = 0;
 static	int	rqCount = 0;
 static	int	totalRequestCount = 0;
@@ -193,8 +383,10 @@ main(int argc, char **argv)
   int	delaySeconds = 1;
   int	minimumRequestsPerBatch = 1;
   bool	debugFlag = false;
+  vector<loadPhase> phases;
+  string em;
 
-  while ((optionChar = getopt(argc, argv, "dhc:i:L:m:")) != -1) {
+  while ((optionChar = getopt(argc, argv, "dhc:i:L:m:P:")) != -1) {
 
     switch (optionChar) {
 
@@ -222,6 +414,14 @@ main(int argc, char **argv)
       lookupMap = optarg;
       break;
 
+    case 'P':
+      if (!parsePhases(optarg, phases, em)) {
+	cerr << "Error: -P " << em << endl;
+	cerr << usage;
+	exit(1);
+      }
+      break;
+
     default:
       cerr << usage;
       exit(1);
@@ -242,19 +442,21 @@ main(int argc, char **argv)
   // Slurp in batch of commands
   ////////////////////////////////////////
 
-  int payloadSize = 1;
-
   vector<command*>	commandList;
   typedef vector<command*>::iterator	cLIter;
 
-  while (!cin.eof()) {
+  string line;
+  int lineNumber = 0;
+  while (getline(cin, line)) {
+    ++lineNumber;
+    string::size_type first = line.find_first_not_of(" \t");
+    if ((first == string::npos) || (line[first] == '#')) continue;
+
     command* c = new command;
-    cin >> c->serviceKey >> c->probability
-	>> c->requestMinSize >> c->requestMaxSize
-	>> c->cpuMinValue >> c->cpuMaxValue
-	>> c->latencyMinValue >> c->latencyMaxValue;
-    if (c->serviceKey.empty()) break;
-    if (c->requestMaxSize > payloadSize) payloadSize = c->requestMaxSize;
+    if (!parseCommand(line, c, em)) {
+      cerr << "Error: Batch file line " << lineNumber << ": " << em << endl;
+      exit(1);
+    }
     commandList.push_back(c);
   }
 
@@ -263,20 +465,14 @@ main(int argc, char **argv)
   for (cLIter cli=commandList.begin(); cli != commandList.end(); ++cli) {
     command* c = *cli;
     cout << "Cmd: "<< c->serviceKey << ": " << c->probability
-	 << " Rsz=" << c->requestMinSize << "/" << c->requestMaxSize
-	 << " CPU=" << c->cpuMinValue << "/" << c->cpuMaxValue
-	 << " Latency=" << c->latencyMinValue << "/" << c->latencyMaxValue
-	 << endl;
+	 << " Rsz=" << c->size.getSpec()
+	 << " CPU=" << c->cpu.getSpec()
+	 << " Latency=" << c->latency.getSpec();
+    if (c->haveMemory) cout << " Memory=" << c->memory.getSpec();
+    cout << endl;
   }
 
-
-  ////////////////////////////////////////
-  // Construct the maximum request payload
-  ////////////////////////////////////////
-
-  char* payload = new char [payloadSize];
   char randomChar = (time(0) % 26) + 'A';
-  memset(payload, randomChar, payloadSize);
 
 
   ////////////////////////////////////////
@@ -292,6 +488,10 @@ main(int argc, char **argv)
   }
 
   srandom(getpid());
+  unsigned short seed[3];
+  seed[0] = getpid();
+  seed[1] = time(0);
+  seed[2] = time(0) >> 16;
 
   ////////////////////////////////////////
   // The main loop to exchange requests
@@ -301,7 +501,30 @@ main(int argc, char **argv)
   struct timeval endTime;
   bool executeFailed = false;
 
-  while (!executeFailed && (repeatCount-- > 0)) {
+  struct timeval runStart;
+  gettimeofday(&runStart, 0);
+  double nextBatch = 0;			// Seconds since runStart
+
+  while (!executeFailed) {
+    double rate = 0;
+    if (phases.empty()) {
+      if (repeatCount-- <= 0) break;
+    }
+    else {
+      gettimeofday(&startTime, 0);
+      double now = util::timevalDiffuS(startTime, runStart) / 1000000.0;
+      if (!phaseRate(phases, now, rate)) break;
+      if (now < nextBatch) {
+	usleep((useconds_t) ((nextBatch - now) * 1000000));
+	continue;			// Re-evaluate as the phase may have changed
+      }
+      if (rate < 0.01) {			// Effectively idle
+	nextBatch = now + 0.1;
+	continue;
+      }
+      nextBatch += 1.0 / rate;
+      if (nextBatch < now) nextBatch = now;	// Don't burst to catch up
+    }
 
     rqCount = 0;
     int totalCPU = 0;
@@ -324,13 +547,10 @@ main(int argc, char **argv)
 	++rqCount;
 	++totalRequestCount;
 	c->R.reset();
-	r %= 10;		// Get bottom digit
-	++r;		// Now in range between 1-10
-	c->requestData.assign(payload,
-			      c->requestMaxSize - r * (c->requestMaxSize - c->requestMinSize) / 10);
+	c->requestData.assign(int(c->size.sample(seed)), randomChar);
 	c->R.setRequestData(c->requestData);
-	int cpu = c->cpuMaxValue - r * (c->cpuMaxValue - c->cpuMinValue) / 10;
-	int latency = c->latencyMaxValue - r * (c->latencyMaxValue - c->latencyMinValue) / 10;
+	int cpu = int(c->cpu.sample(seed) + 0.5);
+	int latency = int(c->latency.sample(seed) + 0.5);
 	if (latency < cpu) latency = cpu;
 	ostringstream os;
 	os << cpu;
@@ -338,6 +558,11 @@ main(int argc, char **argv)
 	ostringstream os1;
 	os1 << latency;
 	c->R.setContext("latency", os1.str());
+	if (c->haveMemory) {
+	  ostringstream os2;
+	  os2 << int(c->memory.sample(seed) + 0.5);
+	  c->R.setContext("memory", os2.str());
+	}
 	if ((maxLatency == 0) || (latency > maxLatency)) maxLatency = latency;
 	C.addRequest(c->serviceKey.c_str(), c->R);
 	totalCPU += cpu;
@@ -378,6 +603,8 @@ main(int argc, char **argv)
       }
       ++rqIndex;
     }
+    if (!phases.empty()) continue;		// Paced by the phases instead
+
     long diff = util::timevalDiffMS(endTime, startTime);
     long sleepTime = delaySeconds * 1000 - diff;
     sleepTime += random() % 100;		// Drift by upto 1/10 of a second
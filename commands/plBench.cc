@@ -0,0 +1,421 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+//////////////////////////////////////////////////////////////////////
+// Drive a service as hard as a fixed number of closed-loop threads
+// can for a fixed period and report throughput, latency percentiles
+// and the client CPU cost per request. The -o option appends the
+// results to a CSV file so that a series of runs builds a
+// machine-readable report for comparison against a baseline.
+//////////////////////////////////////////////////////////////////////
+
+#include "config.h"
+
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "latencyHistogram.h"
+#include "pluton/client.h"
+
+using namespace std;
+
+
+static const char* usage =
+"Usage: plBench [-dh] [-c concurrency] [-C name=value] [-l label] [-L lookupMap]\n"
+"               [-o csvFile] [-s requestSize] [-t seconds] [-T timeout]\n"
+"               [-w warmupSeconds] ServiceKey\n"
+"\n"
+"Send requests to a service from closed-loop threads for a fixed period\n"
+"and report requests/second, latency percentiles and the client CPU\n"
+"used per request.\n"
+"\n"
+"Where:\n"
+" -c   Number of requests in flight at once, each sent by its own\n"
+"       thread (default: 1)\n"
+" -C   Set a context on every request. May be repeated.\n"
+" -d   Turn on pluton::client debugging\n"
+" -h   Print this usage message on STDOUT and exit(0)\n"
+" -l   Label for the CSV row (default: the ServiceKey)\n"
+" -L   The Lookup Map used to connect with the manager (default: '')\n"
+" -o   Append a CSV row of results to csvFile. A header is written\n"
+"       first if the file is empty.\n"
+" -s   Bytes of request data (default: 0)\n"
+" -t   Seconds to measure for (default: 5)\n"
+" -T   Numbers of seconds to wait for a response (default: 5)\n"
+" -w   Seconds to run before measuring starts (default: 1)\n"
+"\n"
+"Only requests that start and complete within the measurement period\n"
+"are counted. Client CPU is the user plus system time of this process\n"
+"over the measurement period divided by the requests counted.\n"
+"\n"
+"The CSV columns are: label, serviceKey, concurrency, size, requests,\n"
+"faults, seconds, requests/second, p50, p99 and p99.9 latency in\n"
+"milliseconds and client CPU in microseconds per request.\n"
+"\n"
+"Exit(1) if any request faulted.\n"
+"\n"
+"Example:\n"
+"\tplBench -c 8 -s 1000 -t 10 -o bench.csv system.echo.0.raw\n"
+"\n"
+"See also: " PACKAGE_URL "\n"
+"\n";
+
+
+static bool		debugFlag = false;
+static int		timeoutMS = 5000;
+static const char*	serviceKey = 0;
+static string		requestData;
+static vector<string>	contextNames;
+static vector<string>	contextValues;
+
+static volatile long long	measureStart = 0;	// Epoch microseconds
+static volatile long long	measureEnd = 0;
+static volatile bool		stopFlag = false;
+
+static pthread_mutex_t	stderrMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static long long
+nowuS()
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+
+  return (long long) now.tv_sec * util::MICROSECOND + now.tv_usec;
+}
+
+static long long
+cpuuS()
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+
+  return (long long) (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * util::MICROSECOND
+    + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Each thread has its own client and results which are merged once
+// all threads have finished.
+//////////////////////////////////////////////////////////////////////
+
+class benchThread {
+public:
+  benchThread() : requests(0), faults(0) {}
+
+  pthread_t			tid;
+  util::latencyHistogram	latency;
+  long	requests;
+  long	faults;
+};
+
+static void*
+bench(void* arg)
+{
+  benchThread* bt = static_cast<benchThread*>(arg);
+
+  pluton::client C("plBench", timeoutMS);
+  C.setDebug(debugFlag);
+  pluton::clientRequest R;
+  R.setRequestData(requestData);
+  for (unsigned int ix=0; ix < contextNames.size(); ++ix) {
+    R.setContext(contextNames[ix].c_str(), contextValues[ix]);
+  }
+
+  while (!stopFlag) {
+    long long startTime = nowuS();
+    if (!C.addRequest(serviceKey, R) || (C.executeAndWaitOne(R) < 0)) {
+      pthread_mutex_lock(&stderrMutex);
+      cerr << C.getFault().getMessage("Error: plBench ", true) << endl;
+      pthread_mutex_unlock(&stderrMutex);
+      ++bt->faults;
+      usleep(10000);			// Don't spin on a dead manager
+      continue;
+    }
+    long long endTime = nowuS();
+
+    if ((startTime < measureStart) || (endTime > measureEnd)) continue;
+
+    ++bt->requests;
+    bt->latency.add(endTime - startTime);
+    if (R.hasFault()) {
+      ++bt->faults;
+      if (bt->faults == 1) {
+	pthread_mutex_lock(&stderrMutex);
+	cerr << "Error: plBench fault " << R.getFaultCode() << " " << R.getFaultText() << endl;
+	pthread_mutex_unlock(&stderrMutex);
+      }
+    }
+  }
+
+  return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Thread handlers for the pluton client
+//////////////////////////////////////////////////////////////////////
+
+static pluton::thread_t
+tSelf(const char* who)
+{
+  return (pluton::thread_t) pthread_self();
+}
+
+static pluton::mutex_t
+mNew(const char* who)
+{
+  pthread_mutex_t* m = new pthread_mutex_t;
+  pthread_mutex_init(m, 0);
+
+  return (pluton::mutex_t) m;
+}
+
+static void
+mDelete(const char* who, pluton::mutex_t m)
+{
+  pthread_mutex_destroy((pthread_mutex_t*) m);
+  delete (pthread_mutex_t*) m;
+}
+
+static int
+mLock(const char* who, pluton::mutex_t m)
+{
+  return pthread_mutex_lock((pthread_mutex_t*) m);
+}
+
+static int
+mUnlock(const char* who, pluton::mutex_t m)
+{
+  return pthread_mutex_unlock((pthread_mutex_t*) m);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+
+static double
+toMS(unsigned long uSecs)
+{
+  return uSecs / 1000.0;
+}
+
+int
+main(int argc, char **argv)
+{
+  char	optionChar;
+  int	concurrency = 1;
+  int	requestSize = 0;
+  int	measureSeconds = 5;
+  int	warmupSeconds = 1;
+  const char* label = 0;
+  const char* lookupMap = "";
+  const char* csvFile = 0;
+
+  while ((optionChar = getopt(argc, argv, "c:C:dhl:L:o:s:t:T:w:")) != -1) {
+    switch (optionChar) {
+
+    case 'c':
+      concurrency = atoi(optarg);
+      if (concurrency <= 0) {
+	cerr << "Error: Concurrency must be greater than zero" << endl;
+	cerr << usage;
+	exit(1);
+      }
+      break;
+
+    case 'C':
+      {
+	const char* eq = strchr(optarg, '=');
+	if (!eq || (eq == optarg)) {
+	  cerr << "Error: Context must be name=value, not " << optarg << endl;
+	  cerr << usage;
+	  exit(1);
+	}
+	contextNames.push_back(string(optarg, eq - optarg));
+	contextValues.push_back(string(eq + 1));
+      }
+      break;
+
+    case 'd': debugFlag = true; break;
+
+    case 'h':
+      cout << usage;
+      exit(0);
+
+    case 'l': label = optarg; break;
+
+    case 'L': lookupMap = optarg; break;
+
+    case 'o': csvFile = optarg; break;
+
+    case 's':
+      requestSize = atoi(optarg);
+      if (requestSize < 0) {
+	cerr << "Error: Request size must not be negative" << endl;
+	cerr << usage;
+	exit(1);
+      }
+      break;
+
+    case 't':
+      measureSeconds = atoi(optarg);
+      if (measureSeconds <= 0) {
+	cerr << "Error: Measurement period must be greater than zero" << endl;
+	cerr << usage;
+	exit(1);
+      }
+      break;
+
+    case 'T':
+      timeoutMS = atoi(optarg) * 1000;
+      if (timeoutMS <= 0) {
+	cerr << "Error: Timeout must be greater than zero" << endl;
+	cerr << usage;
+	exit(1);
+      }
+      break;
+
+    case 'w':
+      warmupSeconds = atoi(optarg);
+      if (warmupSeconds < 0) {
+	cerr << "Error: Warmup must not be negative" << endl;
+	cerr << usage;
+	exit(1);
+      }
+      break;
+
+    default:
+      cerr << usage;
+      exit(1);
+    }
+  }
+
+  argc -= optind;
+  argv += optind;
+
+  if (argc != 1) {
+    cerr << "Error: Must supply exactly one ServiceKey on the command line" << endl;
+    cerr << usage;
+    exit(1);
+  }
+  serviceKey = argv[0];
+  if (!label) label = serviceKey;
+  requestData.assign(requestSize, 'x');
+
+  ////////////////////////////////////////
+  // Have all the options - let's do it
+  ////////////////////////////////////////
+
+  pluton::client::setThreadHandlers(tSelf, mNew, mDelete, mLock, mUnlock);
+
+  pluton::client C("plBench", timeoutMS);
+  C.setDebug(debugFlag);
+  if (!C.initialize(lookupMap)) {
+    cerr << C.getFault().getMessage("Error: plBench initialize: ", true) << endl;
+    exit(1);
+  }
+
+  measureStart = nowuS() + warmupSeconds * util::MICROSECOND;
+  measureEnd = measureStart + measureSeconds * util::MICROSECOND;
+
+  vector<benchThread> threads(concurrency);
+  for (int ix=0; ix < concurrency; ++ix) {
+    if (pthread_create(&threads[ix].tid, 0, bench, &threads[ix]) != 0) {
+      cerr << "Error: plBench pthread_create() failed: " << strerror(errno) << endl;
+      exit(1);
+    }
+  }
+
+  long long now = nowuS();
+  if (measureStart > now) usleep(measureStart - now);
+  long long cpuStart = cpuuS();
+  now = nowuS();
+  if (measureEnd > now) usleep(measureEnd - now);
+  long long cpuUsed = cpuuS() - cpuStart;
+  stopFlag = true;
+
+  benchThread totals;
+  for (int ix=0; ix < concurrency; ++ix) {
+    benchThread& bt = threads[ix];
+    pthread_join(bt.tid, 0);
+    totals.latency.merge(bt.latency);
+    totals.requests += bt.requests;
+    totals.faults += bt.faults;
+  }
+
+  double rate = totals.requests / (double) measureSeconds;
+  long cpuPerRequest = totals.requests ? cpuUsed / totals.requests : 0;
+
+  cout << "plBench: " << label << " Concurrency=" << concurrency << " Size=" << requestSize
+       << " Requests=" << totals.requests << " Faults=" << totals.faults
+       << " Rate=" << (long) rate << "/s"
+       << " ClientCPU=" << cpuPerRequest << "us/rq" << endl;
+  cout << "plBench: ";
+  totals.latency.printSummary(cout);
+  cout << endl;
+
+  if (csvFile) {
+    struct stat sb;
+    bool needHeader = (stat(csvFile, &sb) == -1) || (sb.st_size == 0);
+    ofstream os(csvFile, ios::app);
+    if (!os) {
+      cerr << "Error: plBench could not open " << csvFile << ": " << strerror(errno) << endl;
+      exit(1);
+    }
+    if (needHeader) {
+      os << "label,serviceKey,concurrency,size,requests,faults,seconds,rps,"
+	 << "p50ms,p99ms,p999ms,clientCPUus" << endl;
+    }
+    os << label << "," << serviceKey << "," << concurrency << "," << requestSize
+       << "," << totals.requests << "," << totals.faults << "," << measureSeconds
+       << "," << fixed << setprecision(1) << rate
+       << "," << setprecision(3) << toMS(totals.latency.getPercentile(50))
+       << "," << toMS(totals.latency.getPercentile(99))
+       << "," << toMS(totals.latency.getPercentile(99.9))
+       << "," << cpuPerRequest << endl;
+  }
+
+  return (totals.faults > 0) ? 1 : 0;
+}
@@ -42,10 +42,14 @@ using namespace std;
 
 
 static const char* usage =
-"Usage: plNetStringGrep [-hnv] [typeList]\n"
+"Usage: plNetStringGrep [-dhnv] [typeList]\n"
 "\n"
 "Read netStrings from STDIN and write matching types to STDOUT.\n"
 "\n"
+" -d   Only write the data of matching netStrings. This unwraps\n"
+"       netStrings that contain other netStrings, such as the\n"
+"       request packets in a recorder ring.\n"
+"\n"
 " -h   Display usage and exit\n"
 "\n"
 " -n   Convert the trailing netString terminator to a newline\n"
@@ -76,6 +80,11 @@ static const char* usage =
 "      a previously created regression comparison file to see\n"
 "      whether results have changed or not.\n"
 "\n"
+" $ plNetStringGrep -d I <record.ring.1234 >requests\n"
+" $ myService 3<requests 4>responses\n"
+"\n"
+"      Replay the requests captured in a recorder ring.\n"
+"\n"
 "If the input file does not contain an invalid netString\n"
 "an error message is written to STDERR and the program exits.\n"
 "\n"
@@ -89,10 +98,13 @@ main(int argc, char **argv)
 {
   bool conditionRequired = true;
   bool convertTerminate = false;
+  bool dataOnly = false;
 
   char optionChar;
-  while ((optionChar = getopt(argc, argv, "hnv")) != -1) {
+  while ((optionChar = getopt(argc, argv, "dhnv")) != -1) {
     switch (optionChar) {
+    case 'd': dataOnly = true; break;
+
     case 'h':
       cout << usage;
       exit(0);
@@ -148,7 +160,10 @@ main(int argc, char **argv)
       bool matchCondition = true;
       if (typeList) matchCondition = strchr(typeList, nsType);
       if (matchCondition == conditionRequired) {
-	if (convertTerminate) {
+	if (dataOnly) {
+	  cout.write(nsDataPtr, nsDataLength);
+	}
+	else if (convertTerminate) {
 	  cout.write(rawPtr, rawLength-1);
 	  cout << endl;
 	}
@@ -30,14 +30,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "config.h"
 
+#include <fstream>
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <vector>
 
 #include <sys/time.h>
 
 #include <errno.h>
 #include <ctype.h>
+#include <math.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
@@ -45,6 +49,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <unistd.h>
 
 #include "util.h"
+#include "latencyHistogram.h"
 #include "pluton/client.h"
 
 using namespace std;
@@ -53,6 +58,8 @@ using namespace std;
 static const char* usage =
 "Usage: plPing [-dhKkNnow] [-c count] [-C contextValue] [-s packetsize]\n"
 "                          [-L lookupMap] [-p parallelCount] [-t timeout] [ServiceKey]\n"
+"       plPing -r rate [-dEhno] [-c count] [-C contextValue] [-s packetsize]\n"
+"                      [-L lookupMap] [-S csvFile] [-T threads] [-t timeout] [ServiceKey]\n"
 "\n"
 "Measure the response time of a pluton service\n"
 "\n"
@@ -61,6 +68,8 @@ static const char* usage =
 " -C   Set context with this value (the normal echo service uses this\n"
 "       as a sleep value)\n"
 " -d   Turn on debug\n"
+" -E   Open-loop: start requests at exponentially distributed intervals,\n"
+"       as a Poisson process would, rather than at fixed intervals\n"
 " -h   Print this usage message on STDOUT and exit(0)\n"
 " -i   Wait 'wait' seconds between requests (default: 1)\n"
 "       If set to zero, this is effectively a ping flood.\n"
@@ -71,12 +80,25 @@ static const char* usage =
 " -n   Do *not* check the response for a valid echo\n"
 " -o   Oneshot. Set the 'noRetryAttr' attribute\n"
 " -p   Number of requests to send in parallel (default: 1)\n"
+" -r   Open-loop: start 'rate' requests per second regardless of how\n"
+"       quickly the service responds\n"
+" -S   Open-loop: write per-second latency percentiles to csvFile\n"
 " -s   Size of random data to generate in the request (default: 0)\n"
+" -T   Open-loop: number of threads sending requests (default: 16)\n"
 " -t   Numbers of seconds to wait for a response (default: 5)\n"
 " -w   NoWait. Set the 'noWaitAttr' attribute\n"
 "\n"
 " ServiceKey: name of service to request (default: system.echo.0.raw)\n"
 "\n"
+"Normally plPing is closed-loop: it waits for responses before sending\n"
+"more requests, which hides queueing in the service and under-reports\n"
+"tail latency under load. With -r, requests are started on a schedule\n"
+"and latency is measured from when each request was scheduled to be\n"
+"sent, so any delay caused by the service falling behind is counted.\n"
+"The results are reported as a percentile table. Requests sent more\n"
+"than a millisecond late are reported as 'Behind'; many of these\n"
+"suggest that more threads are needed.\n"
+"\n"
 "See also: " PACKAGE_URL "\n"
 "\n";
 
@@ -230,6 +252,262 @@ checkOneResponse(bool checkEcho, myRequest* retR, struct timeval& startTime, con
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Open-loop mode. Each thread repeatedly claims the next slot in the
+// schedule, sleeps until then and exchanges one request. Latency is
+// measured from the scheduled time rather than the actual send time
+// to avoid coordinated omission: if the service stalls, the requests
+// that should have been sent during the stall are charged with the
+// time they spent waiting to be sent.
+//
+// All results are kept under the one mutex. The cost is trivial
+// compared to a request exchange.
+//////////////////////////////////////////////////////////////////////
+
+class openLoopParameters {
+public:
+  openLoopParameters() : poisson(false), rate(0), context(0), serviceKey(0),
+			 checkEcho(true), oneShot(false), timeoutMS(0) {}
+
+  bool		poisson;
+  double	rate;
+  const char*	context;
+  const char*	serviceKey;
+  string	payload;
+  bool		checkEcho;
+  bool		oneShot;
+  int		timeoutMS;
+};
+
+static pthread_mutex_t	olMutex = PTHREAD_MUTEX_INITIALIZER;
+static long		olRemaining;		// -1 is forever
+static double		olNextScheduled;	// Epoch microseconds
+static unsigned short	olSeed[3];
+static int		olRunning = 0;
+
+static util::latencyHistogram	olTotal;
+static util::latencyHistogram	olInterval;
+static long		olFaults = 0;
+static long		olBehind = 0;
+static long		olIntervalFaults = 0;
+static long		olIntervalBehind = 0;
+
+static long long
+nowuS()
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+
+  return (long long) now.tv_sec * util::MICROSECOND + now.tv_usec;
+}
+
+static void*
+openLoopSender(void* arg)
+{
+  const openLoopParameters* olp = static_cast<const openLoopParameters*>(arg);
+
+  pluton::client C("plPing", olp->timeoutMS);
+  pluton::clientRequest R;
+
+  while (!terminateFlag) {
+    pthread_mutex_lock(&olMutex);
+    if (olRemaining == 0) {
+      pthread_mutex_unlock(&olMutex);
+      break;
+    }
+    if (olRemaining > 0) --olRemaining;
+    long long scheduled = (long long) olNextScheduled;
+    double interval = util::MICROSECOND / olp->rate;
+    if (olp->poisson) interval *= -log(1.0 - erand48(olSeed));
+    olNextScheduled += interval;
+    pthread_mutex_unlock(&olMutex);
+
+    long long sentAt = nowuS();
+    if (scheduled > sentAt) {
+      usleep(scheduled - sentAt);
+      sentAt = nowuS();
+    }
+
+    R.reset();
+    R.setRequestData(olp->payload.data(), olp->payload.length());
+    if (olp->oneShot) R.setAttribute(pluton::noRetryAttr);
+    if (olp->context) R.setContext("echo.sleepMS", olp->context);
+
+    bool ok = C.addRequest(olp->serviceKey, R) && (C.executeAndWaitOne(R) == 1) && !R.hasFault();
+    long long latency = nowuS() - scheduled;
+
+    if (ok && olp->checkEcho) {
+      const char* resp;
+      int respLen;
+      R.getResponseData(resp, respLen);
+      ok = ((unsigned) respLen == olp->payload.length())
+	&& (memcmp(resp, olp->payload.data(), respLen) == 0);
+    }
+
+    pthread_mutex_lock(&olMutex);
+    olTotal.add(latency);
+    olInterval.add(latency);
+    if (!ok) {
+      ++olFaults;
+      ++olIntervalFaults;
+    }
+    if (sentAt - scheduled > 1000) {
+      ++olBehind;
+      ++olIntervalBehind;
+    }
+    pthread_mutex_unlock(&olMutex);
+  }
+
+  pthread_mutex_lock(&olMutex);
+  --olRunning;
+  pthread_mutex_unlock(&olMutex);
+
+  return 0;
+}
+
+static void
+putCSVms(ostream& os, unsigned long uSecs)
+{
+  os << "," << uSecs / 1000 << "." << setfill('0') << setw(3) << uSecs % 1000 << setfill(' ');
+}
+
+static void
+writeCSVInterval(ostream& os, long long elapsed)
+{
+  os << elapsed / util::MICROSECOND << "." << setfill('0') << setw(3)
+     << elapsed % util::MICROSECOND / 1000 << setfill(' ')
+     << "," << olInterval.getCount() << "," << olIntervalFaults << "," << olIntervalBehind;
+  putCSVms(os, olInterval.getMean());
+  putCSVms(os, olInterval.getPercentile(50.0));
+  putCSVms(os, olInterval.getPercentile(90.0));
+  putCSVms(os, olInterval.getPercentile(99.0));
+  putCSVms(os, olInterval.getPercentile(99.9));
+  putCSVms(os, olInterval.getMaximum());
+  os << endl;
+
+  olInterval.reset();
+  olIntervalFaults = 0;
+  olIntervalBehind = 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Thread handlers for the pluton client
+//////////////////////////////////////////////////////////////////////
+
+static pluton::thread_t
+tSelf(const char* who)
+{
+  return (pluton::thread_t) pthread_self();
+}
+
+static pluton::mutex_t
+mNew(const char* who)
+{
+  pthread_mutex_t* m = new pthread_mutex_t;
+  pthread_mutex_init(m, 0);
+
+  return (pluton::mutex_t) m;
+}
+
+static void
+mDelete(const char* who, pluton::mutex_t m)
+{
+  pthread_mutex_destroy((pthread_mutex_t*) m);
+  delete (pthread_mutex_t*) m;
+}
+
+static int
+mLock(const char* who, pluton::mutex_t m)
+{
+  return pthread_mutex_lock((pthread_mutex_t*) m);
+}
+
+static int
+mUnlock(const char* who, pluton::mutex_t m)
+{
+  return pthread_mutex_unlock((pthread_mutex_t*) m);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Run the open-loop threads, write the time series every second and
+// print the percentile table at the end. Return the exit code.
+//////////////////////////////////////////////////////////////////////
+
+static int
+openLoop(openLoopParameters& olp, int threadCount, long count, const char* lookupMap,
+	 const char* csvFile, bool debugFlag)
+{
+  ofstream csv;
+  if (csvFile) {
+    csv.open(csvFile);
+    if (!csv) {
+      cerr << "Error: Could not open " << csvFile << ": " << strerror(errno) << endl;
+      return 17;
+    }
+    csv << "Seconds,Requests,Faults,Behind,Mean,P50,P90,P99,P99.9,Max" << endl;
+  }
+
+  pluton::client::setThreadHandlers(tSelf, mNew, mDelete, mLock, mUnlock);
+
+  pluton::client C("plPing", olp.timeoutMS);
+  if (debugFlag) C.setDebug(true);
+  if (!C.initialize(lookupMap)) {
+    cerr << C.getFault().getMessage("plPing could not initialize") << endl;
+    return 11;
+  }
+
+  signal(SIGINT, catchINT);
+
+  long long startTime = nowuS();
+  olRemaining = count;
+  olNextScheduled = startTime;
+  olSeed[0] = startTime;
+  olSeed[1] = startTime >> 16;
+  olSeed[2] = getpid();
+  olRunning = threadCount;
+
+  vector<pthread_t> threads(threadCount);
+  for (int ix=0; ix < threadCount; ++ix) {
+    if (pthread_create(&threads[ix], 0, openLoopSender, &olp) != 0) {
+      cerr << "Error: pthread_create() failed: " << strerror(errno) << endl;
+      exit(18);
+    }
+  }
+
+  long long nextReport = startTime + util::MICROSECOND;
+  while (true) {
+    usleep(10000);
+    long long now = nowuS();
+    pthread_mutex_lock(&olMutex);
+    bool done = (olRunning == 0);
+    if (csvFile && (done || (now >= nextReport))) {
+      writeCSVInterval(csv, now - startTime);
+      nextReport += util::MICROSECOND;
+    }
+    pthread_mutex_unlock(&olMutex);
+    if (done) break;
+  }
+
+  for (int ix=0; ix < threadCount; ++ix) pthread_join(threads[ix], 0);
+  long long elapsed = nowuS() - startTime;
+
+  if (terminateFlag) cout << endl;	// NL past the ^C to look pretty
+  cout << "plPings: " << olTotal.getCount() << " Faults=" << olFaults << " Behind=" << olBehind
+       << " Elapse: " << elapsed / util::MICROSECOND << "."
+       << setfill('0') << setw(6) << elapsed % util::MICROSECOND << setfill(' ')
+       << " Rate=" << (elapsed > 0 ? olTotal.getCount() * util::MICROSECOND / elapsed : 0) << "/s"
+       << endl;
+  cout << "plPings: ";
+  olTotal.printSummary(cout);
+  cout << endl;
+  olTotal.printPercentiles(cout);
+
+  return (olFaults > 0) ? 15 : 0;
+}
+
+
 int
 main(int argc, char **argv)
 {
@@ -251,8 +529,12 @@ main(int argc, char **argv)
   bool  sendDie = false;
   bool	noWait = false;
   bool	checkEcho = true;
+  bool	poisson = false;
+  double rate = 0;
+  int	threadCount = 16;
+  const char* csvFile = 0;
 
-  while ((optionChar = getopt(argc, argv, "C:c:dhi:KkL:Nnop:s:t:w")) != -1) {
+  while ((optionChar = getopt(argc, argv, "C:c:dEhi:KkL:Nnop:r:S:s:T:t:w")) != -1) {
     switch (optionChar) {
 
     case 'C': context = optarg; break;
@@ -269,6 +551,8 @@ main(int argc, char **argv)
 
     case 'd': debugFlag = true; break;
 
+    case 'E': poisson = true; break;
+
     case 'K': keepAffinity = true; break;
 
     case 'k': sendDie = true; break;
@@ -299,6 +583,17 @@ main(int argc, char **argv)
       }
       break;
 
+    case 'r':
+      rate = atof(optarg);
+      if (rate <= 0) {
+	cerr << "Error: Rate must be greater than zero" << endl;
+	cerr << usage;
+	exit(19);
+      }
+      break;
+
+    case 'S': csvFile = optarg; break;
+
     case 's':
       payloadSize = atoi(optarg);
       if (payloadSize < 0) {
@@ -308,6 +603,15 @@ main(int argc, char **argv)
       }
       break;
 
+    case 'T':
+      threadCount = atoi(optarg);
+      if (threadCount <= 0) {
+	cerr << "Error: Thread count must be greater than zero" << endl;
+	cerr << usage;
+	exit(20);
+      }
+      break;
+
     case 't':
       timeoutSeconds = atoi(optarg);
       if (timeoutSeconds <= 0) {
@@ -345,10 +649,33 @@ main(int argc, char **argv)
     exit(10);
   }
 
+  if ((rate == 0) && (poisson || csvFile)) {
+    cerr << "Error: -E and -S are only valid with -r" << endl;
+    cerr << usage;
+    exit(21);
+  }
+
   ////////////////////////////////////////
   // Have all the options - let's do it
   ////////////////////////////////////////
 
+  if (rate > 0) {
+    openLoopParameters olp;
+    olp.poisson = poisson;
+    olp.rate = rate;
+    olp.context = context;
+    olp.serviceKey = serviceKey;
+    olp.checkEcho = checkEcho;
+    olp.oneShot = oneShot;
+    olp.timeoutMS = timeoutSeconds * 1000;
+    if (payloadSize > 0) {
+      olp.payload.resize(payloadSize);
+      fillRequestData(&olp.payload[0], (time(0) % 26) + 'A', payloadSize);
+    }
+
+    return openLoop(olp, threadCount, repeatCount, lookupMap, csvFile, debugFlag);
+  }
+
   if (debugFlag) {
     cout << "plPing " << lookupMap << " Repeats=";
     if (repeatCount < 0) {
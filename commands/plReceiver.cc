@@ -33,9 +33,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 
 #include <string>
+#include <list>
+#include <vector>
 #include <iostream>
 
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 
 using namespace std;
@@ -61,19 +71,22 @@ static int concurrency = 0;
 static const char* usage =
 "\n"
 "Usage: plReceiver [-dh] [-a maxAccepts] [-k ServiceKey]\n"
-"                  [-l lookupMapPath] [-s maxRequestDurationSecs]\n"
-"                  [[Interface][:port]]\n"
+"                  [-l lookupMapPath] [-m requestsPerConnection]\n"
+"                  [-s maxRequestDurationSecs] [[Interface][:port]]\n"
 "\n"
 "Accept and submit Pluton Requests sent by remote plTransmitters\n"
 "\n"
 "Where:\n"
 "\n"
-" -a   Maximum number of concurrent accepted requests (default: 10)\n"
+" -a   Maximum number of concurrent accepted connections (default: 10)\n"
 " -d   Turn on debugging output\n"
 " -h   Print this usage message on STDOUT and exit(0)\n"
 " -k   Replace requested ServiceKey with this value. This is useful\n"
 "       when running plReceiver on the same system as plTransmitter.\n"
 " -l   The Lookup Map used to connect to the local service (default: '')\n"
+" -m   Maximum requests run at once for each connection on which a\n"
+"       plTransmitter multiplexes requests, so up to -a x -m requests\n"
+"       may be running at once (default: 100)\n"
 " -s   Maximum seconds allowed per request (default: 30)\n"
 "\n"
 " Interface and Port define the listening address (default: localhost:14099)\n"
@@ -81,19 +94,79 @@ static const char* usage =
 "See also: " PACKAGE_URL "\n"
 "\n";
 
+//////////////////////////////////////////////////////////////////////
+// A plTransmitter may multiplex tagged requests over its
+// connection. Each request runs in its own thread and its response
+// is queued for a writer thread, which coalesces whatever responses
+// are ready into writev() calls. The reading thread stops reading
+// while requestsPerConnection are running.
+//////////////////////////////////////////////////////////////////////
+
+class multiplexResponse {
+public:
+  multiplexResponse(unsigned int tag, const char* setPtr, int setLength)
+    : responsePtr(setPtr), responseLength(setLength), writtenFlag(false), cvar(st_cond_new())
+  {
+    pluton::decodeMultiplexFrame::assemble(tag, responseLength, pre, post);
+  }
+  ~multiplexResponse() { st_cond_destroy(cvar); }
+
+  netStringGenerate	pre;
+  const char*		responsePtr;
+  int			responseLength;
+  netStringGenerate	post;
+
+  bool			writtenFlag;
+  st_cond_t		cvar;
+};
+
+typedef list<multiplexResponse*>		multiplexResponseList;
+typedef list<multiplexResponse*>::iterator	multiplexResponseListIter;
+
+class multiplexConnection {
+public:
+  multiplexConnection(st_netfd_t setFD)
+    : fd(setFD), outstanding(0), writerRunning(false), closingFlag(false), failedFlag(false),
+      cvar(st_cond_new()), writerCvar(st_cond_new()) {}
+  ~multiplexConnection() { st_cond_destroy(cvar); st_cond_destroy(writerCvar); }
+
+  st_netfd_t		fd;
+  int			outstanding;		// Request threads running
+  bool			writerRunning;
+  bool			closingFlag;
+  bool			failedFlag;
+  st_cond_t		cvar;			// Request thread or writer finished
+  st_cond_t		writerCvar;		// Something to write or closing
+  multiplexResponseList	writeQueue;
+};
+
+class multiplexRequest {
+public:
+  multiplexRequest(multiplexConnection* setM, unsigned int setTag, const char* p, int l)
+    : M(setM), tag(setTag), packet(p, l) {}
+
+  multiplexConnection*	M;
+  unsigned int		tag;
+  string		packet;
+};
+
+
 //////////////////////////////////////////////////////////////////////
 // These statics are used to communicate command-line parameters to
 // the threads.
 //////////////////////////////////////////////////////////////////////
 
 static void*	handler(void*);
+static void*	multiplexHandler(void*);
+static void*	multiplexWriter(void*);
 
 static  int	maxAccepts = 10;
 static  bool	debugFlag = false;
-static  char*	lookupMapPath = "";
+static  const char*	lookupMapPath = "";
 static	bool	shutdownFlag = false;
 static	char*	serviceKey = 0;
 static	int	maxRequestDurationSecs = 30;
+static	int	requestsPerConnection = 100;
 
 //////////////////////////////////////////////////////////////////////
 
@@ -102,7 +175,7 @@ main(int argc, char** argv)
 {
   char optionChar;
 
-  while ((optionChar = getopt(argc, argv, "a:dhk:l:s:")) != EOF) {
+  while ((optionChar = getopt(argc, argv, "a:dhk:l:m:s:")) != EOF) {
     switch (optionChar) {
     case 'a':
       maxAccepts = atoi(optarg);
@@ -128,6 +201,14 @@ main(int argc, char** argv)
       lookupMapPath = optarg;
       break;
 
+    case 'm':
+      requestsPerConnection = atoi(optarg);
+      if (requestsPerConnection <= 0) {
+	cerr << "Error: requestsPerConnection must be greater than zero" << endl << usage;
+	exit(1);
+      }
+      break;
+
     case 's':
       maxRequestDurationSecs = atoi(optarg);
       if (maxRequestDurationSecs <= 0) {
@@ -164,16 +245,21 @@ main(int argc, char** argv)
     exit(1);
   }
  
+  st_init();					// Before any netfd is opened
   st_netfd_t acceptFDs = st_netfd_open_socket(li.transferFD());
   if (!acceptFDs) {
     perror("Error: Could not st_netfdopen_socket");
     exit(1);
   }
 
+  // A plTransmitter that goes away shows up as a failed write rather
+  // than a signal.
+
+  signal(SIGPIPE, SIG_IGN);
+
   pluton::client C(myName);
   C.initialize(lookupMapPath);
   //  C.setDebug(debugFlag);
-  st_init();
   C.setPollProxy(st_poll);
 
   //////////////////////////////////////////////////////////////////////
@@ -199,17 +285,50 @@ main(int argc, char** argv)
 
 
 //////////////////////////////////////////////////////////////////////
-// Loop on reading data until we have a complete packet or error.
-// Return: -1 = error
+// Loop on reading data until we have a complete packet, or a complete
+// multiplexed frame, or error.
+// Return: -1 = error, -2 = timed out before any of the packet arrived
 //////////////////////////////////////////////////////////////////////
 
 int
 readPacket(st_netfd_t fd, netStringFactoryManaged& packetIn, pluton::decodePacket& decoder,
-	   int maxDuration, string& em)
+	   pluton::decodeMultiplexFrame& frame, int maxDuration, string& em)
 {
   time_t endTime = st_time() + maxDuration;	// Make sure we don't wedge forever
+  bool firstFlag = true;
 
   while (true) {
+
+    //////////////////////////////////////////////////////////////////////
+    // Decode what is already buffered first as a multiplexing
+    // plTransmitter may have sent many frames in the one write.
+    //////////////////////////////////////////////////////////////////////
+
+    const char* parseError = 0;
+    while (packetIn.haveNetString(parseError)) {
+      char nsType;
+      const char* nsDataPtr;
+      int nsDataLength;
+      int nsOffset;
+      packetIn.getNetString(nsType, nsDataPtr, nsDataLength, &nsOffset);
+
+      // A multiplexed frame is recognized by its leading type
+
+      if ((firstFlag && (nsType == pluton::multiplexPT)) || frame.isStarted()) {
+	if (!frame.addType(nsType, nsDataPtr, nsDataLength, nsOffset, em)) return -1;
+	if (frame.haveCompleteFrame()) return 1;	// Have one frame
+      }
+      else {
+	if (!decoder.addType(nsType, nsDataPtr, nsDataLength, nsOffset, em)) return -1;
+	if (decoder.haveCompleteRequest()) return 1;	// Have one packet
+      }
+      firstFlag = false;
+    }
+    if (parseError) {
+      em = parseError;
+      return -1;
+    }
+
     char* bufPtr;
     int minRequired, maxAllowed;
     if (packetIn.getReadParameters(bufPtr, minRequired, maxAllowed) == -1) {
@@ -230,33 +349,41 @@ readPacket(st_netfd_t fd, netStringFactoryManaged& packetIn, pluton::decodePacke
     if (bytes == 0) return 0;
     if (bytes < 0) {
       if (errno == EAGAIN) continue;
+      if ((errno == ETIME) && firstFlag && (packetIn.getBytesInUse() == packetIn.getRawOffset())) {
+	em = "Connection idle for maxRequestDurationSecs";
+	return -2;
+      }
       em = "Socket read failed or timed out";
       return -1;
     }
 
-    //////////////////////////////////////////////////////////////////////
-    // Got some data, decode it and look for a completed response.
-    //////////////////////////////////////////////////////////////////////
-
     packetIn.addBytesRead(bytes);
-    const char* parseError = 0;
-    while (packetIn.haveNetString(parseError)) {
-      char nsType;
-      const char* nsDataPtr;
-      int nsDataLength;
-      int nsOffset;
-      packetIn.getNetString(nsType, nsDataPtr, nsDataLength, &nsOffset);
-      if (!decoder.addType(nsType, nsDataPtr, nsDataLength, nsOffset, em)) return -1;
-      if (decoder.haveCompleteRequest()) return 1;	// Have one packet
-    }
-    if (parseError) {
-      em = parseError;
-      return -1;
-    }
   }
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// A request that failed here never got a response from the local
+// service, so there is nothing to relay. Make a response packet that
+// carries the fault back to the remote client rather than leave it
+// to time out.
+//////////////////////////////////////////////////////////////////////
+
+static void
+faultResponse(pluton::clientRequest& R, unsigned int requestID, string& packet)
+{
+  pluton::clientRequestImpl* rImpl = R.getImpl();
+  if (!rImpl->hasFault()) rImpl->setFault(pluton::remoteTransferFailed, "No response from service");
+  rImpl->setRequestID(requestID);
+  rImpl->setCompressAccept(0, 0);		// Says nothing about the service
+
+  netStringGenerate pre, post;
+  rImpl->assembleResponsePacket(myName, pre, post);
+  packet.assign(pre.data(), pre.length());
+  packet.append(post.data(), post.length());
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // Each accept instance is managed by a separate thread.
 //////////////////////////////////////////////////////////////////////
@@ -280,6 +407,7 @@ handler(void *voidFD)
 
   netStringFactoryManaged packetIn;
   pluton::decodeRequestPacket decoder;
+  pluton::decodeMultiplexFrame frame;
   pluton::clientRequest R;
 
   packetIn.disableCompaction();	// Stop internal data from moving
@@ -304,19 +432,64 @@ handler(void *voidFD)
     if (debugFlag) clog << myName << " accepted by " << st_thread_self()
 			<< " MaxC=" << maxConcurrency << endl;
 
+    // Responses are written in one go, or corked when multiplexed, so
+    // Nagle only ever adds latency.
+
+    int noDelay = 1;
+    setsockopt(st_netfd_fileno(fd), IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    multiplexConnection* M = 0;
+
     while (true) {
       packetIn.reclaimByCompaction();
       decoder.reset();
       decoder.setRequest(R.getImpl());
+      frame.reset();
       R.getImpl()->setPacketOffset(packetIn.getRawOffset());
 
       string em;
-      int packetCount = readPacket(fd, packetIn, decoder, maxRequestDurationSecs, em);
+      int packetCount = readPacket(fd, packetIn, decoder, frame, maxRequestDurationSecs, em);
       if (packetCount == 0) break;		// Eof
+      if ((packetCount == -2) && M && (M->outstanding > 0)) continue;	// Quiet, not idle
       if (packetCount < 0) {
 	if (debugFlag) clog << "ReadPacket error: " << em << endl;
 	break;
       }
+
+      //////////////////////////////////////////////////////////////////////
+      // A multiplexed request is copied out and run by its own thread
+      // so that this thread can get straight on with reading the next.
+      //////////////////////////////////////////////////////////////////////
+
+      if (frame.haveCompleteFrame()) {
+	if (!M) {
+	  M = new multiplexConnection(fd);
+	  if (!st_thread_create(multiplexWriter, (void*) M, 0, 0)) {
+	    clog << "Error: " << myName << " could not create a state thread" << endl;
+	    break;
+	  }
+	  M->writerRunning = true;
+	}
+	while ((M->outstanding >= requestsPerConnection) && !M->failedFlag) st_cond_wait(M->cvar);
+	if (M->failedFlag) break;
+
+	int offset, length;
+	frame.getPacket(offset, length);
+	multiplexRequest* MR = new multiplexRequest(M, frame.getTag(),
+						    packetIn.getBasePtr() + offset, length);
+	if (!st_thread_create(multiplexHandler, (void*) MR, 0, 0)) {
+	  clog << "Error: " << myName << " could not create a state thread" << endl;
+	  delete MR;
+	  break;
+	}
+	++M->outstanding;
+	continue;
+      }
+
+      if (M) {
+	if (debugFlag) clog << "Unframed request on a multiplexed connection" << endl;
+	break;
+      }
       R.getImpl()->adjustOffsets(packetIn.getBasePtr(), packetIn.getRawOffset());
 
 #ifdef NO
@@ -332,12 +505,12 @@ handler(void *voidFD)
       const char* rawPtr;
       int rawLength;
       R.getImpl()->getInboundPacketData(rawPtr, rawLength);
-      if (!C.addRawRequest(serviceKey ? serviceKey : R.getImpl()->getServiceKey().c_str(), &R,
-			   rawPtr, rawLength)) {
+      bool addedFlag = C.addRawRequest(serviceKey ? serviceKey : R.getImpl()->getServiceKey().c_str(),
+				       &R, rawPtr, rawLength);
+      if (!addedFlag) {
 	if (debugFlag) clog << "addRequest failed " << R.getFaultText() << endl;
-	continue;
       }
-      if (C.executeAndWaitOne(R) == -1) {
+      else if (C.executeAndWaitOne(R) == -1) {
 	if (debugFlag) clog << "executeAndWait failed" << endl;
 	break;
       }
@@ -346,7 +519,14 @@ handler(void *voidFD)
       // ... relay the response back to the original sender.
       //////////////////////////////////////////////////////////////////////
 
-      R.getImpl()->getInboundPacketData(rawPtr, rawLength);
+      string faultPacket;
+      rawLength = 0;
+      if (addedFlag) R.getImpl()->getInboundPacketData(rawPtr, rawLength);
+      if (rawLength == 0) {
+	faultResponse(R, decoder.getRequestID(), faultPacket);
+	rawPtr = faultPacket.data();
+	rawLength = faultPacket.length();
+      }
 #ifdef NO
       if (debugFlag) clog << myName << "Request completed: Len="
 			  << rawLength
@@ -358,9 +538,161 @@ handler(void *voidFD)
 	break;
       }
     }
+
+    //////////////////////////////////////////////////////////////////////
+    // Let multiplexed requests finish and the writer drain before
+    // closing the connection from under them.
+    //////////////////////////////////////////////////////////////////////
+
+    if (M) {
+      while (M->outstanding > 0) st_cond_wait(M->cvar);
+      M->closingFlag = true;
+      st_cond_signal(M->writerCvar);
+      while (M->writerRunning) st_cond_wait(M->cvar);
+      delete M;
+    }
+
     --concurrency;
     st_netfd_close(fd);
   }
 
   return 0;
 }
+
+
+//////////////////////////////////////////////////////////////////////
+// Run one multiplexed request with its own pluton::client and queue
+// the tagged response for the writer. The response stays in R until
+// the writer has sent it.
+//////////////////////////////////////////////////////////////////////
+
+static void*
+multiplexHandler(void* voidMR)
+{
+  multiplexRequest* MR = (multiplexRequest*) voidMR;
+  multiplexConnection* M = MR->M;
+
+  pluton::client C;
+  C.initialize("");
+
+  pluton::clientRequest R;
+  pluton::decodeRequestPacket decoder(R.getImpl());
+
+  string em;
+  if (!decoder.decodeEncapsulated(MR->packet.data(), 0, MR->packet.length(), em)) {
+    if (debugFlag) clog << "Multiplexed packet error: " << em << endl;
+    M->failedFlag = true;
+    shutdown(st_netfd_fileno(M->fd), SHUT_RDWR);	// Stop the reader
+  }
+  else {
+    bool addedFlag = C.addRawRequest(serviceKey ? serviceKey : R.getImpl()->getServiceKey().c_str(),
+				     &R, MR->packet.data(), MR->packet.length());
+    if (!addedFlag) {
+      if (debugFlag) clog << "addRequest failed " << R.getFaultText() << endl;
+    }
+    else if (C.executeAndWaitOne(R) == -1) {
+      if (debugFlag) clog << "executeAndWait failed" << endl;
+    }
+
+    const char* rawPtr;
+    int rawLength = 0;
+    string faultPacket;
+    if (addedFlag) R.getImpl()->getInboundPacketData(rawPtr, rawLength);
+    if (rawLength == 0) {
+      faultResponse(R, decoder.getRequestID(), faultPacket);
+      rawPtr = faultPacket.data();
+      rawLength = faultPacket.length();
+    }
+
+    multiplexResponse out(MR->tag, rawPtr, rawLength);
+    M->writeQueue.push_back(&out);
+    st_cond_signal(M->writerCvar);
+    while (!out.writtenFlag) st_cond_wait(out.cvar);
+  }
+
+  --M->outstanding;
+  st_cond_signal(M->cvar);
+  delete MR;
+
+  return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Write as many queued responses as writev() accepts in one call,
+// corking the connection while more remain so that a burst goes out
+// as full segments. Once a write fails, queued responses are simply
+// released.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef IOV_MAX
+#define IOV_MAX 16				// The POSIX minimum
+#endif
+
+static void*
+multiplexWriter(void* voidM)
+{
+  multiplexConnection* M = (multiplexConnection*) voidM;
+  int sock = st_netfd_fileno(M->fd);
+  bool corkedFlag = false;
+
+  while (true) {
+    while (M->writeQueue.empty() && !M->closingFlag) st_cond_wait(M->writerCvar);
+    if (M->writeQueue.empty()) break;		// Closing and drained
+
+    vector<struct iovec> iov;
+    multiplexResponseList batch;
+    int length = 0;
+    while (!M->writeQueue.empty() && (iov.size() + 3 <= IOV_MAX)) {
+      multiplexResponse* out = M->writeQueue.front();
+      M->writeQueue.pop_front();
+      batch.push_back(out);
+
+      struct iovec vec;
+      vec.iov_base = const_cast<char*>(out->pre.data());
+      vec.iov_len = out->pre.length();
+      iov.push_back(vec);
+      if (out->responseLength > 0) {
+	vec.iov_base = const_cast<char*>(out->responsePtr);
+	vec.iov_len = out->responseLength;
+	iov.push_back(vec);
+      }
+      vec.iov_base = const_cast<char*>(out->post.data());
+      vec.iov_len = out->post.length();
+      iov.push_back(vec);
+      length += out->pre.length() + out->responseLength + out->post.length();
+    }
+
+    if (!M->failedFlag) {
+#ifdef TCP_CORK
+      if (!corkedFlag && !M->writeQueue.empty()) {
+	int onOff = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_CORK, &onOff, sizeof(onOff));
+	corkedFlag = true;
+      }
+#endif
+      if (st_writev(M->fd, &iov[0], iov.size(), maxRequestDurationSecs * util::MICROSECOND) != length) {
+	if (debugFlag) perror("st_writev");
+	M->failedFlag = true;
+	shutdown(sock, SHUT_RDWR);		// Stop the reader
+      }
+#ifdef TCP_CORK
+      if (corkedFlag && (M->failedFlag || M->writeQueue.empty())) {
+	int onOff = 0;
+	setsockopt(sock, IPPROTO_TCP, TCP_CORK, &onOff, sizeof(onOff));
+	corkedFlag = false;
+      }
+#endif
+    }
+
+    for (multiplexResponseListIter oi=batch.begin(); oi != batch.end(); ++oi) {
+      (*oi)->writtenFlag = true;
+      st_cond_signal((*oi)->cvar);
+    }
+  }
+
+  M->writerRunning = false;
+  st_cond_signal(M->cvar);
+
+  return 0;
+}
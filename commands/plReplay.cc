@@ -0,0 +1,676 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+//////////////////////////////////////////////////////////////////////
+// Replay the requests captured by the service recorder against a
+// running service. This is the way to benchmark a new build of a
+// service against real traffic: record production, replay against
+// the candidate and compare the latency distributions and responses.
+//////////////////////////////////////////////////////////////////////
+
+#include "config.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "global.h"
+#include "netString.h"
+#include "latencyHistogram.h"
+#include "pluton/client.h"
+
+using namespace std;
+
+
+static const char* usage =
+"Usage: plReplay [-dDhv] [-c concurrency] [-k ServiceKey] [-L lookupMap]\n"
+"                [-n loops] [-r ratePerSecond | -s timeScale] [-t timeout]\n"
+"                recorderPrefix ...\n"
+"\n"
+"Replay requests captured by the service recorder against a running\n"
+"service and report the latency distribution of the responses.\n"
+"\n"
+"Where:\n"
+" -c   Number of requests in flight at once, each sent by its own\n"
+"       thread (default: 1)\n"
+" -D   Diff each response against the recorded response. Fault codes\n"
+"       and response data must match.\n"
+" -d   Turn on pluton::client debugging\n"
+" -h   Print this usage message on STDOUT and exit(0)\n"
+" -k   Send every request to this ServiceKey rather than the one recorded\n"
+" -L   The Lookup Map used to connect with the manager (default: '')\n"
+" -n   Replay the recording this many times (default: 1)\n"
+" -r   Open-loop: start requests at this fixed rate per second\n"
+" -s   Open-loop: preserve the recorded inter-arrival times divided by\n"
+"       timeScale. 2 replays twice as fast, 0.5 at half speed.\n"
+" -t   Numbers of seconds to wait for a response (default: 5)\n"
+" -v   Print each response mismatch to STDERR\n"
+"\n"
+" recorderPrefix: the recorder-prefix configured for the service, such as\n"
+" /var/tmp/record/. Every in./out. file pair and every recorder ring\n"
+" (ring.* and slow.*) with this prefix is loaded and the requests are\n"
+" replayed in the order they originally arrived. The arrival time of an\n"
+" in. file is its modification time.\n"
+"\n"
+"Without -r or -s the replay is closed-loop: each thread sends its next\n"
+"request as soon as the previous one completes. In the open-loop modes\n"
+"latency is measured from when a request was scheduled to be sent, not\n"
+"when it was actually sent, so a service that falls behind is charged\n"
+"with the queueing delay it causes.\n"
+"\n"
+"Exit(1) if any responses mismatch or no requests could be loaded.\n"
+"\n"
+"Example:\n"
+"\tplReplay -c 4 -s 1 -D /var/tmp/record/\n"
+"\n"
+"See also: " PACKAGE_URL "\n"
+"\n";
+
+
+//////////////////////////////////////////////////////////////////////
+// A recorded request with its recorded response, if any. Arrival is
+// in epoch microseconds.
+//////////////////////////////////////////////////////////////////////
+
+class replayRecord {
+public:
+  replayRecord() : arrival(0), haveResponse(false) {}
+
+  string	name;
+  long long	arrival;
+  string	serviceKey;
+  string	request;
+  bool		haveResponse;
+  string	response;
+};
+
+static bool
+byArrival(const replayRecord& a, const replayRecord& b)
+{
+  return a.arrival < b.arrival;
+}
+
+static vector<replayRecord> records;
+
+
+//////////////////////////////////////////////////////////////////////
+// Pull the values out of a recorded packet that matter to the
+// replay. Return false if the packet is unusable.
+//////////////////////////////////////////////////////////////////////
+
+static bool
+isRequestPacket(const string& packet, string& serviceKey)
+{
+  netStringParse nsp(packet);
+  char nsType;
+  const char* p;
+  int len;
+  if (nsp.getNext(nsType, p, len) || (nsType != pluton::requestPT)) return false;	// No batches
+
+  while (!nsp.eof()) {
+    if (nsp.getNext(nsType, p, len)) return false;
+    if (nsType == pluton::serviceKeyNT) serviceKey.assign(p, len);
+  }
+
+  return !serviceKey.empty();
+}
+
+static bool
+decodeResponse(const string& packet, int& faultCode, string& responseData)
+{
+  netStringParse nsp(packet);
+  faultCode = 0;
+  responseData.erase();
+
+  while (!nsp.eof()) {
+    char nsType;
+    const char* p;
+    int len;
+    if (nsp.getNext(nsType, p, len)) return false;
+
+    switch (nsType) {
+    case pluton::faultCodeNT: faultCode = atoi(string(p, len).c_str()); break;
+    case pluton::responseDataNT: responseData.assign(p, len); break;
+    case pluton::memfdDataNT: return false;		// The data went via a memfd
+    default: break;
+    }
+  }
+
+  return true;
+}
+
+static bool
+readFile(const string& path, string& contents)
+{
+  ifstream is(path.c_str(), ios::in | ios::binary);
+  if (!is) return false;
+
+  ostringstream os;
+  os << is.rdbuf();
+  contents = os.str();
+
+  return true;
+}
+
+static void
+addRecord(replayRecord& rr, int& skipped)
+{
+  if (isRequestPacket(rr.request, rr.serviceKey)) {
+    records.push_back(rr);
+  }
+  else {
+    ++skipped;
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// A recorder ring is a series of recordPT slots. Unused slots have no
+// request so they are naturally ignored.
+//////////////////////////////////////////////////////////////////////
+
+static void
+loadRing(const string& path, const string& contents, int& skipped)
+{
+  netStringParse nsp(contents);
+  replayRecord rr;
+
+  while (!nsp.eof()) {
+    char nsType;
+    const char* p;
+    int len;
+    const char* err = nsp.getNext(nsType, p, len);
+    if (err) {
+      cerr << "Warning: plReplay " << path << " is truncated: " << err << endl;
+      return;
+    }
+
+    switch (nsType) {
+    case pluton::recordPT:
+      rr = replayRecord();
+      break;
+
+    case pluton::recordSequenceNT:
+      rr.name = path + "#" + string(p, len);
+      break;
+
+    case pluton::recordStartNT:
+      rr.arrival = strtoll(string(p, len).c_str(), 0, 10);
+      break;
+
+    case pluton::recordRequestNT:
+      rr.request.assign(p, len);
+      break;
+
+    case pluton::recordResponseNT:
+      rr.response.assign(p, len);
+      rr.haveResponse = true;
+      break;
+
+    case pluton::endPacketNT:
+      if (!rr.request.empty()) addRecord(rr, skipped);
+      break;
+
+    default: break;
+    }
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Find everything in the directory that starts with the prefix and is
+// a recorder file. Return the number of requests loaded.
+//////////////////////////////////////////////////////////////////////
+
+static int
+loadPrefix(const string& prefix)
+{
+  string dirName = ".";
+  string base = prefix;
+  string::size_type slash = prefix.rfind('/');
+  if (slash != string::npos) {
+    dirName = prefix.substr(0, slash + 1);
+    base = prefix.substr(slash + 1);
+  }
+
+  DIR* dir = opendir(dirName.c_str());
+  if (!dir) {
+    string em;
+    cerr << util::messageWithErrno(em, "Error: plReplay opendir() failed", dirName.c_str()) << endl;
+    return 0;
+  }
+
+  int loaded = records.size();
+  int skipped = 0;
+  struct dirent* de;
+  while ((de = readdir(dir))) {
+    string name = de->d_name;
+    if (name.compare(0, base.length(), base) != 0) continue;
+
+    string path = (slash == string::npos) ? name : dirName + name;
+    string rest = name.substr(base.length());
+
+    if ((rest.compare(0, 5, "ring.") == 0) || (rest.compare(0, 5, "slow.") == 0)) {
+      string contents;
+      if (readFile(path, contents)) loadRing(path, contents, skipped);
+      continue;
+    }
+
+    if (rest.compare(0, 3, "in.") != 0) continue;
+
+    replayRecord rr;
+    struct stat sb;
+    if ((stat(path.c_str(), &sb) == -1) || !readFile(path, rr.request)) continue;
+    rr.name = path;
+    rr.arrival = (long long) sb.st_mtim.tv_sec * util::MICROSECOND + sb.st_mtim.tv_nsec / 1000;
+
+    string outPath = path.substr(0, path.length() - rest.length()) + "out." + rest.substr(3);
+    rr.haveResponse = readFile(outPath, rr.response) && !rr.response.empty();
+    addRecord(rr, skipped);
+  }
+  closedir(dir);
+
+  if (skipped > 0) {
+    cerr << "Warning: plReplay skipped " << skipped
+	 << " recorded packets that are not single requests" << endl;
+  }
+
+  return records.size() - loaded;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// These statics are used to communicate command-line parameters to
+// the threads.
+//////////////////////////////////////////////////////////////////////
+
+static bool		debugFlag = false;
+static bool		diffFlag = false;
+static bool		verboseFlag = false;
+static const char*	overrideKey = 0;
+static double		ratePerSecond = 0;
+static double		timeScale = 0;
+static int		loops = 1;
+static int		timeoutMS = 5000;
+
+static long long	startTime;		// Epoch microseconds
+static long long	loopSpan;		// Scheduled microseconds per loop
+static long		nextIndex = 0;		// Shared by threads via __sync
+
+static pthread_mutex_t	stderrMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static long long
+nowuS()
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+
+  return (long long) now.tv_sec * util::MICROSECOND + now.tv_usec;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Return when the ix'th request should start in epoch microseconds,
+// or zero for closed-loop.
+//////////////////////////////////////////////////////////////////////
+
+static long long
+scheduledTime(long ix)
+{
+  if (ratePerSecond > 0) return startTime + (long long) (ix * util::MICROSECOND / ratePerSecond);
+
+  if (timeScale > 0) {
+    long recordIx = ix % records.size();
+    long long offset = (long long) ((records[recordIx].arrival - records[0].arrival) / timeScale);
+    return startTime + (ix / records.size()) * loopSpan + offset;
+  }
+
+  return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Each thread has its own client and results which are merged once
+// all threads have finished.
+//////////////////////////////////////////////////////////////////////
+
+class replayThread {
+public:
+  replayThread() : sent(0), faults(0), behind(0), compared(0), mismatches(0), unchecked(0) {}
+
+  pthread_t			tid;
+  util::latencyHistogram	latency;
+  long	sent;
+  long	faults;
+  long	behind;			// Open-loop requests sent over a millisecond late
+  long	compared;
+  long	mismatches;
+  long	unchecked;		// Diffing but no usable recorded response
+};
+
+static void
+compareResponse(replayThread* rt, const replayRecord& rr, pluton::clientRequest& R)
+{
+  int recordedFault;
+  string recordedData;
+  if (!rr.haveResponse || !decodeResponse(rr.response, recordedFault, recordedData)) {
+    ++rt->unchecked;
+    return;
+  }
+
+  ++rt->compared;
+
+  const char* p = "";
+  int len = 0;
+  if (!R.hasFault()) R.getResponseData(p, len);
+
+  if ((R.getFaultCode() == recordedFault)
+      && ((unsigned) len == recordedData.length())
+      && (memcmp(p, recordedData.data(), len) == 0)) return;
+
+  ++rt->mismatches;
+  if (verboseFlag) {
+    pthread_mutex_lock(&stderrMutex);
+    cerr << "Mismatch: " << rr.name
+	 << " fault=" << R.getFaultCode() << "/" << recordedFault
+	 << " length=" << len << "/" << recordedData.length();
+    if (R.hasFault()) cerr << " " << R.getFaultText();
+    cerr << endl;
+    pthread_mutex_unlock(&stderrMutex);
+  }
+}
+
+static void*
+replay(void* arg)
+{
+  replayThread* rt = static_cast<replayThread*>(arg);
+
+  pluton::client C("plReplay", timeoutMS);
+  C.setDebug(debugFlag);
+  pluton::clientRequest R;
+
+  long total = records.size() * loops;
+  while (true) {
+    long ix = __sync_fetch_and_add(&nextIndex, 1);
+    if (ix >= total) break;
+    const replayRecord& rr = records[ix % records.size()];
+
+    long long scheduled = scheduledTime(ix);
+    long long sentAt = nowuS();
+    if (scheduled > sentAt) {
+      usleep(scheduled - sentAt);
+      sentAt = nowuS();
+    }
+    if (scheduled == 0) scheduled = sentAt;
+    if (sentAt - scheduled > 1000) ++rt->behind;
+
+    const char* sk = overrideKey ? overrideKey : rr.serviceKey.c_str();
+    if (!C.addRawRequest(sk, &R, rr.request.data(), rr.request.length())
+	|| (C.executeAndWaitOne(R) < 0)) {
+      pthread_mutex_lock(&stderrMutex);
+      cerr << C.getFault().getMessage("Error: plReplay ", true) << endl;
+      pthread_mutex_unlock(&stderrMutex);
+      ++rt->faults;
+      continue;
+    }
+
+    rt->latency.add(nowuS() - scheduled);
+    ++rt->sent;
+    if (R.hasFault()) ++rt->faults;
+    if (diffFlag) compareResponse(rt, rr, R);
+  }
+
+  return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Thread handlers for the pluton client
+//////////////////////////////////////////////////////////////////////
+
+static pluton::thread_t
+tSelf(const char* who)
+{
+  return (pluton::thread_t) pthread_self();
+}
+
+static pluton::mutex_t
+mNew(const char* who)
+{
+  pthread_mutex_t* m = new pthread_mutex_t;
+  pthread_mutex_init(m, 0);
+
+  return (pluton::mutex_t) m;
+}
+
+static void
+mDelete(const char* who, pluton::mutex_t m)
+{
+  pthread_mutex_destroy((pthread_mutex_t*) m);
+  delete (pthread_mutex_t*) m;
+}
+
+static int
+mLock(const char* who, pluton::mutex_t m)
+{
+  return pthread_mutex_lock((pthread_mutex_t*) m);
+}
+
+static int
+mUnlock(const char* who, pluton::mutex_t m)
+{
+  return pthread_mutex_unlock((pthread_mutex_t*) m);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+
+int
+main(int argc, char **argv)
+{
+  char	optionChar;
+  int	concurrency = 1;
+  const char* lookupMap = "";
+
+  while ((optionChar = getopt(argc, argv, "c:Ddhk:L:n:r:s:t:v")) != -1) {
+    switch (optionChar) {
+
+    case 'c':
+      concurrency = atoi(optarg);
+      if (concurrency <= 0) {
+	cerr << "Error: Concurrency must be greater than zero" << endl;
+	cerr << usage;
+	exit(1);
+      }
+      break;
+
+    case 'D': diffFlag = true; break;
+
+    case 'd': debugFlag = true; break;
+
+    case 'h':
+      cout << usage;
+      exit(0);
+
+    case 'k': overrideKey = optarg; break;
+
+    case 'L': lookupMap = optarg; break;
+
+    case 'n':
+      loops = atoi(optarg);
+      if (loops <= 0) {
+	cerr << "Error: Loop count must be greater than zero" << endl;
+	cerr << usage;
+	exit(1);
+      }
+      break;
+
+    case 'r':
+      ratePerSecond = atof(optarg);
+      if (ratePerSecond <= 0) {
+	cerr << "Error: Rate must be greater than zero" << endl;
+	cerr << usage;
+	exit(1);
+      }
+      break;
+
+    case 's':
+      timeScale = atof(optarg);
+      if (timeScale <= 0) {
+	cerr << "Error: Time scale must be greater than zero" << endl;
+	cerr << usage;
+	exit(1);
+      }
+      break;
+
+    case 't':
+      timeoutMS = atoi(optarg) * 1000;
+      if (timeoutMS <= 0) {
+	cerr << "Error: Timeout must be greater than zero" << endl;
+	cerr << usage;
+	exit(1);
+      }
+      break;
+
+    case 'v': verboseFlag = true; break;
+
+    default:
+      cerr << usage;
+      exit(1);
+    }
+  }
+
+  argc -= optind;
+  argv += optind;
+
+  if ((ratePerSecond > 0) && (timeScale > 0)) {
+    cerr << "Error: Only one of -r and -s is allowed" << endl;
+    cerr << usage;
+    exit(1);
+  }
+
+  if (argc < 1) {
+    cerr << "Error: Must supply at least one recorderPrefix on the command line" << endl;
+    cerr << usage;
+    exit(1);
+  }
+
+  for (; argc > 0; --argc, ++argv) {
+    if (loadPrefix(*argv) == 0) {
+      cerr << "Warning: plReplay found no recorded requests for " << *argv << endl;
+    }
+  }
+
+  if (records.empty()) {
+    cerr << "Error: plReplay has no requests to replay" << endl;
+    exit(1);
+  }
+  stable_sort(records.begin(), records.end(), byArrival);
+
+  // Successive loops are spaced by the recorded span plus the average
+  // gap so the first request of a loop doesn't coincide with the last.
+
+  if (timeScale > 0) {
+    long long span = records.back().arrival - records.front().arrival;
+    if (records.size() > 1) span += span / (records.size() - 1);
+    loopSpan = (long long) (span / timeScale);
+  }
+
+  ////////////////////////////////////////
+  // Have all the options - let's do it
+  ////////////////////////////////////////
+
+  pluton::client::setThreadHandlers(tSelf, mNew, mDelete, mLock, mUnlock);
+
+  pluton::client C("plReplay", timeoutMS);
+  C.setDebug(debugFlag);
+  if (!C.initialize(lookupMap)) {
+    cerr << C.getFault().getMessage("Error: plReplay initialize: ", true) << endl;
+    exit(1);
+  }
+
+  vector<replayThread> threads(concurrency);
+  startTime = nowuS();
+  for (int ix=0; ix < concurrency; ++ix) {
+    if (pthread_create(&threads[ix].tid, 0, replay, &threads[ix]) != 0) {
+      cerr << "Error: plReplay pthread_create() failed: " << strerror(errno) << endl;
+      exit(1);
+    }
+  }
+
+  replayThread totals;
+  for (int ix=0; ix < concurrency; ++ix) {
+    replayThread& rt = threads[ix];
+    pthread_join(rt.tid, 0);
+    totals.latency.merge(rt.latency);
+    totals.sent += rt.sent;
+    totals.faults += rt.faults;
+    totals.behind += rt.behind;
+    totals.compared += rt.compared;
+    totals.mismatches += rt.mismatches;
+    totals.unchecked += rt.unchecked;
+  }
+  long long elapsed = nowuS() - startTime;
+
+  cout << "plReplay: Requests=" << totals.sent << " Faults=" << totals.faults
+       << " Elapsed=" << elapsed / util::MICROSECOND << "."
+       << setfill('0') << setw(6) << elapsed % util::MICROSECOND << setfill(' ')
+       << " Rate=" << (elapsed > 0 ? totals.sent * util::MICROSECOND / elapsed : 0) << "/s";
+  if ((ratePerSecond > 0) || (timeScale > 0)) cout << " Behind=" << totals.behind;
+  cout << endl;
+
+  if (diffFlag) {
+    cout << "plReplay: Compared=" << totals.compared << " Mismatches=" << totals.mismatches
+	 << " Unchecked=" << totals.unchecked << endl;
+  }
+
+  cout << "plReplay: ";
+  totals.latency.printSummary(cout);
+  cout << endl;
+  totals.latency.printPercentiles(cout);
+
+  return (totals.mismatches > 0) ? 1 : 0;
+}
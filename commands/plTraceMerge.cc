@@ -0,0 +1,243 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "config.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "traceRing.h"
+
+using namespace std;
+
+
+static const char* usage =
+"Usage: plTraceMerge [-h] [-t traceID] traceFiles...\n"
+"\n"
+"Merge the per-process trace rings created when plutonTraceDirectory\n"
+"is set and write them to STDOUT as Chrome trace-event JSON, suitable\n"
+"for chrome://tracing and similar viewers.\n"
+"\n"
+"Where:\n"
+" -h   Print this usage message on STDOUT and exit(0)\n"
+" -t   Only output spans belonging to this trace (hex)\n"
+"\n"
+"See also: " PACKAGE_URL "\n"
+"\n";
+
+
+static bool
+earlierStart(const traceSpan& a, const traceSpan& b)
+{
+  return a._startuSecs < b._startuSecs;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Read all valid spans in a ring. Return false if the file is not a
+// trace ring.
+//////////////////////////////////////////////////////////////////////
+
+static bool
+loadRing(const char* path, vector<traceSpan>& spans, unsigned long long traceFilter)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    cerr << "Error: Could not open " << path << ": " << strerror(errno) << endl;
+    return false;
+  }
+
+  traceRingHeader header;
+  if ((read(fd, &header, sizeof(header)) != sizeof(header))
+      || (header._magic != traceRingHeader::ringMagic)
+      || (header._version != traceRingHeader::ringVersion)
+      || (header._recordSize != sizeof(traceSpan))) {
+    cerr << "Error: " << path << " is not a trace ring" << endl;
+    close(fd);
+    return false;
+  }
+
+  traceSpan span;
+  for (unsigned int ix=0; ix < header._capacity; ++ix) {
+    if (read(fd, &span, sizeof(span)) != sizeof(span)) break;
+    if ((span._sequence == 0) || (span._kind == traceSpan::unusedKind)) continue;
+    if (traceFilter && (span._traceID != traceFilter)) continue;
+    span._name[sizeof(span._name)-1] = '\0';
+    spans.push_back(span);
+  }
+
+  close(fd);
+
+  return true;
+}
+
+
+static string
+jsonString(const char* cp)
+{
+  string res("\"");
+  for (; *cp; ++cp) {
+    unsigned char ch = *cp;
+    if ((ch == '"') || (ch == '\\')) {
+      res += '\\';
+      res += ch;
+    }
+    else if (ch < ' ') {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", ch);
+      res += buf;
+    }
+    else {
+      res += ch;
+    }
+  }
+  res += '"';
+
+  return res;
+}
+
+
+static string
+hexID(unsigned long long id)
+{
+  char buf[20];
+  snprintf(buf, sizeof(buf), "%016llx", id);
+
+  return buf;
+}
+
+
+int
+main(int argc, char **argv)
+{
+  char	optionChar;
+  unsigned long long traceFilter = 0;
+
+  while ((optionChar = getopt(argc, argv, "ht:")) != -1) {
+    switch (optionChar) {
+
+    case 't':
+      traceFilter = strtoull(optarg, 0, 16);
+      if (traceFilter == 0) {
+	cerr << "Error: traceID must be a non-zero hex number" << endl;
+	cerr << usage;
+	exit(1);
+      }
+      break;
+
+    case 'h':
+      cout << usage;
+      exit(0);
+
+    default:
+      cerr << usage;
+      exit(1);
+    }
+  }
+
+  argc -= optind;
+  argv += optind;
+
+  if (argc == 0) {
+    cerr << usage;
+    exit(1);
+  }
+
+  vector<traceSpan> spans;
+  int errors = 0;
+  for (int ix=0; ix < argc; ++ix) {
+    if (!loadRing(argv[ix], spans, traceFilter)) ++errors;
+  }
+
+  sort(spans.begin(), spans.end(), earlierStart);
+
+  map<unsigned long long, const traceSpan*> bySpanID;
+  for (vector<traceSpan>::const_iterator si=spans.begin(); si != spans.end(); ++si) {
+    bySpanID[si->_spanID] = &(*si);
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // Each span is a complete ("X") event. Processes are the pids and
+  // the client and service sides of a process are separate
+  // threads. A span whose parent is in another process gets a flow
+  // event pair so that the viewer draws the hop between processes.
+  //////////////////////////////////////////////////////////////////////
+
+  cout << "{\"traceEvents\":[";
+  const char* sep = "\n";
+  unsigned long flowID = 0;
+
+  for (vector<traceSpan>::const_iterator si=spans.begin(); si != spans.end(); ++si) {
+    const char* cat = (si->_kind == traceSpan::clientKind) ? "client" : "service";
+    cout << sep
+	 << "{\"name\":" << jsonString(si->_name)
+	 << ",\"cat\":\"" << cat << "\""
+	 << ",\"ph\":\"X\""
+	 << ",\"ts\":" << si->_startuSecs
+	 << ",\"dur\":" << si->_durationuSecs
+	 << ",\"pid\":" << si->_pid
+	 << ",\"tid\":" << si->_kind
+	 << ",\"args\":{\"trace\":\"" << hexID(si->_traceID) << "\""
+	 << ",\"span\":\"" << hexID(si->_spanID) << "\""
+	 << ",\"parent\":\"" << hexID(si->_parentID) << "\"}}";
+    sep = ",\n";
+
+    if (si->_parentID == 0) continue;
+    map<unsigned long long, const traceSpan*>::const_iterator pi = bySpanID.find(si->_parentID);
+    if ((pi == bySpanID.end()) || (pi->second->_pid == si->_pid)) continue;
+
+    ++flowID;
+    cout << sep
+	 << "{\"name\":\"hop\",\"cat\":\"hop\",\"ph\":\"s\",\"id\":" << flowID
+	 << ",\"ts\":" << si->_startuSecs
+	 << ",\"pid\":" << pi->second->_pid << ",\"tid\":" << pi->second->_kind << "}"
+	 << sep
+	 << "{\"name\":\"hop\",\"cat\":\"hop\",\"ph\":\"f\",\"bp\":\"e\",\"id\":" << flowID
+	 << ",\"ts\":" << si->_startuSecs
+	 << ",\"pid\":" << si->_pid << ",\"tid\":" << si->_kind << "}";
+  }
+
+  cout << "\n]}" << endl;
+
+  return errors ? 1 : 0;
+}
@@ -32,6 +32,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <string>
 #include <list>
+#include <map>
+#include <vector>
 
 #include <iostream>
 
@@ -40,12 +42,18 @@ using namespace std;
 #include <arpa/inet.h>		// htons
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdio.h>
 #include <netdb.h>
 #include <string.h>
 #include <strings.h>
+#include <unistd.h>
 
 #include <st.h>
 
@@ -62,7 +70,8 @@ static const char* myName = "plTransmitter";
 static const char* usage =
 "\n"
 "Usage: plTransmitter [-dhC] [-c connectsPerHost] [-l serviceLifeSecs]\n"
-"                     [-s maxRequestDurationSecs] hosts...\n"
+"                     [-m requestsPerConnection] [-s maxRequestDurationSecs]\n"
+"                     hosts...\n"
 "\n"
 "Transmit Pluton Requests to plReceivers running on remote hosts\n"
 "\n"
@@ -75,6 +84,9 @@ static const char* usage =
 " -l   The service should exit after this many seconds to enable a fresh\n"
 "       set of gethostbyname() results. Zero disables this feature\n"
 "       (default: 3600)\n"
+" -m   Maximum requests outstanding on each connection. More than one\n"
+"       multiplexes tagged requests over the connection, which needs a\n"
+"       plReceiver that understands them (default: 1)\n"
 " -s   Maximum seconds allowed per request (default: 30)\n"
 "\n"
 " hosts are a list of hostname[:port] values that are resolved\n"
@@ -85,16 +97,53 @@ static const char* usage =
 
 
 //////////////////////////////////////////////////////////////////////
-// Each host on the command line expands to a set of host entry as
-// gethostbyname() can return multiple answers per query.
+// A request outstanding on a multiplexed connection. It lives on the
+// handler's stack and points at the handler's request packet, so the
+// handler waits until the writer has let go of it before returning.
 //////////////////////////////////////////////////////////////////////
 
+class multiplexExchange {
+public:
+  multiplexExchange(const char* setPtr, int setLength)
+    : tag(0), requestPtr(setPtr), requestLength(setLength),
+      writeState(queued), state(waiting), cvar(st_cond_new()) {}
+  ~multiplexExchange() { st_cond_destroy(cvar); }
+
+  unsigned int		tag;
+  const char*		requestPtr;
+  int			requestLength;
+  netStringGenerate	pre;
+  netStringGenerate	post;
+
+  enum { queued, writing, released } writeState;
+  enum stateType { waiting, answered, connectFailed, writeFailed, readFailed } state;
+  st_cond_t		cvar;
+
+  string		response;
+};
+
+typedef list<multiplexExchange*>			multiplexExchangeList;
+typedef list<multiplexExchange*>::iterator		multiplexExchangeListIter;
+typedef map<unsigned int, multiplexExchange*>		multiplexExchangeMap;
+typedef map<unsigned int, multiplexExchange*>::iterator	multiplexExchangeMapIter;
 
 
+//////////////////////////////////////////////////////////////////////
+// Each host on the command line expands to a set of host entry as
+// gethostbyname() can return multiple answers per query.
+//
+// A host is either used for one request at a time or, when
+// multiplexing, shared by many handlers. In the latter case a writer
+// thread coalesces queued frames into writev() calls and a reader
+// thread hands each tagged response to the handler waiting for it.
+//////////////////////////////////////////////////////////////////////
+
 class remoteHost {
 public:
   remoteHost(const string& setHostName, int setPort, const char* setAddr)
-    : _hostName(setHostName), _port(setPort), _fd(0)
+    : _hostName(setHostName), _port(setPort), _fd(0),
+      _outstanding(0), _failedFlag(false), _nextTag(1),
+      _writerRunning(false), _readerRunning(false), _corkedFlag(false), _writerCvar(0)
   {
     memcpy((void*) &_addr, (void*) setAddr, sizeof(_addr));
     _packetIn.disableCompaction();	// So we can point at the response data
@@ -109,21 +158,50 @@ public:
 
   int		sendRequest(const char* cp, int len, unsigned int timeoutuS) const;
   void		transferFileDescriptor(int fd) { close(fd); }
-  int		readPacket(unsigned long timeoutuS);
+  int		readPacket(st_utime_t timeoutuS, pluton::decodeMultiplexFrame* frame=0);
   void		getInboundPacketData(const char*& p, int& l) const { p = _packetPtr; l = _packetLen; }
 
+  // Multiplexing
+
+  bool		startWriter();
+  void		exchange(multiplexExchange& X, unsigned long timeoutuS);
+
+  int		getOutstanding() const { return _outstanding; }
+  bool		hasFailed() const { return _failedFlag; }
+  void		addOutstanding() { ++_outstanding; }
+  void		removeOutstanding(bool failedFlag) { --_outstanding; _failedFlag = failedFlag; }
+
 private:
+  static void*	writerThread(void*);
+  static void*	readerThread(void*);
+  void		writer();
+  void		reader();
+  void		writeFrames();
+  void		failQueued(multiplexExchange::stateType state);
+  void		failInFlight(multiplexExchange::stateType state);
+
   string 	_hostName;
   int		_port;
   in_addr_t 	_addr;
   st_netfd_t	_fd;
 
   netStringFactoryManaged 	_packetIn;
-  pluton::decodeRequestPacket	_decoder;
+  pluton::decodeResponsePacket	_decoder;
 
   int		_packetOffset;
   const char*	_packetPtr;
   int		_packetLen;
+
+  int		_outstanding;
+  bool		_failedFlag;
+  unsigned int	_nextTag;
+  bool		_writerRunning;
+  bool		_readerRunning;
+  bool		_corkedFlag;
+  st_cond_t	_writerCvar;
+
+  multiplexExchangeList	_writeQueue;
+  multiplexExchangeMap	_inFlight;
 };
 
 typedef list<remoteHost*>		remoteHostList;
@@ -136,12 +214,14 @@ typedef list<remoteHost*>::iterator	remoteHostListIter;
 //////////////////////////////////////////////////////////////////////
 
 static remoteHostList 	freeHosts;
+static remoteHostList 	allHosts;
 static	st_cond_t	freeHostsCvar;
 
 static void*	handler(void*);
 
 
 static	int	connectsPerHost = 1;
+static	int	requestsPerConnection = 1;
 static  int	serviceLifeSecs = 3600;
 static  bool	debugFlag = false;
 static  bool	connectImmediatelyFlag = false;
@@ -165,7 +245,7 @@ main(int argc, char** argv)
 {
   char optionChar;
 
-  while ((optionChar = getopt(argc, argv, "Cc:dhl:s:")) != EOF) {
+  while ((optionChar = getopt(argc, argv, "Cc:dhl:m:s:")) != EOF) {
     switch (optionChar) {
     case 'c':
       connectsPerHost = atoi(optarg);
@@ -198,6 +278,15 @@ main(int argc, char** argv)
       cout << usage;
       exit(0);
 
+    case 'm':
+      requestsPerConnection = atoi(optarg);
+      if (requestsPerConnection <= 0) {
+	clog << "Error: requestsPerConnection must be greater than zero" << endl;
+	clog << usage;
+	exit(1);
+      }
+      break;
+
     case 's':
       maxRequestDurationSecs = atoi(optarg);
       if (maxRequestDurationSecs <= 0) {
@@ -222,6 +311,11 @@ main(int argc, char** argv)
 
   st_init();
 
+  // A plReceiver that goes away shows up as a failed write rather
+  // than a signal.
+
+  signal(SIGPIPE, SIG_IGN);
+
   //////////////////////////////////////////////////////////////////////
   // Build the list of hosts to establish connections with
   //////////////////////////////////////////////////////////////////////
@@ -249,7 +343,18 @@ main(int argc, char** argv)
       for (int ix=0; ix < connectsPerHost; ++ix) {
 	remoteHost* hp = new remoteHost(string(*argv), port, *hostArgv);
 	freeHosts.push_front(hp);
-	if (connectImmediatelyFlag) hp->connect();
+	allHosts.push_back(hp);
+	if (connectImmediatelyFlag) {
+	  if (requestsPerConnection > 1) {
+	    if (!hp->startWriter()) {
+	      clog << "Error: " << myName << " could not create a state thread" << endl;
+	      exit(1);
+	    }
+	  }
+	  else {
+	    hp->connect();
+	  }
+	}
       }
       hostArgv++;
     }
@@ -335,6 +440,90 @@ returnHostToFreePool(remoteHost* H, bool hostFailedFlag)
   else {
     freeHosts.push_front(H);
   }
+  st_cond_signal(freeHostsCvar);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// When multiplexing, hosts are shared rather than taken from the
+// pool. Use the one with the fewest outstanding requests, preferring
+// those that did not just fail, and wait if all are at their limit.
+//////////////////////////////////////////////////////////////////////
+
+static remoteHost*
+getMultiplexedHost()
+{
+  while (true) {
+    remoteHost* best = 0;
+    for (remoteHostListIter hi=allHosts.begin(); hi != allHosts.end(); ++hi) {
+      remoteHost* H = *hi;
+      if (H->getOutstanding() >= requestsPerConnection) continue;
+      if (!best || (H->hasFailed() < best->hasFailed())
+	  || ((H->hasFailed() == best->hasFailed())
+	      && (H->getOutstanding() < best->getOutstanding()))) {
+	best = H;
+      }
+    }
+    if (best) {
+      best->addOutstanding();
+      return best;
+    }
+    st_cond_wait(freeHostsCvar);
+  }
+}
+
+static void
+returnMultiplexedHost(remoteHost* H, bool hostFailedFlag)
+{
+  H->removeOutstanding(hostFailedFlag);
+  st_cond_signal(freeHostsCvar);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Relay the request over a multiplexed connection and wait for the
+// response, which may well overtake responses to earlier requests.
+//////////////////////////////////////////////////////////////////////
+
+static void
+relayMultiplexed(handlerData* hd, pluton::perCallerService& owner,
+		 pluton::serviceRequestImpl& localR, const char* rawPtr, int rawRequestLength)
+{
+  remoteHost* H = getMultiplexedHost();
+  multiplexExchange X(rawPtr, rawRequestLength);
+  H->exchange(X, localR.getTimeoutuS());
+  returnMultiplexedHost(H, X.state != multiplexExchange::answered);
+
+  if (localR.hasFileDescriptor()) H->transferFileDescriptor(localR.getFileDescriptor());
+
+  if (X.state == multiplexExchange::answered) {
+    if (!hd->S->sendRawResponse(&owner, rawRequestLength, X.response.data(), X.response.length(),
+				myName, maxRequestDurationSecs)) {
+      clog << "Warning: pluton::serviceImpl::sendRawResponse() failed: "
+	   << owner.getFault().getMessage() << endl;
+    }
+    return;
+  }
+
+  string em;
+  pluton::faultCode fc = pluton::remoteTransferFailed;
+  switch (X.state) {
+  case multiplexExchange::connectFailed:
+    em = "Cannot connect to ";
+    fc = pluton::remoteConnectFailed;
+    break;
+
+  case multiplexExchange::writeFailed:
+    em = "Write failed to ";
+    break;
+
+  default:
+    em = "Read failed from ";
+    break;
+  }
+  em += H->getName();
+  localR.setFault(fc, em.c_str());
+  hd->S->sendResponse(&owner, &localR, maxRequestDurationSecs);
 }
 
 
@@ -383,15 +572,6 @@ handler(void* voidH)
       continue;
     }
     if (debugFlag) clog << hd->threadIndex << " have Request" << endl;
-    remoteHost* H = getHostFromFreePool();
-    if (!H->connect()) {
-      string em = "Cannot connect to ";
-      em += H->getName();
-      localR.setFault(pluton::remoteConnectFailed, em.c_str());
-      hd->S->sendResponse(&owner, &localR, maxRequestDurationSecs);
-      returnHostToFreePool(H, true);
-      continue;
-    }
 
     ////////////////////////////////////////////////////////////
     // All we do is transfer the raw bits straight through!
@@ -400,9 +580,46 @@ handler(void* voidH)
     const char* rawPtr;
     int rawRequestLength;
     localR.getInboundPacketData(rawPtr, rawRequestLength);
+
+    //////////////////////////////////////////////////////////////////////
+    // A memfd cannot cross the network, so a request that carries
+    // its data in a memfd, or that offers to accept a memfd response,
+    // is re-assembled with the data inline.
+    //////////////////////////////////////////////////////////////////////
+
+    string inlinePacket;
+    if (localR.hasMemfdData() || (localR.getMemfdAcceptThreshold() > 0)) {
+      localR.setMemfdAcceptThreshold(0);
+      netStringGenerate pre, post;
+      localR.assembleRequestPacket(pre, post);
+      const char* dataPtr;
+      int dataLength;
+      localR.getRequestData(dataPtr, dataLength);
+      inlinePacket.reserve(pre.length() + dataLength + post.length());
+      inlinePacket.append(pre.data(), pre.length());
+      inlinePacket.append(dataPtr, dataLength);
+      inlinePacket.append(post.data(), post.length());
+      rawPtr = inlinePacket.data();
+      rawRequestLength = inlinePacket.length();
+    }
     //    if (debugFlag) clog << "Relay Out: L=" << rawRequestLength << " "
     //			<< string(rawPtr, rawRequestLength) << endl;
 
+    if (requestsPerConnection > 1) {
+      relayMultiplexed(hd, owner, localR, rawPtr, rawRequestLength);
+      continue;
+    }
+
+    remoteHost* H = getHostFromFreePool();
+    if (!H->connect()) {
+      string em = "Cannot connect to ";
+      em += H->getName();
+      localR.setFault(pluton::remoteConnectFailed, em.c_str());
+      hd->S->sendResponse(&owner, &localR, maxRequestDurationSecs);
+      returnHostToFreePool(H, true);
+      continue;
+    }
+
     if (H->sendRequest(rawPtr, rawRequestLength, localR.getTimeoutuS()) != rawRequestLength) {
       string em = "Write failed to ";
       em += H->getName();
@@ -486,9 +703,16 @@ remoteHost::connect(int timeoutuS)
   if (st_connect(_fd, (sockaddr*) &saddr, sizeof(saddr), timeoutuS) == -1) {
     perror("st_connect()");
     st_netfd_close(_fd);
+    _fd = 0;
     return false;
   }
 
+  // Requests are written in one go, or corked when multiplexing, so
+  // Nagle only ever adds latency.
+
+  int noDelay = 1;
+  setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
   return true;
 }
 
@@ -498,6 +722,8 @@ remoteHost::disconnect()
 {
   if (_fd) st_netfd_close(_fd);
   _fd = 0;
+  _corkedFlag = false;
+  _packetIn.reset();			// Nothing left over is of any use
 }
 
 
@@ -510,39 +736,27 @@ remoteHost::sendRequest(const char* cp, int len, unsigned int timeoutuS) const
 
 //////////////////////////////////////////////////////////////////////
 // Reading netStrings from the remote connection until we have a
-// complete packet or error.
+// complete packet or error. If a frame decoder is supplied, the
+// packet is the one carried by the next multiplexed frame.
 //
 // Return: -1 = error otherwise _packetPtr and _packetLen.
 //////////////////////////////////////////////////////////////////////
 
 int
-remoteHost::readPacket(unsigned long timoutuS)
+remoteHost::readPacket(st_utime_t timoutuS, pluton::decodeMultiplexFrame* frame)
 {
   _packetIn.reclaimByCompaction();
   _decoder.reset();
+  if (frame) frame->reset();
   _packetOffset = _packetIn.getRawOffset();	// Need to determine packet location
 
   while (true) {
-    char* bufPtr;
-    int minRequired, maxAllowed;
-    if (_packetIn.getReadParameters(bufPtr, minRequired, maxAllowed) == -1) {
-      errno = E2BIG;
-      return -1;
-    }
-
-    int bytes = st_read(_fd, bufPtr, maxAllowed, timoutuS);
-    //    if (debugFlag) clog << "st_read=" << bytes << " errno=" << errno
-    //			<< " RTO=" << timoutuS << endl;
-    if (bytes <= 0) {
-      errno = EIO;
-      return -1;
-    }
 
     //////////////////////////////////////////////////////////////////////
-    // Got some data, decode it and look for a completed response.
+    // Decode what is already buffered first as multiplexed responses
+    // can arrive many to the one read.
     //////////////////////////////////////////////////////////////////////
 
-    _packetIn.addBytesRead(bytes);
     const char* parseError = 0;
     string em;
     while (_packetIn.haveNetString(parseError)) {
@@ -551,6 +765,16 @@ remoteHost::readPacket(unsigned long timoutuS)
       int nsDataLength;
       int nsOffset;
       _packetIn.getNetString(nsType, nsDataPtr, nsDataLength, &nsOffset);
+      if (frame) {
+	if (!frame->addType(nsType, nsDataPtr, nsDataLength, nsOffset, em)) return -1;
+	if (frame->haveCompleteFrame()) {
+	  frame->getPacket(_packetOffset, _packetLen);
+	  _packetPtr = _packetIn.getBasePtr() + _packetOffset;
+	  return 0;
+	}
+	continue;
+      }
+
       if (!_decoder.addType(nsType, nsDataPtr, nsDataLength, nsOffset, em)) {
 	return -1;
       }
@@ -567,5 +791,284 @@ remoteHost::readPacket(unsigned long timoutuS)
       }
     }
     if (parseError) return -1;
+
+    char* bufPtr;
+    int minRequired, maxAllowed;
+    if (_packetIn.getReadParameters(bufPtr, minRequired, maxAllowed) == -1) {
+      errno = E2BIG;
+      return -1;
+    }
+
+    int bytes = st_read(_fd, bufPtr, maxAllowed, timoutuS);
+    //    if (debugFlag) clog << "st_read=" << bytes << " errno=" << errno
+    //			<< " RTO=" << timoutuS << endl;
+    if (bytes <= 0) {
+      errno = EIO;
+      return -1;
+    }
+
+    _packetIn.addBytesRead(bytes);
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The writer thread is started on first use, or up front by -C, and
+// owns the connection from then on.
+//////////////////////////////////////////////////////////////////////
+
+bool
+remoteHost::startWriter()
+{
+  if (_writerRunning) return true;
+
+  if (!_writerCvar) _writerCvar = st_cond_new();
+  if (!_writerCvar) return false;
+
+  if (!st_thread_create(writerThread, (void*) this, 0, 0)) return false;
+  _writerRunning = true;
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Queue the request for the writer and wait for the response. A
+// request that times out is pulled from the queue if it has not yet
+// been written and a response that turns up later is discarded as
+// the tag is no longer in flight.
+//////////////////////////////////////////////////////////////////////
+
+void
+remoteHost::exchange(multiplexExchange& X, unsigned long timeoutuS)
+{
+  X.tag = _nextTag++;
+  pluton::decodeMultiplexFrame::assemble(X.tag, X.requestLength, X.pre, X.post);
+
+  if (!startWriter()) {
+    X.writeState = multiplexExchange::released;
+    X.state = multiplexExchange::writeFailed;
+    return;
+  }
+  _writeQueue.push_back(&X);
+  st_cond_signal(_writerCvar);
+
+  st_utime_t endTime = st_utime() + timeoutuS;
+  while (X.state == multiplexExchange::waiting) {
+    st_utime_t now = st_utime();
+    if (now >= endTime) break;
+    st_cond_timedwait(X.cvar, endTime - now);
+  }
+
+  if (X.state == multiplexExchange::waiting) {
+    if (debugFlag) clog << "Timeout on tag " << X.tag << " to " << getName() << endl;
+    X.state = multiplexExchange::readFailed;
+    _inFlight.erase(X.tag);
+  }
+
+  if (X.writeState == multiplexExchange::queued) {
+    _writeQueue.remove(&X);
+    X.writeState = multiplexExchange::released;
+  }
+  while (X.writeState != multiplexExchange::released) st_cond_wait(X.cvar);
+}
+
+
+void*
+remoteHost::writerThread(void* voidH)
+{
+  static_cast<remoteHost*>(voidH)->writer();
+
+  return 0;
+}
+
+void*
+remoteHost::readerThread(void* voidH)
+{
+  static_cast<remoteHost*>(voidH)->reader();
+
+  return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Connect when there is something to send - or straight away when
+// first started - and start a reader for the connection. A
+// connection whose reader has stopped is closed and re-established
+// on demand.
+//////////////////////////////////////////////////////////////////////
+
+void
+remoteHost::writer()
+{
+  bool connectNow = true;
+
+  while (true) {
+    if (_fd && !_readerRunning) disconnect();
+
+    if (!_fd && (connectNow || !_writeQueue.empty())) {
+      connectNow = false;
+      if (!connect()) {
+	failQueued(multiplexExchange::connectFailed);
+	continue;
+      }
+      _readerRunning = true;
+      if (!st_thread_create(readerThread, (void*) this, 0, 0)) {
+	clog << "Error: " << myName << " could not create a state thread" << endl;
+	_readerRunning = false;
+	disconnect();
+	failQueued(multiplexExchange::connectFailed);
+      }
+      continue;
+    }
+
+    if (_writeQueue.empty()) {
+      st_cond_wait(_writerCvar);
+      continue;
+    }
+
+    writeFrames();
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Write as many queued frames as writev() accepts in one call. When
+// more remain, the connection is corked so that the successive
+// writes go out as full segments, and uncorked once the queue has
+// drained.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef IOV_MAX
+#define IOV_MAX 16				// The POSIX minimum
+#endif
+
+void
+remoteHost::writeFrames()
+{
+  vector<struct iovec> iov;
+  multiplexExchangeList batch;
+  int length = 0;
+
+  while (!_writeQueue.empty() && (iov.size() + 3 <= IOV_MAX)) {
+    multiplexExchange* X = _writeQueue.front();
+    _writeQueue.pop_front();
+    X->writeState = multiplexExchange::writing;
+    _inFlight[X->tag] = X;		// The response may arrive before writev() returns
+    batch.push_back(X);
+
+    struct iovec vec;
+    vec.iov_base = const_cast<char*>(X->pre.data());
+    vec.iov_len = X->pre.length();
+    iov.push_back(vec);
+    if (X->requestLength > 0) {
+      vec.iov_base = const_cast<char*>(X->requestPtr);
+      vec.iov_len = X->requestLength;
+      iov.push_back(vec);
+    }
+    vec.iov_base = const_cast<char*>(X->post.data());
+    vec.iov_len = X->post.length();
+    iov.push_back(vec);
+    length += X->pre.length() + X->requestLength + X->post.length();
+  }
+
+  int sock = st_netfd_fileno(_fd);
+#ifdef TCP_CORK
+  if (!_corkedFlag && !_writeQueue.empty()) {
+    int onOff = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_CORK, &onOff, sizeof(onOff));
+    _corkedFlag = true;
+  }
+#endif
+
+  if (debugFlag) clog << "Writing " << batch.size() << " frames to " << getName() << endl;
+  int bytes = st_writev(_fd, &iov[0], iov.size(), maxRequestDurationSecs * util::MICROSECOND);
+  bool failedFlag = (bytes != length);
+
+  for (multiplexExchangeListIter xi=batch.begin(); xi != batch.end(); ++xi) {
+    multiplexExchange* X = *xi;
+    X->writeState = multiplexExchange::released;
+    if (failedFlag && (X->state == multiplexExchange::waiting)) {
+      X->state = multiplexExchange::writeFailed;
+      _inFlight.erase(X->tag);
+    }
+    st_cond_signal(X->cvar);
+  }
+
+#ifdef TCP_CORK
+  if (_corkedFlag && (failedFlag || _writeQueue.empty())) {
+    int onOff = 0;
+    setsockopt(sock, IPPROTO_TCP, TCP_CORK, &onOff, sizeof(onOff));
+    _corkedFlag = false;
+  }
+#endif
+
+  //////////////////////////////////////////////////////////////////////
+  // On failure, shut the connection down to stop the reader and wait
+  // for it to fail what remains in flight before closing.
+  //////////////////////////////////////////////////////////////////////
+
+  if (failedFlag) {
+    if (debugFlag) clog << "writev() failed to " << getName() << endl;
+    shutdown(sock, SHUT_RDWR);
+    while (_readerRunning) st_cond_wait(_writerCvar);
+    disconnect();
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Hand each response to the handler waiting on its tag until the
+// connection fails, then fail everything still in flight.
+//////////////////////////////////////////////////////////////////////
+
+void
+remoteHost::reader()
+{
+  pluton::decodeMultiplexFrame frame;
+
+  while (readPacket(ST_UTIME_NO_TIMEOUT, &frame) == 0) {
+    multiplexExchangeMapIter mi = _inFlight.find(frame.getTag());
+    if (mi == _inFlight.end()) {
+      if (debugFlag) clog << "Discarding late response for tag " << frame.getTag() << endl;
+      continue;
+    }
+
+    multiplexExchange* X = mi->second;
+    _inFlight.erase(mi);
+    X->response.assign(_packetPtr, _packetLen);
+    X->state = multiplexExchange::answered;
+    st_cond_signal(X->cvar);
+  }
+
+  if (debugFlag) clog << "Multiplexed read failed from " << getName() << endl;
+  failInFlight(multiplexExchange::readFailed);
+  shutdown(st_netfd_fileno(_fd), SHUT_RDWR);		// Wakes a blocked writer
+  _readerRunning = false;
+  st_cond_signal(_writerCvar);
+}
+
+
+void
+remoteHost::failQueued(multiplexExchange::stateType state)
+{
+  while (!_writeQueue.empty()) {
+    multiplexExchange* X = _writeQueue.front();
+    _writeQueue.pop_front();
+    X->writeState = multiplexExchange::released;
+    if (X->state == multiplexExchange::waiting) X->state = state;
+    st_cond_signal(X->cvar);
+  }
+}
+
+
+void
+remoteHost::failInFlight(multiplexExchange::stateType state)
+{
+  for (multiplexExchangeMapIter mi=_inFlight.begin(); mi != _inFlight.end(); ++mi) {
+    multiplexExchange* X = mi->second;
+    if (X->state == multiplexExchange::waiting) X->state = state;
+    st_cond_signal(X->cvar);
   }
+  _inFlight.clear();
 }
@@ -0,0 +1,283 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "util.h"
+#include "calibrationPolicy.h"
+
+
+util::calibrationPolicy::inputs::inputs()
+  : now(0), listenBacklog(0), activeProcessCount(0), activeuSecs(0),
+    lastPerformanceReport(0), decreaseOkFlag(false), increaseToMinimumOkFlag(false),
+    occupancyPercent(0), minimumProcesses(0), maximumProcesses(0), idleTimeout(0)
+{
+}
+
+util::calibrationPolicy::decision::decision()
+  : what(noAction), count(0), sampled(false), countersInvalid(false), samplePeriod(0),
+    currOccupancy(0), prevOccupancy(0), currListenBacklog(0), prevListenBacklog(0),
+    proposedCurrOccupancy(0), proposedPrevOccupancy(0)
+{
+}
+
+
+util::calibrationPolicy::calibrationPolicy(time_t now)
+  : _prevCalibrationTime(now), _nextCalibrationTime(now + minimumSamplePeriod),
+    _prevOccupancyByTime(0), _currOccupancyByTime(0),
+    _prevListenBacklog(0), _currListenBacklog(0),
+    _calibrateSamples(0)
+{
+}
+
+
+const char*
+util::calibrationPolicy::actionToEnglish(action a)
+{
+  switch (a) {
+  case noAction: return "none";
+  case createMinimum: return "createMinimum";
+  case createIncrease: return "createIncrease";
+  case removeExcess: return "removeExcess";
+  case removeIdle: return "removeIdle";
+  }
+
+  return "?";
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Determine how many processes should be running. At most one action
+// results from each call.
+//////////////////////////////////////////////////////////////////////
+
+util::calibrationPolicy::decision
+util::calibrationPolicy::calibrate(const inputs& in)
+{
+  decision d;
+
+  //////////////////////////////////////////////////////////////////////
+  // If we need to ramp up to minimum, do that and return
+  //////////////////////////////////////////////////////////////////////
+
+  if (in.increaseToMinimumOkFlag && (in.activeProcessCount < in.minimumProcesses)) {
+    d.what = createMinimum;
+    d.count = in.minimumProcesses - in.activeProcessCount;
+    return d;
+  }
+
+  ++_calibrateSamples;
+  _currListenBacklog += in.listenBacklog;
+
+  //////////////////////////////////////////////////////////////////////
+  // Only check for algorithmic changes periodically, so that activity
+  // times and counters aren't too granular.
+  //////////////////////////////////////////////////////////////////////
+
+  bool doneOne = false;
+  d.samplePeriod = in.now - _prevCalibrationTime;
+
+  // First the occupancy-base tests which roll counters, etc.
+
+  if (_nextCalibrationTime <= in.now) {
+    _currListenBacklog /= _calibrateSamples;
+    _calibrateSamples = 0;
+    d.sampled = true;
+
+    // Always do "Up" as that does calibration calcs
+
+    doneOne = occupancyUp(in, d);
+
+    // Only do "Down" if "Up" didn't create a process
+
+    if (!doneOne && in.decreaseOkFlag && (in.activeProcessCount > in.minimumProcesses)) {
+      doneOne = occupancyDown(in, d);
+    }
+
+    // Roll all the values from current -> previous
+
+    _prevListenBacklog = _currListenBacklog;
+    _currListenBacklog = 0;
+    if (doneOne) {
+      _prevOccupancyByTime = in.occupancyPercent;	// That's our guess
+    }
+    else {
+      _prevOccupancyByTime = _currOccupancyByTime;
+    }
+    _prevCalibrationTime = in.now;
+    _nextCalibrationTime = in.now + minimumSamplePeriod;
+  }
+
+  // Idle timeout is done every call if nothing else happened.
+
+  if (!doneOne && in.decreaseOkFlag) doneOne = idleDown(in, d);
+
+  return d;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Ramp up processes based on occupancy. Return true if the decision
+// is to create processes - even if the maximum means none can be.
+//////////////////////////////////////////////////////////////////////
+
+bool
+util::calibrationPolicy::occupancyUp(const inputs& in, decision& d)
+{
+  //////////////////////////////////////////////////////////////////////
+  // Sanity check shared counters and timers. They can get trashed due
+  // to lock-less updates or memory stomping services.
+  //////////////////////////////////////////////////////////////////////
+
+  long activeSecs = in.activeuSecs / util::MICROSECOND;
+  if (	(activeSecs < 0) ||
+	(activeSecs > (minimumSamplePeriod * 2 * in.activeProcessCount))) {
+    d.countersInvalid = true;
+    return false;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // Average out the backlog across the sample period
+  //////////////////////////////////////////////////////////////////////
+
+  if ((in.activeProcessCount > 0) && (d.samplePeriod > 0)) {
+    _currOccupancyByTime = in.activeuSecs;
+    _currOccupancyByTime /= in.activeProcessCount;
+    _currOccupancyByTime *= 100;
+    _currOccupancyByTime /= static_cast<float>(d.samplePeriod * util::MICROSECOND);
+  }
+  else {
+    _currOccupancyByTime = 0;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // Use a moving average occupancy to smooth spikes
+  //////////////////////////////////////////////////////////////////////
+
+  _currOccupancyByTime = _currOccupancyByTime * 0.75 + _prevOccupancyByTime * 0.25;
+  _currListenBacklog = _currListenBacklog * 0.75 + _prevListenBacklog * 0.25;
+
+  d.currOccupancy = _currOccupancyByTime;
+  d.prevOccupancy = _prevOccupancyByTime;
+  d.currListenBacklog = _currListenBacklog;
+  d.prevListenBacklog = _prevListenBacklog;
+
+  //////////////////////////////////////////////////////////////////////
+  // If more are needed, calculate how many more to get to the desired
+  // occupancy.
+  //////////////////////////////////////////////////////////////////////
+
+  if (_currOccupancyByTime <= in.occupancyPercent) return false;
+
+  int shortFall = (int) _currOccupancyByTime - in.occupancyPercent;
+  shortFall *= in.activeProcessCount;
+  shortFall += 99;				// Round % up
+  shortFall /= 100;
+  if (shortFall == 0) ++shortFall;		// Make sure it's at least one
+  if (_currListenBacklog >= 1) ++shortFall;	// These may overshoot since
+  if (_prevListenBacklog >= 10) shortFall += 5;	// backlog is a lagging value
+
+  if (shortFall > (in.maximumProcesses - in.activeProcessCount)) {
+    shortFall = in.maximumProcesses - in.activeProcessCount;
+  }
+
+  d.what = createIncrease;
+  d.count = shortFall;
+
+  return true;					// Say we started some
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Ramp down processes based on occupancy. Return true if a process
+// should be told to exit.
+//
+// Calculate what the new occupancy would be if a process were to be
+// removed. The idea is that a process will only be removed if the new
+// occupancy is still below the threshold. In other words, don't
+// remove a process if the result is that next time through this code
+// a process is started up.
+//
+// n=new, o=old, C=count, O=occupancy
+// nO = oO * nC / (nC-1)
+//////////////////////////////////////////////////////////////////////
+
+bool
+util::calibrationPolicy::occupancyDown(const inputs& in, decision& d)
+{
+  //////////////////////////////////////////////////////////////////////
+  // The last process can only go if it was idle for one of the
+  // periods, otherwise the proposed occupancy is infinite.
+  //////////////////////////////////////////////////////////////////////
+
+  if (in.activeProcessCount == 1) {
+    if ((_currOccupancyByTime > 0) && (_prevOccupancyByTime > 0)) return false;
+    d.what = removeExcess;
+    return true;
+  }
+
+  float new1Occupancy = _currOccupancyByTime;
+  new1Occupancy *= in.activeProcessCount;
+  new1Occupancy /= (in.activeProcessCount - 1);
+
+  float new2Occupancy = _prevOccupancyByTime;
+  new2Occupancy *= in.activeProcessCount;
+  new2Occupancy /= (in.activeProcessCount - 1);
+
+  d.proposedCurrOccupancy = new1Occupancy;
+  d.proposedPrevOccupancy = new2Occupancy;
+
+  int lowerThreshold = in.occupancyPercent - 5;		// XX Hack
+
+  if ((new1Occupancy >= lowerThreshold) && (new2Occupancy >= lowerThreshold)) return false;
+
+  d.what = removeExcess;
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Idle timeout calibration only applies when no reports have been
+// seen for the idle-timeout period and there is more than the
+// configured minimum processes still running.
+//////////////////////////////////////////////////////////////////////
+
+bool
+util::calibrationPolicy::idleDown(const inputs& in, decision& d)
+{
+  if ((in.idleTimeout == 0) || (in.activeProcessCount <= in.minimumProcesses)) {
+    return false;
+  }
+
+  if ((in.lastPerformanceReport + in.idleTimeout) > in.now) return false;
+
+  d.what = removeIdle;
+
+  return true;
+}
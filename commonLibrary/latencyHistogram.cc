@@ -0,0 +1,213 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include <iomanip>
+
+#include <string.h>
+
+#include "latencyHistogram.h"
+
+
+util::latencyHistogram::latencyHistogram()
+{
+  reset();
+}
+
+void
+util::latencyHistogram::reset()
+{
+  _count = 0;
+  _minimum = 0;
+  _maximum = 0;
+  _total = 0;
+  memset((void*) _bucket, '\0', sizeof(_bucket));
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Values below subBuckets map to themselves. Above that the index is
+// the power-of-two times subBuckets plus the top subBucketBits+1 bits
+// of the value, which makes the index continuous across octaves.
+//////////////////////////////////////////////////////////////////////
+
+int
+util::latencyHistogram::bucketIndex(unsigned long uSecs)
+{
+  if (uSecs < (unsigned long) subBuckets) return uSecs;
+
+  int shift = 0;
+  while ((uSecs >> shift) >= (unsigned long) (subBuckets * 2)) ++shift;
+
+  int ix = shift * subBuckets + (uSecs >> shift);
+  if (ix >= bucketCount) ix = bucketCount - 1;
+
+  return ix;
+}
+
+unsigned long
+util::latencyHistogram::bucketUpper(int ix)
+{
+  if (ix < subBuckets * 2) return ix;
+
+  int shift = ix / subBuckets - 1;
+  unsigned long lower = (unsigned long) (ix - shift * subBuckets) << shift;
+
+  return lower + (1UL << shift) - 1;
+}
+
+
+void
+util::latencyHistogram::add(unsigned long uSecs)
+{
+  if ((_count == 0) || (uSecs < _minimum)) _minimum = uSecs;
+  if (uSecs > _maximum) _maximum = uSecs;
+  ++_count;
+  _total += uSecs;
+  ++_bucket[bucketIndex(uSecs)];
+}
+
+void
+util::latencyHistogram::merge(const latencyHistogram& from)
+{
+  if (from._count == 0) return;
+
+  if ((_count == 0) || (from._minimum < _minimum)) _minimum = from._minimum;
+  if (from._maximum > _maximum) _maximum = from._maximum;
+  _count += from._count;
+  _total += from._total;
+  for (int ix=0; ix < bucketCount; ++ix) _bucket[ix] += from._bucket[ix];
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Return the value at or below which "percent" of the values
+// lie. This is the highest value in the bucket holding that
+// percentile, clamped to the largest value actually seen.
+//////////////////////////////////////////////////////////////////////
+
+unsigned long
+util::latencyHistogram::getPercentile(double percent) const
+{
+  if (_count == 0) return 0;
+  if (percent >= 100.0) return _maximum;
+
+  unsigned long target = (unsigned long) (_count * percent / 100.0 + 0.5);
+  if (target < 1) target = 1;
+
+  unsigned long seen = 0;
+  for (int ix=0; ix < bucketCount; ++ix) {
+    seen += _bucket[ix];
+    if (seen >= target) {
+      unsigned long upper = bucketUpper(ix);
+      if (upper > _maximum) upper = _maximum;
+      if (upper < _minimum) upper = _minimum;
+      return upper;
+    }
+  }
+
+  return _maximum;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Reports are in milliseconds with microsecond resolution.
+//////////////////////////////////////////////////////////////////////
+
+static void
+putMS(std::ostream& os, unsigned long uSecs)
+{
+  char fill = os.fill('0');
+  os << uSecs / 1000 << "." << std::setw(3) << uSecs % 1000;
+  os.fill(fill);
+}
+
+void
+util::latencyHistogram::printSummary(std::ostream& os) const
+{
+  os << "Count=" << _count;
+  if (_count == 0) return;
+
+  os << " Min=";	putMS(os, getMinimum());
+  os << " Mean=";	putMS(os, getMean());
+  os << " p50=";	putMS(os, getPercentile(50.0));
+  os << " p90=";	putMS(os, getPercentile(90.0));
+  os << " p99=";	putMS(os, getPercentile(99.0));
+  os << " p99.9=";	putMS(os, getPercentile(99.9));
+  os << " Max=";	putMS(os, getMaximum());
+  os << " (ms)";
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Print a percentile table in the same layout as HdrHistogram's
+// percentile distribution output so that existing plotting tools can
+// read it.
+//////////////////////////////////////////////////////////////////////
+
+void
+util::latencyHistogram::printPercentiles(std::ostream& os) const
+{
+  static const double percentiles[] = {
+    0.0, 10.0, 25.0, 50.0, 75.0, 90.0, 95.0, 99.0, 99.5, 99.9, 99.95, 99.99, 99.999, 100.0
+  };
+
+  std::ios_base::fmtflags flags = os.flags();
+  std::streamsize precision = os.precision();
+
+  os << std::setw(12) << "Value(ms)" << " " << std::setw(14) << "Percentile"
+     << " " << std::setw(10) << "TotalCount" << " " << std::setw(16) << "1/(1-Percentile)"
+     << std::endl;
+
+  for (unsigned int px=0; px < sizeof(percentiles) / sizeof(percentiles[0]); ++px) {
+    double fraction = percentiles[px] / 100.0;
+    unsigned long uSecs = (px == 0) ? getMinimum() : getPercentile(percentiles[px]);
+
+    unsigned long seen = 0;
+    for (int ix=0; ix <= bucketIndex(uSecs); ++ix) seen += _bucket[ix];
+
+    os << std::setw(8) << uSecs / 1000 << "." << std::setfill('0') << std::setw(3) << uSecs % 1000
+       << std::setfill(' ') << " " << std::setw(14) << std::fixed << std::setprecision(6) << fraction
+       << " " << std::setw(10) << seen << " ";
+    if (fraction < 1.0) {
+      os << std::setw(16) << std::setprecision(2) << 1.0 / (1.0 - fraction);
+    }
+    else {
+      os << std::setw(16) << "inf";
+    }
+    os << std::endl;
+  }
+  os.flags(flags);
+  os.precision(precision);
+
+  os << "#[Mean    = ";		putMS(os, getMean());
+  os << ", Max = ";		putMS(os, getMaximum());
+  os << "]" << std::endl;
+  os << "#[Total count = " << _count << "]" << std::endl;
+}
@@ -0,0 +1,207 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "loadDistribution.h"
+
+
+util::loadDistribution::loadDistribution()
+{
+  std::string em;
+  parse("0", em);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Parse a comma separated list of exactly "count" numbers.
+//////////////////////////////////////////////////////////////////////
+
+static bool
+parseNumbers(const std::string& list, double* values, int count)
+{
+  const char* cp = list.c_str();
+  for (int ix=0; ix < count; ++ix) {
+    char* end;
+    values[ix] = strtod(cp, &end);
+    if (end == cp) return false;
+    cp = end;
+    if (ix < count-1) {
+      if (*cp != ',') return false;
+      ++cp;
+    }
+  }
+
+  return *cp == '\0';
+}
+
+bool
+util::loadDistribution::parseComponent(const std::string& spec, component& c, std::string& em)
+{
+  std::string dist = spec;
+  c.weight = 1;
+  std::string::size_type at = spec.find('@');
+  if (at != std::string::npos) {
+    if (!parseNumbers(spec.substr(0, at), &c.weight, 1) || (c.weight <= 0)) {
+      em = "Invalid weight in '" + spec + "'";
+      return false;
+    }
+    dist = spec.substr(at+1);
+  }
+
+  std::string name;
+  std::string args = dist;
+  std::string::size_type colon = dist.find(':');
+  if (colon != std::string::npos) {
+    name = dist.substr(0, colon);
+    args = dist.substr(colon+1);
+  }
+
+  double v[2] = { 0, 0 };
+  bool ok;
+  if (name.empty() || (name == "fixed")) {
+    c.type = fixed;
+    ok = parseNumbers(args, v, 1);
+  }
+  else if (name == "uniform") {
+    c.type = uniform;
+    ok = parseNumbers(args, v, 2) && (v[0] <= v[1]);
+  }
+  else if (name == "exponential") {
+    c.type = exponential;
+    ok = parseNumbers(args, v, 1) && (v[0] > 0);
+  }
+  else if (name == "lognormal") {
+    c.type = lognormal;
+    ok = parseNumbers(args, v, 2) && (v[0] > 0) && (v[1] >= 0);
+  }
+  else if (name == "pareto") {
+    c.type = pareto;
+    ok = parseNumbers(args, v, 2) && (v[0] > 0) && (v[1] > 0);
+  }
+  else {
+    em = "Unknown distribution '" + name + "'";
+    return false;
+  }
+
+  if (!ok) {
+    em = "Invalid parameters in '" + spec + "'";
+    return false;
+  }
+
+  c.a = v[0];
+  c.b = v[1];
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Replace the current distribution with the one described by spec. On
+// error the current distribution is unchanged.
+//////////////////////////////////////////////////////////////////////
+
+bool
+util::loadDistribution::parse(const std::string& spec, std::string& em)
+{
+  std::vector<component> components;
+  double totalWeight = 0;
+
+  std::string::size_type start = 0;
+  while (true) {
+    std::string::size_type bar = spec.find('|', start);
+    component c;
+    if (!parseComponent(spec.substr(start, bar - start), c, em)) return false;
+    totalWeight += c.weight;
+    c.weight = totalWeight;
+    components.push_back(c);
+    if (bar == std::string::npos) break;
+    start = bar + 1;
+  }
+
+  for (unsigned int ix=0; ix < components.size(); ++ix) components[ix].weight /= totalWeight;
+
+  _spec = spec;
+  _components = components;
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Pick a component by weight, then sample it. Samples are never
+// negative.
+//////////////////////////////////////////////////////////////////////
+
+double
+util::loadDistribution::sample(unsigned short xsubi[3]) const
+{
+  const component* c = &_components.back();
+  if (_components.size() > 1) {
+    double w = erand48(xsubi);
+    for (unsigned int ix=0; ix < _components.size(); ++ix) {
+      if (w < _components[ix].weight) {
+	c = &_components[ix];
+	break;
+      }
+    }
+  }
+
+  double u = 1.0 - erand48(xsubi);		// In (0, 1]
+  double v;
+  switch (c->type) {
+  case uniform:
+    v = c->a + (c->b - c->a) * u;
+    break;
+
+  case exponential:
+    v = -c->a * log(u);
+    break;
+
+  case lognormal:
+    {
+      double z = sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * erand48(xsubi));	// Box-Muller
+      v = c->a * exp(c->b * z);
+    }
+    break;
+
+  case pareto:
+    v = c->a / pow(u, 1.0 / c->b);
+    break;
+
+  case fixed:
+  default:
+    v = c->a;
+    break;
+  }
+
+  return (v < 0) ? 0 : v;
+}
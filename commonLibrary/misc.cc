@@ -50,6 +50,10 @@ pluton::misc::packetToEnglish(pluton::packetType pt)
   case (requestPT) : return "requestPT";
   case (loginResponsePT) : return "loginResponsePT";
   case (responsePT) : return "responsePT";
+  case (batchRequestPT) : return "batchRequestPT";
+  case (batchResponsePT) : return "batchResponsePT";
+  case (recordPT) : return "recordPT";
+  case (multiplexPT) : return "multiplexPT";
   }
 
   return "?unknownPT?";
@@ -75,11 +79,32 @@ pluton::misc::NSTypeToEnglish(pluton::netStringType nst)
   case (requestDataNT): return "requestDataNT";
   case (timeoutMSNT): return "timeoutMSNT";
   case (fileDescriptorNT): return "fileDescriptorNT";
+  case (memfdAcceptNT): return "memfdAcceptNT";
+  case (binaryFramingNT): return "binaryFramingNT";
+  case (responsePartAcceptNT): return "responsePartAcceptNT";
 
   case (faultCodeNT): return "faultCodeNT";
   case (responseDataNT): return "responseDataNT";
   case (faultTextNT): return "faultTextNT";
   case (serviceIDNT): return "serviceIDNT";
+  case (cacheMaxAgeNT): return "cacheMaxAgeNT";
+  case (responsePartNT): return "responsePartNT";
+
+  case (memfdDataNT): return "memfdDataNT";
+  case (compressAcceptNT): return "compressAcceptNT";
+  case (compressionNT): return "compressionNT";
+  case (compressedDataNT): return "compressedDataNT";
+  case (batchMemberNT): return "batchMemberNT";
+
+  case (multiplexTagNT): return "multiplexTagNT";
+  case (multiplexPacketNT): return "multiplexPacketNT";
+
+  case (recordSequenceNT): return "recordSequenceNT";
+  case (recordStartNT): return "recordStartNT";
+  case (recordDurationNT): return "recordDurationNT";
+  case (recordRequestNT): return "recordRequestNT";
+  case (recordResponseNT): return "recordResponseNT";
+  case (recordPadNT): return "recordPadNT";
 
   case (credentialsNT): return "credentialsNT";
   case (allowedNT): return "allowedNT";
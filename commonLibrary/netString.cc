@@ -36,6 +36,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <assert.h>
 #include <ctype.h>
+#include <sched.h>
 
 #include "netString.h"
 
@@ -77,6 +78,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // correctly, but that variation allows netstrings to be printed and
 // understood by humans much more easily.
 //
+// There is also an alternate, binary, framing for when the cost of
+// formatting and scanning decimal lengths matters more than being
+// able to read the stream. A binary framed netString starts with the
+// type byte with its top bit set, followed by the length as a
+// base-128 varint (least significant seven bits first, top bit set on
+// all but the last byte), followed by the data. There is no
+// terminator. The same example is: 0xba 0x0a abcdefghij
+//
+// As the top bit distinguishes a binary framed netString from a
+// leading digit, all of the parsers accept either framing, netString
+// by netString, and the generators select one with
+// setBinaryFraming(). Callers that exchange data with a peer which
+// may pre-date binary framing should only generate it once the peer
+// has shown that it understands it.
+//
 //
 // The classes in this module are:
 //
@@ -93,6 +109,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 // - netStringFactoryManaged() derived from netStringFactory() with an
 //   internally managed buffer.
+//
+// - netStringBufferPool() supplies the buffers for
+//   netStringFactoryManaged().
 //////////////////////////////////////////////////////////////////////
 
 
@@ -137,6 +156,25 @@ ltoa(IA& iap, long ival)
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Convert a length to a binary framing varint. Return the number of
+// bytes used, which is at most five for the largest valid length.
+//////////////////////////////////////////////////////////////////////
+
+static int
+lengthToVarint(IA& iap, unsigned int length)
+{
+  int ix = 0;
+  while (length >= 0x80) {
+    iap.buf[ix++] = (length & 0x7f) | 0x80;
+    length >>= 7;
+  }
+  iap.buf[ix++] = length;
+
+  return ix;
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // Calculate the number of encapsulation bytes required.
 //////////////////////////////////////////////////////////////////////
@@ -157,6 +195,14 @@ netStringGenerate::determineOverhead(unsigned int length)
   return overhead;
 }
 
+unsigned int
+netStringGenerate::determineBinaryOverhead(unsigned int length)
+{
+  IA ia;
+
+  return 1 + lengthToVarint(ia, length);		// Type + varint
+}
+
 
 //////////////////////////////////////////////////////////////////////
 // The netStringGenerate class creates netstrings. Given the supplied
@@ -166,7 +212,7 @@ netStringGenerate::determineOverhead(unsigned int length)
 
 netStringGenerate::netStringGenerate(std::string* alternateStringPtr, bool useAlternateTerminator)
   : _sPtr(alternateStringPtr), _terminator(useAlternateTerminator ? '\n' : ','),
-    _defaultBaseString(0)
+    _binaryFraming(false), _defaultBaseString(0)
 {
   if (_sPtr == 0) {
     _defaultBaseString = new std::string;
@@ -177,7 +223,7 @@ netStringGenerate::netStringGenerate(std::string* alternateStringPtr, bool useAl
 
 netStringGenerate::netStringGenerate(std::string& alternateStringRef, bool useAlternateTerminator)
   : _sPtr(&alternateStringRef), _terminator(useAlternateTerminator ? '\n' : ','),
-    _defaultBaseString(0)
+    _binaryFraming(false), _defaultBaseString(0)
 {
 }
 
@@ -188,6 +234,27 @@ netStringGenerate::~netStringGenerate()
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Append the length and type that precede the data in the selected
+// framing. The caller has already checked the type.
+//////////////////////////////////////////////////////////////////////
+
+void
+netStringGenerate::appendPrefix(const char addType, unsigned int addLen)
+{
+  IA ia;
+
+  if (_binaryFraming) {
+    (*_sPtr) += static_cast<char>(addType | 0x80);
+    _sPtr->append(ia.buf, lengthToVarint(ia, addLen));
+  }
+  else {
+    (*_sPtr) += ltoa(ia, addLen);		// Convert length to ascii
+    (*_sPtr) += addType;
+  }
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // The appenders simply take various data types and append them in
 // netstring format.
@@ -201,15 +268,9 @@ netStringGenerate::append(const char addType, const char* addPtr, int addLen)
   if (isdigit(addType)) return -3;
   if (addPtr == NULL) return -4;
 
-  // Convert length to ascii
-
-  IA ia;
-  const char* cp = ltoa(ia, addLen);
-  (*_sPtr) += cp;
-
-  (*_sPtr) += addType;
+  appendPrefix(addType, addLen);
   _sPtr->append(addPtr, addLen);
-  (*_sPtr) += _terminator;
+  if (!_binaryFraming) (*_sPtr) += _terminator;
 
   return _sPtr->length();
 }
@@ -249,15 +310,9 @@ netStringGenerate::append(const char addType, const std::string& addString)
   if (!isprint(addType)) return -2;
   if (isdigit(addType)) return -3;
 
-  // Convert length to ascii
-
-  IA ia;
-  const char* cp = ltoa(ia, addString.length());
-  (*_sPtr) += cp;
-
-  (*_sPtr) += addType;
+  appendPrefix(addType, addString.length());
   (*_sPtr) += addString;
-  (*_sPtr) += _terminator;
+  if (!_binaryFraming) (*_sPtr) += _terminator;
   return _sPtr->length();
 }
 
@@ -274,12 +329,7 @@ netStringGenerate::appendRawPrefix(const char addType, int len)
   if (!isprint(addType)) return -2;
   if (isdigit(addType)) return -3;
 
-  // Convert length to ascii
-
-  IA ia;
-  const char* cp = ltoa(ia, len);
-  (*_sPtr) += cp;
-  (*_sPtr) += addType;
+  appendPrefix(addType, len);
 
   return _sPtr->length();
 }
@@ -287,7 +337,7 @@ netStringGenerate::appendRawPrefix(const char addType, int len)
 int
 netStringGenerate::appendRawTerminator()
 {
-  (*_sPtr) += _terminator;
+  if (!_binaryFraming) (*_sPtr) += _terminator;
   return _sPtr->length();
 }
 
@@ -346,10 +396,9 @@ netStringGenerate::append(const char addType, char addChar)
   if (!isprint(addType)) return -2;
   if (isdigit(addType)) return -3;
 
-  (*_sPtr) += '1';
-  (*_sPtr) += addType;
+  appendPrefix(addType, 1);
   (*_sPtr) += addChar;
-  (*_sPtr) += _terminator;
+  if (!_binaryFraming) (*_sPtr) += _terminator;
   return _sPtr->length();
 }
 
@@ -360,10 +409,9 @@ netStringGenerate::append(const char addType, unsigned char addChar)
   if (!isprint(addType)) return -2;
   if (isdigit(addType)) return -3;
 
-  (*_sPtr) += '1';
-  (*_sPtr) += addType;
+  appendPrefix(addType, 1);
   (*_sPtr) += addChar;
-  (*_sPtr) += _terminator;
+  if (!_binaryFraming) (*_sPtr) += _terminator;
   return _sPtr->length();
 }
 
@@ -374,9 +422,8 @@ netStringGenerate::append(const char addType)
   if (!isprint(addType)) return -2;
   if (isdigit(addType)) return -3;
 
-  (*_sPtr) += '0';
-  (*_sPtr) += addType;
-  (*_sPtr) += _terminator;
+  appendPrefix(addType, 0);
+  if (!_binaryFraming) (*_sPtr) += _terminator;
   return _sPtr->length();
 }
 
@@ -386,9 +433,8 @@ netStringGenerate::appendNL(const char addType)
   if (!isprint(addType)) return -2;
   if (isdigit(addType)) return -3;
 
-  (*_sPtr) += '0';
-  (*_sPtr) += addType;
-  (*_sPtr) += '\n';		// Force this terminator
+  appendPrefix(addType, 0);
+  if (!_binaryFraming) (*_sPtr) += '\n';		// Force this terminator
   return _sPtr->length();
 }
 
@@ -399,10 +445,9 @@ netStringGenerate::append(const char addType, bool trueOrFalse)
   if (!isprint(addType)) return -2;
   if (isdigit(addType)) return -3;
 
-  (*_sPtr) += '1';
-  (*_sPtr) += addType;
+  appendPrefix(addType, 1);
   (*_sPtr) += (trueOrFalse ? 'y' : 'n');
-  (*_sPtr) += _terminator;
+  if (!_binaryFraming) (*_sPtr) += _terminator;
   return _sPtr->length();
 }
 
@@ -492,6 +537,8 @@ netStringGenerateEncapsulated::erase()
 bool
 netStringGenerateEncapsulated::encapsulate(const char addType)
 {
+  if (_binaryFraming) return encapsulateBinary(addType);
+
   unsigned int overHead = netStringGenerate::determineOverhead(_sPtr->length() - _reservedSpace);
   overHead++;	// Need a byte for the type		- step 1)
   if (overHead > _reservedSpace) return false;	//	- step 2)
@@ -517,6 +564,31 @@ netStringGenerateEncapsulated::encapsulate(const char addType)
   return true;
 }
 
+//////////////////////////////////////////////////////////////////////
+// The binary framing version of encapsulate(). The type and varint
+// are written backwards from the end of the reserved space and there
+// is no terminator. The reserved space always has room as a varint is
+// never longer than its decimal counterpart.
+//////////////////////////////////////////////////////////////////////
+
+bool
+netStringGenerateEncapsulated::encapsulateBinary(const char addType)
+{
+  IA ia;
+  unsigned int len = lengthToVarint(ia, _sPtr->length() - _reservedSpace);
+  if ((len+1) > _reservedSpace) return false;
+
+  unsigned startIx = _reservedSpace - len - 1;
+  (*_sPtr)[startIx++] = addType | 0x80;
+  for (unsigned int ix = 0; ix < len; ++ix, ++startIx) {
+    (*_sPtr)[startIx] = ia.buf[ix];
+  }
+
+  _reservedSpace -= (len + 1);
+
+  return true;
+}
+
 const char*
 netStringGenerateEncapsulated::data() const
 {
@@ -566,6 +638,8 @@ netStringParse::getNext(char& returnType, const char*& returnPtr, int& returnLen
 
   if (_ptr == NULL) return "pointer is NULL";
 
+  if (*_ptr & 0x80) return getNextBinary(returnType, returnPtr, returnLen);
+
   if (! isdigit(*_ptr)) return "leading character is not a digit";
 
   while (_remaining > 0) {
@@ -614,6 +688,58 @@ netStringParse::getNext(char& returnType, const char*& returnPtr, int& returnLen
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// The binary framing counterpart of getNext(). The leading byte is
+// known to have the top bit set.
+//////////////////////////////////////////////////////////////////////
+
+const char*
+netStringParse::getNextBinary(char& returnType, const char*& returnPtr, int& returnLen)
+{
+  const unsigned char* up = reinterpret_cast<const unsigned char*>(_ptr);
+  char type = *up & 0x7f;
+  if (!isprint(type) || isdigit(type)) {
+    _remaining = 0;
+    return "invalid binary type (not a non-digit isprint())";
+  }
+
+  int used = 1;
+  int len = 0;
+  for (int shift=0; ; shift += 7) {
+    if (used >= _remaining) {
+      _remaining = 0;
+      return "binary length missing";
+    }
+    unsigned int digit = up[used] & 0x7f;
+    if ((shift > 28) || ((shift == 28) && (digit > 3))) {
+      _remaining = 0;
+      return "binary length longer than five bytes";
+    }
+    len |= digit << shift;
+    if (!(up[used++] & 0x80)) break;
+  }
+
+  if (len > 999999999) {
+    _remaining = 0;
+    return "length value greater than 999999999";
+  }
+
+  if (len > (_remaining - used)) {
+    _remaining = 0;
+    return "length longer than data";
+  }
+
+  returnType = type;
+  returnPtr = _ptr + used;
+  returnLen = len;
+
+  _ptr += used + len;				// No terminator to consume
+  _remaining -= used + len;
+
+  return 0;
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // find is a wrapper routine around getNext that finds a particular
 // netString in a parseable stream of netStrings. It presents a good
@@ -688,7 +814,7 @@ operator<<(std::ostream& s, const netStringParse& nsp)
 netStringStreamParse::netStringStreamParse()
   : _ignoreCRLF(false),
     _parseState(checkLeadingDigit), _dataLength(0), _bytesToSkip(0),
-    _nsType(0), _netStringsFound(0), _bytesSkipped(0)
+    _nsType(0), _binaryFlag(false), _lengthShift(0), _netStringsFound(0), _bytesSkipped(0)
 {
 }
 
@@ -702,6 +828,7 @@ netStringStreamParse::reset()
 {
   _parseState = checkLeadingDigit;
   _nsType = 0;
+  _binaryFlag = false;
   _dataLength = 0;
   _bytesToSkip = 0;
 }
@@ -804,11 +931,14 @@ netStringStreamParse::haveDataEnd(const char* baseAddress, int& parseOffset,
 				  int& nsLengthOffset, int& nsDataOffset, const char*& error)
 {
   error = 0;
-  if ((_parseState != checkingTerminator) && (unparsedBytes > 0)) {
+  if ((_parseState != checkingTerminator) && (_parseState != gotit) && (unparsedBytes > 0)) {
     error = parse(baseAddress, parseOffset, unparsedBytes, nsLengthOffset, nsDataOffset,
 		  false, true);
   }
-  return _parseState == checkingTerminator;
+
+  // A binary framed netString has no terminator so it goes straight to gotit
+
+  return (_parseState == checkingTerminator) || (_binaryFlag && (_parseState == gotit));
 }
 
 
@@ -826,6 +956,19 @@ netStringStreamParse::parse(const char* baseAddress, int& parseOffset, int& unpa
     switch (_parseState) {
     case checkLeadingDigit:
       nsLengthOffset = parseOffset;
+      _binaryFlag = (baseAddress[parseOffset] & 0x80) != 0;
+      if (_binaryFlag) {
+	_nsType = baseAddress[parseOffset] & 0x7f;
+	if (!isprint(_nsType) || isdigit(_nsType)) {
+	  return "invalid binary netString type (not a non-digit isprint())";
+	}
+	_dataLength = 0;
+	_lengthShift = 0;
+	++parseOffset; --unparsedBytes;
+	_parseState = parsingBinaryLength;
+	break;
+      }
+
       if (! isdigit(baseAddress[parseOffset])) {
 	if (_ignoreCRLF
 	    && (unparsedBytes == 2)
@@ -842,6 +985,39 @@ netStringStreamParse::parse(const char* baseAddress, int& parseOffset, int& unpa
       _parseState = parsingLength;
       break;
 
+    case parsingBinaryLength:
+      {
+	unsigned char lengthByte = baseAddress[parseOffset];
+	unsigned int digit = lengthByte & 0x7f;
+	if ((_lengthShift == 28) && (digit > 3)) {
+	  return "netString length value greater than 999999999";
+	}
+	_dataLength |= digit << _lengthShift;
+	if (_dataLength > 999999999) return "netString length value greater than 999999999";
+	++parseOffset; --unparsedBytes;
+
+	if (lengthByte & 0x80) {
+	  _lengthShift += 7;
+	  if (_lengthShift > 28) return "binary netString length longer than five bytes";
+	  break;
+	}
+      }
+
+      // The data starts now, even if there are no more bytes yet, and
+      // there is no terminator to wait for after it.
+
+      nsDataOffset = parseOffset;
+      _bytesToSkip = _dataLength;
+      _bytesSkipped += _dataLength;
+      _parseState = skippingData;
+      if (stopAtDataFlag) return 0;
+      if (_bytesToSkip == 0) {
+	_parseState = gotit;
+	++_netStringsFound;
+	return 0;
+      }
+      break;
+
     case parsingLength:
       if (isdigit(baseAddress[parseOffset])) {
 	_dataLength *= 10;
@@ -878,6 +1054,11 @@ netStringStreamParse::parse(const char* baseAddress, int& parseOffset, int& unpa
 	unparsedBytes -= _bytesToSkip;
 	parseOffset += _bytesToSkip;
 	_bytesToSkip = 0;
+	if (_binaryFlag) {
+	  _parseState = gotit;
+	  ++_netStringsFound;
+	  return 0;
+	}
 	_parseState = checkingTerminator;
 	if (stopAtTerminatorFlag) return 0;
       }
@@ -905,6 +1086,7 @@ netStringStreamParse::stateToEnglish() const
 {
   switch (_parseState) {
   case checkLeadingDigit: return "checkLeadingDigit";
+  case parsingBinaryLength: return "parsingBinaryLength";
   case parsingLength: return "parsingLength";
   case checkType: return "checkType";
   case setDataOffset: return "setDataOffset";
@@ -922,6 +1104,7 @@ netStringStreamParse::stateToEnglish() const
 netStringFactory::netStringFactory(const char* initBuffer, int initBufferSize)
   : _relocationAllowed(true), _baseAddress(initBuffer), _bufferSize(initBufferSize),
     _parseOffset(0), _unparsedBytes(0), _nsLengthOffset(0), _nsDataOffset(0),
+    _bulkNext(0), _bulkCount(0),
     _bytesRead(0), _bytesRelocated(0), _zeroCostRelocates(0), _userReallocations(0)
 {
 }
@@ -1005,7 +1188,7 @@ netStringFactory::getRawString(int& returnDataOffset, int& returnDataLength) con
   }
 
   returnDataOffset = _nsLengthOffset;
-  returnDataLength = _dataLength + (_nsDataOffset - _nsLengthOffset) + 1;
+  returnDataLength = _dataLength + (_nsDataOffset - _nsLengthOffset) + (_binaryFlag ? 0 : 1);
 
   return true;
 }
@@ -1024,6 +1207,13 @@ bool
 netStringFactory::haveNetString(const char*& error)
 {
   error = 0;
+  if ((_parseState == checkLeadingDigit) && (_unparsedBytes > 0)) {
+    if ((_bulkNext < _bulkCount) || ((_unparsedBytes >= bulkParseMinimum) && bulkParse())) {
+      nextFromBulk();
+      return true;
+    }
+  }
+
   if ((_parseState != gotit) && (_unparsedBytes > 0)) {
     error = netStringStreamParse::parse(_baseAddress, _parseOffset, _unparsedBytes,
 					_nsLengthOffset, _nsDataOffset);
@@ -1033,6 +1223,118 @@ netStringFactory::haveNetString(const char*& error)
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Decode all the complete netStrings in the unparsed data in a single
+// pass and queue their descriptors. This avoids a trip around the
+// state machine for every byte of every length and type when a whole
+// packet, or many packets, are already buffered - the common case
+// for the request and response streams.
+//
+// The scan stops at the first netString that is incomplete or does
+// not look right. It does not report errors: whatever it stopped on
+// is left to the state machine which then produces exactly the same
+// results and errors as if the bulk parser did not exist. For the
+// same reason, anything the state machine tolerates but which is
+// unusual, such as lengths with more than nine digits or
+// setIgnoreCRLF(), is also left to the state machine.
+//
+// Return: the number of descriptors queued.
+//////////////////////////////////////////////////////////////////////
+
+int
+netStringFactory::bulkParse()
+{
+  const unsigned char* base = reinterpret_cast<const unsigned char*>(_baseAddress);
+  const unsigned char* cp = base + _parseOffset;
+  const unsigned char* end = cp + _unparsedBytes;
+
+  _bulkNext = 0;
+  _bulkCount = 0;
+
+  while ((_bulkCount < maxDescriptors) && ((end - cp) >= 2)) {	// Smallest is binary "T\0"
+    const unsigned char* lengthStart = cp;
+    unsigned char type;
+    unsigned int length = 0;
+    bool binary = (*cp & 0x80) != 0;
+
+    if (binary) {
+      type = *cp++ & 0x7f;
+      if ((type < ' ') || (type > '~') || ((unsigned int) (type - '0') <= 9)) break;
+
+      int shift = 0;
+      while ((cp < end) && (*cp & 0x80) && (shift < 28)) {
+	length |= (*cp++ & 0x7f) << shift;
+	shift += 7;
+      }
+      if (cp == end) break;				// Length not complete yet
+      if ((shift == 28) && (*cp > 3)) break;		// Too long or too large
+      length |= *cp++ << shift;
+      if (length > 999999999) break;
+      if ((unsigned int) (end - cp) < length) break;	// Data not all here
+    }
+    else {
+      unsigned int digit = *cp - '0';
+      if (digit > 9) break;
+
+      length = digit;
+      const unsigned char* digitLimit = cp + 9;
+      if (digitLimit > end) digitLimit = end;
+      for (++cp; (cp < digitLimit) && ((digit = *cp - '0') <= 9); ++cp) {
+	length = length * 10 + digit;
+      }
+      if (cp == end) break;				// Length not complete yet
+      if ((unsigned int) (*cp - '0') <= 9) break;		// Ten or more digits
+
+      type = *cp++;
+      if ((type < ' ') || (type > '~')) break;		// Not isprint()
+      if ((unsigned int) (end - cp) <= length) break;	// Data+terminator not all here
+      if ((cp[length] != ',') && (cp[length] != '\n')) break;
+    }
+
+    descriptor& d = _bulk[_bulkCount++];
+    d.type = type;
+    d.binary = binary;
+    d.lengthOffset = lengthStart - base;
+    d.dataOffset = cp - base;
+    d.dataLength = length;
+
+    cp += length + (binary ? 0 : 1);
+  }
+
+  return _bulkCount;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Hand out the next queued descriptor by putting the parser in the
+// same state the state machine leaves it in when it completes a
+// netString. The descriptor always starts at _parseOffset as nothing
+// else consumes unparsed data while descriptors are queued.
+//////////////////////////////////////////////////////////////////////
+
+void
+netStringFactory::nextFromBulk()
+{
+  const descriptor& d = _bulk[_bulkNext++];
+  assert(d.lengthOffset == _parseOffset);
+
+  int consumed = d.dataOffset + d.dataLength + (d.binary ? 0 : 1) - _parseOffset;
+  _parseOffset += consumed;
+  _unparsedBytes -= consumed;
+
+  _nsLengthOffset = d.lengthOffset;
+  _nsDataOffset = d.dataOffset;
+  _nsType = d.type;
+  _binaryFlag = d.binary;
+  _dataLength = d.dataLength;
+  _bytesToSkip = 0;
+  _bytesSkipped += d.dataLength;
+  ++_netStringsFound;
+
+  _parseState = gotit;
+}
+
+
 void
 netStringFactory::reset()
 {
@@ -1042,6 +1344,8 @@ netStringFactory::reset()
   _unparsedBytes = 0;
   _nsLengthOffset = 0;
   _nsDataOffset = 0;
+  _bulkNext = 0;
+  _bulkCount = 0;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -1095,6 +1399,10 @@ netStringFactory::getReadParameters(char*& bufferPtr, int& minimumBytesToRead,
     minimumBytesToRead = 1+1+1;		// at least one length byte + type + ,
     break;
 
+  case parsingBinaryLength:		// At least one more length byte
+    minimumBytesToRead = 1;
+    break;
+
   case parsingLength:			// _dataLength is meaninful though incomplete
     minimumBytesToRead = _dataLength + 1+1;
     break;
@@ -1105,7 +1413,7 @@ netStringFactory::getReadParameters(char*& bufferPtr, int& minimumBytesToRead,
 
   case setDataOffset:
   case skippingData:
-    minimumBytesToRead = _bytesToSkip + 1;
+    minimumBytesToRead = _bytesToSkip + (_binaryFlag ? 0 : 1);
     break;
 
   case checkingTerminator:
@@ -1187,6 +1495,11 @@ netStringFactory::tryToCompact()
     _parseOffset -= moveOffset;		// of whether they are currently valid
     _nsDataOffset -= moveOffset;
 
+    for (int ix=_bulkNext; ix < _bulkCount; ++ix) {
+      _bulk[ix].lengthOffset -= moveOffset;
+      _bulk[ix].dataOffset -= moveOffset;
+    }
+
     return true;
   }
 
@@ -1274,9 +1587,142 @@ netStringFactory::getStatistics(int& getBytesRead, int& getBytesRelocated,
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// The buffer pool. Free buffers of each size class are kept on a
+// list linked through their first bytes. The pool is shared by all
+// threads so it is protected by a spin lock; the lock is only held
+// for a list push or pop.
+//////////////////////////////////////////////////////////////////////
+
+static volatile int	S_poolLock = 0;
+static char*		S_freeLists[netStringBufferPool::largestClass+1];
+static unsigned int	S_bytesPooled = 0;
+static unsigned int	S_highWatermark = netStringBufferPool::defaultHighWatermark;
+static int		S_hits = 0;
+static int		S_misses = 0;
+static int		S_trims = 0;
+
+void
+netStringBufferPool::lock()
+{
+  while (__sync_lock_test_and_set(&S_poolLock, 1)) sched_yield();
+}
+
+void
+netStringBufferPool::unlock()
+{
+  __sync_lock_release(&S_poolLock);
+}
+
+// Return the size class of a buffer or -1 if it is not pooled.
+
+static int
+sizeClass(unsigned int size)
+{
+  if ((size < (1U << netStringBufferPool::smallestClass))
+      || (size > (1U << netStringBufferPool::largestClass))) return -1;
+
+  int sc = netStringBufferPool::smallestClass;
+  while ((1U << sc) < size) ++sc;
+
+  return sc;
+}
+
+char*
+netStringBufferPool::acquire(unsigned int& size)
+{
+  int sc = sizeClass(size);
+  if (sc == -1) return new char[size];
+
+  size = 1U << sc;
+
+  lock();
+  char* buffer = S_freeLists[sc];
+  if (buffer) {
+    S_freeLists[sc] = *reinterpret_cast<char**>(buffer);
+    S_bytesPooled -= size;
+    ++S_hits;
+  }
+  else {
+    ++S_misses;
+  }
+  unlock();
+
+  if (!buffer) buffer = new char[size];
+
+  return buffer;
+}
+
+void
+netStringBufferPool::release(char* buffer, unsigned int size)
+{
+  int sc = sizeClass(size);
+  if ((sc != -1) && (size == (1U << sc))) {
+    lock();
+    if (S_bytesPooled + size <= S_highWatermark) {
+      *reinterpret_cast<char**>(buffer) = S_freeLists[sc];
+      S_freeLists[sc] = buffer;
+      S_bytesPooled += size;
+      buffer = 0;
+    }
+    else {
+      ++S_trims;
+    }
+    unlock();
+  }
+
+  delete [] buffer;
+}
+
+void
+netStringBufferPool::setHighWatermark(unsigned int bytes)
+{
+  lock();
+  S_highWatermark = bytes;
+  unlock();
+
+  trimTo(bytes);
+}
+
+// Free the largest buffers first until no more than bytes are pooled
+
+void
+netStringBufferPool::trimTo(unsigned int bytes)
+{
+  for (int sc=largestClass; sc >= smallestClass; --sc) {
+    while (true) {
+      lock();
+      char* buffer = 0;
+      if ((S_bytesPooled > bytes) && S_freeLists[sc]) {
+	buffer = S_freeLists[sc];
+	S_freeLists[sc] = *reinterpret_cast<char**>(buffer);
+	S_bytesPooled -= 1U << sc;
+	++S_trims;
+      }
+      unlock();
+
+      if (!buffer) break;
+      delete [] buffer;
+    }
+  }
+}
+
+void
+netStringBufferPool::getStatistics(unsigned int& bytesPooled, int& hits, int& misses, int& trims)
+{
+  lock();
+  bytesPooled = S_bytesPooled;
+  hits = S_hits;
+  misses = S_misses;
+  trims = S_trims;
+  unlock();
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // A managed netStringFactory handles reallocations internally rather
-// than having the caller manage the space. initialSize+1 is simply to
+// than having the caller manage the space. Buffers come from
+// netStringBufferPool. A zero initialSize is made one byte simply to
 // ensure that the initial buffer is always greater than zero bytes
 // long.
 //////////////////////////////////////////////////////////////////////
@@ -1284,23 +1730,28 @@ netStringFactory::getStatistics(int& getBytesRead, int& getBytesRelocated,
 netStringFactoryManaged::netStringFactoryManaged(unsigned int initialSize,
 						 unsigned int setMaximumSize)
   : netStringFactory(0, 0),
-    _inboundBufferSize(initialSize+1), _maximumSize(setMaximumSize),
-    _inboundBufferPtr(new char[_inboundBufferSize])
+    _initialSize(initialSize ? initialSize : 1), _inboundBufferSize(0), _chunkSize(_initialSize),
+    _maximumSize(setMaximumSize), _inboundBufferPtr(netStringBufferPool::acquire(_chunkSize))
 {
+  _initialSize = _chunkSize;		// Rounded up to the size class
+  if ((_maximumSize > 0) && (initialSize > _maximumSize)) _maximumSize = initialSize;
+  _inboundBufferSize = _chunkSize;
+  if ((_maximumSize > 0) && (_inboundBufferSize > _maximumSize)) _inboundBufferSize = _maximumSize;
   reallocated(_inboundBufferPtr, _inboundBufferSize);
-  if ((_maximumSize > 0) && (_inboundBufferSize > _maximumSize)) _maximumSize = _inboundBufferSize;
 }
 
 netStringFactoryManaged::~netStringFactoryManaged()
 {
-  delete [] _inboundBufferPtr;
+  netStringBufferPool::release(_inboundBufferPtr, _chunkSize);
 }
 
 
 //////////////////////////////////////////////////////////////////////
 // Managed the expansion for the caller. If the buffer given to the
 // netStringFactory isn't big enough to hold the inbound netstring,
-// reallocate the buffer and data upto the allowed maximum.
+// move the data to a buffer of a larger size class, upto the allowed
+// maximum. Only the bytes in use are copied and the old buffer goes
+// back to the pool.
 //////////////////////////////////////////////////////////////////////
 
 int
@@ -1313,23 +1764,22 @@ netStringFactoryManaged::getReadParameters(char*& bufferPtr, int& minimumBytesTo
 
   if ((_maximumSize > 0) && ((unsigned) expandTo > _maximumSize)) return -1;	// Too big
 
-  // Don't nickel and dime the growth of the buffer, rather, make it a
-  // decent chunk of change.
+  // Don't nickel and dime the growth of the buffer, rather, at least
+  // double it so that large netStrings take a handful of moves.
 
-  int minimumExpansion = _inboundBufferSize / 2;
-  if (minimumExpansion > 16*1024) minimumExpansion = 16*1024;
-  minimumExpansion += _inboundBufferSize;
-  if ((_maximumSize > 0) && ((unsigned) minimumExpansion > _maximumSize)) {
-    minimumExpansion = _maximumSize;
-  }
-  if (minimumExpansion > expandTo) expandTo = minimumExpansion;
+  unsigned int newSize = _inboundBufferSize * 2;
+  if (newSize < (unsigned) expandTo) newSize = expandTo;
+  if ((_maximumSize > 0) && (newSize > _maximumSize)) newSize = _maximumSize;
 
-  char* newBuffer = new char[expandTo];
-  memcpy(newBuffer, _inboundBufferPtr, _inboundBufferSize);	// Overkill, but easy and rare
+  unsigned int newChunkSize = newSize;
+  char* newBuffer = netStringBufferPool::acquire(newChunkSize);
+  memcpy(newBuffer, _inboundBufferPtr, getBytesInUse());
+  netStringBufferPool::release(_inboundBufferPtr, _chunkSize);
 
-  _inboundBufferSize = expandTo;					// Remember new buffer details
-  delete [] _inboundBufferPtr;
+  _chunkSize = newChunkSize;					// Remember new buffer details
   _inboundBufferPtr = newBuffer;
+  _inboundBufferSize = newChunkSize;
+  if ((_maximumSize > 0) && (_inboundBufferSize > _maximumSize)) _inboundBufferSize = _maximumSize;
 
   reallocated(_inboundBufferPtr, _inboundBufferSize); 		// Notify factory of new buffer
   expandTo = netStringFactory::getReadParameters(bufferPtr, minimumBytesToRead,
@@ -1340,6 +1790,29 @@ netStringFactoryManaged::getReadParameters(char*& bufferPtr, int& minimumBytesTo
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Reset the factory and, if the buffer has grown to take a large
+// netString, swap it for one of the initial size so that the large
+// buffer goes back to the pool rather than being held indefinitely.
+//////////////////////////////////////////////////////////////////////
+
+void
+netStringFactoryManaged::reset()
+{
+  netStringFactory::reset();
+
+  if (_chunkSize <= _initialSize) return;
+
+  netStringBufferPool::release(_inboundBufferPtr, _chunkSize);
+  _chunkSize = _initialSize;
+  _inboundBufferPtr = netStringBufferPool::acquire(_chunkSize);
+  _inboundBufferSize = _chunkSize;
+  if ((_maximumSize > 0) && (_inboundBufferSize > _maximumSize)) _inboundBufferSize = _maximumSize;
+
+  reallocated(_inboundBufferPtr, _inboundBufferSize);
+}
+
+
 
 //////////////////////////////////////////////////////////////////////
 // Given a string containing a stream of netStrings. "Pop" off the
@@ -0,0 +1,157 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include <stdlib.h>
+
+#include "global.h"
+#include "util.h"
+#include "remoteEndpoints.h"
+
+static const char	prefix[] = "tcp:";
+static const int	prefixLength = sizeof(prefix) - 1;
+
+
+bool
+pluton::remoteEndpoints::isRemote(const std::string& rendezvousID)
+{
+  return rendezvousID.compare(0, prefixLength, prefix) == 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Parse a non-negative number that must make up all of str.
+//////////////////////////////////////////////////////////////////////
+
+static bool
+parseNumber(const std::string& str, long upperLimit, int& value)
+{
+  if (str.empty()) return false;
+
+  const char* cp = str.c_str();
+  char* end;
+  long v = strtol(cp, &end, 10);
+  if ((*cp < '0') || (*cp > '9') || (*end != '\0') || (v > upperLimit)) return false;
+
+  value = v;
+
+  return true;
+}
+
+bool
+pluton::remoteEndpoints::parseEndpoint(const std::string& spec, endpoint& ep, std::string& em)
+{
+  std::string hostPort = spec;
+  ep.maximumOutstanding = 0;
+  std::string::size_type slash = spec.find('/');
+  if (slash != std::string::npos) {
+    if (!parseNumber(spec.substr(slash+1), 100000, ep.maximumOutstanding)) {
+      em = "Invalid maximum outstanding in '" + spec + "'";
+      return false;
+    }
+    hostPort = spec.substr(0, slash);
+  }
+
+  ep.host = hostPort;
+  ep.port = plutonGlobal::plutonPort;
+  std::string::size_type colon = hostPort.find(':');
+  if (colon != std::string::npos) {
+    ep.host = hostPort.substr(0, colon);
+    if (!parseNumber(hostPort.substr(colon+1), 65535, ep.port) || (ep.port == 0)) {
+      em = "Invalid port in '" + spec + "'";
+      return false;
+    }
+  }
+
+  if (ep.host.empty()) {
+    em = "Missing host in '" + spec + "'";
+    return false;
+  }
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Replace the current endpoints with those in spec. On error the
+// current endpoints are unchanged.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::remoteEndpoints::parse(const std::string& spec, std::string& em)
+{
+  std::vector<endpoint> endpoints;
+
+  std::string::size_type start = 0;
+  if (isRemote(spec)) start = prefixLength;
+
+  static const char separators[] = ", \t";
+  while (true) {
+    start = spec.find_first_not_of(separators, start);
+    if (start == std::string::npos) break;
+    std::string::size_type end = spec.find_first_of(separators, start);
+    if (end == std::string::npos) end = spec.length();
+
+    endpoint ep;
+    if (!parseEndpoint(spec.substr(start, end - start), ep, em)) return false;
+    endpoints.push_back(ep);
+    start = end;
+  }
+
+  if (endpoints.empty()) {
+    em = "No endpoints in '" + spec + "'";
+    return false;
+  }
+
+  _endpoints = endpoints;
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Generate the canonical form stored in the lookup map.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::remoteEndpoints::getRendezvousID(std::string& rendezvousID) const
+{
+  rendezvousID = prefix;
+  for (unsigned int ix=0; ix < _endpoints.size(); ++ix) {
+    const endpoint& ep = _endpoints[ix];
+    if (ix > 0) rendezvousID += ",";
+    rendezvousID += ep.host;
+    rendezvousID += ":";
+    rendezvousID += util::ltos(ep.port);
+    if (ep.maximumOutstanding > 0) {
+      rendezvousID += "/";
+      rendezvousID += util::ltos(ep.maximumOutstanding);
+    }
+  }
+}
@@ -58,8 +58,6 @@ pluton::shmServiceHandler::shmServiceHandler()
     _maxProcesses(0), _maxThreads(0),
     _myPid(0), _myTid(0)
 {
-  _myLastStart.tv_sec = 0;
-  _myLastStart.tv_usec = 0;
 }
 
 pluton::shmServiceHandler::~shmServiceHandler()
@@ -107,6 +105,17 @@ pluton::shmServiceHandler::mapService(int fd, pid_t pid, bool threadedFlag)
 
   _myPid = pid;
 
+  //////////////////////////////////////////////////////////////////////
+  // Attach to the shared cache if the manager created one. The
+  // region must lie entirely within what we mapped.
+  //////////////////////////////////////////////////////////////////////
+
+  unsigned int offset = _shmServicePtr->_header._sharedCacheOffset;
+  if ((offset > 0) && (_myConfig._sharedCacheSize > 0)
+      && ((long long) offset + _myConfig._sharedCacheSize <= _mapSize)) {
+    _sharedCache.attach(static_cast<char*>(p) + offset, _myConfig._sharedCacheSize);
+  }
+
   return pluton::noFault;
 }
 
@@ -140,17 +149,17 @@ pluton::shmServiceHandler::setProcessReady(const struct timeval& now)
 //////////////////////////////////////////////////////////////////////
 
 void
-pluton::shmServiceHandler::startResponseTimer(const struct timeval& now, bool affinity)
+pluton::shmServiceHandler::startResponseTimer(const struct timeval& now, bool affinity, int tid)
 {
   if (!_shmProcessPtr) if (!resolvePointers()) return;
 
-  _myLastStart = now;
+  shmThread* tp = threadPtr(tid);
 
   shmTimeVal tv;
   tv.tv_sec = now.tv_sec;
   tv.tv_usec = now.tv_usec;
-  _shmProcessPtr->_lastActive = _shmThreadPtr->_lastActive = tv;
-  _shmThreadPtr->_affinityFlag = affinity;
+  _shmProcessPtr->_lastActive = tp->_lastActive = tv;
+  tp->_affinityFlag = affinity;
 
   //////////////////////////////////////////////////////////////////////
   // Opportunistically count the current service occupancy for the
@@ -172,27 +181,36 @@ pluton::shmServiceHandler::startResponseTimer(const struct timeval& now, bool af
 
 
 //////////////////////////////////////////////////////////////////////
-// Calculate duration of request and transfer state to shm
+// Calculate duration of request and transfer state to shm. The caller
+// supplies the start time as each thread of a threaded service has
+// its own. An event-driven service overlaps many requests on the one
+// thread so it accounts for active time itself with
+// addProcessActiveuSecs() rather than summing request durations.
 //////////////////////////////////////////////////////////////////////
 
 void
-pluton::shmServiceHandler::stopResponseTimer(const struct timeval& now)
+pluton::shmServiceHandler::stopResponseTimer(const struct timeval& startTime,
+					     const struct timeval& now, bool addActive)
 {
   if (!_shmProcessPtr) if (!resolvePointers()) return;
 
-  // setProcessActive may not have resolvedPointers due to Manager
-  // tardiness, so only unwind the setProcessActive actions if it
-  // took any.
-
-  if (_myLastStart.tv_sec > 0) {
-    long uSecs = util::timevalDiffuS(now, _myLastStart);
-    _shmProcessPtr->_activeuSecs += uSecs;
-    _shmServicePtr->_aggregateCounters._activeuSecs += uSecs;
+  if (startTime.tv_sec > 0) {
+    if (addActive) addProcessActiveuSecs(util::timevalDiffuS(now, startTime));
     ++_shmServicePtr->_aggregateCounters._requestCount;
   }
 }
 
 
+void
+pluton::shmServiceHandler::addProcessActiveuSecs(long uSecs)
+{
+  if (!_shmProcessPtr) if (!resolvePointers()) return;
+
+  _shmProcessPtr->_activeuSecs += uSecs;
+  _shmServicePtr->_aggregateCounters._activeuSecs += uSecs;
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // The true definition of an inactive service is when a service/thread
 // is sitting on an accept() waiting for a request. This is the
@@ -201,18 +219,28 @@ pluton::shmServiceHandler::stopResponseTimer(const struct timeval& now)
 //////////////////////////////////////////////////////////////////////
 
 void
-pluton::shmServiceHandler::setProcessAcceptingRequests(bool tf)
+pluton::shmServiceHandler::setProcessAcceptingRequests(bool tf, int tid)
 {
   if (!_shmProcessPtr) if (!resolvePointers()) return;
 
+  shmThread* tp = threadPtr(tid);
+
+  //////////////////////////////////////////////////////////////////////
+  // The active thread count is only adjusted on a real transition of
+  // this thread so that it stays an accurate count of busy threads.
+  //////////////////////////////////////////////////////////////////////
+
   if (tf) {
-    _shmThreadPtr->_activeFlag = false;
-    --_shmProcessPtr->_activeThreadCount;
-    if (--_shmProcessPtr->_activeThreadCount < 0) _shmProcessPtr->_activeThreadCount = 0;
+    if (!tp->_activeFlag) return;
+    tp->_activeFlag = false;
+    if (__sync_sub_and_fetch(&_shmProcessPtr->_activeThreadCount, 1) < 0) {
+      _shmProcessPtr->_activeThreadCount = 0;
+    }
   }
   else {
-    _shmThreadPtr->_activeFlag = true;
-    ++_shmProcessPtr->_activeThreadCount;
+    if (tp->_activeFlag) return;
+    tp->_activeFlag = true;
+    __sync_add_and_fetch(&_shmProcessPtr->_activeThreadCount, 1);
   }
 }
 
@@ -222,6 +250,22 @@ pluton::shmServiceHandler::setProcessAcceptingRequests(bool tf)
 // rather than increment to minimize non-lock issues with shm.
 //////////////////////////////////////////////////////////////////////
 
+//////////////////////////////////////////////////////////////////////
+// An event-driven service has many requests in progress on the one
+// thread so it sets the active count directly to the number of
+// requests in flight.
+//////////////////////////////////////////////////////////////////////
+
+void
+pluton::shmServiceHandler::setProcessActiveCount(int activeCount)
+{
+  if (!_shmProcessPtr) if (!resolvePointers()) return;
+
+  _shmThreadPtr->_activeFlag = (activeCount > 0);
+  _shmProcessPtr->_activeThreadCount = activeCount;
+}
+
+
 void
 pluton::shmServiceHandler::setProcessRequestCount(int c)
 {
@@ -254,24 +298,26 @@ pluton::shmServiceHandler::setProcessFaultCount(int c)
 void
 pluton::shmServiceHandler::setProcessClientDetails(unsigned int requestID,
 						   struct timeval startTime,
-						   const char* cnamePtr, int cnameLength)
+						   const char* cnamePtr, int cnameLength, int tid)
 {
   if (!_shmProcessPtr) if (!resolvePointers()) return;
 
-  _shmThreadPtr->_clientRequestID = requestID;
+  shmThread* tp = threadPtr(tid);
+
+  tp->_clientRequestID = requestID;
 
   shmTimeVal tv;
   tv.tv_sec = startTime.tv_sec;
   tv.tv_usec = startTime.tv_usec;
-  _shmThreadPtr->_clientRequestStartTime = tv;
+  tp->_clientRequestStartTime = tv;
 
   unsigned int cpLen = cnameLength;
-  if (cpLen >= sizeof(_shmThreadPtr->_clientRequestName)) {
-    cpLen = sizeof(_shmThreadPtr->_clientRequestName)-1;
+  if (cpLen >= sizeof(tp->_clientRequestName)) {
+    cpLen = sizeof(tp->_clientRequestName)-1;
   }
 
-  strncpy(_shmThreadPtr->_clientRequestName, cnamePtr, cpLen);
-  _shmThreadPtr->_clientRequestName[cpLen] = '\0';
+  strncpy(tp->_clientRequestName, cnamePtr, cpLen);
+  tp->_clientRequestName[cpLen] = '\0';
 }
 
 
@@ -335,3 +381,19 @@ pluton::shmServiceHandler::resolvePointers()
 
   return false;
 }
+
+
+//////////////////////////////////////////////////////////////////////
+// Return the shmThread for a thread of this process. Out-of-range
+// thread IDs are mapped to the first thread rather than trusting the
+// caller with shm.
+//////////////////////////////////////////////////////////////////////
+
+shmThread*
+pluton::shmServiceHandler::threadPtr(int tid)
+{
+  if ((tid < 0) || (tid >= _myConfig._maximumThreads)) return _shmThreadPtr;
+
+  return &_shmProcessPtr->_thread[tid];
+}
+
@@ -0,0 +1,301 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#include "config.h"
+
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shmSharedCache.h"
+
+
+//////////////////////////////////////////////////////////////////////
+// Barriers and compare-and-swap are needed to share the entries
+// across processes without locks. These are the gcc builtins.
+//////////////////////////////////////////////////////////////////////
+
+#define	memoryBarrier()		__sync_synchronize()
+#define	compareAndSwap(p,o,n)	__sync_bool_compare_and_swap(p,o,n)
+#define	atomicIncrement(p)	__sync_fetch_and_add(p,1)
+
+
+static uint32_t
+hashKey(const char* cp, int len)
+{
+  uint32_t hash = 2166136261U;			// FNV-1a
+  while (len-- > 0) {
+    hash ^= (unsigned char) *cp++;
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+static uint64_t
+nowMS()
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+
+  return (uint64_t) now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// A claim identifies the writer of an entry so that a write abandoned
+// by a dead process can be taken over. A live writer is never
+// displaced, however long it takes: were it only stalled it would
+// later copy its data over the new writer's and publish a torn entry.
+//////////////////////////////////////////////////////////////////////
+
+static uint64_t
+makeClaim()
+{
+  return (uint64_t) getpid();
+}
+
+static bool
+abandonedClaim(uint64_t claim)
+{
+  pid_t pid = (pid_t) claim;
+
+  return (pid > 0) && (kill(pid, 0) == -1) && (errno == ESRCH);
+}
+
+
+pluton::shmSharedCache::shmSharedCache()
+  : _headerPtr(0), _entryBase(0), _entrySize(0), _setCount(0)
+{
+}
+
+pluton::shmSharedCache::~shmSharedCache()
+{
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The manager formats the region. The region is assumed to be zeroed
+// which is what mapManager() gives us.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::shmSharedCache::initialize(void* regionPtr, unsigned int regionSize,
+				   unsigned int entrySize)
+{
+  entrySize = (entrySize + 7) & ~7;		// Keep entries 64bit aligned
+  if (entrySize < (unsigned int) minimumEntrySize) entrySize = minimumEntrySize;
+
+  if (regionSize < sizeof(shmSharedCacheHeader) + entrySize * cacheWays) return false;
+
+  shmSharedCacheHeader* hp = static_cast<shmSharedCacheHeader*>(regionPtr);
+  unsigned int entryCount = (regionSize - sizeof(shmSharedCacheHeader)) / entrySize;
+  entryCount -= entryCount % cacheWays;
+
+  hp->_entrySize = entrySize;
+  hp->_entryCount = entryCount;
+  hp->_hits = hp->_misses = hp->_inserts = hp->_collisions = 0;
+
+  return attach(regionPtr, regionSize);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// A service attaches to a region formatted by the manager. The
+// geometry is checked against the region size so that a corrupt
+// header cannot cause references outside the region.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::shmSharedCache::attach(void* regionPtr, unsigned int regionSize)
+{
+  shmSharedCacheHeader* hp = static_cast<shmSharedCacheHeader*>(regionPtr);
+
+  if ((hp->_entrySize < (unsigned int) minimumEntrySize) || (hp->_entrySize % 8)) return false;
+  if ((hp->_entryCount == 0) || (hp->_entryCount % cacheWays)) return false;
+  if ((sizeof(shmSharedCacheHeader) + (uint64_t) hp->_entrySize * hp->_entryCount)
+      > regionSize) return false;
+
+  _headerPtr = hp;
+  _entryBase = static_cast<char*>(regionPtr) + sizeof(shmSharedCacheHeader);
+  _entrySize = hp->_entrySize;
+  _setCount = hp->_entryCount / cacheWays;
+
+  return true;
+}
+
+
+shmSharedCacheEntry*
+pluton::shmSharedCache::getEntry(unsigned int ix) const
+{
+  return reinterpret_cast<shmSharedCacheEntry*>(_entryBase + ix * _entrySize);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Lock-free lookup. Return true and the value if found.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::shmSharedCache::get(const char* keyPtr, int keyLength, std::string& value) const
+{
+  if (!_headerPtr || (keyLength < 0)) return false;
+
+  uint32_t hash = hashKey(keyPtr, keyLength);
+  unsigned int base = (hash % _setCount) * cacheWays;
+  unsigned int capacity = _entrySize - offsetof(shmSharedCacheEntry, _data);
+  uint64_t now = 0;
+
+  for (int way=0; way < cacheWays; ++way) {
+    shmSharedCacheEntry* E = getEntry(base + way);
+
+    uint32_t seq = E->_sequence;
+    if (seq & 1) continue;			// Being written - treat as a miss
+    memoryBarrier();
+
+    if ((E->_hash != hash) || (E->_keyLength != (uint32_t) keyLength)) continue;
+
+    uint32_t valueLength = E->_valueLength;
+    if ((uint64_t) keyLength + valueLength > capacity) continue;	// Torn read
+
+    if (memcmp(E->_data, keyPtr, keyLength) != 0) continue;
+
+    uint64_t expiresMS = E->_expiresMS;
+    value.assign(E->_data + keyLength, valueLength);
+
+    memoryBarrier();
+    if (E->_sequence != seq) continue;		// Changed underneath us
+
+    if (expiresMS) {
+      if (!now) now = nowMS();
+      if (now >= expiresMS) break;
+    }
+
+    atomicIncrement(&_headerPtr->_hits);
+    return true;
+  }
+
+  value.erase();
+  atomicIncrement(&_headerPtr->_misses);
+
+  return false;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Store a value. Return false if the value was not stored, either
+// because it's too large or another process is writing the chosen
+// entry.
+//
+// The claim is swapped in before the sequence is made odd so that
+// anyone who sees an odd sequence also sees who is writing. An entry
+// left odd by an abandoned write is taken over by moving it to the
+// next odd sequence, which only one writer can do.
+//////////////////////////////////////////////////////////////////////
+
+bool
+pluton::shmSharedCache::put(const char* keyPtr, int keyLength,
+			    const char* valuePtr, int valueLength,
+			    unsigned int maxAgeMS)
+{
+  if (!_headerPtr || (keyLength < 0) || (valueLength < 0)) return false;
+
+  unsigned int capacity = _entrySize - offsetof(shmSharedCacheEntry, _data);
+  if ((unsigned int) keyLength + (unsigned int) valueLength > capacity) {
+    atomicIncrement(&_headerPtr->_collisions);
+    return false;
+  }
+
+  uint32_t hash = hashKey(keyPtr, keyLength);
+  unsigned int base = (hash % _setCount) * cacheWays;
+  uint64_t now = nowMS();
+
+  //////////////////////////////////////////////////////////////////////
+  // Choose the victim. A matching key wins outright, then an empty or
+  // expired entry, then the oldest. These reads are unprotected but
+  // that only risks a poor choice, not a bad entry.
+  //////////////////////////////////////////////////////////////////////
+
+  shmSharedCacheEntry* victim = 0;
+  for (int way=0; way < cacheWays; ++way) {
+    shmSharedCacheEntry* E = getEntry(base + way);
+    if ((E->_hash == hash) && (E->_keyLength == (uint32_t) keyLength) && (E->_storedMS > 0)
+	&& (memcmp(E->_data, keyPtr, keyLength) == 0)) {
+      victim = E;
+      break;
+    }
+
+    if ((E->_storedMS == 0) || (E->_expiresMS && (E->_expiresMS <= now))) {
+      if (!victim || (victim->_storedMS > 0)) victim = E;
+      continue;
+    }
+
+    if (!victim || (E->_storedMS < victim->_storedMS)) victim = E;
+  }
+
+  uint32_t seq = victim->_sequence;
+  memoryBarrier();
+  uint64_t claim = victim->_claim;
+  uint32_t writingSeq = seq + 1;		// Odd while we write
+  if (seq & 1) {
+    if (!abandonedClaim(claim)) {
+      atomicIncrement(&_headerPtr->_collisions);
+      return false;
+    }
+    writingSeq = seq + 2;			// Still odd, but now ours
+  }
+
+  if (!compareAndSwap(&victim->_claim, claim, makeClaim())
+      || !compareAndSwap(&victim->_sequence, seq, writingSeq)) {
+    atomicIncrement(&_headerPtr->_collisions);
+    return false;
+  }
+  memoryBarrier();
+
+  victim->_hash = hash;
+  victim->_keyLength = keyLength;
+  victim->_valueLength = valueLength;
+  victim->_storedMS = now;
+  victim->_expiresMS = maxAgeMS ? now + maxAgeMS : 0;
+  memcpy(victim->_data, keyPtr, keyLength);
+  memcpy(victim->_data + keyLength, valuePtr, valueLength);
+
+  memoryBarrier();
+  victim->_sequence = writingSeq + 1;		// Even again and different
+
+  atomicIncrement(&_headerPtr->_inserts);
+
+  return true;
+}
@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_CALIBRATIONPOLICY_H
+#define P_CALIBRATIONPOLICY_H 1
+
+//////////////////////////////////////////////////////////////////////
+// The calibrationPolicy decides how many processes a service should
+// be running. It is the pure decision half of the manager's process
+// calibration: the caller measures occupancy, backlog and activity,
+// the policy says how many processes to create or whether to remove
+// one, and the caller acts on that decision.
+//
+// The policy has no clock, no I/O and no State Threads dependency so
+// it can be driven by virtual time. The manager calls it with
+// wall-clock seconds; tCalibrationSim drives it with a simulated
+// workload to regression-test policy changes.
+//////////////////////////////////////////////////////////////////////
+
+#include <time.h>
+
+namespace util {
+  class calibrationPolicy {
+
+  public:
+    static const int minimumSamplePeriod = 11;	// Seconds between occupancy calculations
+
+    enum action { noAction, createMinimum, createIncrease, removeExcess, removeIdle };
+
+    // What the caller knows at the time of calibration
+
+    class inputs {
+    public:
+      inputs();
+
+      time_t	now;
+      int	listenBacklog;
+      int	activeProcessCount;
+      long long	activeuSecs;		// Aggregate since the last sample period
+      time_t	lastPerformanceReport;	// For idle timeout purposes
+
+      bool	decreaseOkFlag;
+      bool	increaseToMinimumOkFlag;
+
+      // Current config values
+
+      long	occupancyPercent;
+      long	minimumProcesses;
+      long	maximumProcesses;
+      long	idleTimeout;
+    };
+
+    // What the caller should do about it
+
+    class decision {
+    public:
+      decision();
+
+      action	what;
+      int	count;			// Number of processes to create
+      bool	sampled;		// Sample period rolled, caller resets aggregate counters
+      bool	countersInvalid;	// Shared counters failed the sanity check
+      int	samplePeriod;
+
+      float	currOccupancy;		// Values as used to make the decision
+      float	prevOccupancy;
+      float	currListenBacklog;
+      float	prevListenBacklog;
+      float	proposedCurrOccupancy;	// Occupancy with one less process
+      float	proposedPrevOccupancy;
+    };
+
+    calibrationPolicy(time_t now=0);
+
+    decision	calibrate(const inputs& in);
+
+    float	getOccupancy() const { return _currOccupancyByTime; }
+    float	getListenBacklog() const { return _prevListenBacklog; }
+    time_t	getNextCalibrationTime() const { return _nextCalibrationTime; }
+
+    static const char*	actionToEnglish(action);
+
+  private:
+    bool	occupancyUp(const inputs& in, decision& d);
+    bool	occupancyDown(const inputs& in, decision& d);
+    bool	idleDown(const inputs& in, decision& d);
+
+    time_t	_prevCalibrationTime;
+    time_t	_nextCalibrationTime;
+    float	_prevOccupancyByTime;
+    float	_currOccupancyByTime;
+    float	_prevListenBacklog;
+    float	_currListenBacklog;
+    int		_calibrateSamples;
+  };
+}
+
+#endif
@@ -41,7 +41,7 @@ class plutonGlobal {
   static const int inheritedHighestFD = 5;
 
   static const unsigned int shmLookupMapVersion = 1001;
-  static const unsigned int shmServiceVersion = 2001;
+  static const unsigned int shmServiceVersion = 2004;
 };
 
 namespace pluton {
@@ -60,7 +60,14 @@ namespace pluton {
     loginResponsePT = 'M',
 
     requestPT = 'Q',
-    responsePT = 'A'
+    responsePT = 'A',
+
+    batchRequestPT = 'B',		// Many requests for the one service
+    batchResponsePT = 'C',
+
+    recordPT = 'R',			// One slot of a recorder ring
+
+    multiplexPT = 'X'			// A tagged packet between plTransmitter and plReceiver
   };
 
 
@@ -94,6 +101,9 @@ namespace pluton {
     requestDataNT = 'k',
     timeoutMSNT = 'l',
     fileDescriptorNT = 'm',
+    memfdAcceptNT = 'x',		// Client accepts memfd response data at or above this size
+    binaryFramingNT = 'F',		// Client accepts a binary framed response
+    responsePartAcceptNT = 'S',		// Client accepts response data in parts
 
     // Types in a service response
 
@@ -101,6 +111,34 @@ namespace pluton {
     responseDataNT = 'q',
     faultTextNT = 'r',
     serviceIDNT = 's',
+    cacheMaxAgeNT = 'n',		// Response may be cached by client for this many MS
+    responsePartNT = 'P',		// Response data that precedes responseDataNT, may repeat
+
+    // Types in either a request or a response
+
+    memfdDataNT = 'd',			// Data of this length is in the passed memfd
+    compressAcceptNT = 'Z',		// Request: accepts compressed response data at or
+					// above this size. Response: service can decompress
+    compressionNT = 'E',		// Algorithm and uncompressed length of ...
+    compressedDataNT = 'D',		// ... this data, in place of the usual data
+
+    // Types in a batch request or response
+
+    batchMemberNT = 'w',		// A complete request or response packet
+
+    // Types in a multiplexed frame
+
+    multiplexTagNT = 'T',		// Pairs a response frame with its request frame
+    multiplexPacketNT = 'W',		// The complete request or response packet
+
+    // Types in a recorder ring slot
+
+    recordSequenceNT = 'o',		// Increases by one with each record
+    recordStartNT = 'v',		// Epoch microseconds when the request arrived
+    recordDurationNT = 'y',		// Microseconds until the response was sent
+    recordRequestNT = 'I',		// The complete request packet
+    recordResponseNT = 'O',		// The complete response packet
+    recordPadNT = '_',			// Fills the slot
 
     // Types in Remote Login
 
@@ -0,0 +1,83 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_LATENCYHISTOGRAM_H
+#define P_LATENCYHISTOGRAM_H 1
+
+//////////////////////////////////////////////////////////////////////
+// A latencyHistogram accumulates durations in microseconds for the
+// load generating commands. Buckets are log-linear in the style of
+// HdrHistogram: values below 32 are exact and every power-of-two
+// above that is split into 32 equal buckets, so any reported value is
+// within about three percent of the true value while the whole
+// histogram stays a fixed, small size.
+//
+// Histograms are not thread-safe; multi-threaded callers give each
+// thread its own histogram and merge() them for reporting.
+//////////////////////////////////////////////////////////////////////
+
+#include <ostream>
+
+namespace util {
+  class latencyHistogram {
+
+  public:
+    latencyHistogram();
+
+    void	reset();
+    void	add(unsigned long uSecs);
+    void	merge(const latencyHistogram& from);
+
+    unsigned long	getCount() const { return _count; }
+    unsigned long	getMinimum() const { return _count ? _minimum : 0; }
+    unsigned long	getMaximum() const { return _maximum; }
+    unsigned long	getMean() const { return _count ? _total / _count : 0; }
+    unsigned long	getPercentile(double percent) const;
+
+    void	printSummary(std::ostream& os) const;
+    void	printPercentiles(std::ostream& os) const;
+
+  private:
+    static const int	subBucketBits = 5;
+    static const int	subBuckets = 1 << subBucketBits;
+    static const int	bucketCount = 40 * subBuckets;
+
+    static int			bucketIndex(unsigned long uSecs);
+    static unsigned long	bucketUpper(int ix);
+
+    unsigned long	_count;
+    unsigned long	_minimum;
+    unsigned long	_maximum;
+    unsigned long long	_total;
+    unsigned long	_bucket[bucketCount];
+  };
+}
+
+#endif
@@ -0,0 +1,88 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_LOADDISTRIBUTION_H
+#define P_LOADDISTRIBUTION_H 1
+
+//////////////////////////////////////////////////////////////////////
+// A loadDistribution generates the random request sizes, CPU costs and
+// latencies used by the load simulation tools. Real traffic is rarely
+// uniform - service times are typically heavy-tailed or bimodal - so
+// the distribution is described by a spec string:
+//
+//	5			always 5
+//	fixed:5			always 5
+//	uniform:2,8		uniformly between 2 and 8
+//	exponential:5		exponential with a mean of 5
+//	lognormal:5,0.8		lognormal with a median of 5 and sigma 0.8
+//	pareto:2,1.5		Pareto with a minimum of 2 and shape 1.5
+//
+// Specs can be mixed with '|' and optionally weighted with '@', so
+// "0.9@lognormal:5,0.3|0.1@fixed:200" is a bimodal distribution with
+// one in ten samples at 200. Unweighted components have a weight of
+// one.
+//
+// sample() is const and takes the caller's erand48() state so one
+// distribution can be shared by many threads.
+//////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <vector>
+
+namespace util {
+  class loadDistribution {
+
+  public:
+    loadDistribution();
+
+    bool	parse(const std::string& spec, std::string& errorMessage);
+    const std::string&	getSpec() const { return _spec; }
+
+    double	sample(unsigned short xsubi[3]) const;
+
+  private:
+    enum shape { fixed, uniform, exponential, lognormal, pareto };
+
+    class component {
+    public:
+      shape	type;
+      double	weight;		// Cumulative and normalized to 1.0
+      double	a;
+      double	b;
+    };
+
+    static bool	parseComponent(const std::string& spec, component& c, std::string& em);
+
+    std::string			_spec;
+    std::vector<component>	_components;
+  };
+}
+
+#endif
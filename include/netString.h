@@ -50,6 +50,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // might be used as data for a netString. This class uses std::string
 // as the container, so what is left is largely the creation of the
 // netString length, type, data, terminator syntax.
+//
+// setBinaryFraming() selects the compact binary framing for all
+// subsequent appends - see the .cc file for details.
 //////////////////////////////////////////////////////////////////////
 
 
@@ -61,6 +64,10 @@ class netStringGenerate {
   virtual ~netStringGenerate();
 
   static unsigned int determineOverhead(unsigned int length);		// Return extra bytes needs
+  static unsigned int determineBinaryOverhead(unsigned int length);
+
+  void	setBinaryFraming(bool newFlag) { _binaryFraming = newFlag; }
+  bool	isBinaryFraming() const { return _binaryFraming; }
 
   // Append the content as a netString
 
@@ -107,6 +114,9 @@ class netStringGenerate {
  protected:
   std::string*	_sPtr;
   unsigned char	_terminator;
+  bool		_binaryFraming;
+
+  void		appendPrefix(const char addType, unsigned int addLen);
 
  private:
   netStringGenerate&	operator=(const netStringGenerate& rhs);	// Assign not ok
@@ -149,6 +159,8 @@ class netStringGenerateEncapsulated : public netStringGenerate {
   std::ostream& 	put(std::ostream& s) const;
 
  private:
+  bool		encapsulateBinary(const char addType);
+
   unsigned int	_reservedSpace;		// Before the start of the current netString
   unsigned int	_originalReservedSpace;	// Needed for clear
 };
@@ -226,6 +238,8 @@ class netStringParse {
   netStringParse&	operator=(const netStringParse& rhs);	// Assign not ok
   netStringParse(const netStringParse& rhs);			// Copy not ok
 
+  const char*	getNextBinary(char& returnType, const char*& returnPtr, int& returnLength);
+
   const char*	_ptr;
   int		_remaining;
 
@@ -264,6 +278,7 @@ class netStringStreamParse {
   bool	getNetString(char& returnType, int& returnDataLength);
   void	setIgnoreCRLF(bool newFlag) { _ignoreCRLF = newFlag; }	// Allows telnet for testing
   char  getType() const;
+  bool	isBinary() const { return _binaryFlag; }	// Framing of the current/last netString
 
   virtual void	reset();	// Clear a previous error and parsing state
 
@@ -280,12 +295,14 @@ class netStringStreamParse {
 		      bool stopAtDataFlag=false, bool stopAtTerminatorFlag=false);
 
   bool	_ignoreCRLF;
-  enum { checkLeadingDigit, parsingLength, checkType, setDataOffset, skippingData,
-	 checkingTerminator, gotit } _parseState;
+  enum { checkLeadingDigit, parsingBinaryLength, parsingLength, checkType, setDataOffset,
+	 skippingData, checkingTerminator, gotit } _parseState;
 
   int	_dataLength;		// Computed length of the netstring being parsed
   int 	_bytesToSkip;		// When skipping over data - how many are left
   char	_nsType;		// As a result of parsing the netstring
+  bool	_binaryFlag;		// This netstring uses binary framing
+  int	_lengthShift;		// Of the next binary length byte
 
   int	_netStringsFound;
   int	_bytesSkipped;
@@ -304,6 +321,7 @@ class netStringFactory : public netStringStreamParse {
   bool	getRawString(int& returnDataOffset, int& returnDataLength) const;
   bool	getRawString(const char*& returnDataPtr, int& returnDataLength) const;
   int	getRawOffset() const { return _parseOffset; }
+  int	getBytesInUse() const { return _parseOffset + _unparsedBytes; }
   const char* getBasePtr() const { return _baseAddress; }
 
   virtual int	getReadParameters(char*& bufferPtr, int& minimumBytesToRead,
@@ -330,6 +348,8 @@ class netStringFactory : public netStringStreamParse {
   netStringFactory(const netStringFactory& rhs);			// Copy not ok
 
   bool		tryToCompact();
+  int		bulkParse();
+  void		nextFromBulk();
 
   bool	_relocationAllowed;	// Allowed to make non zero-cost relocates
   const char* _baseAddress;	// Can move between calls - see relocate()
@@ -340,6 +360,25 @@ class netStringFactory : public netStringStreamParse {
   int	_nsLengthOffset;	// Offset to start of length for this netstring
   int	_nsDataOffset;		// Offset to start of data for this netstring
 
+  // When many netStrings are buffered, bulkParse() decodes all the
+  // complete ones in one pass and queues their descriptors here for
+  // haveNetString() to hand out in turn. Offsets are relative to
+  // _baseAddress, like all the others.
+
+  class descriptor {
+  public:
+    char	type;
+    bool	binary;
+    int		lengthOffset;
+    int		dataOffset;
+    int		dataLength;
+  };
+  enum { maxDescriptors = 64, bulkParseMinimum = 16 };
+
+  descriptor	_bulk[maxDescriptors];
+  int	_bulkNext;		// Next descriptor to hand out
+  int	_bulkCount;		// Descriptors in _bulk
+
   int	_bytesRead;		// Statistics
   int	_bytesRelocated;
   int	_zeroCostRelocates;
@@ -347,6 +386,33 @@ class netStringFactory : public netStringStreamParse {
 };
 
 
+//////////////////////////////////////////////////////////////////////
+// netStringBufferPool is a process-wide pool of the buffers used by
+// netStringFactoryManaged. Buffers are allocated in power-of-two size
+// classes and released buffers are kept for re-use up to a high
+// watermark of pooled bytes, beyond which they are freed. Buffers
+// smaller than the smallest class or larger than the largest class
+// are allocated to size and never pooled.
+//////////////////////////////////////////////////////////////////////
+
+class netStringBufferPool {
+ public:
+  static char*	acquire(unsigned int& size);		// Size is rounded up to its class
+  static void	release(char* buffer, unsigned int size);
+
+  static void	setHighWatermark(unsigned int bytes);	// Trims immediately if need be
+  static void	getStatistics(unsigned int& bytesPooled, int& hits, int& misses, int& trims);
+
+  enum { smallestClass = 12, largestClass = 24 };	// 4KB - 16MB
+  enum { defaultHighWatermark = 1024 * 1024 };
+
+ private:
+  static void	lock();
+  static void	unlock();
+  static void	trimTo(unsigned int bytes);
+};
+
+
 //////////////////////////////////////////////////////////////////////
 // A managed netStringFactory looks after memory allocation for the
 // caller.
@@ -360,11 +426,15 @@ class netStringFactoryManaged : public netStringFactory {
   virtual int	getReadParameters(char*& ptr, int& minToRead, int& maxToRead);
   int		getBufferSize() const { return _inboundBufferSize; }
 
+  void		reset();	// Also returns a grown buffer to the pool
+
  private:
   netStringFactoryManaged&	operator=(const netStringFactoryManaged& rhs);	// Assign not ok
   netStringFactoryManaged(const netStringFactoryManaged& rhs);			// Copy not ok
 
-  unsigned int	_inboundBufferSize;
+  unsigned int	_initialSize;
+  unsigned int	_inboundBufferSize;	// As given to netStringFactory
+  unsigned int	_chunkSize;		// As allocated by netStringBufferPool
   unsigned int	_maximumSize;
   char* 	_inboundBufferPtr;
 };
@@ -43,6 +43,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //////////////////////////////////////////////////////////////////////
 
 #include <string>
+#include <vector>
 
 #include <sys/time.h>
 
@@ -73,6 +74,49 @@ namespace pluton {
 
   class perCallerClient;
 
+  //////////////////////////////////////////////////////////////////////
+  // Statistics for the per-thread response cache. Responses are only
+  // cached when a service marks them as cacheable and the caller has
+  // enabled the cache with setResponseCacheSize().
+  //////////////////////////////////////////////////////////////////////
+
+  class responseCacheStats {
+  public:
+    unsigned long	hits;		// Requests completed from the cache
+    unsigned long	misses;		// Cacheable requests sent to a service
+    unsigned long	inserts;	// Responses added to the cache
+    unsigned long	expirations;	// Entries discarded because max-age was reached
+    unsigned long	evictions;	// Entries discarded to honor the size limit
+    unsigned long	entries;	// Current number of entries
+    unsigned long	bytes;		// Current memory charged to the cache
+    unsigned long	maximumBytes;	// Size limit set by setResponseCacheSize()
+  };
+
+  //////////////////////////////////////////////////////////////////////
+  // Aggregate timings of completed requests for one Service Key. Each
+  // clientRequest::stage has a histogram with power-of-two buckets:
+  // bucket[0] counts zero durations and bucket[N] counts durations of
+  // 2^(N-1) up to 2^N-1 microseconds. The last bucket also counts
+  // anything longer.
+  //////////////////////////////////////////////////////////////////////
+
+  class clientStageHistogram {
+  public:
+    static const int	bucketCount = 32;
+
+    unsigned long	count;		// Requests that reached this stage
+    unsigned long long	totaluSecs;
+    unsigned long	maximumuSecs;
+    unsigned long	bucket[bucketCount];
+  };
+
+  class clientTimingStats {
+  public:
+    unsigned long		requests;	// Completed requests
+    unsigned long		faults;		// of which had a fault
+    clientStageHistogram	stage[pluton::clientRequest::stageCount];
+  };
+
   // pluton::client and pluton::clientEvent are derived from clientBase
 
   class clientBase {
@@ -90,6 +134,20 @@ namespace pluton {
 
     void		setDebug(bool nv);
 
+    void		setResponseCacheSize(unsigned long maximumBytes);	// Zero disables
+    void		getResponseCacheStats(pluton::responseCacheStats&) const;
+
+    bool		getTimingStats(const char* serviceKey, pluton::clientTimingStats&) const;
+    void		getTimingServiceKeys(std::vector<std::string>&) const;
+    void		resetTimingStats();
+
+    void		setZeroCopyThreshold(unsigned int bytes);	// Zero disables
+    void		setBatchCoalescing(unsigned int maximumRequests);	// Zero disables
+    void		setBinaryFraming(bool onOff);
+    void		setCompression(pluton::compressionAlgorithm,
+				       unsigned int thresholdBytes);
+    void		getCompressionStats(pluton::compressionStats&) const;
+
   private:
     clientBase&	 operator=(const clientBase& rhs);	// Assign not ok
     clientBase(const clientBase& rhs);			// Copy not ok
@@ -126,6 +184,8 @@ namespace pluton {
 
     bool		addRequest(const char* serviceKey, pluton::clientRequest*);
     bool		addRequest(const char* serviceKey, pluton::clientRequest&);
+    bool		addRequests(const char* serviceKey, pluton::clientRequest* requests[],
+				    int count);
     bool		addRawRequest(const char* serviceKey, pluton::clientRequest*,
 				      const char* rawPtr, int rawLength);	// Tools only
 
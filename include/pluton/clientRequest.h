@@ -33,6 +33,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <string>
 
+#include <sys/uio.h>
+
 //////////////////////////////////////////////////////////////////////
 // Define the clientRequest APIs for the Pluton Framework
 //////////////////////////////////////////////////////////////////////
@@ -57,6 +59,7 @@ namespace pluton {
     void	setRequestData(const char* p);	// Library will strlen(p)
     void	setRequestData(const char* p, int len);
     void	setRequestData(const std::string& request);
+    void	setRequestData(const struct iovec* iov, int iovCount);	// Buffers not copied
 
     void	setAttribute(pluton::requestAttributes);
     bool	getAttribute(pluton::requestAttributes);
@@ -92,6 +95,38 @@ namespace pluton {
     void		setClientHandle(void*);		// Users can store
     void*		getClientHandle() const;	// anything here
 
+    //////////////////////////////////////////////////////////////////////
+    // Where the time went for the most recent exchange of this
+    // request. Stages that were not reached, such as the connect when
+    // an affinity connection is re-used, report zero.
+    //
+    // lookup:	addRequest() until the request is queued for sending
+    // connect:	queued until connected to the service
+    // write:	connected until the request is fully written
+    // service:	written until the first byte of the response arrives
+    // read:	first byte until the response is complete
+    // total:	addRequest() until complete
+    //////////////////////////////////////////////////////////////////////
+
+    enum stage { lookupStage, connectStage, writeStage, serviceStage, readStage, totalStage,
+		 stageCount };
+
+    long		getStageMicroSeconds(pluton::clientRequest::stage) const;
+
+    //////////////////////////////////////////////////////////////////////
+    // A service may send a large response in parts. If a handler is
+    // set, the service is told the parts can be taken as they arrive
+    // and the handler is called with each one during the execute
+    // calls. getResponseData() then only returns the data that
+    // followed the parts. The part is only valid for the duration of
+    // the call and the handler must not call the client API. A
+    // request that has started receiving parts is not retried.
+    //////////////////////////////////////////////////////////////////////
+
+    typedef void	(*responsePartHandler)(pluton::clientRequest* R, const char* p, int len);
+
+    void		setResponsePartHandler(responsePartHandler);
+
 
     //////////////////////////////////////////////////////////////////////
     // End of user methods.
@@ -31,6 +31,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef PLUTON_CLIENT_C_H
 #define PLUTON_CLIENT_C_H
 
+struct iovec;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -58,6 +60,8 @@ extern void     pluton_client_C_delete(pluton_client_C_obj*);
 
 extern void     pluton_request_C_setRequestData(pluton_request_C_obj*,
 					       const char* p, int len, int copyData);
+extern void     pluton_request_C_setRequestDataV(pluton_request_C_obj*,
+						const struct iovec* iov, int iovCount);
 
 #define pluton_request_C_noWaitAttr 		0x0001
 #define pluton_request_C_noRemoteAttr 		0x0002
@@ -87,6 +91,19 @@ extern const char*	pluton_request_C_getServiceName(const pluton_request_C_obj*);
 extern void	pluton_request_C_setClientHandle(pluton_request_C_obj*, void*);
 extern void*	pluton_request_C_getClientHandle(const pluton_request_C_obj*);
 
+#define pluton_request_C_lookupStage		0
+#define pluton_request_C_connectStage		1
+#define pluton_request_C_writeStage		2
+#define pluton_request_C_serviceStage		3
+#define pluton_request_C_readStage		4
+#define pluton_request_C_totalStage		5
+
+extern long	pluton_request_C_getStageMicroSeconds(const pluton_request_C_obj*, int stage);
+
+extern void	pluton_request_C_setResponsePartHandler(pluton_request_C_obj*,
+							void (*)(pluton_request_C_obj*,
+								 const char*, int));
+
 
 /**********************************************************************
  * pluton::client
@@ -109,6 +126,36 @@ extern  void	pluton_client_C_setTimeoutMilliSeconds(pluton_client_C_obj*,
 						       int timeoutMilliSeconds);
 extern  int 	pluton_client_C_getTimeoutMilliSeconds(const pluton_client_C_obj*);
 
+extern  void	pluton_client_C_setResponseCacheSize(pluton_client_C_obj*,
+						     unsigned long maximumBytes);
+extern  void	pluton_client_C_getResponseCacheStats(const pluton_client_C_obj*,
+						      unsigned long* hits,
+						      unsigned long* misses);
+
+extern  void	pluton_client_C_setZeroCopyThreshold(pluton_client_C_obj*, unsigned int bytes);
+extern  void	pluton_client_C_setBatchCoalescing(pluton_client_C_obj*, unsigned int maximumRequests);
+extern  void	pluton_client_C_setBinaryFraming(pluton_client_C_obj*, int onOff);
+
+#define pluton_client_C_noCompression		0
+#define pluton_client_C_zlibCompression		'z'
+
+extern  void	pluton_client_C_setCompression(pluton_client_C_obj*, int algorithm,
+					       unsigned int thresholdBytes);
+extern  void	pluton_client_C_getCompressionStats(const pluton_client_C_obj*,
+						    unsigned long long* uncompressedBytes,
+						    unsigned long long* compressedBytes,
+						    unsigned long long* cpuMicroSeconds);
+
+#define pluton_client_C_histogramBuckets	32
+
+extern  int	pluton_client_C_getTimingStats(const pluton_client_C_obj*,
+					       const char* serviceKey, int stage,
+					       unsigned long* count,
+					       unsigned long long* totaluSecs,
+					       unsigned long* maximumuSecs,
+					       unsigned long* buckets, int bucketCount);
+extern  void	pluton_client_C_resetTimingStats(pluton_client_C_obj*);
+
 
 extern  int	pluton_client_C_addRequest(pluton_client_C_obj*,
 					   const char* serviceKey, pluton_request_C_obj*);
@@ -71,6 +71,32 @@ namespace pluton {
   static const int needAffinityAttr	= 0x0010;
 
   static const int allAttrs		= 0xFFFF;
+
+
+  //////////////////////////////////////////////////////////////////////
+  // Request and response data can be compressed on its way through
+  // the socket. The algorithm is identified on the wire by its value.
+  //////////////////////////////////////////////////////////////////////
+
+  enum compressionAlgorithm {
+    noCompression=0,
+    zlibCompression='z'	// deflate at its fastest level
+  };
+
+  //////////////////////////////////////////////////////////////////////
+  // Costs and savings of compression. The compression ratio is
+  // compressedBytes / uncompressedBytes. Data that did not get any
+  // smaller is sent as is and only adds to cpuMicroSeconds.
+  //////////////////////////////////////////////////////////////////////
+
+  class compressionStats {
+  public:
+    unsigned long	compressed;		// Payloads sent compressed
+    unsigned long	decompressed;		// Compressed payloads received
+    unsigned long long	uncompressedBytes;	// Size of those payloads before compression
+    unsigned long long	compressedBytes;	// and after
+    unsigned long long	cpuMicroSeconds;	// Spent compressing and decompressing
+  };
 }
 
 #endif
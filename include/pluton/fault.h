@@ -82,6 +82,7 @@ namespace pluton {
     noAffinity = -9,			// E: needAffinityAttr set on non-connected request
     noWaitNotAllowed = -10,		// E: Cannot have noWaitAttr and keepAffinityAttr
     needNoRetry = -11,			// E: Must have noRetryAttr with keepAffinityAttr
+    batchNotAllowed = -12,		// E: Request attributes not allowed in a batch
 
     openSocketFailed = -15,		// E: -1 return from socket()
     connectFailed = -16,		// E: -1 return from connect()
@@ -134,6 +135,9 @@ namespace pluton {
     listenFailed = -65,			// E: -1 returned from listen()
     emptyIdentifier = -66,		// E: Empty parameters given to openService()
     pollInterrupted = -67,		// E: -1 and EINTR returned from poll() of pipe
+    batchNotSupported = -68,		// E: Service API cannot process batched requests
+    batchIndexInvalid = -69,		// E: Batch index out of range or already answered
+    sendFileFailed = -70,		// E: Response file range missing or could not be read
 
     // mmap errors -101 to -110
 
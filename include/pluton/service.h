@@ -33,6 +33,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <string>
 
+#include <sys/types.h>
+#include <sys/uio.h>
+
 #include "pluton/fault.h"
 #include "pluton/common.h"
 
@@ -50,7 +53,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace pluton {
 
+  //////////////////////////////////////////////////////////////////////
+  // One member of a batch as returned by service::getRequestBatch().
+  // The data remains valid until the whole batch has been answered.
+  //////////////////////////////////////////////////////////////////////
+
+  class batchRequest {
+  public:
+    const char*	requestData;
+    int		requestLength;
+  };
+
   class serviceImpl;
+  class serviceRequestImpl;
+  class perCallerService;
+  class threadedServiceImpl;
 
   class service {
   public:
@@ -72,9 +89,67 @@ namespace pluton {
     bool	sendResponse(const char* p);	// Will strlen(p)
     bool	sendResponse(const char* p, int len);
     bool	sendResponse(const std::string& responseData);
+    bool	sendResponse(const struct iovec* iov, int iovCount);	// Gathered by writev()
 
     bool	sendFault(unsigned int faultCode, const char* faultText);
 
+    //////////////////////////////////////////////////////////////////////
+    // A large response can be sent in parts as it is produced rather
+    // than being built up in memory first. Each part goes to the
+    // client straight away if it accepts parts, otherwise the parts
+    // are held and sent ahead of the final data. The response is
+    // completed with sendResponse(), whose data follows the parts, or
+    // with sendFault().
+    //////////////////////////////////////////////////////////////////////
+
+    bool	sendResponsePart(const char* p, int len);
+    bool	sendResponsePart(const std::string& partData);
+
+    //////////////////////////////////////////////////////////////////////
+    // Send length bytes of an open file, starting at offset, as the
+    // response data. The data goes to the client with sendfile() so it
+    // is never read into the service. The file must stay open and
+    // unchanged until the call returns.
+    //////////////////////////////////////////////////////////////////////
+
+    bool	sendResponseFromFile(int fd, off_t offset, int length);
+
+    //////////////////////////////////////////////////////////////////////
+    // A client may send many requests in one batch packet. getRequest()
+    // hands the members out one at a time so existing services need no
+    // change. Services that can do the work for all members in one
+    // pass can use getRequestBatch() instead, which returns the
+    // members as an array; a request that was not batched is returned
+    // as a batch of one. Every member must be answered with
+    // sendBatchResponse() or sendBatchFault() and the batch response
+    // goes back to the client once the last one is answered.
+    //////////////////////////////////////////////////////////////////////
+
+    int		getRequestBatch(const pluton::batchRequest*& batch);	// Returns count
+    bool	sendBatchResponse(int index, const char* p, int len);
+    bool	sendBatchFault(int index, unsigned int faultCode, const char* faultText);
+
+    //////////////////////////////////////////////////////////////////////
+    // Tell the client it may re-use the next response to an identical
+    // request for up to this many milliseconds. Applies to the current
+    // request only and must be called prior to sendResponse().
+    //////////////////////////////////////////////////////////////////////
+
+    void	setCacheMaxAgeMilliSeconds(unsigned int maxAgeMilliSeconds);
+
+    //////////////////////////////////////////////////////////////////////
+    // Memoize results across all processes of this service via a cache
+    // in shared memory. Only available when the service is run by
+    // the manager with a shared-cache-size configured, otherwise
+    // these methods always return false. A maxAge of zero means the
+    // value only goes when evicted.
+    //////////////////////////////////////////////////////////////////////
+
+    bool	getSharedCache(const char* keyPtr, int keyLength, std::string& value) const;
+    bool	putSharedCache(const char* keyPtr, int keyLength,
+			       const char* valuePtr, int valueLength,
+			       unsigned int maxAgeMilliSeconds=0);
+
     void	terminate();
 
     //////////////////////////////////////////////////////////////////////
@@ -102,6 +177,14 @@ namespace pluton {
     service(const service& rhs);			// Copy not ok
 
     serviceImpl*       _impl;
+    perCallerService*	_owner;
+    serviceRequestImpl*	_request;
+    bool		_ownsImpl;
+
+    // Each thread of a threadedService has a handle on the shared Impl
+
+    friend class threadedServiceImpl;
+    service(serviceImpl* sharedImpl, const char* name, int threadID);
 
   protected:
     static int		setInternalAttributes(int);
@@ -0,0 +1,153 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef PLUTON_SERVICEEVENT_H
+#define PLUTON_SERVICEEVENT_H
+
+
+//////////////////////////////////////////////////////////////////////
+// serviceEvent is the event-oriented analogue of pluton::service for
+// services that spend most of their time waiting on I/O. It accepts
+// and reads requests from many connections at once and the service
+// can respond to them in any order. As with clientEvent the caller
+// runs the event loop and sends in I/O available and timeout events;
+// this class never issues any blocking calls of its own.
+//////////////////////////////////////////////////////////////////////
+
+#include <string>
+
+#include <sys/time.h>
+
+#include "pluton/common.h"
+#include "pluton/fault.h"
+
+
+namespace pluton {
+
+  class serviceEventImpl;
+  class serviceEventConnection;
+
+  //////////////////////////////////////////////////////////////////////
+  // A request handed out by serviceEvent::getNextRequest(). It is only
+  // valid until the response is sent.
+  //////////////////////////////////////////////////////////////////////
+
+  class serviceEventRequest {
+  public:
+    const std::string&		getServiceKey(std::string&) const;
+    const std::string&		getServiceApplication(std::string&) const;
+    const std::string&		getServiceFunction(std::string&) const;
+    unsigned int		getServiceVersion() const;
+    pluton::serializationType 	getSerializationType() const;
+
+    const std::string&		getClientName(std::string&) const;
+
+    void		getRequestData(const char*& requestPointer, int& requestLength) const;
+    const std::string&	getRequestData(std::string& requestData) const;
+
+    bool		getContext(const char* key, std::string& value) const;
+
+    void		setCacheMaxAgeMilliSeconds(unsigned int maxAgeMilliSeconds);
+
+  private:
+    serviceEventRequest&	operator=(const serviceEventRequest& rhs);	// Assign not ok
+    serviceEventRequest(const serviceEventRequest& rhs);		// Copy not ok
+
+    friend class serviceEvent;
+    friend class serviceEventConnection;
+    serviceEventRequest(serviceEventConnection* connection);
+    ~serviceEventRequest();
+
+    serviceEventConnection*	_connection;
+  };
+
+
+  class serviceEvent {
+  public:
+    serviceEvent(const char* name="");
+    ~serviceEvent();
+
+    bool		initialize();
+
+    bool		hasFault() const;
+    const pluton::fault& getFault() const;
+
+    //////////////////////////////////////////////////////////////////////
+    // No more than maximumConnections are accepted at a time. Zero
+    // for requestTimeoutMilliSeconds means connections do not time
+    // out while reading or writing.
+    //////////////////////////////////////////////////////////////////////
+
+    void	setMaximumConnections(int maximumConnections);
+    void	setRequestTimeoutMilliSeconds(unsigned int requestTimeoutMilliSeconds);
+
+    //////////////////////////////////////////////////////////////////////
+    // Outstanding events *must* all come back via one of the
+    // send*Event() methods. The timeout is relative to "now".
+    //////////////////////////////////////////////////////////////////////
+
+    enum eventType { wantNothing=0, wantRead=1, wantWrite=2 };
+
+    typedef struct {
+      eventType		type;
+      int		fd;
+      struct timeval	timeout;
+    } eventWanted;
+
+    const eventWanted*	getNextEventWanted(const struct timeval* now);
+    int			sendCanReadEvent(int fd);
+    int			sendCanWriteEvent(int fd);
+    int			sendTimeoutEvent(int fd, bool abortFlag=false);
+
+    pluton::serviceEventRequest*	getNextRequest();
+
+    bool	sendResponse(pluton::serviceEventRequest*, const char* p, int len);
+    bool	sendResponse(pluton::serviceEventRequest*, const std::string& responseData);
+    bool	sendFault(pluton::serviceEventRequest*, unsigned int faultCode, const char* faultText);
+
+    //////////////////////////////////////////////////////////////////////
+    // True once the service has stopped accepting connections - say,
+    // because the manager wants it to exit - and all connections have
+    // completed. The caller should then terminate() and exit.
+    //////////////////////////////////////////////////////////////////////
+
+    bool	isShutdown() const;
+
+    void	terminate();
+
+  private:
+    serviceEvent&	operator=(const serviceEvent& rhs);	// Assign not ok
+    serviceEvent(const serviceEvent& rhs);			// Copy not ok
+
+    serviceEventImpl*	_impl;
+  };
+}
+
+#endif
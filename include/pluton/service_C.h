@@ -31,6 +31,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef PLUTON_SERVICE_C_H
 #define PLUTON_SERVICE_C_H
 
+#include <sys/types.h>
+
+struct iovec;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -53,7 +57,16 @@ typedef enum {
   extern void		pluton_service_C_terminate();
   extern int		pluton_service_C_getRequest();
   extern int		pluton_service_C_sendResponse(const char* ptr, int len);
+  extern int		pluton_service_C_sendResponseV(const struct iovec* iov, int iovCount);
+  extern int		pluton_service_C_sendResponsePart(const char* ptr, int len);
+  extern int		pluton_service_C_sendResponseFromFile(int fd, off_t offset, int length);
   extern int		pluton_service_C_sendFault(unsigned int code, const char* txt);
+  extern void		pluton_service_C_setCacheMaxAgeMilliSeconds(unsigned int maxAgeMS);
+  extern int		pluton_service_C_getSharedCache(const char* key, int keyLen,
+							const char** valuePtr, int* valueLen);
+  extern int		pluton_service_C_putSharedCache(const char* key, int keyLen,
+							const char* valuePtr, int valueLen,
+							unsigned int maxAgeMS);
   extern int		pluton_service_C_hasFault();
   extern int		pluton_service_C_getFaultCode();
   extern const char*	pluton_service_C_getFaultMessage(const char* preMessage, int longFormat);
@@ -0,0 +1,85 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef PLUTON_THREADEDSERVICE_H
+#define PLUTON_THREADEDSERVICE_H
+
+#include "pluton/fault.h"
+#include "pluton/service.h"
+
+
+//////////////////////////////////////////////////////////////////////
+// threadedService runs a pool of threads that each get requests and
+// pass them to the caller's handler. Every thread has its own
+// pluton::service handle so the handler uses the regular service
+// API. The handler must be thread-safe.
+//
+// When run by the manager, the number of threads is the
+// maximum-threads configuration of the service, which must be
+// greater than one. Otherwise setThreadCount() decides, except that
+// a service reading from fd3/fd4 only ever has one thread.
+//
+// run() returns once every thread has stopped. That happens when
+// the manager shuts the service down, when a thread gets a fault, or
+// when a handler calls terminate() on its service.
+//////////////////////////////////////////////////////////////////////
+
+namespace pluton {
+
+  class threadedServiceImpl;
+
+  class threadedService {
+  public:
+    typedef void (*requestHandler_t)(pluton::service& S, void* arg);
+
+    threadedService(const char* name="");
+    ~threadedService();
+
+    bool		initialize();
+
+    bool		hasFault() const;
+    const pluton::fault& getFault() const;
+
+    void	setThreadCount(int threadCount);
+    int		getThreadCount() const;
+
+    bool	run(requestHandler_t handler, void* arg=0);
+
+    void	terminate();
+
+  private:
+    threadedService&	operator=(const threadedService& rhs);	// Assign not ok
+    threadedService(const threadedService& rhs);		// Copy not ok
+
+    threadedServiceImpl*	_impl;
+  };
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_REMOTEENDPOINTS_H
+#define P_REMOTEENDPOINTS_H 1
+
+//////////////////////////////////////////////////////////////////////
+// A service can be configured to run on other hosts with its
+// requests going directly over TCP to the plReceivers listening
+// there. The lookup map then holds the list of endpoints in place of
+// the accept socket path:
+//
+//	tcp:host1:14099/20,host2/20,host3:14100
+//
+// Each endpoint is host[:port][/maximumOutstanding]. The port
+// defaults to the plutonPort and a zero or missing limit means the
+// number of outstanding requests to that endpoint is unlimited. The
+// "tcp:" prefix is what distinguishes a remote rendezvous from a
+// socket path which always starts with a '/'.
+//
+// The same syntax, with or without the prefix and with white-space
+// as an alternative separator, is accepted in the remote-endpoints
+// service configuration parameter.
+//////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <vector>
+
+namespace pluton {
+  class remoteEndpoints {
+
+  public:
+    class endpoint {
+    public:
+      std::string	host;
+      int		port;
+      int		maximumOutstanding;	// Zero means no limit
+    };
+
+    static bool	isRemote(const std::string& rendezvousID);
+
+    bool	parse(const std::string& spec, std::string& errorMessage);
+    void	getRendezvousID(std::string& rendezvousID) const;
+
+    const std::vector<endpoint>&	getEndpoints() const { return _endpoints; }
+
+  private:
+    static bool	parseEndpoint(const std::string& spec, endpoint& ep, std::string& em);
+
+    std::vector<endpoint>	_endpoints;
+  };
+}
+
+#endif
@@ -69,9 +69,15 @@ namespace pluton {
       char	function[16];
     } performanceDetails;
 
+    // Compression costs are totals across the entries rather than per
+    // entry as there is no room for them in each entry.
+
     class performanceData {
       public:
       int			entries;
+      unsigned int		uncompressedBytes;
+      unsigned int		compressedBytes;
+      unsigned int		compressionMicroSeconds;
       performanceDetails	rqL[pluton::reportingChannel::maximumPerformanceEntries];
     };
 
@@ -45,6 +45,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "pluton/fault.h"
 #include "processExitReason.h"
+#include "shmSharedCache.h"
 
 
 //////////////////////////////////////////////////////////////////////
@@ -86,6 +87,12 @@ class shmConfig {
   int32_t	_recorderCycle;			// 28
   int32_t	_align1;			// 32 *
   char		_recorderPrefix[256];		// 32+64 *
+  int32_t	_sharedCacheSize;		// 4 Zero means no shared cache
+  int32_t	_sharedCacheEntrySize;		// 8 *
+  int32_t	_recorderSlotSize;		// 12 Non-zero means record to a ring
+  int32_t	_slowRequestMilliSeconds;	// 16 * Only record slow requests
+  int32_t	_slowRequestPermille;		// 20
+  int32_t	_align2;			// 24 *
 };
 
 
@@ -137,7 +144,7 @@ class shmService {
  public:
   struct {
     uint32_t	_version;		// Set from global.h
-    int32_t	_align1;
+    uint32_t	_sharedCacheOffset;	// Zero if there is no shared cache
   } _header;				// 8 * Header is only set by manager
 
   uint64_t	_managerHeartbeat;	// 16 * Manager ticks this to keep services alive
@@ -150,6 +157,8 @@ class shmService {
   } _aggregateCounters;			// * + 16
 
   shmProcess	_process[1];	// Set by Manager and service
+
+  // The optional shmSharedCache region follows the shmProcess array
 };
 
 
@@ -167,7 +176,8 @@ namespace pluton {
     // Mapping methods
     //////////////////////////////////////////////////////////////////////
 
-    pluton::faultCode	mapManager(int fd, int processCount, int threadCount);
+    pluton::faultCode	mapManager(int fd, int processCount, int threadCount,
+				   int sharedCacheSize=0, int sharedCacheEntrySize=0);
     pluton::faultCode	mapService(int fd, pid_t pid, bool threadedFlag);
 
     bool	ifMapped() const { return _shmServicePtr != 0; }
@@ -187,6 +197,18 @@ namespace pluton {
     int		getMaximumRequests() const { return _myConfig._maximumRequests; }
     int		getIdleTimeout() const { return _myConfig._idleTimeout; }
 
+    //////////////////////////////////////////////////////////////////////
+    // Shared cache methods - usable by manager and service
+    //////////////////////////////////////////////////////////////////////
+
+    bool	ifSharedCache() const { return _sharedCache.ifAttached(); }
+    bool	getSharedCache(const char* keyPtr, int keyLength, std::string& value) const
+    { return _sharedCache.get(keyPtr, keyLength, value); }
+    bool	putSharedCache(const char* keyPtr, int keyLength,
+			       const char* valuePtr, int valueLength, unsigned int maxAgeMS)
+    { return _sharedCache.put(keyPtr, keyLength, valuePtr, valueLength, maxAgeMS); }
+    const shmSharedCacheHeader*	getSharedCacheHeader() const { return _sharedCache.getHeader(); }
+
     //////////////////////////////////////////////////////////////////////
     // Aggregate Service methods
     //////////////////////////////////////////////////////////////////////
@@ -226,15 +248,20 @@ namespace pluton {
     // Process methods
     ////////////////////
 
+    // Threaded services identify the calling thread with tid
+
     bool	setProcessReady(const struct timeval& now);
-    void	startResponseTimer(const struct timeval& now, bool affinity);
-    void	stopResponseTimer(const struct timeval& now);
-    void	setProcessAcceptingRequests(bool);
+    void	startResponseTimer(const struct timeval& now, bool affinity, int tid=0);
+    void	stopResponseTimer(const struct timeval& startTime, const struct timeval& now,
+				  bool addActive=true);
+    void	addProcessActiveuSecs(long uSecs);
+    void	setProcessAcceptingRequests(bool, int tid=0);
+    void	setProcessActiveCount(int activeCount);
     void	setProcessRequestCount(int);
     void	setProcessResponseCount(int);
     void	setProcessFaultCount(int);
     void	setProcessClientDetails(unsigned int requestID, struct timeval,
-					const char* cnamePtr, int cnameLength);
+					const char* cnamePtr, int cnameLength, int tid=0);
     void	setProcessExitReason(processExit::reason);
     void	setProcessTerminated();
 
@@ -243,6 +270,7 @@ namespace pluton {
 
   private:
     bool	resolvePointers();	// Search for pid and set _shmProcessPtr, _shmThreadPtr
+    shmThread*	threadPtr(int tid);
 
     shmService*		_shmServicePtr;
     shmProcess*		_shmProcessPtr;
@@ -261,8 +289,9 @@ namespace pluton {
 
     pid_t		_myPid;
     int			_myTid;
-    struct timeval	_myLastStart;
     shmConfig		_myConfig;	// Copy to protect against corruption
+
+    pluton::shmSharedCache	_sharedCache;
   };
 }
 
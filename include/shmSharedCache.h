@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_SHMSHAREDCACHE_H
+#define P_SHMSHAREDCACHE_H
+
+//////////////////////////////////////////////////////////////////////
+// The shared cache is an optional region at the end of the shmService
+// segment which all processes of a service can use to memoize
+// results. It is sized by the manager from the service config and is
+// a fixed array of fixed-sized entries so memory is bounded by
+// construction.
+//
+// Entries are grouped into sets of cacheWays. A key hashes to a set
+// and may occupy any entry in that set. Replacement prefers an empty,
+// expired or matching entry and otherwise evicts the oldest entry in
+// the set.
+//
+// Readers never lock. Each entry has a sequence number which a
+// writer makes odd while it is changing the entry and even again
+// when done. A reader copies the entry then checks that the sequence
+// is even and unchanged, otherwise the read is discarded. Writers
+// claim an entry with a compare-and-swap on the sequence and simply
+// give up if another writer has it - this is a cache after all.
+//
+// A writer records its pid in the entry's claim before making the
+// sequence odd. Should it die mid-write, the entry would otherwise
+// stay odd until the manager re-creates the segment, so a later
+// writer takes over an odd entry once the claiming process has gone.
+// An entry claimed by a live process is left alone, as a stalled
+// writer resuming over a new writer's data would tear the entry.
+//
+// As with shmService, all types are of a specific size so that 32bit
+// and 64bit services can share the region.
+//////////////////////////////////////////////////////////////////////
+
+#include <string>
+
+#include "stdintWrapper.h"
+
+
+class shmSharedCacheHeader {
+ public:
+  uint32_t	_entrySize;		// 4 Bytes per entry, including shmSharedCacheEntry
+  uint32_t	_entryCount;		// 8 *
+  uint64_t	_hits;			// 16 * Counters are approximate
+  uint64_t	_misses;		// 24 *
+  uint64_t	_inserts;		// 32 *
+  uint64_t	_collisions;		// 40 * Writer lost a race or entry too big
+};
+
+
+class shmSharedCacheEntry {
+ public:
+  uint32_t	_sequence;		// 4 Odd while being written
+  uint32_t	_hash;			// 8 *
+  uint32_t	_keyLength;		// 12
+  uint32_t	_valueLength;		// 16 *
+  uint64_t	_storedMS;		// 24 * Epoch milliseconds
+  uint64_t	_expiresMS;		// 32 * Zero means no expiry
+  uint64_t	_claim;			// 40 * Pid of the latest writer
+  char		_data[8];		// 48 * Key followed by value
+};
+
+
+namespace pluton {
+  class shmSharedCache {
+  public:
+    shmSharedCache();
+    ~shmSharedCache();
+
+    static const int	cacheWays = 4;
+    static const int	minimumEntrySize = 64;
+
+    bool	initialize(void* regionPtr, unsigned int regionSize, unsigned int entrySize);
+    bool	attach(void* regionPtr, unsigned int regionSize);
+    bool	ifAttached() const { return _headerPtr != 0; }
+
+    bool	get(const char* keyPtr, int keyLength, std::string& value) const;
+    bool	put(const char* keyPtr, int keyLength, const char* valuePtr, int valueLength,
+		    unsigned int maxAgeMS);
+
+    const shmSharedCacheHeader*	getHeader() const { return _headerPtr; }
+
+  private:
+    shmSharedCache&	operator=(const shmSharedCache& rhs);	// Assign not ok
+    shmSharedCache(const shmSharedCache& rhs);		// Copy not ok
+
+    shmSharedCacheEntry*	getEntry(unsigned int ix) const;
+
+    shmSharedCacheHeader*	_headerPtr;
+    char*			_entryBase;
+    unsigned int		_entrySize;		// Copies protect against
+    unsigned int		_setCount;		// corruption of shm
+  };
+}
+
+#endif
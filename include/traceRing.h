@@ -0,0 +1,84 @@
+/*
+Copyright (c) 2010, Yahoo! Inc. All rights reserved.
+
+Redistribution and use of this software in source and binary forms, with or
+without modification, are permitted provided that the following conditions are
+met: 
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation and/or 
+other materials provided with the distribution.
+
+* Neither the name of Yahoo! Inc. nor the names of its contributors may be used 
+to endorse or promote products derived from this software without specific prior 
+written permission of Yahoo! Inc.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+*/
+
+#ifndef P_TRACERING_H
+#define P_TRACERING_H
+
+//////////////////////////////////////////////////////////////////////
+// A trace ring is a per-process file of fixed-size span records
+// written by the client and service libraries when tracing is
+// enabled via the plutonTraceDirectory environment variable. The file
+// is mmap()ed and treated as a circular buffer so it never grows
+// beyond its initial size. plTraceMerge reads these files and
+// produces a Chrome trace-event JSON file.
+//
+// A trace is identified by a 64bit traceID that is carried from
+// client to service in the reserved "pluton.trace" context
+// key. Each span has its own spanID and the spanID of its parent so
+// that the hops of a request, including nested requests made by a
+// service, can be linked together.
+//
+// As with shmService, all types are of a specific size so that 32bit
+// and 64bit programs produce the same file format.
+//////////////////////////////////////////////////////////////////////
+
+#include "stdintWrapper.h"
+
+
+class traceRingHeader {
+ public:
+  enum { ringMagic = 0x706c5452, ringVersion = 1 };	// "plTR"
+
+  uint32_t	_magic;			// 4
+  uint32_t	_version;		// 8 *
+  uint32_t	_recordSize;		// 12
+  uint32_t	_capacity;		// 16 * Number of records in the ring
+  uint64_t	_next;			// 24 * Monotonic, modulo _capacity is the next slot
+  uint32_t	_pid;			// 28
+  uint32_t	_align1;		// 32 *
+};
+
+
+class traceSpan {
+ public:
+  enum kind { unusedKind=0, clientKind=1, serviceKind=2 };
+
+  uint64_t	_traceID;		// 8 *
+  uint64_t	_spanID;		// 16 *
+  uint64_t	_parentID;		// 24 * Zero for a root span
+  uint64_t	_startuSecs;		// 32 * Epoch microseconds
+  uint32_t	_durationuSecs;		// 36
+  uint32_t	_pid;			// 40 *
+  uint32_t	_kind;			// 44
+  uint32_t	_sequence;		// 48 * Non-zero once written
+  char		_name[80];		// 128 * Always \0 terminated
+};
+
+#endif
@@ -47,6 +47,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "logging.h"
 #include "serviceKey.h"
 #include "configParser.h"
+#include "remoteEndpoints.h"
 #include "service.h"
 #include "manager.h"
 
@@ -70,6 +71,11 @@ serviceConfig::serviceConfig() :
   maximumThreads(1),
   occupancyPercent(70),
   recorderCycle(0),
+  recorderSlotSize(0),
+  slowRequestMilliSeconds(0),
+  slowRequestPermille(0),
+  sharedCacheSize(0),
+  sharedCacheEntrySize(4096),
   ulimitCPUMilliSeconds(0),
   ulimitOpenFiles(0),
   ulimitDATAMemory(0),
@@ -220,7 +226,7 @@ manager::loadConfigurations(time_t loadSince)
   //////////////////////////////////////////////////////////////////////
 
   int deletedServiceCount = oldMap->size();
-  if (newServiceCount || deletedServiceCount || (loadSince == 0)) {
+  if (newServiceCount || deletedServiceCount || replacedServiceCount || (loadSince == 0)) {
     const char* err = rebuildLookup();
     if (err) {
       string em;
@@ -371,6 +377,24 @@ service::loadConfiguration(const std::string& path)
   if (C.getString("recorder-prefix", _config.recorderPrefix,
 		_config.recorderPrefix, _errorMessage)) return false;
 
+  if (getNumber(C, "recorder-slot-size", _config.recorderSlotSize,
+		_config.recorderSlotSize, 0, 64*1024*1024, _errorMessage)) return false;
+
+  if (C.getString("remote-endpoints", _config.remoteEndpoints,
+		  _config.remoteEndpoints, _errorMessage)) return false;
+
+  if (getNumber(C, "slow-request-milliseconds", _config.slowRequestMilliSeconds,
+		_config.slowRequestMilliSeconds, 0, -1, _errorMessage)) return false;
+
+  if (getNumber(C, "slow-request-permille", _config.slowRequestPermille,
+		_config.slowRequestPermille, 0, 1000, _errorMessage)) return false;
+
+  if (getNumber(C, "shared-cache-entry-size", _config.sharedCacheEntrySize,
+		_config.sharedCacheEntrySize, 64, 1024*1024, _errorMessage)) return false;
+
+  if (getNumber(C, "shared-cache-size", _config.sharedCacheSize,
+		_config.sharedCacheSize, 0, 1024*1024*1024, _errorMessage)) return false;
+
   if (getNumber(C, "ulimit-cpu-milliseconds", _config.ulimitCPUMilliSeconds,
 		_config.ulimitCPUMilliSeconds, 0, -1, _errorMessage)) return false;
 
@@ -416,6 +440,29 @@ service::loadConfiguration(const std::string& path)
     return false;
   }
 
+  //////////////////////////////////////////////////////////////////////
+  // A remote service is run by some other manager so there is
+  // nothing to exec here.
+  //////////////////////////////////////////////////////////////////////
+
+  if (!_config.remoteEndpoints.empty()) {
+    if (!_config.exec.empty()) {
+      _errorMessage = "Config Error: 'exec' and 'remote-endpoints' are mutually exclusive";
+      return false;
+    }
+    pluton::remoteEndpoints RE;
+    string em;
+    if (!RE.parse(_config.remoteEndpoints, em)) {
+      _errorMessage = "Config Error: remote-endpoints: ";
+      _errorMessage += em;
+      return false;
+    }
+    RE.getRendezvousID(_remoteRendezvousID);
+    _type = isRemoteService;
+
+    return true;
+  }
+
   if (_config.exec.empty()) {
     _errorMessage = "Config Error: Must include an 'exec' parameter";
     return false;
@@ -332,7 +332,7 @@ manager::rebuildLookup()
     SK.parse(sm->getName(), false);
     string sk;
     SK.getSearchKey(sk);
-    keysIn[sk] = sm->getAcceptPath();	// and add it into the temporary hash.
+    keysIn[sk] = sm->getRendezvousID();	// and add it into the temporary hash.
   }
 
   const char* res = _shmLookupPtr->buildMap(_lookupMapFile, keysIn);
@@ -127,7 +127,8 @@ process::process(service* setS, int setID, const std::string& setName,
     _totalTimeInProcess(0), _requestsCompleted(0),
     _totalRequestLength(0), _totalResponseLength(0),
     _maximumRequestLength(0), _maximumResponseLength(0),
-    _readErrors(0), _writeErrors(0), _faultsReported(0)
+    _readErrors(0), _writeErrors(0), _faultsReported(0),
+    _totalUncompressedBytes(0), _totalCompressedBytes(0), _totalCompressionMicroSeconds(0)
 {
   ++currentObjectCount;
   if (currentObjectCount > maximumObjectCount) maximumObjectCount = currentObjectCount;
@@ -234,6 +235,19 @@ process::trackCosts(const char* function, const pluton::reportingChannel::perfor
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Compression is reported as totals for each batch of reports.
+//////////////////////////////////////////////////////////////////////
+
+void
+process::trackCompression(const pluton::reportingChannel::performanceData& pd)
+{
+  _totalUncompressedBytes += pd.uncompressedBytes;
+  _totalCompressedBytes += pd.compressedBytes;
+  _totalCompressionMicroSeconds += pd.compressionMicroSeconds;
+}
+
+
 //////////////////////////////////////////////////////////////////////
 // Tell the process thread that the child has exited and record the
 // exit status and resource costs for logging and analysis. This
@@ -815,8 +829,14 @@ process::reportChildCosts()
   LOGPRT << " CPUms/rq=" << CONVERTOR utime << "/" << CONVERTOR stime
 	 << " Mem=" << _resourcesUsed.ru_maxrss / 1024
 	 << "/"	 << _resourcesUsed.ru_idrss / 1024
-	 << "/" << _resourcesUsed.ru_isrss / 1024
-	 << endl;
+	 << "/" << _resourcesUsed.ru_isrss / 1024;
+
+  if (_totalUncompressedBytes > 0) {
+    LOGPRT << " Zip=" << (int) (_totalCompressedBytes * 100 / _totalUncompressedBytes) << "%"
+	   << "/" << (int) (_totalCompressionMicroSeconds / _requestsCompleted) << "uS";
+  }
+
+  LOGPRT << endl;
 }
 
 
@@ -78,6 +78,7 @@ class process : public threadedObject {
   service* 	getSERVICE() const { return _pS; }
 
   void	trackCosts(const char* function, const pluton::reportingChannel::performanceDetails&);
+  void	trackCompression(const pluton::reportingChannel::performanceData&);
   void	notifyChildExit(int status, struct rusage& ru);
   bool	childDied() const { return _childHasExitedFlag; }
   static const char*	exitCodeToEnglish(int);
@@ -169,6 +170,9 @@ class process : public threadedObject {
   int			_readErrors;
   int			_writeErrors;
   int			_faultsReported;
+  long long		_totalUncompressedBytes;
+  long long		_totalCompressedBytes;
+  long long		_totalCompressionMicroSeconds;
 };
 
 #endif
@@ -85,11 +85,7 @@ service::service(const std::string& setName, manager* setM)
     _name(setName), _M(setM), _type(isLocalService),
     _shutdownFlag(false), _nextStartAttempt(0), _shutdownReason(""),
     _childCount(0), _activeProcessCount(0),
-    _prevCalibrationTime(time(0)),
-    _nextCalibrationTime(_prevCalibrationTime+minimumSamplePeriod),
-    _prevOccupancyByTime(0), _currOccupancyByTime(0),
-    _prevListenBacklog(0), _currListenBacklog(0),
-    _calibrateSamples(0),
+    _calibration(time(0)),
     _timeInProcess(0), _requestsCompleted(0)
 {
   ++currentObjectCount;
@@ -130,6 +126,21 @@ service::initialize()
   _logID = _name;
 
   if (!loadConfiguration(_configurationPath)) return false;
+
+  //////////////////////////////////////////////////////////////////////
+  // A remote service only needs a lookup entry naming its endpoints,
+  // but still has a thread so that it is shutdown and replaced like
+  // any other service.
+  //////////////////////////////////////////////////////////////////////
+
+  if (_type == isRemoteService) {
+    if (!service::startThread(this)) {
+      util::messageWithErrno(_errorMessage, " service::startThread() failed");
+      return false;
+    }
+    return true;
+  }
+
   if (!createAcceptSocket(_rendezvousDirectory)) return false;
   if (!createServiceMap(_rendezvousDirectory)) return false;
 
@@ -168,7 +179,9 @@ service::initialize()
   //////////////////////////////////////////////////////////////////////
 
   pluton::faultCode fc = _shmService.mapManager(_shmServiceFD, _config.maximumProcesses,
-						_config.maximumThreads);
+						_config.maximumThreads,
+						_config.sharedCacheSize,
+						_config.sharedCacheEntrySize);
   if (fc != pluton::noFault) {
     util::messageWithErrno(_errorMessage, "mmap() failed for serviceMap", 0, (int) fc);
     return false;
@@ -188,6 +201,13 @@ service::initialize()
   p->_config._idleTimeout = _config.idleTimeout;
   p->_config._affinityTimeout = _config.affinityTimeout;
   p->_config._recorderCycle = _config.recorderCycle;
+  p->_config._recorderSlotSize = _config.recorderSlotSize;
+  p->_config._slowRequestMilliSeconds = _config.slowRequestMilliSeconds;
+  p->_config._slowRequestPermille = _config.slowRequestPermille;
+  if (_shmService.ifSharedCache()) {
+    p->_config._sharedCacheSize = _config.sharedCacheSize;
+    p->_config._sharedCacheEntrySize = _config.sharedCacheEntrySize;
+  }
 
   strncpy(p->_config._recorderPrefix,
 	  _config.recorderPrefix.c_str(), sizeof(p->_config._recorderPrefix)-1);
@@ -263,7 +283,7 @@ service::secondsToNextCreation(int upperLimit)
 void
 service::preRun()
 {
-  if (_config.prestartProcessesFlag) {
+  if (_config.prestartProcessesFlag && (_type == isLocalService)) {
     int startedCount = 0;
     for (int ix=0; ix < _config.minimumProcesses; ++ix) {
       if (createProcess("preStart", false)) ++startedCount;
@@ -291,6 +311,12 @@ service::run()
 {
   if (debug::service()) DBGPRT << "service::run " << _logID << endl;
 
+  while ((_type == isRemoteService) && !shutdownInProgress()) {	// Nothing to manage
+    enableInterrupts();
+    st_sleep(pollInterval);
+    disableInterrupts();
+  }
+
   while (!shutdownInProgress()) {
 
     _shmService.updateManagerHeartbeat(st_time());
@@ -441,6 +467,7 @@ service::readReportingChannel()
       P->trackCosts(ev.U.pd.rqL[ix].function, ev.U.pd.rqL[ix]);
       trackCosts(ev.U.pd.rqL[ix].durationMicroSeconds);
     }
+    P->trackCompression(ev.U.pd);
     _M->addRequestReported(ev.U.pd.entries);
     {
       int backlog = getMANAGER()->getListenBacklog(_stAcceptingFD);
@@ -687,8 +714,9 @@ service::list(ostringstream& os, const char* name)
       << setw(25) << setiosflags(ios::left) << SM->_name << resetiosflags(ios::left)
       << setw(0) << " " << setw(8) << SM->getActiveProcessCount()
       << setw(0) << " " << setw(8) << SM->_unusedIds.size()
-      << setw(0) << " " << setw(6) << (int) SM->_currOccupancyByTime
-      << setw(0) << " " << setw(6) << SM->getMANAGER()->getListenBacklog(SM->_stAcceptingFD);
+      << setw(0) << " " << setw(6) << (int) SM->_calibration.getOccupancy()
+      << setw(0) << " " << setw(6)
+      << (SM->_stAcceptingFD ? SM->getMANAGER()->getListenBacklog(SM->_stAcceptingFD) : 0);
 
     if (SM->_nextStartAttempt > now) {
       os << " " << setw(8) << SM->_nextStartAttempt - now;
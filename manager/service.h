@@ -46,6 +46,7 @@ class manager;
 class process;
 
 #include "hashString.h"
+#include "calibrationPolicy.h"
 #include "hashPointer.h"
 #include "rateLimit.h"
 #include "serviceConfig.h"
@@ -80,6 +81,8 @@ class service : public threadedObject {
 
   const std::string&	getName() const { return _name; }
   const std::string&	getAcceptPath() const { return _acceptPath; }
+  const std::string&	getRendezvousID() const
+    { return (_type == isRemoteService) ? _remoteRendezvousID : _acceptPath; }
 
   bool			loadConfiguration(const std::string& path);
   serviceConfig&	getConfig() { return _config; }
@@ -151,8 +154,6 @@ class service : public threadedObject {
   service&	operator=(const service& rhs);	// Assign not ok
   service(const service& rhs);			// Copy not ok
 
-  static const int minimumSamplePeriod = 11;	// For calibrating services
-
   int	secondsToNextCreation(int upperLimit);
   bool	createAcceptSocket(const std::string& socketDirectory);
   bool	createServiceMap(const std::string& mapDirectory);
@@ -163,10 +164,6 @@ class service : public threadedObject {
   void	calibrateProcesses(const char* why, int acceptQueueLength,
 			   bool decreaseOkFlag, bool increaseToMinimumOkFlag);
 
-  bool	calibrateOccupancyUp(const char* why, const struct timeval& now, int samplePeriod);
-  bool	calibrateOccupancyDown(const char* why, const struct timeval& now, int samplePeriod);
-  bool	calibrateIdleDown(const char* why, const struct timeval& now, int samplePeriod);
-
   process*	findOldestProcess();
   bool		removeOldestProcess(processExit::reason why);
 
@@ -195,6 +192,7 @@ class service : public threadedObject {
 
   std::string		_acceptPath;
   std::string		_shmPath;
+  std::string		_remoteRendezvousID;	// Lookup value of a remote service
 
   int		_reportingChannelPipes[2];
   st_netfd_t	_stReportingFD;
@@ -227,13 +225,7 @@ class service : public threadedObject {
   // queue lengths.
   //////////////////////////////////////////////////////////////////////
 
-  time_t	_prevCalibrationTime;
-  time_t	_nextCalibrationTime;
-  float		_prevOccupancyByTime;
-  float		_currOccupancyByTime;
-  float		_prevListenBacklog;
-  float		_currListenBacklog;
-  int		_calibrateSamples;
+  util::calibrationPolicy	_calibration;
 
   long		_timeInProcess;			// uSecs from reporting Channel
   long		_requestsCompleted;
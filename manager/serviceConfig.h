@@ -52,6 +52,13 @@ class serviceConfig {
   long occupancyPercent;	// Desired percentage of busy processes
 
   long recorderCycle;		// Number of recorder files to cycle through
+  long recorderSlotSize;	// Bytes per slot when recording to a ring
+
+  long slowRequestMilliSeconds;	// Only record requests taking at least this long
+  long slowRequestPermille;	// or in this slowest fraction
+
+  long sharedCacheSize;		// Bytes of shm for the shared cache, zero means none
+  long sharedCacheEntrySize;	// Maximum bytes of key + value per cache entry
 
   long ulimitCPUMilliSeconds;	// Amortized per request
   long ulimitOpenFiles;
@@ -62,6 +69,7 @@ class serviceConfig {
   std::string cd;
   std::string exec;
   std::string recorderPrefix;
+  std::string remoteEndpoints;	// Run elsewhere and reached via these plReceivers
 
  private:
   serviceConfig&	operator=(const serviceConfig& rhs);	// Assign not ok
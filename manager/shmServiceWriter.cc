@@ -58,11 +58,23 @@ using namespace std;
 //////////////////////////////////////////////////////////////////////
 
 pluton::faultCode
-pluton::shmServiceHandler::mapManager(int fd, int processCount, int threadCount)
+pluton::shmServiceHandler::mapManager(int fd, int processCount, int threadCount,
+				      int sharedCacheSize, int sharedCacheEntrySize)
 {
   _mapSize = sizeof(shmService) + sizeof(shmProcess) * processCount
     + sizeof(shmThread) * processCount * threadCount;
 
+  //////////////////////////////////////////////////////////////////////
+  // The optional shared cache is appended to the same segment so that
+  // services find it via the one fd they already inherit.
+  //////////////////////////////////////////////////////////////////////
+
+  int sharedCacheOffset = 0;
+  if (sharedCacheSize > 0) {
+    sharedCacheOffset = (_mapSize + 7) & ~7;
+    _mapSize = sharedCacheOffset + sharedCacheSize;
+  }
+
   _maxProcesses = processCount;
   _maxThreads = threadCount;
 
@@ -80,6 +92,15 @@ pluton::shmServiceHandler::mapManager(int fd, int processCount, int threadCount)
   memset((void*) _shmServicePtr, '\0', _mapSize);
   _shmServicePtr->_header._version = plutonGlobal::shmServiceVersion;
 
+  // A cache that is too small for even one set is simply not created
+
+  if (sharedCacheOffset > 0) {
+    if (_sharedCache.initialize(static_cast<char*>(p) + sharedCacheOffset,
+				sharedCacheSize, sharedCacheEntrySize)) {
+      _shmServicePtr->_header._sharedCacheOffset = sharedCacheOffset;
+    }
+  }
+
   return pluton::noFault;
 }
 
@@ -0,0 +1,74 @@
+#! /bin/sh
+
+# Measure throughput, latency and CPU per request across the matrix
+# of services, concurrencies and request sizes and fail if anything
+# regressed beyond the thresholds against the stored baseline. This
+# directory is not part of the default regression run:
+#
+#	sh runall.sh p.10.benchmark
+#
+# rgBenchSeconds sets the measurement period per run (default: 5)
+# and rgBenchBaseline an alternate baseline file. If the baseline does
+# not exist, this run becomes the baseline.
+
+map=/tmp/benchlookup.map
+seconds=${rgBenchSeconds:-5}
+baseline=${rgBenchBaseline:-$1/baseline.$PLATFORM.csv}
+results=$rgData/bench.plBench.csv
+report=$rgData/bench.csv
+
+rm -f $results $report $report.rows $rgData/bench.manager
+grep -v '^#' $1/matrix >$rgData/bench.matrix
+
+failed=0
+while read label key concurrency size contexts
+do
+  [ -z "$label" ] && continue
+
+  ./start_manager -C $1/config -R/tmp -L$map -lprocessUsage </dev/null
+  if [ $? -ne 0 ]; then
+      echo Failed: manager did not start for $label
+      failed=1
+      continue
+  fi
+
+  options=""
+  for c in $contexts
+  do
+    options="$options -C $c"
+  done
+
+  $rgBinPath/plBench -L$map -c$concurrency -s$size -t$seconds -w1 -l$label \
+      -o $results $options $key </dev/null
+  if [ $? -ne 0 ]; then
+      echo Failed: plBench $label
+      failed=1
+  fi
+
+  ./stop_manager
+  cat $rgMANAGEROut >>$rgData/bench.manager
+
+  row=`grep "^$label," $results`
+  [ -z "$row" ] && continue
+  cpu=`awk -v service=$key -f $1/usage.awk $rgMANAGEROut`
+  echo "$row,$cpu" >>$report.rows
+done <$rgData/bench.matrix
+
+if [ ! -s $report.rows ]; then
+    echo Failed: no benchmark results
+    exit 1
+fi
+
+echo "`head -1 $results`,serviceCPUus" >$report
+cat $report.rows >>$report
+rm -f $report.rows
+
+if [ ! -f $baseline ]; then
+    cp $report $baseline
+    echo Recorded new baseline $baseline
+    exit $failed
+fi
+
+awk -v thresholds=$1/thresholds -f $1/compare.awk $baseline $report || failed=1
+
+exit $failed
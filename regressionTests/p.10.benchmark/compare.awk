@@ -0,0 +1,63 @@
+# Compare a benchmark report against a baseline report, row by row on
+# the label column, using the limits in the thresholds file.
+#
+# Usage: awk -v thresholds=file -f compare.awk baseline.csv report.csv
+#
+# Exit(1) if any column regressed beyond its threshold.
+
+BEGIN {
+  while ((getline line < thresholds) > 0) {
+    if ((line ~ /^#/) || (line ~ /^[ \t]*$/)) continue
+    split(line, f, /[ \t]+/)
+    columns[f[1]] = 1
+    worse[f[1]] = f[2]
+    percent[f[1]] = f[3]
+    floor[f[1]] = f[4]
+  }
+  FS = ","
+  regressions = 0
+  printf "%-16s %-13s %12s %12s %8s\n", "Label", "Column", "Baseline", "Now", "Worse"
+}
+
+FNR == 1 {
+  ++file
+  for (ix = 1; ix <= NF; ++ix) name[file, ix] = $ix
+  next
+}
+
+file == 1 {
+  for (ix = 1; ix <= NF; ++ix) base[$1, name[1, ix]] = $ix
+  have[$1] = 1
+  next
+}
+
+{
+  if (!have[$1]) {
+    printf "%-16s not in baseline\n", $1
+    next
+  }
+
+  for (ix = 1; ix <= NF; ++ix) {
+    col = name[2, ix]
+    if (!(col in columns)) continue
+
+    was = base[$1, col] + 0
+    now = $ix + 0
+    delta = (worse[col] == "lower") ? was - now : now - was
+    change = (was > 0) ? delta * 100 / was : 0
+
+    status = "ok"
+    if ((delta > floor[col]) && (change > percent[col])) {
+      status = "REGRESSED"
+      ++regressions
+    }
+    printf "%-16s %-13s %12.3f %12.3f %+7.1f%% %s\n", $1, col, was, now, change, status
+  }
+}
+
+END {
+  if (regressions > 0) {
+    print "Failed: " regressions " results regressed beyond thresholds"
+    exit 1
+  }
+}
@@ -0,0 +1,38 @@
+# Average the service CPU per request from the manager's processUsage
+# log lines for one service. Reqs= is abbreviated by intToEnglish (eg
+# 1.2K) and CPUms/rq= is user/system milliseconds per request.
+#
+# Usage: awk -v service=serviceKey -f usage.awk managerLog
+#
+# Prints microseconds per request, or zero if no usage was logged.
+
+function englishToInt(s,	mult) {
+  mult = 1
+  if (s ~ /K$/) mult = 1000
+  if (s ~ /M$/) mult = 1000000
+  if (s ~ /G$/) mult = 1000000000
+  sub(/[KMG]$/, "", s)
+  return s * mult
+}
+
+$1 == "Usage:" && index($2, service "/") == 1 {
+  reqs = 0
+  cpu = 0
+  for (ix = 3; ix <= NF; ++ix) {
+    if ($ix ~ /^Reqs=/) {
+      split(substr($ix, 6), r, "/")
+      reqs = englishToInt(r[1])
+    }
+    if ($ix ~ /^CPUms\/rq=/) {
+      split(substr($ix, 10), c, "/")
+      cpu = c[1] + c[2]
+    }
+  }
+  requests += reqs
+  cost += reqs * cpu
+}
+
+END {
+  if (requests > 0) printf "%d\n", cost * 1000 / requests
+  else print 0
+}
@@ -62,10 +62,11 @@ mkdir -p $STDOUT $STDERR data
 # Service and test paths are platform dependent, but configs have
 # hard-coded exec paths. Create symlinks for the hard-codes.
 
-rm -f platform-services platform-tests platform-jar platform-jni
+rm -f platform-services platform-tests platform-commands platform-jar platform-jni
 
 ln -sf $rgServicesPath platform-services
 ln -sf $rgTestPath platform-tests
+ln -sf $rgBinPath platform-commands
 ln -sf $rgTOP/wrappers/java/jar platform-jar
 ln -sf $rgTOP/wrappers/java/jni/$PLATFORM platform-jni
 
@@ -0,0 +1,15 @@
+#! /bin/sh
+
+# Steady load should settle at two processes with modest latency
+
+$rgTestPath/tCalibrationSim -H 24 -r 50 -L 200 -A 3 >/dev/null || exit 1
+
+# A daily cycle should scale up and idle back down again
+
+$rgTestPath/tCalibrationSim -H 48 -r 1 -R 150 -L 300 -A 4 >/dev/null || exit 1
+
+# Processes exiting on maximum-requests should be replaced
+
+$rgTestPath/tCalibrationSim -H 24 -r 50 -q 1000 -m 2 -L 300 -A 4 >/dev/null || exit 1
+
+exit 0
@@ -0,0 +1,5 @@
+#! /bin/sh
+
+# One quick repetition to check the benchmarks still parse correctly
+
+$rgTestPath/tNetStringBench -q
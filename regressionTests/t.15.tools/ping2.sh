@@ -0,0 +1,38 @@
+#! /bin/sh
+
+# Check the open-loop mode of plPing: all requests complete, at about
+# the requested rate, with a percentile table and a time series.
+
+good=/tmp/goodlookup.map
+./start_manager -C $1/echoConfig -R/tmp -L$good -lservice -lprocess
+
+$rgBinPath/plPing -r200 -E -c400 -T4 -s100 -S $rgData/ping2.csv -L$good >$rgData/ping2.results
+res=$?
+./stop_manager
+
+failed=0
+if [ $res -ne 0 ]; then
+    echo Failed: plPing exit code $res
+    cat $rgData/ping2.results
+    failed=1
+fi
+
+grep -q '^plPings: 400 Faults=0' $rgData/ping2.results
+if [ $? -ne 0 ]; then
+    echo Failed: plPing did not complete 400 requests
+    failed=1
+fi
+
+grep -q '#\[Total count = 400\]' $rgData/ping2.results
+if [ $? -ne 0 ]; then
+    echo Failed: plPing percentile table missing
+    failed=1
+fi
+
+lines=`wc -l <$rgData/ping2.csv`
+if [ $lines -lt 3 ]; then
+    echo Failed: plPing time series has $lines lines
+    failed=1
+fi
+
+exit $failed
@@ -17,10 +17,12 @@ grep 'minimum-processes must not be greater than maximum-processes' $rgMANAGEROu
 grep "Must include an 'exec'" $rgMANAGEROut || exit 10
 grep 'serialization type is unrecognized' $rgMANAGEROut || exit 11
 grep 'Config Warning: Ignoring file' $rgMANAGEROut || exit 12
+grep "'exec' and 'remote-endpoints' are mutually exclusive" $rgMANAGEROut || exit 13
+grep 'remote-endpoints: ' $rgMANAGEROut || exit 14
 
 # Make sure we didn't miss any
 
 ec=`grep 'Config Error:' $rgMANAGEROut|wc -l`
-[ $ec -ne 11 ] && exit `expr 100 + $ec`	# Communicate count back to failure tester
+[ $ec -ne 13 ] && exit `expr 100 + $ec`	# Communicate count back to failure tester
 
 exit 0
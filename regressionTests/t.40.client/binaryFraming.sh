@@ -0,0 +1,11 @@
+#! /bin/sh
+
+good=/tmp/goodlookup.map
+./start_manager -C $1/echoConfigAffinity -R/tmp -L$good
+
+$rgTestPath/tBinaryFraming $good
+res=$?
+
+./stop_manager
+
+exit $res
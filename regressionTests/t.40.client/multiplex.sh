@@ -0,0 +1,19 @@
+#! /bin/sh
+
+good=/tmp/goodlookup.map
+./start_manager -C $1/echoConfigMultiplex -R/tmp -L$good
+
+# plTransmitter multiplexes requests to this plReceiver, which relays
+# them to the local echo service. tMultiplex kills it part way through.
+
+$rgBinPath/plReceiver -l $good -m 10 -k system.echo.0.raw localhost:15011 &
+r1=$!
+sleep 1
+
+$rgTestPath/tMultiplex $good system.echo.1.raw $r1
+res=$?
+
+kill $r1 2>/dev/null
+./stop_manager
+
+exit $res
@@ -0,0 +1,20 @@
+#! /bin/sh
+
+good=/tmp/goodlookup.map
+./start_manager -C $1/echoConfigRemote -R/tmp -L$good
+
+# Two plReceivers relay to the local echo service
+
+$rgBinPath/plReceiver -l $good -k system.echo.0.raw localhost:15001 &
+r1=$!
+$rgBinPath/plReceiver -l $good -k system.echo.0.raw localhost:15002 &
+r2=$!
+sleep 1
+
+$rgTestPath/tRemoteEndpoints $good
+res=$?
+
+kill $r1 $r2
+./stop_manager
+
+exit $res
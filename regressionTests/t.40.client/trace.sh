@@ -0,0 +1,23 @@
+#! /bin/sh
+
+good=/tmp/goodlookup.map
+plutonTraceDirectory=/tmp/plTrace.$$
+export plutonTraceDirectory
+rm -rf $plutonTraceDirectory
+mkdir $plutonTraceDirectory
+
+./start_manager -C $1/echoConfig -R/tmp -L$good
+
+$rgTestPath/tTrace $good
+res=$?
+
+./stop_manager
+
+if [ $res -eq 0 ]; then
+    $rgBinPath/plTraceMerge $plutonTraceDirectory/pluton.trace.* >/dev/null
+    res=$?
+fi
+
+rm -rf $plutonTraceDirectory
+
+exit $res
@@ -0,0 +1,17 @@
+#! /bin/sh
+
+# Batches to a service that takes members one at a time and to one
+# that takes the whole batch with getRequestBatch().
+
+good=/tmp/goodlookup.map
+./start_manager -C $1/batchConfig -R/tmp -L$good
+
+$rgTestPath/tBatch $good system.echo.0.raw
+res1=$?
+$rgTestPath/tBatch $good test.batch.0.raw
+res2=$?
+
+./stop_manager
+
+[ $res1 -ne 0 ] && exit $res1
+exit $res2
@@ -0,0 +1,35 @@
+#! /bin/sh
+
+# A single event-driven process should handle ten slow requests
+# concurrently and respond to them out of order.
+
+good=/tmp/goodlookup.map
+./start_manager -C $1/eventConfig -R/tmp -L$good
+
+start=`date +%s`
+for ix in 1 2 3 4 5 6 7 8 9 10
+do
+  $rgBinPath/plSend -L$good -CsleepMS=`expr 2200 - $ix \* 200` test.event.0.raw "request$ix" >/tmp/event.$ix &
+done
+wait
+finish=`date +%s`
+
+./stop_manager
+
+res=0
+for ix in 1 2 3 4 5 6 7 8 9 10
+do
+  if [ "`cat /tmp/event.$ix`" != "request$ix" ]; then
+      echo Expected response request$ix, not `cat /tmp/event.$ix`
+      res=1
+  fi
+  rm -f /tmp/event.$ix
+done
+
+elapsed=`expr $finish - $start`
+if [ $elapsed -ge 6 ]; then
+    echo Expected concurrent requests to take less than 6 seconds, not $elapsed
+    res=1
+fi
+
+exit $res
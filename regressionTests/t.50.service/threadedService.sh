@@ -0,0 +1,35 @@
+#! /bin/sh
+
+# A single process with four threads should handle four slow requests
+# concurrently.
+
+good=/tmp/goodlookup.map
+./start_manager -C $1/threadedConfig -R/tmp -L$good
+
+start=`date +%s`
+for ix in 1 2 3 4
+do
+  $rgBinPath/plSend -L$good -CsleepMS=2000 test.threaded.0.raw "request$ix" >/tmp/threaded.$ix &
+done
+wait
+finish=`date +%s`
+
+./stop_manager
+
+res=0
+for ix in 1 2 3 4
+do
+  if [ "`cat /tmp/threaded.$ix`" != "request$ix" ]; then
+      echo Expected response request$ix, not `cat /tmp/threaded.$ix`
+      res=1
+  fi
+  rm -f /tmp/threaded.$ix
+done
+
+elapsed=`expr $finish - $start`
+if [ $elapsed -ge 6 ]; then
+    echo Expected concurrent requests to take less than 6 seconds, not $elapsed
+    res=1
+fi
+
+exit $res
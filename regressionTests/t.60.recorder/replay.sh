@@ -0,0 +1,34 @@
+#! /bin/sh
+
+# Check that plReplay sends recorded requests back to the service and
+# that the responses match what was recorded.
+
+good=/tmp/goodlookup.map
+rm -f $rgData/replay.in.* $rgData/replay.out.*
+./start_manager -C $1/configReplay -R/tmp -L$good -lservice -lprocess
+
+$rgBinPath/plPing -c10 -i0 -s100 -L$good system.echo.0.raw
+$rgBinPath/plReplay -D -c2 -n3 -L$good $rgData/replay. >$rgData/replay.results
+res=$?
+./stop_manager
+
+failed=0
+if [ $res -ne 0 ]; then
+    echo Failed: plReplay exit code $res
+    failed=1
+fi
+
+grep -q 'Requests=30 Faults=0' $rgData/replay.results
+if [ $? -ne 0 ]; then
+    echo Failed: plReplay did not replay 30 requests
+    cat $rgData/replay.results
+    failed=1
+fi
+
+grep -q 'Compared=30 Mismatches=0' $rgData/replay.results
+if [ $? -ne 0 ]; then
+    echo Failed: plReplay responses differ from the recording
+    failed=1
+fi
+
+exit $failed
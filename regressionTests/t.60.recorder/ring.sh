@@ -0,0 +1,42 @@
+#! /bin/sh
+
+# Check that a recorder ring keeps the most recent requests and that
+# they can be extracted and replayed.
+
+good=/tmp/goodlookup.map
+rm -f $rgData/ring.ring.*
+./start_manager -C $1/configRing -R/tmp -L$good -lservice -lprocess
+
+$rgBinPath/plPing -c20 -i0 -s100 -L$good system.echo.0.raw
+./stop_manager
+
+failed=0
+ring=`ls $rgData/ring.ring.* | head -1`
+if [ ! -r "$ring" ]; then
+    echo Failed: ring file not created
+    exit 1
+fi
+
+# The ring holds 8 slots of 4096 bytes regardless of the request count
+
+size=`wc -c <$ring`
+if [ $size -ne 32768 ]; then
+    echo Failed: ring size is $size
+    failed=1
+fi
+
+records=`$rgBinPath/plNetStringGrep -n o <$ring | wc -l`
+if [ $records -ne 8 ]; then
+    echo Failed: ring has $records records
+    failed=1
+fi
+
+$rgBinPath/plNetStringGrep -d I <$ring >$rgData/ring.requests
+$rgServicesPath/echo 3<$rgData/ring.requests 4>$rgData/ring.responses
+responses=`$rgBinPath/plNetStringGrep -n q <$rgData/ring.responses | wc -l`
+if [ $responses -ne 8 ]; then
+    echo Failed: replay produced $responses responses
+    failed=1
+fi
+
+exit $failed
@@ -0,0 +1,39 @@
+#! /bin/sh
+
+# Check that only requests over the slow threshold are recorded.
+
+good=/tmp/goodlookup.map
+rm -f $rgData/slow.slow.*
+./start_manager -C $1/configSlow -R/tmp -L$good -lservice -lprocess
+
+$rgBinPath/plPing -c10 -i0 -s100 -L$good system.echo.0.raw
+$rgBinPath/plSend -L$good -Cecho.sleepMS=300 system.echo.0.raw "slow one" >/dev/null
+$rgBinPath/plPing -c10 -i0 -s100 -L$good system.echo.0.raw
+$rgBinPath/plSend -L$good -Cecho.sleepMS=300 system.echo.0.raw "slow two" >/dev/null
+
+./stop_manager
+
+failed=0
+ring=`ls $rgData/slow.slow.* | head -1`
+if [ ! -r "$ring" ]; then
+    echo Failed: slow ring file not created
+    exit 1
+fi
+
+records=`$rgBinPath/plNetStringGrep -n o <$ring | wc -l`
+if [ $records -ne 2 ]; then
+    echo Failed: slow ring has $records records
+    failed=1
+fi
+
+$rgBinPath/plNetStringGrep -d I <$ring | $rgBinPath/plNetStringGrep -n k >$rgData/slow.data
+for d in "slow one" "slow two"
+do
+  grep -q "$d" $rgData/slow.data
+  if [ $? -ne 0 ]; then
+      echo Failed: "$d" not recorded
+      failed=1
+  fi
+done
+
+exit $failed
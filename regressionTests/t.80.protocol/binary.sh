@@ -0,0 +1,49 @@
+#! /bin/sh
+
+# Test that binary framed requests are decoded and that the response
+# framing follows the request: binary if the request was binary or
+# offered binary with a binaryFramingNT ('F'), otherwise ascii.
+
+ascii='0Q,3b100,12aplPing:26666,17csystem.echo.0.raw,4l5000,0z'
+offer='0Q,3b100,0F,12aplPing:26666,17csystem.echo.0.raw,4l5000,0z'
+binary='\321\000\342\003100\341\014plPing:26666\343\021system.echo.0.raw\354\0045000\372\000'
+badBinary='\321\000\342\003100\341\377\377\377\377\017plPing:26666\372\000'	# Large length
+
+out=/tmp/binary.$$
+
+ret=0
+
+# Prints the first byte of the response, in octal if it is not printable
+
+firstByte()
+{
+    od -An -c -N1 $out | tr -d ' '
+}
+
+echo $ascii | $rgServicesPath/echo 3<&0 4>$out
+if [ $? -ne 0 -o "`firstByte`" != "0" ]; then
+    echo Expected an ascii response to an ascii packet
+    ret=1
+fi
+
+echo $offer | $rgServicesPath/echo 3<&0 4>$out
+if [ $? -ne 0 -o "`firstByte`" != "301" ]; then
+    echo Expected a binary response to a binary offer
+    ret=1
+fi
+
+printf $binary | $rgServicesPath/echo 3<&0 4>$out
+if [ $? -ne 0 -o "`firstByte`" != "301" ]; then
+    echo Expected a binary response to a binary packet
+    ret=1
+fi
+
+printf $badBinary | $rgServicesPath/echo 3<&0 4>$out
+if [ $? -eq 0 ]; then
+    echo Expected fault with oversized binary length
+    ret=1
+fi
+
+rm -f $out
+
+exit $ret
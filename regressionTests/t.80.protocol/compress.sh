@@ -0,0 +1,30 @@
+#! /bin/sh
+
+# Test that a request offering to accept compressed data gets a large
+# compressible response back compressed along with the service saying
+# that it can decompress. A small response goes as is.
+
+data=abcdefghij
+for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do data="$data"abcdefghij; done
+
+out=/tmp/compress.$$
+
+ret=0
+
+request="0Q,3b100,12aplPing:26666,17csystem.echo.0.raw,4l5000,4Zz100,210k$data,0z"
+echo $request | $rgServicesPath/echo 3<&0 4>$out
+if [ $? -ne 0 ] || ! grep -q '1Zz,' $out || ! grep -q '4Ez210,' $out || grep -q "$data" $out; then
+    echo Expected compressed response data
+    ret=1
+fi
+
+request="0Q,3b100,12aplPing:26666,17csystem.echo.0.raw,4l5000,4Zz500,210k$data,0z"
+echo $request | $rgServicesPath/echo 3<&0 4>$out
+if [ $? -ne 0 ] || grep -q '4Ez210,' $out || ! grep -q "210q$data," $out; then
+    echo Expected uncompressed response data below the threshold
+    ret=1
+fi
+
+rm -f $out
+
+exit $ret
@@ -0,0 +1,29 @@
+#! /bin/sh
+
+# Test that response parts are only sent to a client that offers to
+# take them with a responsePartAcceptNT ('S'). Otherwise the parts go
+# ahead of the final data as one responseDataNT ('q').
+
+context='22j14kecho.partBytes,1v4,'
+offer="0Q,3b100,0S,12aplPing:26666,17csystem.echo.0.raw,4l5000,$context,10kabcdefghij,0z"
+plain="0Q,3b100,12aplPing:26666,17csystem.echo.0.raw,4l5000,$context,10kabcdefghij,0z"
+
+out=/tmp/parts.$$
+
+ret=0
+
+echo $offer | $rgServicesPath/echo 3<&0 4>$out
+if [ $? -ne 0 ] || ! grep -q '4Pabcd,4Pefgh,2qij,0z' $out; then
+    echo Expected response parts when offered
+    ret=1
+fi
+
+echo $plain | $rgServicesPath/echo 3<&0 4>$out
+if [ $? -ne 0 ] || ! grep -q '10qabcdefghij,0z' $out || grep -q '4P' $out; then
+    echo Expected a whole response when parts are not offered
+    ret=1
+fi
+
+rm -f $out
+
+exit $ret
@@ -0,0 +1,21 @@
+#! /bin/sh
+
+# Test that a response sent from a file reaches faux STDOUT, which is
+# a plain file here, with only the requested range of the file.
+
+context='21j13kecho.fromFile,1v7,'
+request="0Q,3b100,12aplPing:26666,17csystem.echo.0.raw,4l5000,$context,10kabcdefghij,0z"
+
+out=/tmp/sendfile.$$
+
+ret=0
+
+echo $request | $rgServicesPath/echo 3<&0 4>$out
+if [ $? -ne 0 ] || ! grep -q '10qabcdefghij,0z' $out || grep -q '\.\.' $out; then
+    echo Expected the file range as response data
+    ret=1
+fi
+
+rm -f $out
+
+exit $ret
@@ -28,12 +28,15 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
 */
 
+#include <algorithm>
 #include <string>
+#include <vector>
 #include <iostream>
 #include <sstream>
 
 using namespace std;
 
+#include <stdio.h>
 #include <time.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -100,7 +103,69 @@ main(int argc, char** argv)
 	   << " got=" << util::timevalDiffMS(endTime, startTime) << endl;
     }
 
-    if (!S.sendResponse(cp, len)) break;
+    std::string cacheStr;
+    if (S.getContext("echo.cacheMS", cacheStr)) {
+      S.setCacheMaxAgeMilliSeconds(atoi(cacheStr.c_str()));
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    // Optionally send all but the last piece as response parts
+    //////////////////////////////////////////////////////////////////////
+
+    std::string partStr;
+    S.getContext("echo.partBytes", partStr);
+    int partBytes = atoi(partStr.c_str());
+    int offset = 0;
+    while ((partBytes > 0) && (len - offset > partBytes)) {
+      if (!S.sendResponsePart(cp + offset, partBytes)) break;
+      offset += partBytes;
+    }
+    if (S.hasFault()) break;
+
+    //////////////////////////////////////////////////////////////////////
+    // Optionally scatter the rest across many iovecs
+    //////////////////////////////////////////////////////////////////////
+
+    std::string scatterStr;
+    S.getContext("echo.scatterBytes", scatterStr);
+    int scatterBytes = atoi(scatterStr.c_str());
+
+    //////////////////////////////////////////////////////////////////////
+    // Or write it to a file after some padding and send it from there
+    //////////////////////////////////////////////////////////////////////
+
+    std::string fileStr;
+    S.getContext("echo.fromFile", fileStr);
+    int filePadding = atoi(fileStr.c_str());
+
+    if (!fileStr.empty()) {
+      FILE* fp = tmpfile();
+      if (!fp) {
+	if (!S.sendFault(112, "tmpfile() failed")) break;
+	continue;
+      }
+      std::string padding(std::max(filePadding, 0), '.');
+      fwrite(padding.data(), 1, padding.length(), fp);
+      fwrite(cp + offset, 1, len - offset, fp);
+      fflush(fp);
+      bool res = S.sendResponseFromFile(fileno(fp), filePadding, len - offset);
+      fclose(fp);
+      if (!res && (S.getFault().getFaultCode() != pluton::sendFileFailed)) break;
+      if (!res && !S.sendFault(113, "sendResponseFromFile() failed")) break;
+    }
+    else if (scatterBytes > 0) {
+      std::vector<struct iovec> iov;
+      for (int ix=offset; ix < len; ix += scatterBytes) {
+	struct iovec vec;
+	vec.iov_base = const_cast<char*>(cp + ix);
+	vec.iov_len = std::min(scatterBytes, len - ix);
+	iov.push_back(vec);
+      }
+      if (!S.sendResponse(iov.empty() ? 0 : &iov[0], iov.size())) break;
+    }
+    else {
+      if (!S.sendResponse(cp + offset, len - offset)) break;
+    }
 
     if (logFlag) clog << "Response sent" << endl;
 
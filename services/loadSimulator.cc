@@ -30,13 +30,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 //////////////////////////////////////////////////////////////////////
 // This program tries to simulate the cost of a service. The context
-// contains the cpu and latency to burn.
+// contains the cpu and latency to burn and the memory to allocate,
+// each as a number or as a util::loadDistribution spec so that
+// heavy-tailed and bimodal service times can be reproduced. Defaults
+// for requests without context can be set on the command line.
+//
+// Context:	cpu		milliseconds of CPU to burn
+//		latency		milliseconds before responding (at least cpu)
+//		memory		kilobytes per allocation, touched and freed
+//		allocations	number of allocations (default: 1)
 //////////////////////////////////////////////////////////////////////
 
 
 #include <string>
 #include <iostream>
-#include <sstream>
+#include <vector>
 
 using namespace std;
 
@@ -50,9 +58,12 @@ using namespace std;
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "util.h"
+#include "loadDistribution.h"
 #include "pluton/service.h"
 
 extern char* optarg;
@@ -99,14 +110,59 @@ calibrateCPU()
 }
 
 
+//////////////////////////////////////////////////////////////////////
+// Return a sample from the distribution in the context, or from the
+// default if the context is absent or invalid. Samples are capped so
+// a heavy tail can't wedge the service.
+//////////////////////////////////////////////////////////////////////
+
+static unsigned short seed[3];
+
+static int
+sampleContext(pluton::service& S, const char* key, const util::loadDistribution& defaultDist,
+	      int maximum)
+{
+  const util::loadDistribution* dist = &defaultDist;
+  util::loadDistribution contextDist;
+  string sc, em;
+  if (S.getContext(key, sc) && contextDist.parse(sc, em)) dist = &contextDist;
+
+  double v = dist->sample(seed);
+  if (v > maximum) v = maximum;
+
+  return int(v + 0.5);
+}
+
+static void
+setDefault(util::loadDistribution& dist, const char* spec)
+{
+  string em;
+  if (!dist.parse(spec, em)) {
+    clog << "Error: " << em << endl;
+    exit(4);
+  }
+}
+
+
 static int duplicateCount = 1;
 
+static const int maximumMS = 60 * 1000;
+static const int maximumKB = 1024 * 1024;
+static const int maximumAllocations = 1000;
+
 int
 main(int argc, char** argv)
 {
+  util::loadDistribution cpuDefault;
+  util::loadDistribution latencyDefault;
+  util::loadDistribution memoryDefault;
+
   char optionChar;
-  while ((optionChar = getopt(argc, argv, "m:")) != EOF) {
+  while ((optionChar = getopt(argc, argv, "c:l:M:m:")) != EOF) {
     switch (optionChar) {
+    case 'c': setDefault(cpuDefault, optarg); break;
+    case 'l': setDefault(latencyDefault, optarg); break;
+    case 'M': setDefault(memoryDefault, optarg); break;
     case 'm': duplicateCount = atoi(optarg); break;
     default:
       clog << "Invalid option sent" << endl;
@@ -114,6 +170,10 @@ main(int argc, char** argv)
     }
   }
 
+  seed[0] = getpid();
+  seed[1] = time(0);
+  seed[2] = time(0) >> 16;
+
   int burnCount = calibrateCPU();		// Work out how to burn a ms of CPU
   if (burnCount <= 0) {
     clog << "Burn Rate of zero is impossible to use" << endl;
@@ -132,23 +192,28 @@ main(int argc, char** argv)
     string sr;
     S.getRequestData(sr);
 
-    int cpuMS=0;
-    int elapseMS=0;
-    string sc;
-    if (S.getContext("cpu", sc)) {
-      istringstream is(sc);
-      is >> cpuMS;
-    }
+    int cpuMS = sampleContext(S, "cpu", cpuDefault, maximumMS);
+    int elapseMS = sampleContext(S, "latency", latencyDefault, maximumMS);
 
-    if (S.getContext("latency", sc)) {
-      istringstream is(sc);
-      is >> elapseMS;
+    int allocations = 1;
+    string sc;
+    if (S.getContext("allocations", sc)) allocations = atoi(sc.c_str());
+    if (allocations > maximumAllocations) allocations = maximumAllocations;
+    vector<char*> memory;
+    for (int ix=0; ix < allocations; ++ix) {
+      int kb = sampleContext(S, "memory", memoryDefault, maximumKB);
+      if (kb <= 0) continue;
+      char* p = new char[kb * 1024];
+      memset(p, ix, kb * 1024);		// Touch every page
+      memory.push_back(p);
     }
 
     int bc = burnCount * cpuMS;
     while (bc-- > 0) burnAthousand();
     if ((elapseMS-cpuMS) > 0) usleep((elapseMS-cpuMS) * 1000);
 
+    for (unsigned int ix=0; ix < memory.size(); ++ix) delete [] memory[ix];
+
     string r;
     int dc = duplicateCount;
     while (dc-- > 0) r.append(sr);
@@ -32,9 +32,14 @@ main(int argc, char** argv)
   checkSizeOf("shmThread", sizeof(shmThread));
   checkSizeOf("shmProcess", sizeof(shmProcess));
   checkSizeOf("shmService", sizeof(shmService));
+  checkSizeOf("shmSharedCacheHeader", sizeof(shmSharedCacheHeader));
+  checkSizeOf("shmSharedCacheEntry", sizeof(shmSharedCacheEntry));
 
   checkOffsetOf("shmConfig,_maximumRequests", offsetof(shmConfig,_maximumRequests));
   checkOffsetOf("shmConfig,_recorderPrefix", offsetof(shmConfig,_recorderPrefix));
+  checkOffsetOf("shmConfig,_sharedCacheSize", offsetof(shmConfig,_sharedCacheSize));
+  checkOffsetOf("shmConfig,_recorderSlotSize", offsetof(shmConfig,_recorderSlotSize));
+  checkOffsetOf("shmConfig,_slowRequestPermille", offsetof(shmConfig,_slowRequestPermille));
 
   checkOffsetOf("shmThread,_firstActive", offsetof(shmThread,_firstActive));
   checkOffsetOf("shmThread,_lastActive", offsetof(shmThread,_lastActive));
@@ -49,6 +54,10 @@ main(int argc, char** argv)
   checkOffsetOf("shmService,_config", offsetof(shmService,_config));
   checkOffsetOf("shmService,_process", offsetof(shmService,_process));
 
+  checkOffsetOf("shmSharedCacheEntry,_storedMS", offsetof(shmSharedCacheEntry,_storedMS));
+  checkOffsetOf("shmSharedCacheEntry,_claim", offsetof(shmSharedCacheEntry,_claim));
+  checkOffsetOf("shmSharedCacheEntry,_data", offsetof(shmSharedCacheEntry,_data));
+
   exit(0);
 }
 
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <stdlib.h>
+
+#include <pluton/client.h>
+
+using namespace std;
+
+// Exchange batches of requests with an echo-like service, both
+// explicitly with addRequests() and implicitly via coalescing, and
+// check that each request gets its own response or fault. The faulty
+// request is identified by its context for the echo service and by
+// its data for tBatchService.
+
+static int errors = 0;
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tBatch " << err << " val=" << val << endl;
+  ++errors;
+}
+
+static const char* SK = "system.echo.0.raw";
+
+static const int maxRequests = 20;
+
+static string
+makeData(int ix)
+{
+  ostringstream os;
+  os << "batch request " << ix;
+  return string(ix * 37, 'x') + os.str();
+}
+
+static void
+check(pluton::clientRequest* R, int ix, bool expectFault)
+{
+  if (expectFault) {
+    if (R->getFaultCode() != 111) failed("expected fault 111", R->getFaultCode());
+    return;
+  }
+
+  if (R->hasFault()) {
+    failed(R->getFaultText().c_str(), R->getFaultCode());
+    return;
+  }
+
+  string rd;
+  R->getResponseData(rd);
+  if (rd != makeData(ix)) failed("response data mismatch", ix);
+}
+
+int
+main(int argc, char** argv)
+{
+  const char* goodPath = 0;
+  if (argc > 1) goodPath = argv[1];
+  if (argc > 2) SK = argv[2];
+
+  pluton::client C;
+
+  if (!C.initialize(goodPath)) {
+    failed("bad return from good path");
+    cout << C.getFault().getMessage("C.initialize()") << endl;
+    exit(1);
+  }
+
+  pluton::clientRequest R[maxRequests];
+  pluton::clientRequest* RP[maxRequests];
+  string data[maxRequests];
+  for (int ix=0; ix < maxRequests; ++ix) {
+    RP[ix] = &R[ix];
+    data[ix] = makeData(ix);
+  }
+  static const string faultData = "fault";
+
+  // An explicit batch with one member that faults
+
+  for (int ix=0; ix < maxRequests; ++ix) {
+    R[ix].setRequestData((ix == 7) ? faultData : data[ix]);
+    R[ix].setContext("echo.sleepMS", (ix == 7) ? "-1" : "0");
+  }
+
+  if (!C.addRequests(SK, RP, maxRequests)) {
+    failed("bad return from addRequests");
+    cout << C.getFault().getMessage("C.addRequests()") << endl;
+    exit(1);
+  }
+
+  if (C.executeAndWaitAll() <= 0) {
+    failed("bad return from executeAndWaitAll");
+    cout << C.getFault().getMessage() << endl;
+    exit(1);
+  }
+  for (int ix=0; ix < maxRequests; ++ix) check(RP[ix], ix, ix == 7);
+
+  // Requests that need their own connection are not allowed
+
+  R[0].setAttribute(pluton::noWaitAttr);
+  if (C.addRequests(SK, RP, 2)) failed("addRequests accepted noWaitAttr");
+  if (C.getFault().getFaultCode() != pluton::batchNotAllowed) {
+    failed("expected batchNotAllowed", C.getFault().getFaultCode());
+  }
+  R[0].clearAttribute(pluton::noWaitAttr);
+
+  // Coalesced batches of up to six, completed one at a time
+
+  C.setBatchCoalescing(6);
+  for (int ix=0; ix < maxRequests; ++ix) {
+    R[ix].setRequestData(data[ix]);
+    R[ix].setContext("echo.sleepMS", "0");
+    if (!C.addRequest(SK, R[ix])) {
+      failed("bad return from addRequest", ix);
+      cout << C.getFault().getMessage("C.addRequest()") << endl;
+      exit(1);
+    }
+  }
+
+  int count = 0;
+  pluton::clientRequest* doneR;
+  while ((doneR = C.executeAndWaitAny())) {
+    check(doneR, doneR - R, false);
+    ++count;
+  }
+  if (count != maxRequests) failed("executeAndWaitAny count", count);
+
+  // And after a reset everything goes individually again
+
+  C.setBatchCoalescing(0);
+  for (int ix=0; ix < 3; ++ix) {
+    R[ix].setRequestData(data[ix]);
+    C.addRequest(SK, R[ix]);
+  }
+  C.executeAndWaitAll();
+  for (int ix=0; ix < 3; ++ix) check(RP[ix], ix, false);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,51 @@
+#include <iostream>
+#include <string>
+
+#include <stdlib.h>
+
+#include "pluton/service.h"
+
+using namespace std;
+
+//////////////////////////////////////////////////////////////////////
+// An echo service that takes whole batches with getRequestBatch() and
+// answers the members in reverse order to show that the order of
+// answers does not matter. A member whose data is "fault" is given
+// fault 111 to match the echo service's behaviour for tBatch.
+//////////////////////////////////////////////////////////////////////
+
+int
+main(int argc, char** argv)
+{
+  pluton::service S("tBatchService");
+
+  if (!S.initialize()) {
+    cerr << S.getFault().getMessage("tBatchService", true) << endl;
+    exit(1);
+  }
+
+  const pluton::batchRequest* batch;
+  int count;
+  while ((count = S.getRequestBatch(batch)) > 0) {
+    for (int ix=count-1; ix >= 0; --ix) {
+      string data(batch[ix].requestData, batch[ix].requestLength);
+      bool ok;
+      if (data == "fault") {
+	ok = S.sendBatchFault(ix, 111, "faulty batch member");
+      }
+      else {
+	ok = S.sendBatchResponse(ix, batch[ix].requestData, batch[ix].requestLength);
+      }
+      if (!ok) {
+	clog << "Error: " << S.getFault().getMessage() << endl;
+	break;
+      }
+    }
+  }
+
+  if (S.hasFault()) clog << "Error: " << S.getFault().getMessage() << endl;
+
+  S.terminate();
+
+  return 0;
+}
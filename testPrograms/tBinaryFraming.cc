@@ -0,0 +1,155 @@
+#include <iostream>
+#include <string>
+
+#include <stdlib.h>
+
+#include <pluton/client.h>
+
+using namespace std;
+
+// Exchange requests with the echo service with binary framing offered
+// and check that data, context and faults all survive. Requests with
+// affinity re-use the connection, so after the first response they
+// are sent binary framed as well. Batches and zero-copy transfers are
+// mixed in as they assemble packets differently.
+
+static int errors = 0;
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tBinaryFraming " << err << " val=" << val << endl;
+  ++errors;
+}
+
+static const char* SK = "system.echo.0.raw";
+
+static string
+makeData(int length)
+{
+  string data;
+  data.reserve(length);
+  for (int ix=0; ix < length; ++ix) data.append(1, (char) (ix * 7));	// All byte values
+
+  return data;
+}
+
+static void
+check(pluton::clientRequest& R, const string& data, const char* what, long val)
+{
+  if (R.hasFault()) {
+    failed(R.getFaultText().c_str(), R.getFaultCode());
+    return;
+  }
+
+  string rd;
+  R.getResponseData(rd);
+  if (rd != data) failed(what, val);
+}
+
+static void
+exchange(pluton::client& C, pluton::clientRequest& R, int length)
+{
+  string data = makeData(length);
+  R.setRequestData(data);
+  R.setContext("echo.sleepMS", "0");
+
+  if (!C.addRequest(SK, R)) {
+    failed("bad return from addRequest", length);
+    cout << C.getFault().getMessage("C.addRequest()") << endl;
+    exit(1);
+  }
+
+  if (C.executeAndWaitOne(R) <= 0) {
+    failed("bad return from executeAndWaitOne()", length);
+    cout << C.getFault().getMessage() << endl;
+    exit(1);
+  }
+  check(R, data, "response data mismatch", length);
+}
+
+int
+main(int argc, char** argv)
+{
+  const char* goodPath = 0;
+  if (argc > 1) goodPath = argv[1];
+
+  pluton::client C;
+
+  if (!C.initialize(goodPath)) {
+    failed("bad return from good path");
+    cout << C.getFault().getMessage("C.initialize()") << endl;
+    exit(1);
+  }
+
+  C.setBinaryFraming(true);
+
+  // Lengths either side of the varint byte boundaries
+
+  static const int lengths[] = { 0, 1, 127, 128, 16383, 16384, 100000, 2100000 };
+  for (unsigned int lx=0; lx < sizeof(lengths)/sizeof(lengths[0]); ++lx) {
+    pluton::clientRequest R;
+    exchange(C, R, lengths[lx]);
+  }
+
+  // A fault comes back intact
+
+  {
+    pluton::clientRequest R;
+    R.setRequestData("fault");
+    R.setContext("echo.sleepMS", "-1");
+    C.addRequest(SK, R);
+    C.executeAndWaitOne(R);
+    if (R.getFaultCode() != 111) failed("expected fault 111", R.getFaultCode());
+  }
+
+  // Affinity: the second and subsequent requests go binary framed
+
+  {
+    pluton::clientRequest R;
+    R.setAttribute(pluton::keepAffinityAttr | pluton::noRetryAttr);
+    for (int ix=0; ix < 10; ++ix) exchange(C, R, ix * 1000);
+    R.clearAttribute(pluton::keepAffinityAttr);
+    exchange(C, R, 10);
+  }
+
+  // Batches and zero-copy
+
+  {
+    static const int batchSize = 8;
+    pluton::clientRequest R[batchSize];
+    pluton::clientRequest* RP[batchSize];
+    string data[batchSize];
+    for (int ix=0; ix < batchSize; ++ix) {
+      RP[ix] = &R[ix];
+      data[ix] = makeData(ix * 300);
+      R[ix].setRequestData(data[ix]);
+      R[ix].setContext("echo.sleepMS", "0");
+    }
+    if (!C.addRequests(SK, RP, batchSize)) {
+      failed("bad return from addRequests");
+      cout << C.getFault().getMessage("C.addRequests()") << endl;
+      exit(1);
+    }
+    C.executeAndWaitAll();
+    for (int ix=0; ix < batchSize; ++ix) check(R[ix], data[ix], "batch data mismatch", ix);
+  }
+
+  C.setZeroCopyThreshold(64 * 1024);
+  {
+    pluton::clientRequest R;
+    exchange(C, R, 1000);
+    exchange(C, R, 1000000);
+  }
+  C.setZeroCopyThreshold(0);
+
+  // And turning it off again
+
+  C.setBinaryFraming(false);
+  {
+    pluton::clientRequest R;
+    exchange(C, R, 5000);
+  }
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,656 @@
+#include <iostream>
+#include <iomanip>
+#include <queue>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "calibrationPolicy.h"
+#include "latencyHistogram.h"
+#include "loadDistribution.h"
+
+using namespace std;
+
+// A discrete-event simulator for the manager's process calibration
+// policy. Synthetic arrivals queue on a simulated listen socket and
+// are served by simulated processes that take time to start, report
+// every fifteen requests and exit when told to or after a maximum
+// number of requests. The service side mirrors service::run() - it
+// calibrates after every report and after five seconds without one -
+// and acts on the decisions of util::calibrationPolicy exactly as
+// service::calibrateProcesses() does.
+//
+// Time is virtual and the random sequence is seeded, so a given set
+// of options always produces the same trajectory. Thousands of
+// simulated hours take well under a minute at moderate request rates.
+
+static const char* usage =
+"\n"
+"Usage: tCalibrationSim [-hv] [-H hours] [-I seconds] [-S seed]\n"
+"                       [-r rate] [-R peakRate] [-p periodSeconds]\n"
+"                       [-s serviceMS] [-d startMS] [-b listenQueue]\n"
+"                       [-o occupancy] [-m minimum] [-M maximum]\n"
+"                       [-i idleTimeout] [-q maximumRequests]\n"
+"                       [-L p99MS] [-A averageProcesses]\n"
+"\n"
+"Simulate the process calibration policy against a synthetic workload.\n"
+"\n"
+" -h     Print usage and exit\n"
+" -v     Print every calibration decision\n"
+"\n"
+" -H     Simulated hours to run (default: 24)\n"
+" -I     Seconds between trajectory lines (default: 3600)\n"
+" -S     Random seed (default: 1)\n"
+"\n"
+" -r     Poisson arrival rate per second (default: 50)\n"
+" -R     Peak arrival rate. With -p the rate follows a sinusoid\n"
+"        between -r and -R (default: same as -r)\n"
+" -p     Period of the sinusoid in seconds (default: 86400)\n"
+" -s     Service time distribution in milliseconds (default: lognormal:20,0.6)\n"
+" -d     Process start delay distribution in milliseconds (default: fixed:500)\n"
+" -b     Listen queue length, arrivals beyond this are rejected (default: 128)\n"
+"\n"
+" -o     occupancy-percent (default: 70)\n"
+" -m     minimum-processes (default: 1)\n"
+" -M     maximum-processes (default: 40)\n"
+" -i     idle-timeout seconds (default: 60)\n"
+" -q     maximum-requests per process, zero means unlimited (default: 0)\n"
+"\n"
+" -L     Fail if the overall 99th percentile latency exceeds this many ms\n"
+" -A     Fail if the time-averaged process count exceeds this\n"
+"\n"
+"Distributions are as for loadSimulator. Exit status is non-zero if the\n"
+"simulated service breaks a policy invariant or a -L/-A check.\n"
+"\n";
+
+
+//////////////////////////////////////////////////////////////////////
+// Simulation state
+//////////////////////////////////////////////////////////////////////
+
+typedef long long vtime;		// Virtual microseconds
+
+static const int reportEntries = 15;	// Same as reportingChannel::maximumPerformanceEntries
+static const vtime pollInterval = 5 * util::MICROSECOND;
+
+enum eventType { arrivalEvent, readyEvent, completeEvent, offTimerEvent, intervalEvent };
+
+class event {
+public:
+  vtime		when;
+  long		sequence;		// Keeps same-time events in FIFO order
+  eventType	type;
+  int		id;
+
+  bool operator<(const event& rhs) const {	// For a min-heap
+    if (when != rhs.when) return when > rhs.when;
+    return sequence > rhs.sequence;
+  }
+};
+
+enum processState { starting, idle, busy, gone };
+
+class simProcess {
+public:
+  processState	state;
+  bool		shutdown;
+  long		requests;
+  int		entries;
+  vtime		arrivalTime;		// Of the request being served
+  vtime		serviceTime;
+};
+
+static priority_queue<event>	events;
+static long			sequence = 0;
+
+static vector<simProcess>	processes;
+static vector<int>		idleList;
+static deque<vtime>		listenQueue;
+
+static util::calibrationPolicy	policy;
+static util::calibrationPolicy::inputs config;
+
+static vtime	now = 0;
+static vtime	offTimerDue = 0;
+static time_t	lastPerformanceReport = 0;
+static long long activeuSecs = 0;	// Aggregate since the last sample period
+static int	activeProcessCount = 0;
+static unsigned short xsubi[3];
+
+static util::loadDistribution	serviceDist;
+static util::loadDistribution	startDist;
+static int	listenQueueLength = 128;
+static long	maximumRequests = 0;
+static bool	verboseFlag = false;
+static int	errors = 0;
+
+// Trajectory accumulators, per interval and overall
+
+class intervalStats {
+public:
+  intervalStats() { reset(); }
+  void reset() {
+    arrivals = completed = rejected = starts = exits = 0;
+    maxQueue = 0; queueIntegral = processIntegral = 0;
+    minProcesses = maxProcesses = activeProcessCount;
+    latency.reset();
+  }
+
+  long	arrivals;
+  long	completed;
+  long	rejected;
+  long	starts;
+  long	exits;
+  int	maxQueue;
+  int	minProcesses;
+  int	maxProcesses;
+  double queueIntegral;			// Length * uSecs
+  double processIntegral;
+  util::latencyHistogram latency;
+};
+
+static intervalStats	interval;
+static intervalStats	overall;
+static vtime		lastAccounted = 0;
+
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tCalibrationSim " << err << " val=" << val << " at " << now / util::MICROSECOND << endl;
+  ++errors;
+}
+
+static void
+schedule(vtime when, eventType type, int id=0)
+{
+  event e;
+  e.when = when;
+  e.sequence = sequence++;
+  e.type = type;
+  e.id = id;
+  events.push(e);
+}
+
+static vtime
+sampleMS(const util::loadDistribution& ld)
+{
+  double ms = ld.sample(xsubi);
+  if (ms < 0) ms = 0;
+  return static_cast<vtime>(ms * 1000);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Integrate the queue length and process count over time so the
+// trajectory reports time-weighted averages.
+//////////////////////////////////////////////////////////////////////
+
+static void
+account()
+{
+  double elapsed = now - lastAccounted;
+  interval.queueIntegral += elapsed * listenQueue.size();
+  interval.processIntegral += elapsed * activeProcessCount;
+  overall.queueIntegral += elapsed * listenQueue.size();
+  overall.processIntegral += elapsed * activeProcessCount;
+  lastAccounted = now;
+}
+
+static void
+trackProcessCount()
+{
+  if (activeProcessCount < interval.minProcesses) interval.minProcesses = activeProcessCount;
+  if (activeProcessCount > interval.maxProcesses) interval.maxProcesses = activeProcessCount;
+  if (activeProcessCount < overall.minProcesses) overall.minProcesses = activeProcessCount;
+  if (activeProcessCount > overall.maxProcesses) overall.maxProcesses = activeProcessCount;
+
+  if (activeProcessCount < 0) failed("negative process count", activeProcessCount);
+  if (activeProcessCount > config.maximumProcesses) {
+    failed("process count exceeds maximum", activeProcessCount);
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The process side: start, serve and exit.
+//////////////////////////////////////////////////////////////////////
+
+static bool
+createProcess()
+{
+  if (activeProcessCount >= config.maximumProcesses) return false;	// No unused ids
+
+  int id;
+  for (id=0; id < static_cast<int>(processes.size()); ++id) {
+    if (processes[id].state == gone) break;
+  }
+  if (id == static_cast<int>(processes.size())) processes.push_back(simProcess());
+
+  simProcess& P = processes[id];
+  P.state = starting;
+  P.shutdown = false;
+  P.requests = 0;
+  P.entries = 0;
+
+  ++activeProcessCount;
+  ++interval.starts;
+  ++overall.starts;
+  trackProcessCount();
+
+  schedule(now + sampleMS(startDist), readyEvent, id);
+
+  return true;
+}
+
+static void
+exitProcess(int id)
+{
+  processes[id].state = gone;
+  --activeProcessCount;
+  ++interval.exits;
+  ++overall.exits;
+  trackProcessCount();
+}
+
+static void
+dispatch()
+{
+  while (!listenQueue.empty() && !idleList.empty()) {
+    int id = idleList.back();
+    idleList.pop_back();
+
+    simProcess& P = processes[id];
+    P.state = busy;
+    P.arrivalTime = listenQueue.front();
+    P.serviceTime = sampleMS(serviceDist);
+    listenQueue.pop_front();
+
+    schedule(now + P.serviceTime, completeEvent, id);
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The service side: act on the policy's decisions the same way
+// service::calibrateProcesses() does. The oldest process is the one
+// that has handled the most requests.
+//////////////////////////////////////////////////////////////////////
+
+static void
+removeOldestProcess()
+{
+  int oldest = -1;
+  for (int ix=0; ix < static_cast<int>(processes.size()); ++ix) {
+    const simProcess& P = processes[ix];
+    if ((P.state == gone) || P.shutdown) continue;
+    if ((oldest == -1) || (P.requests > processes[oldest].requests)) oldest = ix;
+  }
+  if (oldest == -1) return;
+
+  processes[oldest].shutdown = true;
+  if (processes[oldest].state != idle) return;	// Exits when ready or done
+
+  for (vector<int>::iterator ix=idleList.begin(); ix != idleList.end(); ++ix) {
+    if (*ix == oldest) {
+      idleList.erase(ix);
+      break;
+    }
+  }
+  exitProcess(oldest);
+}
+
+static void
+calibrate(const char* why, bool decreaseOkFlag, bool increaseToMinimumOkFlag)
+{
+  util::calibrationPolicy::inputs in = config;
+  in.now = now / util::MICROSECOND;
+  in.listenBacklog = listenQueue.size();
+  in.activeProcessCount = activeProcessCount;
+  in.activeuSecs = activeuSecs;
+  in.lastPerformanceReport = lastPerformanceReport;
+  in.decreaseOkFlag = decreaseOkFlag;
+  in.increaseToMinimumOkFlag = increaseToMinimumOkFlag;
+
+  util::calibrationPolicy::decision d = policy.calibrate(in);
+
+  if (verboseFlag && (d.what != util::calibrationPolicy::noAction)) {
+    cout << "T=" << in.now << " " << why
+	 << " " << util::calibrationPolicy::actionToEnglish(d.what)
+	 << " count=" << d.count
+	 << " apc=" << activeProcessCount
+	 << " LQ=" << in.listenBacklog
+	 << " occ=" << (int) d.currOccupancy << "/" << (int) d.prevOccupancy
+	 << endl;
+  }
+
+  switch (d.what) {
+  case util::calibrationPolicy::noAction:
+    break;
+
+  case util::calibrationPolicy::createMinimum:
+  case util::calibrationPolicy::createIncrease:
+    while (d.count-- > 0) {
+      if (!createProcess()) break;
+    }
+    break;
+
+  case util::calibrationPolicy::removeExcess:
+  case util::calibrationPolicy::removeIdle:
+    removeOldestProcess();
+    break;
+  }
+
+  if (d.sampled) activeuSecs = 0;
+}
+
+// Mirror the service::run() poll loop: calibrate after five seconds
+// without a report, but only while processes are running.
+
+static void
+resetOffTimer()
+{
+  offTimerDue = now + pollInterval;
+  schedule(offTimerDue, offTimerEvent);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Arrival rate, possibly following a sinusoid between the base and
+// peak rates. Non-homogeneous arrivals are generated by thinning a
+// Poisson process running at the peak rate.
+//////////////////////////////////////////////////////////////////////
+
+static double	baseRate = 50;
+static double	peakRate = -1;
+static double	period = 86400;
+
+static double
+rateAt(vtime t)
+{
+  if (peakRate <= baseRate) return baseRate;
+  double phase = 2 * M_PI * (t / static_cast<double>(util::MICROSECOND)) / period;
+  return baseRate + (peakRate - baseRate) * (1 - cos(phase)) / 2;
+}
+
+static void
+scheduleArrival()
+{
+  double maxRate = (peakRate > baseRate) ? peakRate : baseRate;
+  if (maxRate <= 0) return;
+
+  vtime t = now;
+  do {
+    t += static_cast<vtime>(-log(1 - erand48(xsubi)) / maxRate * util::MICROSECOND);
+  } while (erand48(xsubi) * maxRate > rateAt(t));
+
+  schedule(t, arrivalEvent);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Event handlers
+//////////////////////////////////////////////////////////////////////
+
+static void
+arrival()
+{
+  ++interval.arrivals;
+  ++overall.arrivals;
+  scheduleArrival();
+
+  if (static_cast<int>(listenQueue.size()) >= listenQueueLength) {
+    ++interval.rejected;
+    ++overall.rejected;
+    return;
+  }
+  listenQueue.push_back(now);
+  if (static_cast<int>(listenQueue.size()) > interval.maxQueue) interval.maxQueue = listenQueue.size();
+  if (static_cast<int>(listenQueue.size()) > overall.maxQueue) overall.maxQueue = listenQueue.size();
+
+  dispatch();
+}
+
+// With no processes the service listens on the accept socket itself
+// and creates a process as soon as a connection is pending.
+
+static void
+listenForAccept()
+{
+  if ((activeProcessCount == 0) && !listenQueue.empty() && createProcess()) resetOffTimer();
+}
+
+static void
+ready(int id)
+{
+  simProcess& P = processes[id];
+  if (P.shutdown) {
+    exitProcess(id);
+    return;
+  }
+  P.state = idle;
+  idleList.push_back(id);
+  dispatch();
+}
+
+static void
+complete(int id)
+{
+  simProcess& P = processes[id];
+
+  vtime latency = now - P.arrivalTime;
+  interval.latency.add(latency);
+  overall.latency.add(latency);
+  ++interval.completed;
+  ++overall.completed;
+
+  activeuSecs += P.serviceTime;
+  ++P.requests;
+
+  bool exiting = P.shutdown || ((maximumRequests > 0) && (P.requests >= maximumRequests));
+
+  if (++P.entries == reportEntries) {
+    P.entries = 0;
+    lastPerformanceReport = now / util::MICROSECOND;
+    calibrate("report", true, true);
+    resetOffTimer();
+  }
+  else if (exiting) {				// Final partial report
+    P.entries = 0;
+    calibrate("report", true, false);
+    resetOffTimer();
+  }
+
+  if (exiting || P.shutdown) {			// Calibration may have picked this one
+    exitProcess(id);
+    dispatch();
+    return;
+  }
+
+  P.state = idle;
+  idleList.push_back(id);
+  dispatch();
+}
+
+static void
+offTimer(vtime when)
+{
+  if (when != offTimerDue) return;		// Superseded by a report
+  if (activeProcessCount == 0) return;		// Back to listening
+
+  calibrate("offTimer", true, false);
+  resetOffTimer();
+}
+
+static void
+printHeader()
+{
+  cout << setw(8) << "Hour"
+       << setw(11) << "Arrive"
+       << setw(10) << "Reject"
+       << setw(9) << "Mean(ms)"
+       << setw(9) << "P99(ms)"
+       << setw(7) << "AvgQ"
+       << setw(7) << "MaxQ"
+       << setw(7) << "AvgP"
+       << setw(5) << "MinP"
+       << setw(5) << "MaxP"
+       << setw(7) << "Starts"
+       << setw(7) << "Exits"
+       << endl;
+}
+
+static void
+printInterval(const intervalStats& s, vtime elapsed, double hour)
+{
+  if (elapsed <= 0) elapsed = 1;
+  cout << setw(8) << fixed << setprecision(2) << hour
+       << setw(11) << s.arrivals
+       << setw(10) << s.rejected
+       << setw(9) << setprecision(1) << s.latency.getMean() / 1000.0
+       << setw(9) << s.latency.getPercentile(99) / 1000.0
+       << setw(7) << setprecision(2) << s.queueIntegral / elapsed
+       << setw(7) << s.maxQueue
+       << setw(7) << s.processIntegral / elapsed
+       << setw(5) << s.minProcesses
+       << setw(5) << s.maxProcesses
+       << setw(7) << s.starts
+       << setw(7) << s.exits
+       << endl;
+}
+
+
+int
+main(int argc, char** argv)
+{
+  double hours = 24;
+  long intervalSeconds = 3600;
+  long seed = 1;
+  double p99Limit = 0;
+  double averageLimit = 0;
+  string serviceSpec = "lognormal:20,0.6";
+  string startSpec = "fixed:500";
+
+  config.occupancyPercent = 70;
+  config.minimumProcesses = 1;
+  config.maximumProcesses = 40;
+  config.idleTimeout = 60;
+
+  char	optionChar;
+  while ((optionChar = getopt(argc, argv, "hvA:b:d:H:i:I:L:m:M:o:p:q:r:R:s:S:")) != -1) {
+    switch (optionChar) {
+    case 'A': averageLimit = atof(optarg); break;
+    case 'b': listenQueueLength = atoi(optarg); break;
+    case 'd': startSpec = optarg; break;
+    case 'H': hours = atof(optarg); break;
+    case 'i': config.idleTimeout = atol(optarg); break;
+    case 'I': intervalSeconds = atol(optarg); break;
+    case 'L': p99Limit = atof(optarg); break;
+    case 'm': config.minimumProcesses = atol(optarg); break;
+    case 'M': config.maximumProcesses = atol(optarg); break;
+    case 'o': config.occupancyPercent = atol(optarg); break;
+    case 'p': period = atof(optarg); break;
+    case 'q': maximumRequests = atol(optarg); break;
+    case 'r': baseRate = atof(optarg); break;
+    case 'R': peakRate = atof(optarg); break;
+    case 's': serviceSpec = optarg; break;
+    case 'S': seed = atol(optarg); break;
+    case 'v': verboseFlag = true; break;
+
+    case 'h':
+      cout << usage;
+      exit(0);
+
+    default:
+      cerr << usage;
+      exit(1);
+    }
+  }
+
+  string em;
+  if (!serviceDist.parse(serviceSpec, em) || !startDist.parse(startSpec, em)) {
+    cerr << "Error: tCalibrationSim: " << em << endl;
+    exit(1);
+  }
+  if ((hours <= 0) || (intervalSeconds <= 0) || (period <= 0) || (listenQueueLength < 0) ||
+      (config.maximumProcesses < 1) || (config.minimumProcesses > config.maximumProcesses)) {
+    cerr << usage;
+    exit(1);
+  }
+
+  xsubi[0] = 0x330E;
+  xsubi[1] = seed & 0xFFFF;
+  xsubi[2] = (seed >> 16) & 0xFFFF;
+
+  vtime endTime = static_cast<vtime>(hours * 3600 * util::MICROSECOND);
+  vtime intervalLength = intervalSeconds * util::MICROSECOND;
+  vtime intervalStart = 0;
+
+  cout << "Simulate " << hours << " hours: rate=" << baseRate;
+  if (peakRate > baseRate) cout << "-" << peakRate << "/" << period << "s";
+  cout << " service=" << serviceSpec << " start=" << startSpec
+       << " occupancy=" << config.occupancyPercent
+       << " min=" << config.minimumProcesses << " max=" << config.maximumProcesses
+       << " idle=" << config.idleTimeout << endl;
+  printHeader();
+
+  interval.reset();
+  overall.reset();
+  scheduleArrival();
+  schedule(intervalLength, intervalEvent);
+
+  time_t wallStart = time(0);
+  long eventCount = 0;
+
+  while (!events.empty()) {
+    event e = events.top();
+    if (e.when > endTime) break;
+    events.pop();
+    ++eventCount;
+
+    now = e.when;
+    account();
+
+    switch (e.type) {
+    case arrivalEvent: arrival(); break;
+    case readyEvent: ready(e.id); break;
+    case completeEvent: complete(e.id); break;
+    case offTimerEvent: offTimer(e.when); break;
+
+    case intervalEvent:
+      printInterval(interval, now - intervalStart, now / 3600.0 / util::MICROSECOND);
+      interval.reset();
+      intervalStart = now;
+      schedule(now + intervalLength, intervalEvent);
+      break;
+    }
+
+    listenForAccept();
+  }
+
+  now = endTime;
+  account();
+  if (now > intervalStart) printInterval(interval, now - intervalStart, hours);
+
+  cout << "Overall:" << endl;
+  printHeader();
+  printInterval(overall, endTime, hours);
+  overall.latency.printSummary(cout);
+  cout << endl;
+  cout << "Events: " << eventCount << " in " << time(0) - wallStart << "s" << endl;
+
+  double p99 = overall.latency.getPercentile(99) / 1000.0;
+  double averageProcesses = overall.processIntegral / endTime;
+  if ((p99Limit > 0) && (p99 > p99Limit)) failed("p99 latency exceeds -L", (long) p99);
+  if ((averageLimit > 0) && (averageProcesses > averageLimit)) {
+    failed("average processes exceeds -A", (long) averageProcesses);
+  }
+
+  return errors ? 1 : 0;
+}
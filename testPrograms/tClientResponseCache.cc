@@ -0,0 +1,140 @@
+#include <iostream>
+
+#include <sys/time.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <pluton/client.h>
+
+using namespace std;
+
+// Exercise the client response cache. The echo service marks a
+// response as cacheable if the request has an echo.cacheMS context.
+
+static int errors = 0;
+
+static void
+failed(const char* err, int val=0)
+{
+  cout << "Failed: tClientResponseCache " << err << " val=" << val << endl;
+  ++errors;
+}
+
+const char* SK = "system.echo.0.raw";
+
+static std::string
+exchange(pluton::client& C, const char* data, const char* cacheMS, const char* context=0)
+{
+  pluton::clientRequest R;
+  R.setRequestData(data);
+  if (cacheMS) R.setContext("echo.cacheMS", cacheMS);
+  if (context) R.setContext("echo.log", context);
+
+  if (!C.addRequest(SK, R)) {
+    failed("bad return from addRequest");
+    cout << C.getFault().getMessage("C.addRequest()") << endl;
+    exit(1);
+  }
+
+  int res = C.executeAndWaitOne(R);
+  if (res <= 0) {
+    failed("bad return from executeAndWaitOne()", res);
+    cout << C.getFault().getMessage() << endl;
+    exit(1);
+  }
+
+  if (R.hasFault()) failed(R.getFaultText().c_str(), R.getFaultCode());
+
+  std::string resp;
+  R.getResponseData(resp);
+  if (resp != data) failed("Response mismatch", resp.length());
+
+  return resp;
+}
+
+static void
+checkStats(pluton::client& C, const char* who, unsigned long hits, unsigned long misses)
+{
+  pluton::responseCacheStats stats;
+  C.getResponseCacheStats(stats);
+  cout << who << ": hits=" << stats.hits << " misses=" << stats.misses
+       << " inserts=" << stats.inserts << " entries=" << stats.entries
+       << " bytes=" << stats.bytes << " evictions=" << stats.evictions
+       << " expirations=" << stats.expirations << endl;
+
+  if (stats.hits != hits) failed(who, stats.hits);
+  if (stats.misses != misses) failed(who, stats.misses);
+}
+
+
+int
+main(int argc, char** argv)
+{
+  const char* goodPath = 0;
+  if (argc > 1) goodPath = argv[1];
+
+  pluton::client C;
+
+  if (!C.initialize(goodPath)) {
+    failed("bad return from good path");
+    cout << C.getFault().getMessage("C.initialize()") << endl;
+    exit(1);
+  }
+
+  // Without a cache size, nothing is cached
+
+  exchange(C, "one", "10000");
+  exchange(C, "one", "10000");
+  checkStats(C, "disabled", 0, 0);
+
+  C.setResponseCacheSize(100 * 1024);
+
+  // Non-cacheable responses are never hits
+
+  exchange(C, "two", 0);
+  exchange(C, "two", 0);
+  checkStats(C, "not cacheable", 0, 2);
+
+  // The first is a miss, the rest are hits
+
+  exchange(C, "three", "10000");
+  checkStats(C, "cacheable miss", 0, 3);
+  exchange(C, "three", "10000");
+  checkStats(C, "cacheable hit", 1, 3);
+  exchange(C, "three", "10000");
+  checkStats(C, "cacheable", 2, 3);
+
+  // Context is part of the key
+
+  exchange(C, "three", "10000", "yes");
+  checkStats(C, "context", 2, 4);
+
+  // Entries expire
+
+  exchange(C, "four", "200");
+  usleep(300 * 1000);
+  exchange(C, "four", "200");
+  checkStats(C, "expire", 2, 6);
+
+  // LRU eviction keeps the cache within bounds
+
+  C.setResponseCacheSize(2000);
+  std::string big(700, 'x');
+  exchange(C, big.c_str(), "10000");
+  exchange(C, (big + "y").c_str(), "10000");
+  exchange(C, (big + "z").c_str(), "10000");
+
+  pluton::responseCacheStats stats;
+  C.getResponseCacheStats(stats);
+  if (stats.bytes > 2000) failed("Cache exceeded maximum", stats.bytes);
+  if (stats.evictions == 0) failed("No evictions", stats.evictions);
+
+  // A zero size disables and flushes the cache
+
+  C.setResponseCacheSize(0);
+  C.getResponseCacheStats(stats);
+  if (stats.entries != 0) failed("Entries remain after disable", stats.entries);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <vector>
+
+#include <sys/time.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <pluton/client.h>
+
+using namespace std;
+
+// Check the per-request stage timings and the per-service
+// histograms. The echo service is asked to sleep so that the service
+// stage dominates.
+
+static int errors = 0;
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tClientTimings " << err << " val=" << val << endl;
+  ++errors;
+}
+
+const char* SK = "system.echo.0.raw";
+
+static const char* stageNames[] = { "lookup", "connect", "write", "service", "read", "total" };
+
+int
+main(int argc, char** argv)
+{
+  const char* goodPath = 0;
+  if (argc > 1) goodPath = argv[1];
+
+  pluton::client C;
+
+  if (!C.initialize(goodPath)) {
+    failed("bad return from good path");
+    cout << C.getFault().getMessage("C.initialize()") << endl;
+    exit(1);
+  }
+
+  static const int requestCount = 5;
+  for (int ix=0; ix < requestCount; ++ix) {
+    pluton::clientRequest R;
+    R.setRequestData("timing data");
+    R.setContext("echo.sleepMS", "20");
+
+    if (!C.addRequest(SK, R)) {
+      failed("bad return from addRequest");
+      cout << C.getFault().getMessage("C.addRequest()") << endl;
+      exit(1);
+    }
+
+    if (C.executeAndWaitOne(R) <= 0) {
+      failed("bad return from executeAndWaitOne()");
+      cout << C.getFault().getMessage() << endl;
+      exit(1);
+    }
+    if (R.hasFault()) failed(R.getFaultText().c_str(), R.getFaultCode());
+
+    long sum = 0;
+    for (int st=0; st < pluton::clientRequest::totalStage; ++st) {
+      long uSecs = R.getStageMicroSeconds(static_cast<pluton::clientRequest::stage>(st));
+      if (uSecs < 0) failed(stageNames[st], uSecs);
+      sum += uSecs;
+    }
+
+    long service = R.getStageMicroSeconds(pluton::clientRequest::serviceStage);
+    long total = R.getStageMicroSeconds(pluton::clientRequest::totalStage);
+    if (service < 20000) failed("service stage shorter than sleep", service);
+    if (total < service) failed("total less than service stage", total);
+    if (sum > total) failed("stages exceed total", sum - total);
+  }
+
+  // An unknown Service Key has no stats, a known one does
+
+  pluton::clientTimingStats ts;
+  if (C.getTimingStats("system.nosuchservice.0.raw", ts)) failed("stats for unknown service");
+
+  vector<string> keys;
+  C.getTimingServiceKeys(keys);
+  if (keys.size() != 1) failed("service key count", keys.size());
+
+  if (!C.getTimingStats(SK, ts)) {
+    failed("no stats for service");
+    exit(1);
+  }
+
+  if (ts.requests != requestCount) failed("request count", ts.requests);
+  if (ts.faults != 0) failed("fault count", ts.faults);
+
+  for (int st=0; st < pluton::clientRequest::stageCount; ++st) {
+    const pluton::clientStageHistogram& sh = ts.stage[st];
+    unsigned long bucketSum = 0;
+    for (int bx=0; bx < pluton::clientStageHistogram::bucketCount; ++bx) bucketSum += sh.bucket[bx];
+    if (bucketSum != sh.count) failed(stageNames[st], bucketSum);
+    if (sh.count > 0) {
+      cout << stageNames[st] << ": count=" << sh.count
+	   << " mean=" << sh.totaluSecs / sh.count << "us max=" << sh.maximumuSecs << "us" << endl;
+    }
+  }
+
+  if (ts.stage[pluton::clientRequest::serviceStage].count != requestCount) {
+    failed("service stage count", ts.stage[pluton::clientRequest::serviceStage].count);
+  }
+
+  C.resetTimingStats();
+  if (C.getTimingStats(SK, ts)) failed("stats remain after reset");
+
+  return errors ? 1 : 0;
+}
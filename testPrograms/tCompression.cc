@@ -0,0 +1,213 @@
+#include <iostream>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pluton/client.h>
+
+using namespace std;
+
+// Exchange compressible and incompressible data with the echo service
+// with compression offered and check that the data survives and that
+// the stats show compression happening when, and only when, it
+// should. Requests with affinity have their request data compressed
+// once the service has said it can decompress. Zero-copy takes
+// precedence and batches are never compressed.
+
+static int errors = 0;
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tCompression " << err << " val=" << val << endl;
+  ++errors;
+}
+
+static const char* SK = "system.echo.0.raw";
+
+static string
+makeData(int length, bool compressible)
+{
+  string data;
+  data.reserve(length);
+  unsigned int seed = length;
+  char buf[20];
+  while ((int) data.length() < length) {
+    if (compressible) {
+      sprintf(buf, "line %d ", (int) data.length() / 100);
+      data.append(buf);
+    }
+    else {
+      seed = seed * 1103515245 + 12345;
+      data.append(1, (char) (seed >> 16));
+    }
+  }
+  data.resize(length);
+
+  return data;
+}
+
+static pluton::compressionStats
+stats(pluton::client& C)
+{
+  pluton::compressionStats s;
+  C.getCompressionStats(s);
+
+  return s;
+}
+
+static void
+exchange(pluton::client& C, pluton::clientRequest& R, int length, bool compressible=true)
+{
+  string data = makeData(length, compressible);
+  R.setRequestData(data);
+  R.setContext("echo.sleepMS", "0");
+
+  if (!C.addRequest(SK, R)) {
+    failed("bad return from addRequest", length);
+    cout << C.getFault().getMessage("C.addRequest()") << endl;
+    exit(1);
+  }
+
+  if (C.executeAndWaitOne(R) <= 0) {
+    failed("bad return from executeAndWaitOne()", length);
+    cout << C.getFault().getMessage() << endl;
+    exit(1);
+  }
+
+  if (R.hasFault()) {
+    failed(R.getFaultText().c_str(), R.getFaultCode());
+    return;
+  }
+
+  string rd;
+  R.getResponseData(rd);
+  if (rd != data) failed("response data mismatch", length);
+}
+
+int
+main(int argc, char** argv)
+{
+  const char* goodPath = 0;
+  if (argc > 1) goodPath = argv[1];
+
+  pluton::client C;
+
+  if (!C.initialize(goodPath)) {
+    failed("bad return from good path");
+    cout << C.getFault().getMessage("C.initialize()") << endl;
+    exit(1);
+  }
+
+  C.setCompression(pluton::zlibCompression, 1000);
+
+  // Responses below the threshold go as is
+
+  {
+    pluton::clientRequest R;
+    exchange(C, R, 0);
+    exchange(C, R, 10);
+    exchange(C, R, 999);
+    if (stats(C).decompressed != 0) failed("small response compressed", stats(C).decompressed);
+  }
+
+  // Those at or above it are compressed
+
+  static const int lengths[] = { 1000, 5000, 100000, 2000000 };
+  for (unsigned int lx=0; lx < sizeof(lengths)/sizeof(lengths[0]); ++lx) {
+    pluton::clientRequest R;
+    unsigned long before = stats(C).decompressed;
+    exchange(C, R, lengths[lx]);
+    if (stats(C).decompressed != before + 1) failed("response not compressed", lengths[lx]);
+  }
+
+  pluton::compressionStats s = stats(C);
+  if ((s.compressedBytes == 0) || (s.compressedBytes * 4 > s.uncompressedBytes)) {
+    failed("poor compression ratio", (long) s.compressedBytes);
+  }
+  if (s.compressed != 0) failed("request compressed without affinity", s.compressed);
+
+  // Incompressible data is sent as is
+
+  {
+    pluton::clientRequest R;
+    unsigned long before = stats(C).decompressed;
+    exchange(C, R, 100000, false);
+    if (stats(C).decompressed != before) failed("incompressible response compressed");
+  }
+
+  // Affinity: the second and subsequent requests are compressed
+
+  {
+    pluton::clientRequest R;
+    R.setAttribute(pluton::keepAffinityAttr | pluton::noRetryAttr);
+    unsigned long before = stats(C).compressed;
+    exchange(C, R, 50000);
+    if (stats(C).compressed != before) failed("first affinity request compressed");
+    for (int ix=1; ix < 5; ++ix) exchange(C, R, ix * 50000);
+    if (stats(C).compressed != before + 4) failed("affinity requests", stats(C).compressed);
+    exchange(C, R, 500);
+    exchange(C, R, 50000, false);
+    if (stats(C).compressed != before + 4) failed("small or incompressible request compressed");
+
+    C.setBinaryFraming(true);
+    exchange(C, R, 80000);
+    exchange(C, R, 80000);
+    C.setBinaryFraming(false);
+    R.clearAttribute(pluton::keepAffinityAttr);
+    exchange(C, R, 10);
+  }
+
+  // Zero-copy takes precedence
+
+  C.setZeroCopyThreshold(64 * 1024);
+  {
+    pluton::clientRequest R;
+    unsigned long before = stats(C).decompressed;
+    exchange(C, R, 1000000);
+    if (stats(C).decompressed != before) failed("zero-copy response compressed");
+    exchange(C, R, 5000);
+  }
+  C.setZeroCopyThreshold(0);
+
+  // Batch members are not compressed
+
+  {
+    static const int batchSize = 4;
+    pluton::clientRequest R[batchSize];
+    pluton::clientRequest* RP[batchSize];
+    string data[batchSize];
+    for (int ix=0; ix < batchSize; ++ix) {
+      RP[ix] = &R[ix];
+      data[ix] = makeData(2000 + ix * 3000, true);
+      R[ix].setRequestData(data[ix]);
+      R[ix].setContext("echo.sleepMS", "0");
+    }
+    if (!C.addRequests(SK, RP, batchSize)) {
+      failed("bad return from addRequests");
+      cout << C.getFault().getMessage("C.addRequests()") << endl;
+      exit(1);
+    }
+    unsigned long before = stats(C).decompressed;
+    C.executeAndWaitAll();
+    for (int ix=0; ix < batchSize; ++ix) {
+      string rd;
+      R[ix].getResponseData(rd);
+      if (rd != data[ix]) failed("batch member mismatch", ix);
+    }
+    if (stats(C).decompressed != before) failed("batch compressed");
+  }
+
+  // And turning it off again
+
+  C.setCompression(pluton::noCompression, 0);
+  {
+    pluton::clientRequest R;
+    unsigned long before = stats(C).decompressed;
+    exchange(C, R, 100000);
+    if (stats(C).decompressed != before) failed("compressed after being turned off");
+  }
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,292 @@
+#include <iostream>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "netString.h"
+#include "decodePacket.h"
+
+#include <pluton/client.h>
+
+using namespace std;
+
+// Check the framing that plTransmitter and plReceiver use to
+// multiplex requests over the one connection. Given a lookup map, a
+// plTransmitter service key and the pid of the plReceiver it relays
+// to, also check that concurrent requests of differing latency each
+// get their own response as they complete, that a request which
+// times out does not leave its late response for a later request and
+// that killing the plReceiver fails a request in flight promptly.
+
+static int errors = 0;
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tMultiplex " << err << " val=" << val << endl;
+  ++errors;
+}
+
+static long
+elapsedMS(const struct timeval& start)
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+
+  return (now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Frame two packets, feed them to a factory a few bytes at a time and
+// check that each comes back out with its tag. The packets look like
+// netStrings themselves to show that a frame does not look inside.
+//////////////////////////////////////////////////////////////////////
+
+static void
+feed(netStringFactoryManaged& nsf, const string& data)
+{
+  for (unsigned int ix=0; ix < data.length(); ix += 7) {
+    char* bufPtr;
+    int minToRead, maxToRead;
+    if (nsf.getReadParameters(bufPtr, minToRead, maxToRead) != 0) {
+      failed("getReadParameters", ix);
+      return;
+    }
+    int len = data.length() - ix;
+    if (len > 7) len = 7;
+    if (len > maxToRead) len = maxToRead;
+    memcpy(bufPtr, data.data() + ix, len);
+    nsf.addBytesRead(len);
+  }
+}
+
+static void
+roundTrip()
+{
+  static const unsigned int tags[] = { 0, 4000000000U };
+  static const char* packets[] = { "", "3:abc,0z,X" };
+
+  string stream;
+  for (int ix=0; ix < 2; ++ix) {
+    netStringGenerate pre, post;
+    pluton::decodeMultiplexFrame::assemble(tags[ix], strlen(packets[ix]), pre, post);
+    stream.append(pre.data(), pre.length());
+    stream.append(packets[ix]);
+    stream.append(post.data(), post.length());
+  }
+
+  netStringFactoryManaged nsf;
+  feed(nsf, stream);
+
+  pluton::decodeMultiplexFrame frame;
+  string em;
+  int frames = 0;
+  const char* parseError = 0;
+  while (nsf.haveNetString(parseError)) {
+    char nsType;
+    const char* nsDataPtr;
+    int nsDataLength;
+    int nsOffset;
+    nsf.getNetString(nsType, nsDataPtr, nsDataLength, &nsOffset);
+    if (!frame.addType(nsType, nsDataPtr, nsDataLength, nsOffset, em)) {
+      failed(em.c_str(), frames);
+      return;
+    }
+    if (!frame.haveCompleteFrame()) continue;
+
+    if (frames >= 2) {
+      failed("too many frames", frames);
+      return;
+    }
+    if (frame.getTag() != tags[frames]) failed("tag mismatch", frames);
+    int offset, length;
+    frame.getPacket(offset, length);
+    if (string(nsf.getBasePtr() + offset, length) != packets[frames]) {
+      failed("packet mismatch", frames);
+    }
+    ++frames;
+    frame.reset();
+  }
+  if (parseError) failed(parseError);
+  if (frames != 2) failed("frames decoded", frames);
+
+  // A frame must start with multiplexPT and must carry a packet
+
+  frame.reset();
+  if (frame.addType(pluton::requestPT, "", 0, 0, em)) failed("accepted requestPT as a frame");
+
+  frame.reset();
+  frame.addType(pluton::multiplexPT, "", 0, 0, em);
+  frame.addType(pluton::multiplexTagNT, "1", 1, 0, em);
+  if (frame.addType(pluton::endPacketNT, "", 0, 0, em)) failed("accepted a frame without a packet");
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The slowest request is sent first, so the responses can only come
+// back in latency order if they overtake each other on the
+// multiplexed connection.
+//////////////////////////////////////////////////////////////////////
+
+static void
+outOfOrder(pluton::client& C, const char* SK)
+{
+  static const int count = 5;
+  static const char* sleeps[count] = { "800", "600", "400", "200", "0" };
+
+  pluton::clientRequest R[count];
+  string data[count];
+  for (int ix=0; ix < count; ++ix) {
+    data[ix] = "request ";
+    data[ix].append(1, 'A' + ix);
+    R[ix].setRequestData(data[ix]);
+    R[ix].setContext("echo.sleepMS", sleeps[ix]);
+    R[ix].setClientHandle(&data[ix]);
+    if (!C.addRequest(SK, R[ix])) {
+      failed("bad return from addRequest", ix);
+      cout << C.getFault().getMessage("C.addRequest()") << endl;
+      exit(1);
+    }
+  }
+
+  for (int ix=count-1; ix >= 0; --ix) {
+    pluton::clientRequest* rp = C.executeAndWaitAny();
+    if (!rp) {
+      failed("executeAndWaitAny() returned nothing", ix);
+      cout << C.getFault().getMessage() << endl;
+      return;
+    }
+    if (rp->hasFault()) {
+      failed(rp->getFaultText().c_str(), rp->getFaultCode());
+      continue;
+    }
+    if (rp != &R[ix]) failed("response out of latency order", ix);
+
+    string rd;
+    rp->getResponseData(rd);
+    if (rd != *(string*) rp->getClientHandle()) failed("response went to the wrong request", ix);
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The first request times out well before the service responds. Keep
+// exchanging requests past the time its response arrives, which
+// must be discarded rather than handed to one of them.
+//////////////////////////////////////////////////////////////////////
+
+static void
+lateResponse(pluton::client& C, const char* SK)
+{
+  C.setTimeoutMilliSeconds(1000);
+
+  pluton::clientRequest R;
+  R.setRequestData("too slow");
+  R.setContext("echo.sleepMS", "2000");
+  C.addRequest(SK, R);
+  C.executeAndWaitOne(R);
+
+  // Either this client or plTransmitter can notice the timeout first
+
+  if ((R.getFaultCode() != pluton::serviceTimeout)
+      && (R.getFaultCode() != pluton::remoteTransferFailed)) {
+    failed("expected a timeout", R.getFaultCode());
+  }
+
+  C.setTimeoutMilliSeconds(4000);
+
+  for (int ix=0; ix < 4; ++ix) {
+    pluton::clientRequest R2;
+    string data = "in time ";
+    data.append(1, '0' + ix);
+    R2.setRequestData(data);
+    R2.setContext("echo.sleepMS", "400");
+    C.addRequest(SK, R2);
+    C.executeAndWaitOne(R2);
+    if (R2.hasFault()) {
+      failed(R2.getFaultText().c_str(), R2.getFaultCode());
+      continue;
+    }
+    string rd;
+    R2.getResponseData(rd);
+    if (rd != data) failed("late response delivered to a later request", ix);
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Kill the plReceiver while a request is in flight. The request must
+// fail as soon as plTransmitter sees the connection go, not when the
+// service would have answered, and plTransmitter must carry on.
+//////////////////////////////////////////////////////////////////////
+
+static void
+receiverKilled(pluton::client& C, const char* SK, pid_t receiverPid)
+{
+  pid_t child = fork();
+  if (child == 0) {
+    usleep(300 * 1000);
+    kill(receiverPid, SIGKILL);
+    _exit(0);
+  }
+
+  struct timeval start;
+  gettimeofday(&start, 0);
+
+  pluton::clientRequest R;
+  R.setRequestData("in flight");
+  R.setContext("echo.sleepMS", "2000");
+  C.addRequest(SK, R);
+  C.executeAndWaitOne(R);
+  long ms = elapsedMS(start);
+
+  waitpid(child, 0, 0);
+
+  if (R.getFaultCode() != pluton::remoteTransferFailed) {
+    failed("expected remoteTransferFailed", R.getFaultCode());
+  }
+  if (ms >= 1500) failed("in flight request was not failed promptly", ms);
+
+  pluton::clientRequest R2;
+  R2.setRequestData("after");
+  C.addRequest(SK, R2);
+  C.executeAndWaitOne(R2);
+  if (R2.getFaultCode() != pluton::remoteConnectFailed) {
+    failed("expected remoteConnectFailed", R2.getFaultCode());
+  }
+}
+
+
+int
+main(int argc, char** argv)
+{
+  roundTrip();
+
+  if (argc > 3) {
+    pluton::client C;
+    if (!C.initialize(argv[1])) {
+      failed("bad return from good path");
+      cout << C.getFault().getMessage("C.initialize()") << endl;
+      exit(1);
+    }
+
+    outOfOrder(C, argv[2]);
+    lateResponse(C, argv[2]);
+    receiverKilled(C, argv[2], atoi(argv[3]));
+  }
+
+  if (errors > 0) return 1;
+
+  cout << "ok" << endl;
+
+  return 0;
+}
@@ -0,0 +1,464 @@
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include <sys/time.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "netString.h"
+
+using namespace std;
+
+// Microbenchmarks for the netString framing code that sits on every
+// request's path: generating packets, parsing complete packets and
+// parsing a byte stream fed in fragments. Each benchmark runs for a
+// calibrated number of iterations, repeated several times, and the
+// fastest repetition is reported along with the median so runs can
+// be compared across commits. The small field benchmarks are also
+// run with binary framing. Every benchmark also checks what it
+// parsed, so a broken parser fails rather than looking fast.
+
+static const char* usage =
+"\n"
+"Usage: tNetStringBench [-chq] [-f filter] [-r repetitions] [-t targetMS]\n"
+"\n"
+"Measure ns/op and MB/s for generating and parsing netString packets.\n"
+"\n"
+" -c     Print CSV rather than a table\n"
+" -f     Only run benchmarks whose name contains this string\n"
+" -h     Print usage and exit\n"
+" -q     Quick: one short repetition, for checking that it works\n"
+" -r     Repetitions of each benchmark (default: 5)\n"
+" -t     Target milliseconds per repetition (default: 200)\n"
+"\n"
+"Exit status is non-zero if any benchmark parsed the wrong result.\n"
+"\n";
+
+
+static int	errors = 0;
+static long	sink = 0;		// Defeats dead-code elimination
+
+static void
+failed(const char* name, const char* err, long val=0)
+{
+  cout << "Failed: tNetStringBench " << name << " " << err << " val=" << val << endl;
+  ++errors;
+}
+
+static long long
+nowNS()
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+
+  return (long long) now.tv_sec * 1000000000LL + now.tv_usec * 1000LL;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Packet shapes. A request packet is a series of small fields around
+// one data field, much as clientRequestImpl assembles them.
+//////////////////////////////////////////////////////////////////////
+
+static const int smallFields = 32;
+static const int largeSize = 64 * 1024;
+static const int streamPackets = 64;
+
+static string	largeData(largeSize, 'x');
+static string	smallPacket;		// Pre-generated for the parse benchmarks
+static string	largePacket;
+static string	encapsulatedPacket;
+static string	smallStream;		// streamPackets copies of smallPacket
+static string	smallPacketBinary;	// smallPacket with binary framing
+static string	smallStreamBinary;
+static string	largeStream;
+
+static void
+generateSmall(netStringGenerate& nsg)
+{
+  for (int ix=0; ix < smallFields / 4; ++ix) {
+    nsg.append('i', ix);
+    nsg.append('c', 'k');
+    nsg.append('s', "system.echo.0.raw");
+    nsg.append('t');
+  }
+}
+
+static void
+generateLarge(netStringGenerate& nsg)
+{
+  nsg.append('s', "system.echo.0.raw");
+  nsg.append('d', largeData.data(), largeData.length());
+}
+
+static void
+buildPackets()
+{
+  netStringGenerate s1(smallPacket);
+  generateSmall(s1);
+
+  netStringGenerate s2(largePacket);
+  generateLarge(s2);
+
+  netStringGenerateEncapsulated e;
+  generateSmall(e);
+  e.encapsulate('P');
+  encapsulatedPacket = e.getString();
+
+  netStringGenerate s3(smallPacketBinary);
+  s3.setBinaryFraming(true);
+  generateSmall(s3);
+
+  for (int ix=0; ix < streamPackets; ++ix) {
+    smallStream += smallPacket;
+    largeStream += largePacket;
+    smallStreamBinary += smallPacketBinary;
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// The benchmarks. Each runs one operation and returns the number of
+// bytes generated or parsed by that operation.
+//////////////////////////////////////////////////////////////////////
+
+static int
+benchGenerateSmall()
+{
+  static string s;
+  s.erase();
+  netStringGenerate nsg(s);
+  generateSmall(nsg);
+
+  return s.length();
+}
+
+static int
+benchGenerateSmallBinary()
+{
+  static string s;
+  s.erase();
+  netStringGenerate nsg(s);
+  nsg.setBinaryFraming(true);
+  generateSmall(nsg);
+
+  return s.length();
+}
+
+static int
+benchGenerateLarge()
+{
+  static string s;
+  s.erase();
+  netStringGenerate nsg(s);
+  generateLarge(nsg);
+
+  return s.length();
+}
+
+static int
+benchGenerateEncapsulated()
+{
+  static netStringGenerateEncapsulated e;
+  e.erase();
+  generateSmall(e);
+  e.encapsulate('P');
+
+  return e.length();
+}
+
+static int
+parseAll(const char* name, const char* p, int len, int expected)
+{
+  netStringParse nsp(p, len);
+  char type;
+  const char* dp;
+  int dl;
+  int count = 0;
+  while (!nsp.eof()) {
+    const char* err = nsp.getNext(type, dp, dl);
+    if (err) {
+      failed(name, err);
+      return len;
+    }
+    sink += dl;
+    ++count;
+  }
+  if (count != expected) failed(name, "field count", count);
+
+  return len;
+}
+
+static int
+benchParseSmall()
+{
+  return parseAll("parse.smallFields", smallPacket.data(), smallPacket.length(), smallFields);
+}
+
+static int
+benchParseSmallBinary()
+{
+  return parseAll("parse.smallFieldsBinary", smallPacketBinary.data(), smallPacketBinary.length(),
+		  smallFields);
+}
+
+static int
+benchParseLarge()
+{
+  return parseAll("parse.largeData", largePacket.data(), largePacket.length(), 2);
+}
+
+static int
+benchParseEncapsulated()
+{
+  netStringParse outer(encapsulatedPacket);
+  char type;
+  const char* dp;
+  int dl;
+  const char* err = outer.getNext(type, dp, dl);
+  if (err || (type != 'P')) {
+    failed("parse.encapsulated", err ? err : "type", type);
+    return encapsulatedPacket.length();
+  }
+  parseAll("parse.encapsulated", dp, dl, smallFields);
+
+  return encapsulatedPacket.length();
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Stream parsing. The whole stream is presented to a factory, or it
+// is fed to a managed factory in fragments as a socket would, which
+// exercises the buffer compaction. Each op is one whole stream.
+//////////////////////////////////////////////////////////////////////
+
+static int
+drain(const char* name, netStringFactory& nsf, int& count)
+{
+  const char* err = 0;
+  while (nsf.haveNetString(err)) {
+    char type;
+    const char* dp;
+    int dl;
+    nsf.getNetString(type, dp, dl);
+    sink += dl;
+    ++count;
+  }
+  if (err) failed(name, err);
+
+  return count;
+}
+
+static int
+streamWhole(const char* name, const string& stream, int expected)
+{
+  netStringFactory nsf(stream.data(), stream.length());
+  nsf.addBytesRead(stream.length());
+  nsf.disableCompaction();
+
+  int count = 0;
+  drain(name, nsf, count);
+  if (count != expected) failed(name, "netString count", count);
+
+  return stream.length();
+}
+
+static int
+streamFragmented(const char* name, const string& stream, int fragment, int expected)
+{
+  static netStringFactoryManaged* nsf = 0;
+  if (!nsf) nsf = new netStringFactoryManaged(4096, 1024 * 1024);
+  nsf->reset();
+
+  int offset = 0;
+  int count = 0;
+  while (offset < (int) stream.length()) {
+    char* bufPtr;
+    int minToRead;
+    int maxToRead;
+    if (nsf->getReadParameters(bufPtr, minToRead, maxToRead) != 0) {
+      failed(name, "getReadParameters");
+      return stream.length();
+    }
+    int len = min(fragment, min(maxToRead, (int) stream.length() - offset));
+    memcpy(bufPtr, stream.data() + offset, len);
+    nsf->addBytesRead(len);
+    offset += len;
+    drain(name, *nsf, count);
+  }
+  if (count != expected) failed(name, "netString count", count);
+
+  return stream.length();
+}
+
+static int
+benchStreamSmall()
+{
+  return streamWhole("stream.smallFields", smallStream, smallFields * streamPackets);
+}
+
+static int
+benchStreamSmallBinary()
+{
+  return streamWhole("stream.smallFieldsBinary", smallStreamBinary, smallFields * streamPackets);
+}
+
+static int
+benchStreamLarge()
+{
+  return streamWhole("stream.largeData", largeStream, 2 * streamPackets);
+}
+
+static int
+benchStreamSmallFragmented()
+{
+  return streamFragmented("stream.smallFragmented", smallStream, 7, smallFields * streamPackets);
+}
+
+static int
+benchStreamSmallMTU()
+{
+  return streamFragmented("stream.smallMTU", smallStream, 1500, smallFields * streamPackets);
+}
+
+static int
+benchStreamLargeFragmented()
+{
+  return streamFragmented("stream.largeFragmented", largeStream, 4096, 2 * streamPackets);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+
+class benchmark {
+public:
+  const char*	name;
+  int		(*op)();
+};
+
+static benchmark benchmarks[] = {
+  { "generate.smallFields", benchGenerateSmall },
+  { "generate.smallFieldsBinary", benchGenerateSmallBinary },
+  { "generate.largeData", benchGenerateLarge },
+  { "generate.encapsulated", benchGenerateEncapsulated },
+  { "parse.smallFields", benchParseSmall },
+  { "parse.smallFieldsBinary", benchParseSmallBinary },
+  { "parse.largeData", benchParseLarge },
+  { "parse.encapsulated", benchParseEncapsulated },
+  { "stream.smallFields", benchStreamSmall },
+  { "stream.smallFieldsBinary", benchStreamSmallBinary },
+  { "stream.largeData", benchStreamLarge },
+  { "stream.smallFragmented", benchStreamSmallFragmented },
+  { "stream.smallMTU", benchStreamSmallMTU },
+  { "stream.largeFragmented", benchStreamLargeFragmented },
+  { 0, 0 }
+};
+
+// Run op iterations times and return the elapsed nanoseconds
+
+static long long
+timeRun(const benchmark& b, long iterations, long long& bytes)
+{
+  bytes = 0;
+  long long start = nowNS();
+  for (long ix=0; ix < iterations; ++ix) bytes += b.op();
+
+  return nowNS() - start;
+}
+
+int
+main(int argc, char** argv)
+{
+  bool csvFlag = false;
+  const char* filter = 0;
+  int repetitions = 5;
+  int targetMS = 200;
+
+  char	optionChar;
+  while ((optionChar = getopt(argc, argv, "cf:hqr:t:")) != -1) {
+    switch (optionChar) {
+    case 'c': csvFlag = true; break;
+    case 'f': filter = optarg; break;
+    case 'q': repetitions = 1; targetMS = 5; break;
+    case 'r': repetitions = atoi(optarg); break;
+    case 't': targetMS = atoi(optarg); break;
+
+    case 'h':
+      cout << usage;
+      exit(0);
+
+    default:
+      cerr << usage;
+      exit(1);
+    }
+  }
+  if ((repetitions < 1) || (targetMS < 1)) {
+    cerr << usage;
+    exit(1);
+  }
+
+  buildPackets();
+
+  if (csvFlag) {
+    cout << "benchmark,iterations,nsPerOp,medianNsPerOp,MBPerSec" << endl;
+  }
+  else {
+    cout << "netString benchmarks: repetitions=" << repetitions << " target=" << targetMS << "ms"
+	 << endl;
+    cout << setiosflags(ios::left) << setw(28) << "Benchmark" << resetiosflags(ios::left)
+	 << setw(11) << "Iterations"
+	 << setw(12) << "ns/op"
+	 << setw(12) << "median"
+	 << setw(12) << "MB/s"
+	 << endl;
+  }
+
+  for (int bx=0; benchmarks[bx].name; ++bx) {
+    const benchmark& b = benchmarks[bx];
+    if (filter && !strstr(b.name, filter)) continue;
+
+    // Calibrate the iteration count so a repetition takes about the
+    // target time. The count is then fixed for all repetitions.
+
+    long long bytes;
+    long iterations = 1;
+    long long elapsed;
+    while ((elapsed = timeRun(b, iterations, bytes)) < targetMS * 1000000LL / 10) {
+      iterations *= 2;
+    }
+    iterations = max(1L, (long) (iterations * (targetMS * 1000000.0 / max(elapsed, 1LL))));
+
+    vector<double> nsPerOp;
+    for (int rx=0; rx < repetitions; ++rx) {
+      elapsed = timeRun(b, iterations, bytes);
+      nsPerOp.push_back((double) elapsed / iterations);
+    }
+    sort(nsPerOp.begin(), nsPerOp.end());
+    double best = nsPerOp.front();
+    double median = nsPerOp[nsPerOp.size() / 2];
+    double mbPerSec = (bytes / (double) iterations) / best * 1000.0;	// bytes/ns -> MB/s
+
+    if (csvFlag) {
+      cout << b.name << "," << iterations
+	   << "," << fixed << setprecision(1) << best << "," << median << "," << mbPerSec << endl;
+    }
+    else {
+      cout << setiosflags(ios::left) << setw(28) << b.name << resetiosflags(ios::left)
+	   << setw(11) << iterations
+	   << fixed << setprecision(1)
+	   << setw(12) << best
+	   << setw(12) << median
+	   << setw(12) << mbPerSec
+	   << endl;
+    }
+  }
+
+  if (sink == 0) cout << "Warning: nothing was parsed" << endl;
+
+  return errors ? 1 : 0;
+}
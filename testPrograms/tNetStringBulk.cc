@@ -0,0 +1,258 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netString.h"
+
+using namespace std;
+
+// Check that netStringFactory produces the same netStrings whether
+// they are decoded by the bulk parser or the byte-at-a-time state
+// machine. Random streams of netStrings, some with binary framing,
+// are fed in random fragment sizes, with and without compaction, and
+// every netString returned is compared with what was generated. The
+// whole stream is also checked with netStringParse. Streams that go
+// bad part way through must deliver all the good netStrings before
+// the error.
+
+static int errors = 0;
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tNetStringBulk " << err << " val=" << val << endl;
+  ++errors;
+}
+
+class expected {
+public:
+  char		type;
+  bool		binary;
+  string	data;
+  string	raw;
+};
+
+static string
+randomData(int maxLength)
+{
+  int len = random() % (maxLength + 1);
+  string s;
+  for (int ix=0; ix < len; ++ix) s += (char) (random() % 256);
+
+  return s;
+}
+
+// Generate a stream of netStrings, mostly small with the occasional
+// large one. Some have leading zeros on the length and some use the
+// alternate terminator, both of which are legal. If binaryFlag is
+// set, about half of them use binary framing.
+
+static string
+makeStream(vector<expected>& ev, int count, bool binaryFlag)
+{
+  string stream;
+  ev.clear();
+  for (int ix=0; ix < count; ++ix) {
+    expected e;
+    do e.type = ' ' + random() % 95; while (isdigit(e.type));	// Digits extend the length
+    e.data = randomData((random() % 20) ? 40 : ((random() % 2) ? 5000 : 20000));
+    e.binary = binaryFlag && (random() % 2);
+
+    if (e.binary) {
+      netStringGenerate nsg(e.raw);
+      nsg.setBinaryFraming(true);
+      nsg.append(e.type, e.data);
+    }
+    else {
+      char lengthBuf[20];
+      sprintf(lengthBuf, (random() % 10) ? "%d" : "000%d", (int) e.data.length());
+      e.raw = lengthBuf;
+      e.raw += e.type;
+      e.raw += e.data;
+      e.raw += (random() % 10) ? ',' : '\n';
+    }
+
+    stream += e.raw;
+    ev.push_back(e);
+  }
+
+  return stream;
+}
+
+// Feed the stream and return the number of netStrings that matched
+// before the end or an error.
+
+static int
+feed(netStringFactory& nsf, const string& stream, const vector<expected>& ev,
+     int maxFragment, const char*& err)
+{
+  unsigned int next = 0;
+  int offset = 0;
+  err = 0;
+
+  while ((offset < (int) stream.length()) && !err) {
+    char* bufPtr;
+    int minToRead;
+    int maxToRead;
+    if (nsf.getReadParameters(bufPtr, minToRead, maxToRead) != 0) {
+      failed("getReadParameters wants to expand", offset);
+      return next;
+    }
+    int len = 1 + random() % maxFragment;
+    if (len > maxToRead) len = maxToRead;
+    if (len > (int) stream.length() - offset) len = stream.length() - offset;
+    memcpy(bufPtr, stream.data() + offset, len);
+    nsf.addBytesRead(len);
+    offset += len;
+
+    while (nsf.haveNetString(err)) {
+      const char* rawPtr;
+      int rawLength;
+      nsf.getRawString(rawPtr, rawLength);
+
+      char type;
+      const char* dataPtr;
+      int dataLength;
+      nsf.getNetString(type, dataPtr, dataLength);
+      if (next >= ev.size()) {
+	failed("more netStrings than generated", next);
+	return next;
+      }
+      const expected& e = ev[next];
+      if ((type != e.type) || (string(dataPtr, dataLength) != e.data)
+	  || (string(rawPtr, rawLength) != e.raw)) {
+	failed("netString mismatch", next);
+	return next;
+      }
+      ++next;
+    }
+  }
+
+  return next;
+}
+
+static void
+checkStream(int seed, int count, int maxFragment, bool compaction, int badAt,
+	    bool binaryFlag=false)
+{
+  srandom(seed);
+
+  vector<expected> ev;
+  string stream = makeStream(ev, count, binaryFlag);
+
+  if (badAt < 0) {			// The static parser should agree
+    netStringParse nsp(stream);
+    for (unsigned int ix=0; ix < ev.size(); ++ix) {
+      char type;
+      const char* dataPtr;
+      int dataLength;
+      const char* err = nsp.getNext(type, dataPtr, dataLength);
+      if (err || (type != ev[ix].type) || (string(dataPtr, dataLength) != ev[ix].data)) {
+	failed(err ? err : "netStringParse mismatch", ix);
+	break;
+      }
+    }
+    if (!nsp.eof()) failed("netStringParse not at eof", seed);
+  }
+
+  // Corrupt one netString: the terminator if it has one, otherwise
+  // the type.
+
+  if (badAt >= 0) {
+    int offset = 0;
+    for (int ix=0; ix < badAt; ++ix) offset += ev[ix].raw.length();
+    if (ev[badAt].binary) {
+      stream[offset] = (char) (0x80 | '7');
+    }
+    else {
+      offset += ev[badAt].raw.length() - 1;
+      stream[offset] = ';';
+    }
+  }
+
+  char* buffer = new char[stream.length()];
+  netStringFactory plain(buffer, stream.length());
+  netStringFactoryManaged managed(64, stream.length() + 1);
+  netStringFactory& nsf = compaction ? static_cast<netStringFactory&>(managed) : plain;
+  if (!compaction) nsf.disableCompaction();
+
+  const char* err;
+  int found = feed(nsf, stream, ev, maxFragment, err);
+
+  if (badAt < 0) {
+    if (err) failed(err, seed);
+    if (found != count) failed("netString count", found);
+
+    int bytesRead, bytesRelocated, netStringsFound, bytesSkipped, zeroCost, reallocs;
+    nsf.getStatistics(bytesRead, bytesRelocated, netStringsFound, bytesSkipped,
+		      zeroCost, reallocs);
+    int dataBytes = 0;
+    for (unsigned int ix=0; ix < ev.size(); ++ix) dataBytes += ev[ix].data.length();
+    if (netStringsFound != count) failed("statistics netStringsFound", netStringsFound);
+    if (bytesSkipped != dataBytes) failed("statistics bytesSkipped", bytesSkipped);
+  }
+  else {
+    if (!err) failed("corrupt stream not detected", seed);
+    if (found != badAt) failed("netStrings before the error", found);
+  }
+
+  delete [] buffer;
+}
+
+int
+main()
+{
+  // Whole streams, MTU-ish and tiny fragments, with and without compaction
+
+  static const int fragments[] = { 1, 7, 100, 1500, 100000 };
+  for (int seed=1; seed <= 20; ++seed) {
+    for (unsigned int fx=0; fx < sizeof(fragments)/sizeof(fragments[0]); ++fx) {
+      checkStream(seed, 200, fragments[fx], true, -1);
+      checkStream(seed, 200, fragments[fx], false, -1);
+      checkStream(seed, 200, fragments[fx], true, -1, true);
+      checkStream(seed, 200, fragments[fx], false, -1, true);
+    }
+  }
+
+  // Errors part way through are only reported after the good ones
+
+  for (int seed=1; seed <= 20; ++seed) {
+    checkStream(seed, 150, 100000, false, seed * 7);
+    checkStream(seed, 150, 1500, true, seed * 7);
+    checkStream(seed, 150, 3, true, seed * 7);
+    checkStream(seed, 150, 100000, false, seed * 7, true);
+    checkStream(seed, 150, 3, true, seed * 7, true);
+  }
+
+  // Encapsulation in binary framing wraps the same as in ascii
+
+  netStringGenerateEncapsulated e;
+  e.setBinaryFraming(true);
+  e.append('a', "first");
+  e.append('b', string(300, 'x'));
+  e.encapsulate('P');
+  netStringParse outer(e.data(), e.length());
+  char type;
+  const char* dataPtr;
+  int dataLength;
+  if (outer.getNext(type, dataPtr, dataLength) || (type != 'P') || !outer.eof()) {
+    failed("binary encapsulate outer", e.length());
+  }
+  else {
+    netStringParse inner(dataPtr, dataLength);
+    string value;
+    if (!inner.find('b', value) || (value != string(300, 'x'))) {
+      failed("binary encapsulate inner", dataLength);
+    }
+  }
+  if (e.length() != 1 + 2 + (1+1+5) + (1+2+300)) failed("binary encapsulate length", e.length());
+
+  if (errors == 0) cout << "tNetStringBulk: ok" << endl;
+
+  return errors ? 1 : 0;
+}
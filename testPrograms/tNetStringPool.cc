@@ -0,0 +1,175 @@
+#include <iostream>
+#include <string>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "netString.h"
+
+using namespace std;
+
+// Check netStringBufferPool size classes, re-use and trimming, and
+// that netStringFactoryManaged grows through the pool with its data
+// intact and hands large buffers back on reset().
+
+static int errors = 0;
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tNetStringPool " << err << " val=" << val << endl;
+  ++errors;
+}
+
+static unsigned int
+pooled()
+{
+  unsigned int bytesPooled;
+  int hits, misses, trims;
+  netStringBufferPool::getStatistics(bytesPooled, hits, misses, trims);
+
+  return bytesPooled;
+}
+
+static int
+hits()
+{
+  unsigned int bytesPooled;
+  int hits, misses, trims;
+  netStringBufferPool::getStatistics(bytesPooled, hits, misses, trims);
+
+  return hits;
+}
+
+// Feed one large netString in fragments and check it comes out
+// intact. Return the number of buffer moves.
+
+static int
+feedLarge(netStringFactoryManaged& nsf, int length)
+{
+  string data;
+  for (int ix=0; ix < length; ++ix) data += (char) ('a' + ix % 26);
+  string stream;
+  netStringGenerate nsg(stream);
+  nsg.append('d', data);
+
+  unsigned int offset = 0;
+  const char* err = 0;
+  bool haveNS = false;
+  while (!haveNS && !err && (offset < stream.length())) {
+    char* bufPtr;
+    int minToRead, maxToRead;
+    if (nsf.getReadParameters(bufPtr, minToRead, maxToRead) != 0) {
+      failed("getReadParameters", offset);
+      return 0;
+    }
+    int len = min(maxToRead, min(64 * 1024, (int) (stream.length() - offset)));
+    memcpy(bufPtr, stream.data() + offset, len);
+    nsf.addBytesRead(len);
+    offset += len;
+    haveNS = nsf.haveNetString(err);
+  }
+
+  if (!haveNS) {
+    failed(err ? err : "no netString", length);
+    return 0;
+  }
+  char type;
+  const char* dataPtr;
+  int dataLength;
+  nsf.getNetString(type, dataPtr, dataLength);
+  if ((type != 'd') || (string(dataPtr, dataLength) != data)) failed("large data mismatch", length);
+
+  int bytesRead, bytesRelocated, netStringsFound, bytesSkipped, zeroCost, reallocs;
+  nsf.getStatistics(bytesRead, bytesRelocated, netStringsFound, bytesSkipped, zeroCost, reallocs);
+
+  return reallocs;
+}
+
+int
+main()
+{
+  netStringBufferPool::setHighWatermark(8 * 1024 * 1024);
+
+  // Size classes and re-use
+
+  unsigned int size = 5000;
+  char* b1 = netStringBufferPool::acquire(size);
+  if (size != 8192) failed("size class of 5000", size);
+  netStringBufferPool::release(b1, size);
+  if (pooled() != 8192) failed("pooled after release", pooled());
+
+  int h = hits();
+  size = 6000;
+  char* b2 = netStringBufferPool::acquire(size);
+  if (b2 != b1) failed("buffer not re-used");
+  if (hits() != h + 1) failed("hits", hits());
+  if (pooled() != 0) failed("pooled after re-use", pooled());
+  netStringBufferPool::release(b2, size);
+
+  // Small and huge buffers are allocated to size and not pooled
+
+  size = 100;
+  b1 = netStringBufferPool::acquire(size);
+  if (size != 100) failed("small size changed", size);
+  netStringBufferPool::release(b1, size);
+
+  size = 32 * 1024 * 1024 + 1;
+  b1 = netStringBufferPool::acquire(size);
+  if (size != 32 * 1024 * 1024 + 1) failed("huge size changed", size);
+  netStringBufferPool::release(b1, size);
+  if (pooled() != 8192) failed("small or huge buffer pooled", pooled());
+
+  // A managed factory grows by doubling and gives its large buffer
+  // back on reset, keeping the data where it was put.
+
+  {
+    netStringFactoryManaged nsf(16 * 1024);
+    nsf.disableCompaction();
+    if (nsf.getBufferSize() != 16 * 1024) failed("initial buffer size", nsf.getBufferSize());
+
+    int moves = feedLarge(nsf, 2000000);
+    if ((moves < 1) || (moves > 8)) failed("buffer moves for 2MB", moves);
+    if (nsf.getBufferSize() < 2000000) failed("grown buffer size", nsf.getBufferSize());
+
+    nsf.reset();
+    if (nsf.getBufferSize() != 16 * 1024) failed("buffer size after reset", nsf.getBufferSize());
+    if (pooled() < 2 * 1024 * 1024) failed("large buffer not pooled", pooled());
+
+    h = hits();
+    feedLarge(nsf, 2000000);
+    if (hits() <= h) failed("large buffer not re-used", hits());
+    nsf.reset();
+  }
+
+  // The high watermark bounds what the pool holds
+
+  netStringBufferPool::setHighWatermark(1024 * 1024);
+  if (pooled() > 1024 * 1024) failed("pool not trimmed", pooled());
+  {
+    netStringFactoryManaged nsf(1024);
+    feedLarge(nsf, 3000000);
+    nsf.reset();
+    if (pooled() > 1024 * 1024) failed("pool exceeds high watermark", pooled());
+  }
+  netStringBufferPool::setHighWatermark(0);
+  if (pooled() != 0) failed("pool not emptied", pooled());
+
+  // The maximum size still applies
+
+  {
+    netStringFactoryManaged nsf(1024, 4096);
+    char* bufPtr;
+    int minToRead, maxToRead;
+    nsf.getReadParameters(bufPtr, minToRead, maxToRead);
+    memcpy(bufPtr, "5000d", 5);
+    nsf.addBytesRead(5);
+    const char* err;
+    nsf.haveNetString(err);
+    if (nsf.getReadParameters(bufPtr, minToRead, maxToRead) != -1) failed("maximum size ignored");
+  }
+
+  if (errors == 0) cout << "tNetStringPool: ok" << endl;
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,244 @@
+#include <iostream>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pluton/client.h>
+
+using namespace std;
+
+// Exchange requests with a remote service whose lookup entry names
+// three plReceiver endpoints: two that are limited to two outstanding
+// requests each and a third that refuses connections. Requests must
+// all complete intact whether sent one at a time, more in parallel
+// than the endpoints allow or with affinity, and the features that
+// cannot cross a plReceiver must quietly fall back when offered. A
+// second service names a host that does not resolve at first; once it
+// does, requests must reach it after the endpoint's down time.
+
+static int errors = 0;
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tRemoteEndpoints " << err << " val=" << val << endl;
+  ++errors;
+}
+
+static const char* SK = "system.echo.1.raw";
+static const char* lateSK = "system.echo.2.raw";
+
+
+//////////////////////////////////////////////////////////////////////
+// Stand in for the C library's getaddrinfo() so that lateHost fails
+// to resolve until lateResolves is set, after which it is localhost.
+//////////////////////////////////////////////////////////////////////
+
+static const char* lateHost = "pluton-late-resolve";
+static bool lateResolves = false;
+
+typedef int (*getaddrinfo_t)(const char*, const char*, const struct addrinfo*, struct addrinfo**);
+
+extern "C" int
+getaddrinfo(const char* node, const char* service, const struct addrinfo* hints,
+	    struct addrinfo** res) throw()
+{
+  static getaddrinfo_t realGetaddrinfo = (getaddrinfo_t) dlsym(RTLD_NEXT, "getaddrinfo");
+
+  if (node && (strcmp(node, lateHost) == 0)) {
+    if (!lateResolves) return EAI_AGAIN;
+    node = "localhost";
+  }
+
+  return realGetaddrinfo(node, service, hints, res);
+}
+
+static string
+makeData(int length, int seed)
+{
+  string data;
+  data.reserve(length);
+  for (int ix=0; ix < length; ++ix) data.append(1, (char) (ix * seed));
+
+  return data;
+}
+
+static void
+exchange(pluton::client& C, pluton::clientRequest& R, int length, const char* sk=SK)
+{
+  string data = makeData(length, 7);
+  R.setRequestData(data);
+  R.setContext("echo.sleepMS", "0");
+
+  if (!C.addRequest(sk, R)) {
+    failed("bad return from addRequest", length);
+    cout << C.getFault().getMessage("C.addRequest()") << endl;
+    exit(1);
+  }
+
+  if (C.executeAndWaitOne(R) <= 0) {
+    failed("bad return from executeAndWaitOne()", length);
+    cout << C.getFault().getMessage() << endl;
+    exit(1);
+  }
+
+  if (R.hasFault()) {
+    failed(R.getFaultText().c_str(), R.getFaultCode());
+    return;
+  }
+
+  string rd;
+  R.getResponseData(rd);
+  if (rd != data) failed("response data mismatch", length);
+}
+
+static void
+parallel(pluton::client& C, int count)
+{
+  pluton::clientRequest* R = new pluton::clientRequest[count];
+  string* data = new string[count];
+
+  for (int ix=0; ix < count; ++ix) {
+    data[ix] = makeData(1000 + ix * 100, ix + 1);
+    R[ix].setRequestData(data[ix]);
+    R[ix].setContext("echo.sleepMS", "50");
+    if (!C.addRequest(SK, R[ix])) {
+      failed("bad return from parallel addRequest", ix);
+      cout << C.getFault().getMessage("C.addRequest()") << endl;
+      exit(1);
+    }
+  }
+
+  if (C.executeAndWaitAll() <= 0) {
+    failed("bad return from executeAndWaitAll()", count);
+    cout << C.getFault().getMessage() << endl;
+  }
+
+  for (int ix=0; ix < count; ++ix) {
+    if (R[ix].hasFault()) {
+      failed(R[ix].getFaultText().c_str(), ix);
+      continue;
+    }
+    string rd;
+    R[ix].getResponseData(rd);
+    if (rd != data[ix]) failed("parallel response mismatch", ix);
+  }
+
+  delete [] R;
+  delete [] data;
+}
+
+int
+main(int argc, char** argv)
+{
+  const char* goodPath = 0;
+  if (argc > 1) goodPath = argv[1];
+
+  pluton::client C;
+
+  if (!C.initialize(goodPath)) {
+    failed("bad return from good path");
+    cout << C.getFault().getMessage("C.initialize()") << endl;
+    exit(1);
+  }
+
+  // One at a time re-uses pooled connections
+
+  static const int lengths[] = { 0, 1, 1000, 100000, 2000000 };
+  for (unsigned int lx=0; lx < sizeof(lengths)/sizeof(lengths[0]); ++lx) {
+    for (int ix=0; ix < 10; ++ix) {
+      pluton::clientRequest R;
+      exchange(C, R, lengths[lx]);
+    }
+  }
+
+  // More than the four the endpoints allow wait their turn
+
+  parallel(C, 4);
+  parallel(C, 20);
+
+  // Affinity holds its connection across requests
+
+  {
+    pluton::clientRequest R;
+    R.setAttribute(pluton::keepAffinityAttr | pluton::noRetryAttr);
+    for (int ix=0; ix < 5; ++ix) exchange(C, R, 5000 * ix);
+    R.clearAttribute(pluton::keepAffinityAttr);
+    exchange(C, R, 10);
+  }
+
+  // Zero-copy, binary framing and compression can all be offered
+
+  C.setZeroCopyThreshold(64 * 1024);
+  C.setBinaryFraming(true);
+  C.setCompression(pluton::zlibCompression, 1000);
+  {
+    pluton::clientRequest R;
+    exchange(C, R, 1000000);
+    exchange(C, R, 5000);
+  }
+  C.setCompression(pluton::noCompression, 0);
+  C.setBinaryFraming(false);
+  C.setZeroCopyThreshold(0);
+
+  // Batched requests go individually
+
+  {
+    static const int batchSize = 4;
+    pluton::clientRequest R[batchSize];
+    pluton::clientRequest* RP[batchSize];
+    string data[batchSize];
+    for (int ix=0; ix < batchSize; ++ix) {
+      RP[ix] = &R[ix];
+      data[ix] = makeData(1000 + ix * 3000, 3);
+      R[ix].setRequestData(data[ix]);
+      R[ix].setContext("echo.sleepMS", "0");
+    }
+    if (!C.addRequests(SK, RP, batchSize)) {
+      failed("bad return from addRequests");
+      cout << C.getFault().getMessage("C.addRequests()") << endl;
+      exit(1);
+    }
+    C.executeAndWaitAll();
+    for (int ix=0; ix < batchSize; ++ix) {
+      string rd;
+      R[ix].getResponseData(rd);
+      if (rd != data[ix]) failed("batch member mismatch", ix);
+    }
+  }
+
+  // An endpoint that did not resolve is resolved again once its down
+  // time has passed, rather than being skipped for good
+
+  {
+    pluton::clientRequest R;
+    R.setAttribute(pluton::noRetryAttr);
+    R.setRequestData("late");
+    if (!C.addRequest(lateSK, R)) {
+      failed("bad return from late addRequest");
+      cout << C.getFault().getMessage("C.addRequest()") << endl;
+      exit(1);
+    }
+    C.executeAndWaitOne(R);
+    if (!R.hasFault()) failed("unresolved endpoint did not fault");
+    else if (R.getFaultText().find("Could not resolve") == string::npos) {
+      failed(R.getFaultText().c_str(), R.getFaultCode());
+    }
+
+    lateResolves = true;
+    sleep(6);			// endpointPool::downSeconds plus one
+
+    pluton::clientRequest R2;
+    exchange(C, R2, 1000, lateSK);
+  }
+
+  return errors ? 1 : 0;
+}
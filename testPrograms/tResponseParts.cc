@@ -0,0 +1,168 @@
+#include <iostream>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pluton/client.h>
+
+using namespace std;
+
+// Have the echo service send its response in parts and check that a
+// request with a part handler sees the parts arrive ahead of the
+// final data and that, together, they make up the request data.
+// Requests without a handler and batch members must get the whole
+// response as before.
+
+static int errors = 0;
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tResponseParts " << err << " val=" << val << endl;
+  ++errors;
+}
+
+static const char* SK = "system.echo.0.raw";
+
+class partCollector {
+public:
+  partCollector() : count(0) {}
+
+  string	data;
+  int		count;
+};
+
+static void
+collect(pluton::clientRequest* R, const char* p, int len)
+{
+  partCollector* pc = static_cast<partCollector*>(R->getClientHandle());
+  pc->data.append(p, len);
+  ++pc->count;
+}
+
+static string
+makeData(int length)
+{
+  string data;
+  data.reserve(length);
+  for (int ix=0; ix < length; ++ix) data.append(1, (char) (ix * 13));
+
+  return data;
+}
+
+static void
+exchange(pluton::client& C, int length, int partBytes, bool withHandler)
+{
+  pluton::clientRequest R;
+  partCollector pc;
+  string data = makeData(length);
+  R.setRequestData(data);
+  R.setContext("echo.sleepMS", "0");
+  char partStr[20];
+  sprintf(partStr, "%d", partBytes);
+  R.setContext("echo.partBytes", partStr);
+  R.setClientHandle(&pc);
+  if (withHandler) R.setResponsePartHandler(collect);
+
+  if (!C.addRequest(SK, R)) {
+    failed("bad return from addRequest", length);
+    cout << C.getFault().getMessage("C.addRequest()") << endl;
+    exit(1);
+  }
+
+  if (C.executeAndWaitOne(R) <= 0) {
+    failed("bad return from executeAndWaitOne()", length);
+    cout << C.getFault().getMessage() << endl;
+    exit(1);
+  }
+
+  if (R.hasFault()) {
+    failed(R.getFaultText().c_str(), R.getFaultCode());
+    return;
+  }
+
+  string rd;
+  R.getResponseData(rd);
+
+  if (!withHandler) {
+    if (rd != data) failed("whole response mismatch", length);
+    if (pc.count != 0) failed("parts without a handler", pc.count);
+    return;
+  }
+
+  int expectedParts = 0;
+  if (partBytes > 0) expectedParts = (length - 1) / partBytes;
+  if (pc.count != expectedParts) failed("part count", pc.count);
+  if (pc.data + rd != data) failed("parts plus final data mismatch", length);
+  if ((partBytes > 0) && (length > 0) && ((int) rd.length() > partBytes)) {
+    failed("final data too long", rd.length());
+  }
+}
+
+int
+main(int argc, char** argv)
+{
+  const char* goodPath = 0;
+  if (argc > 1) goodPath = argv[1];
+
+  pluton::client C;
+
+  if (!C.initialize(goodPath)) {
+    failed("bad return from good path");
+    cout << C.getFault().getMessage("C.initialize()") << endl;
+    exit(1);
+  }
+
+  static const int lengths[] = { 0, 1, 4096, 4097, 100000, 3000000 };
+  for (unsigned int lx=0; lx < sizeof(lengths)/sizeof(lengths[0]); ++lx) {
+    exchange(C, lengths[lx], 4096, true);
+    exchange(C, lengths[lx], 4096, false);
+    exchange(C, lengths[lx], 0, true);
+  }
+
+  // Parts with binary framing and zero-copy, which the final data
+  // must not use once parts have gone.
+
+  C.setBinaryFraming(true);
+  exchange(C, 200000, 1000, true);
+  C.setBinaryFraming(false);
+
+  C.setZeroCopyThreshold(64 * 1024);
+  exchange(C, 1000000, 300000, true);
+  exchange(C, 1000000, 300000, false);
+  C.setZeroCopyThreshold(0);
+
+  // Batch members get the parts in with the final data
+
+  {
+    static const int batchSize = 4;
+    pluton::clientRequest R[batchSize];
+    pluton::clientRequest* RP[batchSize];
+    partCollector pc[batchSize];
+    string data[batchSize];
+    for (int ix=0; ix < batchSize; ++ix) {
+      RP[ix] = &R[ix];
+      data[ix] = makeData(1000 + ix * 3000);
+      R[ix].setRequestData(data[ix]);
+      R[ix].setContext("echo.sleepMS", "0");
+      R[ix].setContext("echo.partBytes", "500");
+      R[ix].setClientHandle(&pc[ix]);
+      R[ix].setResponsePartHandler(collect);
+    }
+    if (!C.addRequests(SK, RP, batchSize)) {
+      failed("bad return from addRequests");
+      cout << C.getFault().getMessage("C.addRequests()") << endl;
+      exit(1);
+    }
+    C.executeAndWaitAll();
+    for (int ix=0; ix < batchSize; ++ix) {
+      string rd;
+      R[ix].getResponseData(rd);
+      if (rd != data[ix]) failed("batch member mismatch", ix);
+      if (pc[ix].count != 0) failed("batch member had parts", ix);
+    }
+  }
+
+  return errors ? 1 : 0;
+}
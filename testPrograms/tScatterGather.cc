@@ -0,0 +1,159 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+
+#include <pluton/client.h>
+
+using namespace std;
+
+// Exchange scattered request data with the echo service and have it
+// answer with scattered response data. Piece counts either side of
+// what writev() takes in one call are covered, as are empty pieces,
+// zero-copy transfers and batches which need the data gathered.
+
+static int errors = 0;
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tScatterGather " << err << " val=" << val << endl;
+  ++errors;
+}
+
+static const char* SK = "system.echo.0.raw";
+
+static string
+makeData(int length)
+{
+  string data;
+  data.reserve(length);
+  for (int ix=0; ix < length; ++ix) data.append(1, (char) (ix * 11));
+
+  return data;
+}
+
+// Cut the data into pieces of pieceSize with an empty piece after
+// every tenth.
+
+static void
+scatter(const string& data, int pieceSize, vector<struct iovec>& iov)
+{
+  iov.clear();
+  for (unsigned int ix=0; ix < data.length(); ix += pieceSize) {
+    struct iovec vec;
+    vec.iov_base = const_cast<char*>(data.data() + ix);
+    vec.iov_len = min((unsigned int) pieceSize, (unsigned int) data.length() - ix);
+    iov.push_back(vec);
+    if ((iov.size() % 10) == 0) {
+      vec.iov_len = 0;
+      iov.push_back(vec);
+    }
+  }
+}
+
+static void
+exchange(pluton::client& C, int length, int requestPiece, int responsePiece)
+{
+  pluton::clientRequest R;
+  string data = makeData(length);
+  vector<struct iovec> iov;
+  scatter(data, requestPiece, iov);
+  R.setRequestData(iov.empty() ? 0 : &iov[0], iov.size());
+  R.setContext("echo.sleepMS", "0");
+  char scatterStr[20];
+  sprintf(scatterStr, "%d", responsePiece);
+  R.setContext("echo.scatterBytes", scatterStr);
+
+  if (!C.addRequest(SK, R)) {
+    failed("bad return from addRequest", length);
+    cout << C.getFault().getMessage("C.addRequest()") << endl;
+    exit(1);
+  }
+
+  if (C.executeAndWaitOne(R) <= 0) {
+    failed("bad return from executeAndWaitOne()", length);
+    cout << C.getFault().getMessage() << endl;
+    exit(1);
+  }
+
+  if (R.hasFault()) {
+    failed(R.getFaultText().c_str(), R.getFaultCode());
+    return;
+  }
+
+  string rd;
+  R.getResponseData(rd);
+  if (rd != data) failed("response data mismatch", length);
+}
+
+int
+main(int argc, char** argv)
+{
+  const char* goodPath = 0;
+  if (argc > 1) goodPath = argv[1];
+
+  pluton::client C;
+
+  if (!C.initialize(goodPath)) {
+    failed("bad return from good path");
+    cout << C.getFault().getMessage("C.initialize()") << endl;
+    exit(1);
+  }
+
+  // Piece counts from none through to more than IOV_MAX
+
+  static const int lengths[] = { 0, 1, 100, 5000, 100000, 2000000 };
+  static const int pieces[] = { 1, 7, 1000, 100000 };
+  for (unsigned int lx=0; lx < sizeof(lengths)/sizeof(lengths[0]); ++lx) {
+    for (unsigned int px=0; px < sizeof(pieces)/sizeof(pieces[0]); ++px) {
+      exchange(C, lengths[lx], pieces[px], pieces[px]);
+      exchange(C, lengths[lx], pieces[px], 0);
+    }
+  }
+
+  // Zero-copy and binary framing
+
+  C.setZeroCopyThreshold(64 * 1024);
+  exchange(C, 1000000, 4096, 4096);
+  exchange(C, 1000000, 1, 1);
+  C.setZeroCopyThreshold(0);
+
+  C.setBinaryFraming(true);
+  exchange(C, 300000, 1000, 1000);
+  C.setBinaryFraming(false);
+
+  // Batch members are copied into the batch packet
+
+  {
+    static const int batchSize = 4;
+    pluton::clientRequest R[batchSize];
+    pluton::clientRequest* RP[batchSize];
+    string data[batchSize];
+    vector<struct iovec> iov[batchSize];
+    for (int ix=0; ix < batchSize; ++ix) {
+      RP[ix] = &R[ix];
+      data[ix] = makeData(1000 + ix * 3000);
+      scatter(data[ix], 100 + ix, iov[ix]);
+      R[ix].setRequestData(&iov[ix][0], iov[ix].size());
+      R[ix].setContext("echo.sleepMS", "0");
+      R[ix].setContext("echo.scatterBytes", "50");
+    }
+    if (!C.addRequests(SK, RP, batchSize)) {
+      failed("bad return from addRequests");
+      cout << C.getFault().getMessage("C.addRequests()") << endl;
+      exit(1);
+    }
+    C.executeAndWaitAll();
+    for (int ix=0; ix < batchSize; ++ix) {
+      string rd;
+      R[ix].getResponseData(rd);
+      if (rd != data[ix]) failed("batch member mismatch", ix);
+    }
+  }
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+#include <iostream>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pluton/client.h>
+
+using namespace std;
+
+// Have the echo service send its response from a file with
+// sendResponseFromFile() and check that only the requested range
+// arrives, with and without padding ahead of it in the file. The
+// range is also sent after held parts, in a batch, with binary
+// framing and to a client offering zero-copy, and an impossible
+// range must leave the service free to send a fault.
+
+static int errors = 0;
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tSendFile " << err << " val=" << val << endl;
+  ++errors;
+}
+
+static const char* SK = "system.echo.0.raw";
+
+static string
+makeData(int length)
+{
+  string data;
+  data.reserve(length);
+  for (int ix=0; ix < length; ++ix) data.append(1, (char) (ix * 17));
+
+  return data;
+}
+
+static void
+setContext(pluton::clientRequest& R, int padding, int partBytes)
+{
+  R.setContext("echo.sleepMS", "0");
+  char contextStr[20];
+  sprintf(contextStr, "%d", padding);
+  R.setContext("echo.fromFile", contextStr);
+  if (partBytes > 0) {
+    sprintf(contextStr, "%d", partBytes);
+    R.setContext("echo.partBytes", contextStr);
+  }
+}
+
+static void
+exchange(pluton::client& C, int length, int padding, int partBytes=0)
+{
+  pluton::clientRequest R;
+  string data = makeData(length);
+  R.setRequestData(data);
+  setContext(R, padding, partBytes);
+
+  if (!C.addRequest(SK, R)) {
+    failed("bad return from addRequest", length);
+    cout << C.getFault().getMessage("C.addRequest()") << endl;
+    exit(1);
+  }
+
+  if (C.executeAndWaitOne(R) <= 0) {
+    failed("bad return from executeAndWaitOne()", length);
+    cout << C.getFault().getMessage() << endl;
+    exit(1);
+  }
+
+  if (R.hasFault()) {
+    failed(R.getFaultText().c_str(), R.getFaultCode());
+    return;
+  }
+
+  string rd;
+  R.getResponseData(rd);
+  if (rd != data) failed("response data mismatch", length);
+}
+
+int
+main(int argc, char** argv)
+{
+  const char* goodPath = 0;
+  if (argc > 1) goodPath = argv[1];
+
+  pluton::client C;
+
+  if (!C.initialize(goodPath)) {
+    failed("bad return from good path");
+    cout << C.getFault().getMessage("C.initialize()") << endl;
+    exit(1);
+  }
+
+  static const int lengths[] = { 0, 1, 100, 5000, 100000, 3000000 };
+  static const int paddings[] = { 0, 1, 4096 };
+  for (unsigned int lx=0; lx < sizeof(lengths)/sizeof(lengths[0]); ++lx) {
+    for (unsigned int px=0; px < sizeof(paddings)/sizeof(paddings[0]); ++px) {
+      exchange(C, lengths[lx], paddings[px]);
+    }
+  }
+
+  // Held parts have the file read in behind them
+
+  exchange(C, 20000, 10, 3000);
+
+  // Binary framing and zero-copy, which file data does not use
+
+  C.setBinaryFraming(true);
+  exchange(C, 300000, 7);
+  C.setBinaryFraming(false);
+
+  C.setZeroCopyThreshold(64 * 1024);
+  exchange(C, 1000000, 7);
+  C.setZeroCopyThreshold(0);
+
+  // A range before the start of the file is refused and the service
+  // answers with a fault instead.
+
+  {
+    pluton::clientRequest R;
+    R.setRequestData("abc");
+    setContext(R, -1, 0);
+    C.addRequest(SK, R);
+    C.executeAndWaitOne(R);
+    if (R.getFaultCode() != 113) failed("bad range not faulted", R.getFaultCode());
+  }
+
+  // Batch members are copied into the batch packet
+
+  {
+    static const int batchSize = 4;
+    pluton::clientRequest R[batchSize];
+    pluton::clientRequest* RP[batchSize];
+    string data[batchSize];
+    for (int ix=0; ix < batchSize; ++ix) {
+      RP[ix] = &R[ix];
+      data[ix] = makeData(1000 + ix * 3000);
+      R[ix].setRequestData(data[ix]);
+      setContext(R[ix], ix * 11, 0);
+    }
+    if (!C.addRequests(SK, RP, batchSize)) {
+      failed("bad return from addRequests");
+      cout << C.getFault().getMessage("C.addRequests()") << endl;
+      exit(1);
+    }
+    C.executeAndWaitAll();
+    for (int ix=0; ix < batchSize; ++ix) {
+      string rd;
+      R[ix].getResponseData(rd);
+      if (rd != data[ix]) failed("batch member mismatch", ix);
+    }
+  }
+
+  // The service must still be answering after all that
+
+  exchange(C, 10, 0);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "pluton/serviceEvent.h"
+
+using namespace std;
+
+//////////////////////////////////////////////////////////////////////
+// An event-driven echo service. The context "sleepMS" delays the
+// response without blocking the event loop so that a test can show
+// many requests in progress in one process and responses going back
+// out of order.
+//////////////////////////////////////////////////////////////////////
+
+struct delayed {
+  pluton::serviceEventRequest*	R;
+  struct timeval		due;
+};
+
+static long
+diffMS(const struct timeval& a, const struct timeval& b)
+{
+  return (a.tv_sec - b.tv_sec) * 1000 + (a.tv_usec - b.tv_usec) / 1000;
+}
+
+int
+main(int argc, char** argv)
+{
+  pluton::serviceEvent S("tServiceEvent");
+
+  if (!S.initialize()) {
+    cerr << S.getFault().getMessage("tServiceEvent", true) << endl;
+    exit(1);
+  }
+
+  vector<delayed> pending;
+
+  while (!S.isShutdown()) {
+    struct timeval now;
+    gettimeofday(&now, 0);
+
+    // Respond to any delayed requests that are now due
+
+    for (unsigned int ix=0; ix < pending.size();) {
+      if (diffMS(pending[ix].due, now) <= 0) {
+	string rd;
+	pending[ix].R->getRequestData(rd);
+	if (!S.sendResponse(pending[ix].R, rd)) clog << "Error: " << S.getFault().getMessage() << endl;
+	pending.erase(pending.begin() + ix);
+      }
+      else {
+	++ix;
+      }
+    }
+
+    // Gather all the events wanted and poll on them
+
+    vector<struct pollfd> fds;
+    int timeoutMS = 1000;
+    const pluton::serviceEvent::eventWanted* ew;
+    while ((ew = S.getNextEventWanted(&now))) {
+      struct pollfd pfd;
+      pfd.fd = ew->fd;
+      pfd.events = (ew->type == pluton::serviceEvent::wantRead) ? POLLIN : POLLOUT;
+      pfd.revents = 0;
+      fds.push_back(pfd);
+      int ms = ew->timeout.tv_sec * 1000 + ew->timeout.tv_usec / 1000;
+      if (ms < timeoutMS) timeoutMS = ms;
+    }
+    for (unsigned int ix=0; ix < pending.size(); ++ix) {
+      long ms = diffMS(pending[ix].due, now);
+      if (ms < timeoutMS) timeoutMS = ms;
+    }
+    if (timeoutMS < 0) timeoutMS = 0;
+
+    int res = poll(fds.empty() ? 0 : &fds[0], fds.size(), timeoutMS);
+    if (res < 0) res = 0;		// Signals are checked by the next getNextEventWanted()
+
+    for (unsigned int ix=0; ix < fds.size(); ++ix) {
+      if (fds[ix].revents & POLLOUT) {
+	S.sendCanWriteEvent(fds[ix].fd);
+      }
+      else if (fds[ix].revents) {
+	S.sendCanReadEvent(fds[ix].fd);
+      }
+      else {
+	S.sendTimeoutEvent(fds[ix].fd);
+      }
+    }
+
+    // Queue up the new requests
+
+    gettimeofday(&now, 0);
+    pluton::serviceEventRequest* R;
+    while ((R = S.getNextRequest())) {
+      string sleepMS;
+      delayed d;
+      d.R = R;
+      d.due = now;
+      if (R->getContext("sleepMS", sleepMS)) {
+	long ms = atoi(sleepMS.c_str());
+	d.due.tv_sec += ms / 1000;
+	d.due.tv_usec += (ms % 1000) * 1000;
+	if (d.due.tv_usec >= 1000000) {
+	  d.due.tv_usec -= 1000000;
+	  ++d.due.tv_sec;
+	}
+      }
+      pending.push_back(d);
+    }
+  }
+
+  if (S.hasFault()) clog << "Error: " << S.getFault().getMessage() << endl;
+
+  S.terminate();
+
+  return 0;
+}
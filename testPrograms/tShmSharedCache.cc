@@ -0,0 +1,175 @@
+#include <iostream>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shmService.h"
+
+using namespace std;
+
+//////////////////////////////////////////////////////////////////////
+// Exercise the shared cache between a "manager" and a forked
+// "service" to check that entries are visible across processes,
+// expire and that the cache stays within its bounds.
+//////////////////////////////////////////////////////////////////////
+
+static const int cacheSize = 64 * 1024;
+static const int entrySize = 256;
+
+static bool
+check(bool condition, const char* what)
+{
+  if (!condition) cout << "Failed: " << what << endl;
+  return condition;
+}
+
+// Reach into the region for the entry holding this key
+
+static shmSharedCacheEntry*
+findEntry(const shmSharedCacheHeader* hp, const char* key)
+{
+  char* base = (char*) hp + sizeof(shmSharedCacheHeader);
+  for (unsigned int ix=0; ix < hp->_entryCount; ++ix) {
+    shmSharedCacheEntry* E = (shmSharedCacheEntry*) (base + ix * hp->_entrySize);
+    if ((E->_keyLength == strlen(key)) && (memcmp(E->_data, key, E->_keyLength) == 0)) return E;
+  }
+
+  return 0;
+}
+
+static uint64_t
+makeClaim(pid_t pid)
+{
+  return (uint64_t) pid;
+}
+
+int
+main(int argc, char** argv)
+{
+  pluton::shmServiceHandler	shmManager;
+
+  const char* fname = "tShmSharedCache.mmap";
+  int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1) {
+    perror("open");
+    exit(1);
+  }
+  unlink(fname);
+
+  pluton::faultCode fc = shmManager.mapManager(fd, 3, 1, cacheSize, entrySize);
+  if (fc != pluton::noFault) {
+    cout << "mapManager() failed: " << fc << endl;
+    exit(1);
+  }
+
+  if (!check(shmManager.ifSharedCache(), "manager created shared cache")) exit(1);
+  shmService* sp = shmManager.getServicePtr();
+  sp->_config._maximumProcesses = 3;
+  sp->_config._maximumThreads = 1;
+  sp->_config._sharedCacheSize = cacheSize;
+  sp->_config._sharedCacheEntrySize = entrySize;
+
+  bool ok = true;
+  std::string value;
+
+  ok &= check(shmManager.putSharedCache("k1", 2, "v1", 2, 0), "put k1");
+  ok &= check(shmManager.putSharedCache("k2", 2, "v2", 2, 1), "put k2 expiring");
+  ok &= check(!shmManager.putSharedCache("big", 3, (const char*) sp, entrySize, 0),
+	      "oversized put rejected");
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    pluton::shmServiceHandler shmService;
+    fc = shmService.mapService(fd, getpid(), false);
+    if (fc != pluton::noFault) {
+      cout << "mapService failed: " << fc << endl;
+      exit(1);
+    }
+    if (!check(shmService.ifSharedCache(), "service attached shared cache")) exit(1);
+
+    bool cok = true;
+    cok &= check(shmService.getSharedCache("k1", 2, value) && (value == "v1"), "child get k1");
+    cok &= check(!shmService.getSharedCache("k3", 2, value), "child miss k3");
+    cok &= check(shmService.putSharedCache("k4", 2, "from child", 10, 0), "child put k4");
+
+    exit(cok ? 0 : 1);
+  }
+
+  int status;
+  waitpid(pid, &status, 0);
+  ok &= check(WIFEXITED(status) && (WEXITSTATUS(status) == 0), "child checks");
+
+  ok &= check(shmManager.getSharedCache("k4", 2, value) && (value == "from child"),
+	      "parent sees child put");
+
+  usleep(20 * 1000);
+  ok &= check(!shmManager.getSharedCache("k2", 2, value), "k2 expired");
+
+  ok &= check(shmManager.putSharedCache("k1", 2, "v1 again", 8, 0), "replace k1");
+  ok &= check(shmManager.getSharedCache("k1", 2, value) && (value == "v1 again"), "get new k1");
+
+  //////////////////////////////////////////////////////////////////////
+  // Simulate a writer that died mid-write, leaving its entry odd. It
+  // reads as busy but the next writer takes it over. A live writer's
+  // claim is left alone however long it has held the entry.
+  //////////////////////////////////////////////////////////////////////
+
+  const shmSharedCacheHeader* hp = shmManager.getSharedCacheHeader();
+  ok &= check(shmManager.putSharedCache("dead", 4, "before", 6, 0), "put dead");
+  shmSharedCacheEntry* E = findEntry(hp, "dead");
+  if (!check(E != 0, "find dead entry")) exit(1);
+
+  pid_t gone = fork();
+  if (gone == 0) exit(0);
+  waitpid(gone, &status, 0);
+
+  E->_claim = makeClaim(gone);
+  ++E->_sequence;
+  ok &= check(!shmManager.getSharedCache("dead", 4, value), "abandoned entry is busy");
+  ok &= check(shmManager.putSharedCache("dead", 4, "after", 5, 0), "take over dead writer");
+  ok &= check(!(E->_sequence & 1), "even after take over");
+  ok &= check(shmManager.getSharedCache("dead", 4, value) && (value == "after"), "get after");
+
+  E->_claim = makeClaim(getpid());
+  ++E->_sequence;
+  uint64_t collisions = hp->_collisions;
+  ok &= check(!shmManager.putSharedCache("dead", 4, "live", 4, 0), "live writer left alone");
+  ok &= check(hp->_collisions == collisions + 1, "live writer counts a collision");
+  ok &= check(E->_claim == makeClaim(getpid()), "live claim unchanged");
+  ++E->_sequence;				// The live writer finishes
+  ok &= check(shmManager.getSharedCache("dead", 4, value) && (value == "after"), "get after live");
+
+  //////////////////////////////////////////////////////////////////////
+  // Flood the cache. Everything must fit within the fixed entry count.
+  //////////////////////////////////////////////////////////////////////
+
+  for (int ix=0; ix < 10000; ++ix) {
+    char key[32];
+    int len = snprintf(key, sizeof(key), "flood%d", ix);
+    shmManager.putSharedCache(key, len, key, len, 0);
+  }
+
+  int found = 0;
+  for (int ix=0; ix < 10000; ++ix) {
+    char key[32];
+    int len = snprintf(key, sizeof(key), "flood%d", ix);
+    if (shmManager.getSharedCache(key, len, value)) {
+      if (!check(value == key, "flood value")) ok = false;
+      ++found;
+    }
+  }
+
+  ok &= check((found > 0) && (found <= (int) hp->_entryCount), "cache bounded");
+  ok &= check(shmManager.getSize() <= (int) (sizeof(shmService) + 8
+					     + 3 * (sizeof(shmProcess) + sizeof(shmThread))
+					     + cacheSize), "map size bounded");
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+#include <iostream>
+#include <string>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pluton/threadedService.h"
+
+using namespace std;
+
+//////////////////////////////////////////////////////////////////////
+// A threaded echo service. The context "sleepMS" delays the response
+// so that a test can show requests being handled concurrently.
+//////////////////////////////////////////////////////////////////////
+
+static void
+echoHandler(pluton::service& S, void* arg)
+{
+  string sleepMS;
+  if (S.getContext("sleepMS", sleepMS)) usleep(atoi(sleepMS.c_str()) * 1000);
+
+  string rd;
+  S.getRequestData(rd);
+  S.sendResponse(rd);
+}
+
+int
+main(int argc, char** argv)
+{
+  pluton::threadedService TS("tThreadedService");
+
+  if (argc > 1) TS.setThreadCount(atoi(argv[1]));	// Only used outside the manager
+
+  if (!TS.initialize()) {
+    cerr << TS.getFault().getMessage("tThreadedService", true) << endl;
+    exit(1);
+  }
+
+  if (!TS.run(echoHandler)) clog << "Error: " << TS.getFault().getMessage() << endl;
+
+  TS.terminate();
+
+  return 0;
+}
@@ -0,0 +1,271 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pluton/client.h>
+
+#include "traceRing.h"
+#include "traceRecorder.h"
+
+using namespace std;
+
+// Check that traced requests produce client spans and that the echo
+// service produces spans linked to them. Then check that two threads,
+// each acting as if serving a different request, concurrently issue
+// requests linked to their own current trace rather than each
+// other's. The caller must set plutonTraceDirectory for both this
+// program and the manager.
+
+static int errors = 0;
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tTrace " << err << " val=" << val << endl;
+  ++errors;
+}
+
+const char* SK = "system.echo.0.raw";
+static const char* goodPath = 0;
+
+static void
+loadSpans(const char* directory, vector<traceSpan>& spans)
+{
+  DIR* dp = opendir(directory);
+  if (!dp) {
+    failed("opendir of trace directory");
+    exit(1);
+  }
+
+  struct dirent* de;
+  while ((de = readdir(dp))) {
+    if (strncmp(de->d_name, "pluton.trace.", 13) != 0) continue;
+    string path(directory);
+    path += "/";
+    path += de->d_name;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) continue;
+    traceRingHeader header;
+    if ((read(fd, &header, sizeof(header)) == sizeof(header))
+	&& (header._magic == traceRingHeader::ringMagic)) {
+      traceSpan span;
+      while (read(fd, &span, sizeof(span)) == sizeof(span)) {
+	if (span._sequence != 0) spans.push_back(span);
+      }
+    }
+    close(fd);
+  }
+  closedir(dp);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Minimal pthread handlers so that each thread has its own client.
+//////////////////////////////////////////////////////////////////////
+
+static pluton::thread_t
+myThreadSelf(const char* who)
+{
+  return (pluton::thread_t) pthread_self();
+}
+
+static pluton::mutex_t
+myMutexNew(const char* who)
+{
+  pthread_mutex_t *m = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+  if (pthread_mutex_init(m, 0) != 0) return 0;
+
+  return (pluton::mutex_t) m;
+}
+
+static void
+myMutexDelete(const char* who, pluton::mutex_t m)
+{
+  pthread_mutex_destroy((pthread_mutex_t*) m);
+  free((void*) m);
+}
+
+static int
+myMutexLock(const char* who, pluton::mutex_t m)
+{
+  return pthread_mutex_lock((pthread_mutex_t*) m);
+}
+
+static int
+myMutexUnlock(const char* who, pluton::mutex_t m)
+{
+  return pthread_mutex_unlock((pthread_mutex_t*) m);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Each concurrent caller sets its own current trace, waits until the
+// other has done the same, then issues requests that overlap with
+// the other caller's.
+//////////////////////////////////////////////////////////////////////
+
+static const int concurrentCallers = 2;
+static const int concurrentRequests = 5;
+
+struct concurrentCaller {
+  pthread_t	thread;
+  uint64_t	traceID;
+  uint64_t	spanID;
+};
+
+static pthread_barrier_t barrier;
+
+static void*
+issueTracedRequests(void* arg)
+{
+  concurrentCaller* cc = (concurrentCaller*) arg;
+
+  pluton::client C;
+  if (!C.initialize(goodPath)) {
+    failed("concurrent C.initialize()");
+    return 0;
+  }
+
+  pluton::traceRecorder::setCurrent(cc->traceID, cc->spanID);
+  pthread_barrier_wait(&barrier);
+
+  for (int ix=0; ix < concurrentRequests; ++ix) {
+    pluton::clientRequest R;
+    R.setRequestData("concurrent");
+    R.setContext("echo.sleepMS", "20");
+    if (!C.addRequest(SK, R)) {
+      failed("bad return from concurrent addRequest");
+      break;
+    }
+    if (C.executeAndWaitOne(R) <= 0) {
+      failed("bad return from concurrent executeAndWaitOne()");
+      break;
+    }
+    if (R.hasFault()) failed(R.getFaultText().c_str(), R.getFaultCode());
+  }
+
+  pluton::traceRecorder::setCurrent(0, 0);
+
+  return 0;
+}
+
+
+int
+main(int argc, char** argv)
+{
+  if (argc > 1) goodPath = argv[1];
+
+  const char* directory = getenv("plutonTraceDirectory");
+  if (!directory) {
+    failed("plutonTraceDirectory not set");
+    exit(1);
+  }
+
+  pluton::client::setThreadHandlers(myThreadSelf, myMutexNew, myMutexDelete,
+				    myMutexLock, myMutexUnlock);
+
+  pluton::client C;
+
+  if (!C.initialize(goodPath)) {
+    failed("bad return from good path");
+    cout << C.getFault().getMessage("C.initialize()") << endl;
+    exit(1);
+  }
+
+  static const int requestCount = 3;
+  for (int ix=0; ix < requestCount; ++ix) {
+    pluton::clientRequest R;
+    R.setRequestData("traced");
+    if (!C.addRequest(SK, R)) {
+      failed("bad return from addRequest");
+      exit(1);
+    }
+    if (C.executeAndWaitOne(R) <= 0) {
+      failed("bad return from executeAndWaitOne()");
+      exit(1);
+    }
+    if (R.hasFault()) failed(R.getFaultText().c_str(), R.getFaultCode());
+  }
+
+  concurrentCaller callers[concurrentCallers];
+  pthread_barrier_init(&barrier, 0, concurrentCallers);
+  for (int ix=0; ix < concurrentCallers; ++ix) {
+    callers[ix].traceID = pluton::traceRecorder::newID();
+    callers[ix].spanID = pluton::traceRecorder::newID();
+    pthread_create(&callers[ix].thread, 0, issueTracedRequests, callers + ix);
+  }
+  for (int ix=0; ix < concurrentCallers; ++ix) pthread_join(callers[ix].thread, 0);
+
+  usleep(200 * 1000);		// Let the service finish writing its spans
+
+  vector<traceSpan> spans;
+  loadSpans(directory, spans);
+
+  //////////////////////////////////////////////////////////////////////
+  // Every client request span must have exactly one service span as
+  // a child in the same trace, in another process.
+  //////////////////////////////////////////////////////////////////////
+
+  int clientRoots = 0;
+  for (unsigned int ix=0; ix < spans.size(); ++ix) {
+    const traceSpan& cs = spans[ix];
+    if ((cs._kind != traceSpan::clientKind) || (cs._parentID != 0)) continue;
+    if (strcmp(cs._name, SK) != 0) continue;
+    ++clientRoots;
+
+    int serviceChildren = 0;
+    for (unsigned int jx=0; jx < spans.size(); ++jx) {
+      const traceSpan& ss = spans[jx];
+      if ((ss._kind == traceSpan::serviceKind) && (ss._parentID == cs._spanID)) {
+	++serviceChildren;
+	if (ss._traceID != cs._traceID) failed("service span in wrong trace");
+	if (ss._pid == cs._pid) failed("service span in client process");
+      }
+    }
+    if (serviceChildren != 1) failed("service spans per client span", serviceChildren);
+  }
+
+  if (clientRoots != requestCount) failed("client root spans", clientRoots);
+
+  //////////////////////////////////////////////////////////////////////
+  // Each concurrent caller's requests must be children of its own
+  // current span and each must have its own service child.
+  //////////////////////////////////////////////////////////////////////
+
+  for (int cx=0; cx < concurrentCallers; ++cx) {
+    const concurrentCaller& cc = callers[cx];
+    int children = 0;
+    for (unsigned int ix=0; ix < spans.size(); ++ix) {
+      const traceSpan& cs = spans[ix];
+      if ((cs._kind != traceSpan::clientKind) || (cs._parentID == 0)) continue;
+      if (strcmp(cs._name, SK) != 0) continue;
+      if ((cs._traceID != cc.traceID) && (cs._parentID != cc.spanID)) continue;
+      if (cs._traceID != cc.traceID) failed("concurrent span in other trace", cx);
+      if (cs._parentID != cc.spanID) failed("concurrent span with other parent", cx);
+      ++children;
+
+      int serviceChildren = 0;
+      for (unsigned int jx=0; jx < spans.size(); ++jx) {
+	const traceSpan& ss = spans[jx];
+	if ((ss._kind == traceSpan::serviceKind) && (ss._parentID == cs._spanID)) {
+	  ++serviceChildren;
+	  if (ss._traceID != cs._traceID) failed("concurrent service span in wrong trace");
+	}
+      }
+      if (serviceChildren != 1) failed("service spans per concurrent span", serviceChildren);
+    }
+    if (children != concurrentRequests) failed("concurrent client spans", children);
+  }
+
+  return errors ? 1 : 0;
+}
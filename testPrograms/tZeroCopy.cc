@@ -0,0 +1,93 @@
+#include <iostream>
+#include <string>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <pluton/client.h>
+
+using namespace std;
+
+// Exchange requests either side of the zero-copy threshold with the
+// echo service and check that the data survives the round-trip. On
+// Linux, large responses should be a page-aligned memfd mapping.
+
+static int errors = 0;
+
+static void
+failed(const char* err, long val=0)
+{
+  cout << "Failed: tZeroCopy " << err << " val=" << val << endl;
+  ++errors;
+}
+
+const char* SK = "system.echo.0.raw";
+
+static const unsigned int threshold = 64 * 1024;
+
+static void
+exchange(pluton::client& C, int length, bool expectMapped)
+{
+  string data;
+  data.reserve(length);
+  for (int ix=0; ix < length; ++ix) data.append(1, 'a' + (ix % 23));
+
+  pluton::clientRequest R;
+  R.setRequestData(data);
+
+  if (!C.addRequest(SK, R)) {
+    failed("bad return from addRequest", length);
+    cout << C.getFault().getMessage("C.addRequest()") << endl;
+    exit(1);
+  }
+
+  if (C.executeAndWaitOne(R) <= 0) {
+    failed("bad return from executeAndWaitOne()", length);
+    cout << C.getFault().getMessage() << endl;
+    exit(1);
+  }
+  if (R.hasFault()) failed(R.getFaultText().c_str(), R.getFaultCode());
+
+  const char* p;
+  int l;
+  R.getResponseData(p, l);
+  if (l != length) failed("response length mismatch", l);
+  if (string(p, l) != data) failed("response data mismatch", length);
+
+#ifdef __linux__
+  bool aligned = (((unsigned long) p) % getpagesize()) == 0;
+  if (expectMapped && !aligned) failed("large response is not mapped", length);
+#endif
+}
+
+int
+main(int argc, char** argv)
+{
+  const char* goodPath = 0;
+  if (argc > 1) goodPath = argv[1];
+
+  pluton::client C;
+
+  if (!C.initialize(goodPath)) {
+    failed("bad return from good path");
+    cout << C.getFault().getMessage("C.initialize()") << endl;
+    exit(1);
+  }
+
+  exchange(C, 4 * 1024 * 1024, false);		// Disabled by default
+
+  C.setZeroCopyThreshold(threshold);
+  exchange(C, 100, false);
+  exchange(C, threshold - 1, false);
+  exchange(C, threshold, true);
+  exchange(C, 4 * 1024 * 1024, true);
+
+  // Several in a row on the same request to check mappings are released
+
+  for (int ix=0; ix < 20; ++ix) exchange(C, threshold * 2 + ix, true);
+
+  C.setZeroCopyThreshold(0);
+  exchange(C, 4 * 1024 * 1024, false);
+
+  return errors ? 1 : 0;
+}